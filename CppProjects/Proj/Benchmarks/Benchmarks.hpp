@@ -0,0 +1,64 @@
+#pragma once
+#include <stdio.h>
+#include <stdint.h>
+#include <chrono>
+#include <atomic>
+
+#ifdef _DEBUG
+#include <assert.h>
+#define MY_ASSERT(E) assert( E )
+#else
+#define MY_ASSERT(E)
+#endif
+
+/// Замер времени выполнения участка кода
+class BenchTimer
+{
+	private:
+		std::chrono::steady_clock::time_point StartPoint;
+
+	public:
+		BenchTimer(): StartPoint( std::chrono::steady_clock::now() ) {}
+
+		/// Прошедшее время в миллисекундах
+		double ElapsedMs() const
+		{
+			return std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - StartPoint ).count();
+		}
+};
+
+/**
+ * @brief PrintResult вывод результата замера
+ * @param name название замера
+ * @param ops количество операций
+ * @param ms затраченное время в миллисекундах
+ */
+inline void PrintResult( const char *name, uint64_t ops, double ms )
+{
+	printf( "  %-48s %10.2f ms %10.1f ns/op\n", name, ms, ops > 0 ? ms*1e6/ops : 0.0 );
+	fflush( stdout );
+}
+
+/// Счётчик выделений памяти через operator new (все потоки)
+extern std::atomic<uint64_t> AllocCount;
+
+/**
+ * @brief PrintAllocs вывод количества выделений памяти за замер
+ * @param name название замера
+ * @param allocs количество выделений памяти
+ * @param ops количество операций
+ */
+inline void PrintAllocs( const char *name, uint64_t allocs, uint64_t ops )
+{
+	printf( "  %-48s %10llu allocs %8.4f allocs/op\n", name, ( unsigned long long ) allocs,
+	        ops > 0 ? ( double ) allocs/ops : 0.0 );
+	fflush( stdout );
+}
+
+void timer_benchmarks();
+void sync_benchmarks();
+void queue_benchmarks();
+void reclaim_benchmarks();
+void map_benchmarks();
+void layout_benchmarks();
+void stack_benchmarks();
@@ -0,0 +1,266 @@
+#include "Benchmarks.hpp"
+#include "LockFree.hpp"
+#include "CoroService.hpp"
+
+#include <thread>
+#include <vector>
+
+namespace
+{
+	/// Количество увеличений счётчика одним потоком
+	const uint64_t OneThreadOpsNum = 1000*1000;
+
+	/// Максимальное количество потоков
+	const uint8_t MaxThreadsNum = 16;
+
+	/// Счётчики потоков, лежащие вплотную (по 8 на кэш-линию)
+	std::atomic<uint64_t> PackedCounters[ MaxThreadsNum ];
+
+	/// Счётчики потоков, каждый в своей кэш-линии
+	LockFree::PaddedAtomic<uint64_t> PaddedCounters[ MaxThreadsNum ];
+
+	/**
+	 * @brief counters_bench замер ложного разделения: каждый поток увеличивает
+	 * только свой счётчик, но при плотном размещении соседние потоки
+	 * забирают друг у друга кэш-линию при каждой записи
+	 * @param name название замера
+	 * @param threads_num количество потоков
+	 * @param counters счётчики потоков
+	 */
+	template<typename Counter>
+	void counters_bench( const char *name, uint8_t threads_num, Counter *counters )
+	{
+		std::atomic<uint8_t> ready( 0 );
+		std::atomic<bool> start( false );
+		std::vector<std::thread> threads;
+		threads.reserve( threads_num );
+
+		for( uint8_t t = 0; t < threads_num; ++t )
+		{
+			counters[ t ].store( 0 );
+			threads.push_back( std::thread( [ &, t ]()
+			{
+				++ready;
+				while( !start.load() )
+				{
+					std::this_thread::yield();
+				}
+
+				std::atomic<uint64_t> &counter = counters[ t ];
+				for( uint64_t i = 0; i < OneThreadOpsNum; ++i )
+				{
+					counter.fetch_add( 1, std::memory_order_relaxed );
+				}
+			} ) );
+		}
+
+		while( ready.load() < threads_num )
+		{
+			std::this_thread::yield();
+		}
+
+		BenchTimer timer;
+		start = true;
+		for( auto &th : threads )
+		{
+			th.join();
+		}
+		const double ms = timer.ElapsedMs();
+
+		for( uint8_t t = 0; t < threads_num; ++t )
+		{
+			MY_ASSERT( counters[ t ].load() == OneThreadOpsNum );
+		}
+
+		char full_name[ 128 ];
+		snprintf( full_name, sizeof( full_name ), "%s, %u threads", name, threads_num );
+		PrintResult( full_name, OneThreadOpsNum*threads_num, ms );
+	} // void counters_bench
+
+	/**
+	 * @brief run_threads запуск потоков, одновременно начинающих работу, и замер её времени
+	 * @param name название замера
+	 * @param threads_num количество потоков
+	 * @param ops общее количество операций
+	 * @param work работа потока (получает номер потока)
+	 */
+	template<typename Work>
+	void run_threads( const char *name, uint8_t threads_num, uint64_t ops, const Work &work )
+	{
+		std::atomic<uint8_t> ready( 0 );
+		std::atomic<bool> start( false );
+		std::vector<std::thread> threads;
+		threads.reserve( threads_num );
+
+		for( uint8_t t = 0; t < threads_num; ++t )
+		{
+			threads.push_back( std::thread( [ &, t ]()
+			{
+				++ready;
+				while( !start.load() )
+				{
+					std::this_thread::yield();
+				}
+				work( t );
+			} ) );
+		}
+
+		while( ready.load() < threads_num )
+		{
+			std::this_thread::yield();
+		}
+
+		BenchTimer timer;
+		start = true;
+		for( auto &th : threads )
+		{
+			th.join();
+		}
+		const double ms = timer.ElapsedMs();
+
+		char full_name[ 128 ];
+		snprintf( full_name, sizeof( full_name ), "%s, %u threads", name, threads_num );
+		PrintResult( full_name, ops, ms );
+	} // void run_threads
+
+	/**
+	 * @brief digits_queue_bench замер DigitsQueue: половина потоков пишет
+	 * (меняет Tail), половина читает (меняет Head)
+	 * @param threads_num общее количество потоков (чётное)
+	 */
+	void digits_queue_bench( uint8_t threads_num )
+	{
+		const uint64_t fake = 0;
+		const uint64_t one_thread_num = OneThreadOpsNum / 4;
+		LockFree::DigitsQueue queue( fake, threads_num );
+		std::atomic<uint64_t> readed( 0 );
+		const uint64_t total = one_thread_num*( threads_num / 2 );
+
+		run_threads( "DigitsQueue: Push / Pop", threads_num, total, [ & ]( uint8_t t )
+		{
+			if( ( t % 2 ) == 0 )
+			{
+				for( uint64_t i = 1; i <= one_thread_num; ++i )
+				{
+					queue.Push( i );
+				}
+				return;
+			}
+
+			while( readed.load( std::memory_order_relaxed ) < total )
+			{
+				if( queue.Pop() != fake )
+				{
+					++readed;
+				}
+				else
+				{
+					std::this_thread::yield();
+				}
+			}
+		} );
+	} // void digits_queue_bench( uint8_t threads_num )
+
+	/**
+	 * @brief epochs_bench замер захвата и освобождения эпох DeferredDeleter
+	 * (каждый поток пишет только в ячейку своей эпохи)
+	 * @param threads_num количество потоков
+	 */
+	void epochs_bench( uint8_t threads_num )
+	{
+		LockFree::DeferredDeleter deleter( threads_num );
+		run_threads( "DeferredDeleter: Acquire + Release", threads_num,
+		             OneThreadOpsNum*threads_num, [ & ]( uint8_t )
+		{
+			for( uint64_t i = 0; i < OneThreadOpsNum; ++i )
+			{
+				auto guard = deleter.Acquire();
+			}
+		} );
+	}
+
+	/**
+	 * @brief service_bench замер Post (CoroutinesToExecute) и создания-завершения
+	 * сопрограмм (CoroCount) потоками сервиса
+	 * @param threads_num количество рабочих потоков сервиса
+	 */
+	void service_bench( uint8_t threads_num )
+	{
+		using namespace Bicycle;
+		using namespace Bicycle::CoroService;
+
+		const uint8_t coros_num = 16;
+		const uint64_t yields_num = OneThreadOpsNum / 64;
+		Service srv;
+		if( !srv.Restart() )
+		{
+			MY_ASSERT( false );
+			return;
+		}
+
+		BenchTimer timer;
+		double ms = 0;
+		std::atomic<uint8_t> working( coros_num );
+		Error err = srv.AddCoro( [ & ]()
+		{
+			for( uint8_t c = 0; c < coros_num; ++c )
+			{
+				Error err = Go( [ & ]()
+				{
+					for( uint64_t i = 0; i < yields_num; ++i )
+					{
+						// Каждая сотая итерация - через новую сопрограмму
+						if( ( i % 100 ) == 0 )
+						{
+							Go( []{} );
+						}
+						YieldCoro();
+					}
+
+					if( --working == 0 )
+					{
+						ms = timer.ElapsedMs();
+					}
+				} );
+				MY_ASSERT( !err );
+			}
+		} );
+		MY_ASSERT( !err );
+
+		std::vector<std::thread> threads;
+		for( uint8_t t = 0; t < threads_num; ++t )
+		{
+			threads.push_back( std::thread( [ &srv ]{ srv.Run(); } ) );
+		}
+		for( auto &th : threads )
+		{
+			th.join();
+		}
+		srv.Stop();
+
+		char full_name[ 128 ];
+		snprintf( full_name, sizeof( full_name ), "Service: YieldCoro + Go, %u threads", threads_num );
+		PrintResult( full_name, coros_num*yields_num, ms );
+	} // void service_bench( uint8_t threads_num )
+} // namespace
+
+void layout_benchmarks()
+{
+	const uint8_t threads_nums[] = { 1, 2, 4, 8, 16 };
+	for( uint8_t threads_num : threads_nums )
+	{
+		counters_bench( "std::atomic (packed)", threads_num, PackedCounters );
+		counters_bench( "LockFree::PaddedAtomic", threads_num, PaddedCounters );
+	}
+
+	// Структуры, поля которых разнесены по кэш-линиям
+	for( uint8_t threads_num : threads_nums )
+	{
+		if( threads_num > 1 )
+		{
+			digits_queue_bench( threads_num );
+		}
+		epochs_bench( threads_num );
+		service_bench( threads_num );
+	}
+}
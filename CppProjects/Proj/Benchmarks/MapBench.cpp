@@ -0,0 +1,151 @@
+#include "Benchmarks.hpp"
+#include "LockFree.hpp"
+
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace
+{
+	/// Общее количество операций в замере
+	const uint64_t OpsNum = 1000*1000;
+
+	/// Количество различных ключей
+	const uint32_t KeysNum = 1 << 16;
+
+	/// Таблица под мьютексом (для сравнения)
+	class MutexMap
+	{
+		private:
+			std::mutex Lock;
+			std::unordered_map<uint32_t, uint64_t> Map;
+
+		public:
+			bool Insert( uint32_t key, uint64_t val )
+			{
+				std::lock_guard<std::mutex> lock( Lock );
+				return Map.insert( std::make_pair( key, val ) ).second;
+			}
+
+			bool Find( uint32_t key, uint64_t &val )
+			{
+				std::lock_guard<std::mutex> lock( Lock );
+				auto iter = Map.find( key );
+				if( iter == Map.end() )
+				{
+					return false;
+				}
+
+				val = iter->second;
+				return true;
+			}
+
+			bool Erase( uint32_t key )
+			{
+				std::lock_guard<std::mutex> lock( Lock );
+				return Map.erase( key ) > 0;
+			}
+	};
+
+	/**
+	 * @brief mixed_bench замер смешанной нагрузки: 80% поиска, 10% добавления
+	 * и 10% удаления случайных ключей (таблица заранее заполнена наполовину)
+	 * @param name название замера
+	 * @param threads_num количество потоков
+	 * @param map таблица
+	 */
+	template<typename Map>
+	void mixed_bench( const char *name, uint8_t threads_num, Map &map )
+	{
+		for( uint32_t key = 0; key < KeysNum; key += 2 )
+		{
+			map.Insert( key, key );
+		}
+
+		const uint64_t one_thread_num = OpsNum / threads_num;
+		std::atomic<uint8_t> ready( 0 );
+		std::atomic<bool> start( false );
+		std::atomic<uint64_t> found( 0 );
+		std::vector<std::thread> threads;
+		threads.reserve( threads_num );
+
+		for( uint8_t t = 0; t < threads_num; ++t )
+		{
+			threads.push_back( std::thread( [ &, t ]()
+			{
+				++ready;
+				while( !start.load() )
+				{
+					std::this_thread::yield();
+				}
+
+				// Простой генератор псевдослучайных чисел (свой у каждого потока)
+				uint64_t rnd = 0x2545F4914F6CDD1DULL*( t + 1 );
+				uint64_t found_num = 0;
+				uint64_t val = 0;
+				for( uint64_t i = 0; i < one_thread_num; ++i )
+				{
+					rnd ^= rnd << 13;
+					rnd ^= rnd >> 7;
+					rnd ^= rnd << 17;
+
+					const uint32_t key = ( uint32_t ) ( rnd >> 32 ) % KeysNum;
+					const uint32_t op = ( uint32_t ) rnd % 10;
+					if( op == 0 )
+					{
+						map.Insert( key, i );
+					}
+					else if( op == 1 )
+					{
+						map.Erase( key );
+					}
+					else if( map.Find( key, val ) )
+					{
+						++found_num;
+					}
+				}
+				found += found_num;
+			} ) );
+		}
+
+		while( ready.load() < threads_num )
+		{
+			std::this_thread::yield();
+		}
+
+		BenchTimer timer;
+		start = true;
+		for( auto &th : threads )
+		{
+			th.join();
+		}
+		const double ms = timer.ElapsedMs();
+
+		char full_name[ 128 ];
+		snprintf( full_name, sizeof( full_name ), "%s, %u threads", name, threads_num );
+		PrintResult( full_name, one_thread_num*threads_num, ms );
+	} // void mixed_bench
+} // namespace
+
+void map_benchmarks()
+{
+	const uint8_t threads_nums[] = { 1, 2, 4, 8, 16, 32 };
+	for( uint8_t threads_num : threads_nums )
+	{
+		{
+			MutexMap map;
+			mixed_bench( "std::unordered_map + std::mutex", threads_num, map );
+		}
+
+		{
+			LockFree::HashMap<uint32_t, uint64_t> map;
+			mixed_bench( "LockFree::HashMap", threads_num, map );
+		}
+
+		{
+			LockFree::HashMap<uint32_t, uint64_t, std::hash<uint32_t>, LockFree::PoolAllocator> map;
+			mixed_bench( "LockFree::HashMap (PoolAllocator)", threads_num, map );
+		}
+	}
+}
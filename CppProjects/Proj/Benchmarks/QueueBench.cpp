@@ -0,0 +1,224 @@
+#include "Benchmarks.hpp"
+#include "LockFree.hpp"
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	/// Общее количество значений, проходящих через очередь в замере
+	const uint64_t ValuesNum = 1000*1000;
+
+	/// Ёмкость кольцевой очереди
+	const size_t RingCapacity = 1024;
+
+	/// Размер пакета при пакетных операциях
+	const size_t BatchSize = 16;
+
+	/**
+	 * @brief throughput_bench замер пропускной способности очереди:
+	 * threads_num писателей и столько же читателей передают ValuesNum значений
+	 * @param name название замера
+	 * @param threads_num количество писателей (и читателей)
+	 * @param push функция записи значений (получает первое значение и количество
+	 * оставшихся, возвращает количество записанных; 0 - если очередь полна)
+	 * @param pop функция чтения значений (возвращает количество прочитанных)
+	 */
+	template<typename Push, typename Pop>
+	void throughput_bench( const char *name, uint8_t threads_num, const Push &push, const Pop &pop )
+	{
+		const uint64_t one_thread_num = ValuesNum / threads_num;
+		std::atomic<uint64_t> readed( 0 );
+		std::atomic<uint8_t> ready( 0 );
+		std::atomic<bool> start( false );
+		std::vector<std::thread> threads;
+		threads.reserve( 2*threads_num );
+
+		// Без учёта выделений памяти под состояния потоков
+		const uint64_t allocs_before = AllocCount.load() + 2*threads_num;
+		for( uint8_t t = 0; t < threads_num; ++t )
+		{
+			threads.push_back( std::thread( [ & ]()
+			{
+				++ready;
+				while( !start.load() )
+				{
+					std::this_thread::yield();
+				}
+
+				for( uint64_t i = 0; i < one_thread_num; )
+				{
+					const uint64_t num = push( i, one_thread_num - i );
+					if( num > 0 )
+					{
+						i += num;
+					}
+					else
+					{
+						std::this_thread::yield();
+					}
+				}
+			} ) );
+
+			threads.push_back( std::thread( [ & ]()
+			{
+				++ready;
+				while( !start.load() )
+				{
+					std::this_thread::yield();
+				}
+
+				while( readed.load() < one_thread_num*threads_num )
+				{
+					const uint64_t num = pop();
+					if( num > 0 )
+					{
+						readed += num;
+					}
+					else
+					{
+						std::this_thread::yield();
+					}
+				}
+			} ) );
+		}
+
+		while( ready.load() < 2*threads_num )
+		{
+			std::this_thread::yield();
+		}
+
+		BenchTimer timer;
+		start = true;
+		for( auto &th : threads )
+		{
+			th.join();
+		}
+		const double ms = timer.ElapsedMs();
+
+		char full_name[ 128 ];
+		snprintf( full_name, sizeof( full_name ), "%s, %u x %u", name, threads_num, threads_num );
+		PrintResult( full_name, one_thread_num*threads_num, ms );
+		PrintAllocs( full_name, AllocCount.load() - allocs_before, one_thread_num*threads_num );
+	} // void throughput_bench
+
+	/// Замер Push + Pop стека в одном потоке (выделения памяти на элемент)
+	template<typename StackT>
+	void stack_bench( const char *name )
+	{
+		StackT stack;
+		const uint64_t def_val = 0;
+
+		// Прогрев (заполнение кэша пула)
+		stack.Push( 1 );
+		stack.Pop( &def_val );
+
+		const uint64_t allocs_before = AllocCount.load();
+		BenchTimer timer;
+		for( uint64_t t = 0; t < ValuesNum; ++t )
+		{
+			stack.Push( t );
+			stack.Pop( &def_val );
+		}
+		const double ms = timer.ElapsedMs();
+
+		PrintResult( name, ValuesNum, ms );
+		PrintAllocs( name, AllocCount.load() - allocs_before, ValuesNum );
+	}
+} // namespace
+
+void queue_benchmarks()
+{
+	stack_bench<LockFree::Stack<uint64_t>>( "LockFree::Stack: Push + Pop" );
+	stack_bench<LockFree::Stack<uint64_t, LockFree::PoolAllocator>>( "LockFree::Stack (PoolAllocator): Push + Pop" );
+
+	const uint8_t threads_nums[] = { 1, 2, 4, 8, 16 };
+	for( uint8_t threads_num : threads_nums )
+	{
+		{
+			LockFree::Queue<uint64_t> queue;
+			throughput_bench( "LockFree::Queue", threads_num, [ &queue ]( uint64_t val, uint64_t )
+			{
+				queue.Push( val );
+				return true;
+			}, [ &queue ]() -> uint64_t
+			{
+				return queue.Pop() ? 1 : 0;
+			} );
+		}
+
+		{
+			LockFree::RingQueue<uint64_t, RingCapacity> queue;
+			throughput_bench( "LockFree::RingQueue", threads_num, [ &queue ]( uint64_t val, uint64_t )
+			{
+				return queue.TryPush( val );
+			}, [ &queue ]() -> uint64_t
+			{
+				uint64_t val = 0;
+				return queue.TryPop( val ) ? 1 : 0;
+			} );
+		}
+
+		{
+			LockFree::SegmentedQueue<uint64_t> queue;
+			throughput_bench( "LockFree::SegmentedQueue", threads_num, [ &queue ]( uint64_t val, uint64_t )
+			{
+				queue.Push( val );
+				return true;
+			}, [ &queue ]() -> uint64_t
+			{
+				uint64_t val = 0;
+				return queue.TryPop( val ) ? 1 : 0;
+			} );
+		}
+
+		if( threads_num == 1 )
+		{
+			LockFree::SpscRingQueue<uint64_t, RingCapacity> queue;
+			throughput_bench( "LockFree::SpscRingQueue", threads_num, [ &queue ]( uint64_t val, uint64_t )
+			{
+				return queue.TryPush( val );
+			}, [ &queue ]() -> uint64_t
+			{
+				uint64_t val = 0;
+				return queue.TryPop( val ) ? 1 : 0;
+			} );
+		}
+
+		{
+			// Писатели добавляют, а читатели забирают значения пакетами
+			LockFree::Queue<uint64_t> queue;
+			throughput_bench( "LockFree::Queue (PushBatch + PopAll)", threads_num, [ &queue ]( uint64_t val, uint64_t left_num ) -> uint64_t
+			{
+				uint64_t vals[ BatchSize ];
+				const size_t num = ( size_t ) std::min<uint64_t>( BatchSize, left_num );
+				for( size_t t = 0; t < num; ++t )
+				{
+					vals[ t ] = val + t;
+				}
+
+				queue.PushBatch( vals, num );
+				return num;
+			}, [ &queue ]() -> uint64_t
+			{
+				static thread_local std::vector<std::unique_ptr<uint64_t>> vals;
+				vals.clear();
+				return queue.PopAll( vals );
+			} );
+		}
+
+		{
+			// Читатели забирают значения пакетами
+			LockFree::RingQueue<uint64_t, RingCapacity> queue;
+			throughput_bench( "LockFree::RingQueue (TryPopBatch)", threads_num, [ &queue ]( uint64_t val, uint64_t )
+			{
+				return queue.TryPush( val );
+			}, [ &queue ]() -> uint64_t
+			{
+				uint64_t vals[ BatchSize ];
+				return queue.TryPopBatch( vals, BatchSize );
+			} );
+		}
+	}
+}
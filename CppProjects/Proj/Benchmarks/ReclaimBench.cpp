@@ -0,0 +1,114 @@
+#include "Benchmarks.hpp"
+#include "LockFree.hpp"
+
+#include <thread>
+#include <vector>
+
+namespace
+{
+	/// Общее количество объектов, отправляемых на удаление в замере
+	const uint64_t ObjectsNum = 1000*1000;
+
+	/// Периодичность очистки собственной очереди
+	const uint16_t CleanPeriod = 0x100;
+
+	/// Количество неудалённых объектов
+	std::atomic<uint64_t> AliveNum( 0 );
+
+	/// Максимальное количество неудалённых объектов за замер
+	std::atomic<uint64_t> PeakAliveNum( 0 );
+
+	/// Удаляемый объект (учитывает количество неудалённых)
+	struct Garbage
+	{
+		uint64_t Val;
+
+		Garbage( uint64_t val ): Val( val )
+		{
+			const uint64_t alive = ++AliveNum;
+			uint64_t peak = PeakAliveNum.load( std::memory_order_relaxed );
+			while( ( alive > peak ) && !PeakAliveNum.compare_exchange_weak( peak, alive ) ) {}
+		}
+
+		~Garbage()
+		{
+			--AliveNum;
+		}
+	};
+
+	/**
+	 * @brief retire_bench замер отправки объектов на удаление: каждый поток
+	 * захватывает эпоху, отправляет объект на удаление, освобождает эпоху
+	 * и вызывает ClearIfNeed
+	 * @param name название замера
+	 * @param threads_num количество потоков
+	 * @param deleter очередь на удаление
+	 */
+	void retire_bench( const char *name, uint8_t threads_num, LockFree::DeferredDeleter &deleter )
+	{
+		const uint64_t one_thread_num = ObjectsNum / threads_num;
+		std::atomic<uint8_t> ready( 0 );
+		std::atomic<bool> start( false );
+		std::vector<std::thread> threads;
+		threads.reserve( threads_num );
+
+		AliveNum = 0;
+		PeakAliveNum = 0;
+		for( uint8_t t = 0; t < threads_num; ++t )
+		{
+			threads.push_back( std::thread( [ & ]()
+			{
+				++ready;
+				while( !start.load() )
+				{
+					std::this_thread::yield();
+				}
+
+				for( uint64_t i = 0; i < one_thread_num; ++i )
+				{
+					{
+						auto keeper = deleter.EpochAcquire();
+						deleter.Delete( new Garbage( i ) );
+					}
+					deleter.ClearIfNeed();
+				}
+			} ) );
+		}
+
+		while( ready.load() < threads_num )
+		{
+			std::this_thread::yield();
+		}
+
+		BenchTimer timer;
+		start = true;
+		for( auto &th : threads )
+		{
+			th.join();
+		}
+		const double ms = timer.ElapsedMs();
+		deleter.Clear();
+
+		char full_name[ 128 ];
+		snprintf( full_name, sizeof( full_name ), "%s, %u threads", name, threads_num );
+		PrintResult( full_name, one_thread_num*threads_num, ms );
+		printf( "  %-48s %10llu peak garbage, %llu left\n", full_name,
+		        ( unsigned long long ) PeakAliveNum.load(),
+		        ( unsigned long long ) AliveNum.load() );
+		fflush( stdout );
+	} // void retire_bench
+} // namespace
+
+void reclaim_benchmarks()
+{
+	const uint8_t threads_nums[] = { 1, 2, 4, 8, 16, 32 };
+	for( uint8_t threads_num : threads_nums )
+	{
+		{
+			LockFree::DeferredDeleter deleter( threads_num, CleanPeriod );
+			retire_bench( "LockFree::DeferredDeleter", threads_num, deleter );
+		}
+
+		retire_bench( "LockFree::DeferredDeleter::Shared", threads_num, LockFree::DeferredDeleter::Shared() );
+	}
+}
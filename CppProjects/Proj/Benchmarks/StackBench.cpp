@@ -0,0 +1,131 @@
+#include "Benchmarks.hpp"
+#include "LockFree.hpp"
+
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	/// Общее количество пар Push + Pop в замере
+	const uint64_t OpsNum = 1000*1000;
+
+	/// Стек под мьютексом (для сравнения)
+	class MutexStack
+	{
+		private:
+			std::mutex Lock;
+			std::vector<uint64_t> Values;
+
+		public:
+			void Push( uint64_t val )
+			{
+				std::lock_guard<std::mutex> lock( Lock );
+				Values.push_back( val );
+			}
+
+			uint64_t Pop( const uint64_t *def_val )
+			{
+				std::lock_guard<std::mutex> lock( Lock );
+				if( Values.empty() )
+				{
+					return *def_val;
+				}
+
+				const uint64_t res = Values.back();
+				Values.pop_back();
+				return res;
+			}
+	};
+
+	/**
+	 * @brief contention_bench замер стека под нагрузкой: каждый поток
+	 * поочерёдно добавляет и извлекает значения, все потоки работают с головой
+	 * @param name название замера
+	 * @param threads_num количество потоков
+	 * @param stack стек
+	 */
+	template<typename StackT>
+	void contention_bench( const char *name, uint8_t threads_num, StackT &stack )
+	{
+		const uint64_t one_thread_num = OpsNum / threads_num;
+		std::atomic<uint8_t> ready( 0 );
+		std::atomic<bool> start( false );
+		std::atomic<uint64_t> sum( 0 );
+		std::vector<std::thread> threads;
+		threads.reserve( threads_num );
+
+		for( uint8_t t = 0; t < threads_num; ++t )
+		{
+			threads.push_back( std::thread( [ & ]()
+			{
+				++ready;
+				while( !start.load() )
+				{
+					std::this_thread::yield();
+				}
+
+				const uint64_t def_val = 0;
+				uint64_t local_sum = 0;
+				for( uint64_t i = 1; i <= one_thread_num; ++i )
+				{
+					stack.Push( i );
+					local_sum += stack.Pop( &def_val );
+				}
+				sum += local_sum;
+			} ) );
+		}
+
+		while( ready.load() < threads_num )
+		{
+			std::this_thread::yield();
+		}
+
+		BenchTimer timer;
+		start = true;
+		for( auto &th : threads )
+		{
+			th.join();
+		}
+		const double ms = timer.ElapsedMs();
+
+		// Каждый поток извлекает столько же, сколько добавил
+		MY_ASSERT( sum.load() == threads_num*one_thread_num*( one_thread_num + 1 ) / 2 );
+
+		char full_name[ 128 ];
+		snprintf( full_name, sizeof( full_name ), "%s, %u threads", name, threads_num );
+		PrintResult( full_name, one_thread_num*threads_num, ms );
+	} // void contention_bench
+} // namespace
+
+void stack_benchmarks()
+{
+	const uint8_t threads_nums[] = { 1, 2, 4, 8, 16, 32 };
+	for( uint8_t threads_num : threads_nums )
+	{
+		{
+			MutexStack stack;
+			contention_bench( "std::vector + std::mutex", threads_num, stack );
+		}
+
+		{
+			LockFree::Stack<uint64_t> stack;
+			contention_bench( "LockFree::Stack", threads_num, stack );
+		}
+
+		{
+			LockFree::Stack<uint64_t, LockFree::PoolAllocator> stack;
+			contention_bench( "LockFree::Stack (PoolAllocator)", threads_num, stack );
+		}
+
+		{
+			LockFree::Stack<uint64_t, LockFree::NewAllocator, LockFree::DeferredDeleter, false> stack;
+			contention_bench( "LockFree::Stack (no elimination)", threads_num, stack );
+		}
+
+		{
+			LockFree::Stack<uint64_t, LockFree::PoolAllocator, LockFree::DeferredDeleter, false> stack;
+			contention_bench( "LockFree::Stack (PoolAllocator, no elimination)", threads_num, stack );
+		}
+	}
+}
@@ -0,0 +1,237 @@
+#include "Benchmarks.hpp"
+#include "CoroService.hpp"
+
+#include <thread>
+#include <vector>
+
+using namespace Bicycle;
+using namespace Bicycle::CoroService;
+
+namespace
+{
+	/// Количество рабочих потоков сервиса
+	const uint8_t ThreadsNum = 4;
+
+	/// Количество сопрограмм, конкурирующих за объект
+	const uint8_t CorosNum = 16;
+
+	/// Количество захватов на одну сопрограмму
+	const uint64_t StepsNum = 20*1000;
+
+	/// Вывод размера объекта
+	void print_size( const char *name, size_t sz )
+	{
+		printf( "  %-48s %10llu bytes\n", name, ( unsigned long long ) sz );
+		fflush( stdout );
+	}
+
+	/**
+	 * @brief contended_bench замер захватов-освобождений объекта
+	 * несколькими сопрограммами в нескольких потоках
+	 * (объекты синхронизации создаются только внутри сопрограмм сервиса)
+	 * @param name название замера
+	 * @param init функция подготовки объекта (и его возврата в исходное состояние)
+	 * @param step функция одного захвата-освобождения (получает номер захвата
+	 * сопрограммы, сдвинутый на номер сопрограммы, чтобы сопрограммы не шли в фазе)
+	 */
+	template<typename T, typename Init, typename Step>
+	void contended_bench( const char *name, const Init &init, const Step &step )
+	{
+		Service srv;
+		if( !srv.Restart() )
+		{
+			MY_ASSERT( false );
+			return;
+		}
+
+		std::atomic<uint64_t> allocs( 0 );
+		double ms = 0;
+		ResetSyncSpinStats();
+
+		Error err = srv.AddCoro( [ & ]()
+		{
+			T obj;
+			init( obj, true );
+
+			// Сопрограммы стартуют одновременно, когда все созданы
+			// (выделения памяти под них не попадают в замер)
+			Event start;
+			Event done;
+			std::atomic<uint8_t> waiting( 0 );
+			std::atomic<uint8_t> working( CorosNum );
+			BenchTimer timer;
+
+			for( uint8_t c = 0; c < CorosNum; ++c )
+			{
+				Error err = Go( [ &, c ]()
+				{
+					++waiting;
+					start.Wait();
+					for( uint64_t i = 0; i < StepsNum; ++i )
+					{
+						step( obj, c + i );
+					}
+
+					if( --working == 0 )
+					{
+						ms = timer.ElapsedMs();
+						allocs = AllocCount.load() - allocs.load();
+						done.Set();
+					}
+				} );
+				MY_ASSERT( !err );
+			}
+
+			while( waiting.load() < CorosNum )
+			{
+				YieldCoro();
+			}
+
+			timer = BenchTimer();
+			allocs = AllocCount.load();
+			start.Set();
+			done.Wait();
+			init( obj, false );
+		} );
+		MY_ASSERT( !err );
+
+		std::vector<std::thread> threads( ThreadsNum );
+		for( auto &th : threads )
+		{
+			th = std::thread( [ &srv ]{ srv.Run(); } );
+		}
+
+		for( auto &th : threads )
+		{
+			th.join();
+		}
+		srv.Stop();
+
+		PrintResult( name, CorosNum*StepsNum, ms );
+		PrintAllocs( name, allocs.load(), CorosNum*StepsNum );
+
+		const SyncSpinStats stats = GetSyncSpinStats();
+		if( stats.Spins + stats.Parked > 0 )
+		{
+			printf( "  %-48s spins %llu (acquired %llu), parked %llu\n", name,
+			        ( unsigned long long ) stats.Spins,
+			        ( unsigned long long ) stats.SpinAcquired,
+			        ( unsigned long long ) stats.Parked );
+			fflush( stdout );
+		}
+	} // void contended_bench
+
+	/// Разделяемый мьютекс со счётчиками читателей по числу потоков замера
+	/// (объект создаётся, когда ещё не все потоки запустили Run)
+	class BenchDistributedSharedMutex: public DistributedSharedMutex
+	{
+		public:
+			BenchDistributedSharedMutex(): DistributedSharedMutex( ThreadsNum ) {}
+	};
+} // namespace
+
+void sync_benchmarks()
+{
+	print_size( "sizeof( Mutex )", sizeof( Mutex ) );
+	print_size( "sizeof( SharedMutex )", sizeof( SharedMutex ) );
+	print_size( "sizeof( Semaphore )", sizeof( Semaphore ) );
+	print_size( "sizeof( Event )", sizeof( Event ) );
+	print_size( "sizeof( DistributedSharedMutex ) (+ reader slots)", sizeof( DistributedSharedMutex ) +
+	            ( ThreadsNum + 1 )*DistributedSharedMutex::CacheLineSize );
+
+	// Прежде каждый объект держал очередь(и) ожидающих с собственной
+	// очередью на отложенное удаление (вектор на 255 эпох)
+	print_size( "sizeof( LockFree::DigitsQueue ) (without deleter)", sizeof( LockFree::DigitsQueue ) );
+	print_size( "sizeof( LockFree::DeferredDeleter )", sizeof( LockFree::DeferredDeleter ) );
+	print_size( "LockFree::DeferredDeleter( 0xFF ): epochs vector", 0xFF*sizeof( LockFree::PaddedAtomic<uint64_t> ) );
+
+	auto mut_step = []( Mutex &mut, uint64_t )
+	{
+		mut.Lock();
+		mut.Unlock();
+	};
+
+	// Сравниваем с немедленной постановкой в очередь (без активного ожидания)
+	const uint32_t spin_limit = GetSyncSpinLimit();
+	SetSyncSpinLimit( 0 );
+	contended_bench<Mutex>( "Mutex: contended Lock + Unlock (no spin)", []( Mutex&, bool ){}, mut_step );
+	SetSyncSpinLimit( spin_limit );
+	contended_bench<Mutex>( "Mutex: contended Lock + Unlock", []( Mutex&, bool ){}, mut_step );
+
+	std::atomic<uint64_t> counter( 0 );
+	contended_bench<SharedMutex>( "SharedMutex: 1 Lock : 7 SharedLock", []( SharedMutex&, bool ){}, [ &counter ]( SharedMutex &sh_mut, uint64_t )
+	{
+		if( ( ( counter++ ) % 8 ) == 0 )
+		{
+			sh_mut.Lock();
+		}
+		else
+		{
+			sh_mut.SharedLock();
+		}
+		sh_mut.Unlock();
+	} );
+
+	// Разделяемые мьютексы при преобладании читателей: 1 писатель на period захватов
+	// (номер захвата свой у каждой сопрограммы, чтобы не добавлять общую кэш-линию)
+	const uint16_t write_periods[] = { 10, 100, 1000 };
+	const char *sh_names[] = { "SharedMutex: 90% reads", "SharedMutex: 99% reads", "SharedMutex: 99.9% reads" };
+	const char *dsh_names[] = { "DistributedSharedMutex: 90% reads", "DistributedSharedMutex: 99% reads",
+	                            "DistributedSharedMutex: 99.9% reads" };
+	for( uint8_t t = 0; t < 3; ++t )
+	{
+		const uint16_t period = write_periods[ t ];
+		contended_bench<SharedMutex>( sh_names[ t ], []( SharedMutex&, bool ){},
+		                              [ period ]( SharedMutex &sh_mut, uint64_t num )
+		{
+			if( ( num % period ) == 0 )
+			{
+				sh_mut.Lock();
+			}
+			else
+			{
+				sh_mut.SharedLock();
+			}
+			sh_mut.Unlock();
+		} );
+
+		contended_bench<BenchDistributedSharedMutex>( dsh_names[ t ], []( DistributedSharedMutex&, bool ){},
+		                                              [ period ]( DistributedSharedMutex &dsh_mut, uint64_t num )
+		{
+			if( ( num % period ) == 0 )
+			{
+				dsh_mut.Lock();
+				dsh_mut.Unlock();
+			}
+			else
+			{
+				dsh_mut.SharedLock();
+				dsh_mut.SharedUnlock();
+			}
+		} );
+	}
+
+	// Семафор с единичным счётчиком (по завершении счётчик обнуляем)
+	auto sem_init = []( Semaphore &sem, bool start )
+	{
+		if( start )
+		{
+			sem.Push();
+		}
+		else
+		{
+			sem.Pop();
+		}
+	};
+
+	auto sem_step = []( Semaphore &sem, uint64_t )
+	{
+		sem.Pop();
+		sem.Push();
+	};
+
+	SetSyncSpinLimit( 0 );
+	contended_bench<Semaphore>( "Semaphore: contended Pop + Push (no spin)", sem_init, sem_step );
+	SetSyncSpinLimit( spin_limit );
+	contended_bench<Semaphore>( "Semaphore: contended Pop + Push", sem_init, sem_step );
+}
@@ -0,0 +1,165 @@
+#include "Benchmarks.hpp"
+#include "TimingWheel.hpp"
+
+#include <map>
+#include <vector>
+#include <functional>
+#include <memory>
+#include <random>
+
+using namespace Bicycle;
+
+namespace
+{
+	typedef TimingWheel::ClockType ClockType;
+	typedef TimingWheel::TimePoint TimePoint;
+
+	/// Количество таймеров в замере
+	const size_t TimersNum = 1000*1000;
+
+	/// Узел колеса для замеров
+	struct BenchNode: public TimingWheelNode
+	{
+		uint64_t *CounterPtr;
+
+		BenchNode(): TimingWheelNode(), CounterPtr( nullptr ) {}
+
+		virtual void OnExpired() override
+		{
+			++( *CounterPtr );
+		}
+	};
+
+	/// Сроки сработки: от 1 мс до 60 с от start (как у таймаутов простоя соединений)
+	std::vector<TimePoint> MakeDeadlines( const TimePoint &start )
+	{
+		std::mt19937_64 gen( 12345 );
+		std::uniform_int_distribution<uint64_t> dist( 1000, 60*1000*1000 );
+
+		std::vector<TimePoint> res( TimersNum );
+		for( auto &tp : res )
+		{
+			tp = start + std::chrono::microseconds( dist( gen ) );
+		}
+
+		return res;
+	}
+
+	/// Прежняя реализация потока таймера: std::map с векторами std::function
+	void map_bench( const std::vector<TimePoint> &deadlines, const TimePoint &end )
+	{
+		typedef std::map<TimePoint, std::vector<std::function<void()>>> map_type;
+		uint64_t counter = 0;
+
+		{
+			map_type tasks_map;
+			BenchTimer timer;
+			for( const auto &tp : deadlines )
+			{
+				tasks_map[ tp ].push_back( [ &counter ]{ ++counter; } );
+			}
+			PrintResult( "std::map: arm", TimersNum, timer.ElapsedMs() );
+
+			// Отмены в прежней реализации нет (отменённая задача лежит в
+			// map-е до сработки), поэтому замеряем лучший для map-а
+			// вариант - удаление по ключу
+			timer = BenchTimer();
+			for( const auto &tp : deadlines )
+			{
+				auto iter = tasks_map.find( tp );
+				MY_ASSERT( iter != tasks_map.end() );
+				iter->second.pop_back();
+				if( iter->second.empty() )
+				{
+					tasks_map.erase( iter );
+				}
+			}
+			PrintResult( "std::map: cancel (erase by key)", TimersNum, timer.ElapsedMs() );
+			MY_ASSERT( tasks_map.empty() );
+		}
+
+		{
+			map_type tasks_map;
+			BenchTimer timer;
+			for( const auto &tp : deadlines )
+			{
+				tasks_map[ tp ].push_back( [ &counter ]{ ++counter; } );
+			}
+
+			while( !tasks_map.empty() )
+			{
+				auto iter = tasks_map.begin();
+				if( iter->first > end )
+				{
+					break;
+				}
+
+				auto cur_tasks = std::move( iter->second );
+				tasks_map.erase( iter );
+				for( auto &one_task : cur_tasks )
+				{
+					one_task();
+				}
+			}
+			PrintResult( "std::map: arm + expire", TimersNum, timer.ElapsedMs() );
+		}
+
+		MY_ASSERT( counter == TimersNum );
+	} // void map_bench
+
+	void wheel_bench( const std::vector<TimePoint> &deadlines,
+	                  const TimePoint &start,
+	                  const TimePoint &end,
+	                  uint64_t tick_microsec )
+	{
+		std::unique_ptr<BenchNode[]> nodes( new BenchNode[ TimersNum ] );
+		uint64_t counter = 0;
+		for( size_t t = 0; t < TimersNum; ++t )
+		{
+			nodes[ t ].CounterPtr = &counter;
+		}
+
+		char name[ 64 ] = { 0 };
+		TimingWheel wheel( std::chrono::microseconds( tick_microsec ), start );
+
+		BenchTimer timer;
+		for( size_t t = 0; t < TimersNum; ++t )
+		{
+			wheel.Insert( nodes[ t ], deadlines[ t ] );
+		}
+		snprintf( name, sizeof( name ), "TimingWheel (tick %llu us): arm", ( unsigned long long ) tick_microsec );
+		PrintResult( name, TimersNum, timer.ElapsedMs() );
+
+		timer = BenchTimer();
+		for( size_t t = 0; t < TimersNum; ++t )
+		{
+			wheel.Remove( nodes[ t ] );
+		}
+		snprintf( name, sizeof( name ), "TimingWheel (tick %llu us): cancel", ( unsigned long long ) tick_microsec );
+		PrintResult( name, TimersNum, timer.ElapsedMs() );
+		MY_ASSERT( wheel.Empty() );
+
+		timer = BenchTimer();
+		for( size_t t = 0; t < TimersNum; ++t )
+		{
+			wheel.Insert( nodes[ t ], deadlines[ t ] );
+		}
+		wheel.Advance( end );
+		snprintf( name, sizeof( name ), "TimingWheel (tick %llu us): arm + expire", ( unsigned long long ) tick_microsec );
+		PrintResult( name, TimersNum, timer.ElapsedMs() );
+
+		MY_ASSERT( wheel.Empty() );
+		MY_ASSERT( counter == TimersNum );
+	} // void wheel_bench
+} // namespace
+
+void timer_benchmarks()
+{
+	const TimePoint start = ClockType::now();
+	const TimePoint end = start + std::chrono::seconds( 61 );
+	const std::vector<TimePoint> deadlines = MakeDeadlines( start );
+
+	map_bench( deadlines, end );
+	wheel_bench( deadlines, start, end, 1000 );
+	wheel_bench( deadlines, start, end, 100 );
+}
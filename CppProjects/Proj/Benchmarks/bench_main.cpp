@@ -0,0 +1,53 @@
+#include "Benchmarks.hpp"
+#include <string.h>
+#include <stdlib.h>
+#include <new>
+
+std::atomic<uint64_t> AllocCount( 0 );
+
+// Подсчёт выделений памяти (для замеров, где их быть не должно)
+void* operator new( size_t sz )
+{
+	AllocCount.fetch_add( 1, std::memory_order_relaxed );
+	void *res = malloc( sz > 0 ? sz : 1 );
+	if( res == nullptr )
+	{
+		throw std::bad_alloc();
+	}
+	return res;
+}
+
+void operator delete( void *ptr ) noexcept
+{
+	free( ptr );
+}
+
+int main( int argc, char *argv[] )
+{
+	// Если указан аргумент - запускаем только замеры с таким названием
+	const char *filter = argc > 1 ? argv[ 1 ] : nullptr;
+
+	struct
+	{
+		const char *Name;
+		void ( *Fnc )();
+	} benchmarks[] = { { "timer", timer_benchmarks },
+	                   { "sync", sync_benchmarks },
+	                   { "queue", queue_benchmarks },
+	                   { "reclaim", reclaim_benchmarks },
+	                   { "map", map_benchmarks },
+	                   { "layout", layout_benchmarks },
+	                   { "stack", stack_benchmarks } };
+
+	for( const auto &bench : benchmarks )
+	{
+		if( ( filter == nullptr ) || ( strcmp( filter, bench.Name ) == 0 ) )
+		{
+			printf( "%s:\n", bench.Name );
+			fflush( stdout );
+			bench.Fnc();
+		}
+	}
+
+	return 0;
+}
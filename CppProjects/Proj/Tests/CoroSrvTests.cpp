@@ -645,10 +645,29 @@ void check_sync( bool single_thread )
 	std::atomic<int64_t> sh_unique_locks_counter( 0 );
 	std::atomic<int64_t> sh_shared_locks_counter( 0 );
 
+	std::atomic<int64_t> total_dsh_unique_locks( 0 );
+	std::atomic<int64_t> total_dsh_shared_locks( 0 );
+	std::atomic<int64_t> dsh_unique_locks_counter( 0 );
+	std::atomic<int64_t> dsh_shared_locks_counter( 0 );
+
 	std::atomic<int64_t> semaphore_counter( 0 );
 
 	std::atomic<int64_t> ev_waiters_num( 0 );
 
+	std::atomic<int64_t> cv_consumed( 0 );
+	std::atomic<int64_t> cv_waiters_num( 0 );
+
+	// Очереди ожидающих интрузивные: объекты синхронизации занимают
+	// несколько машинных слов - не больше одной LockFree-очереди,
+	// которую (без её очереди на отложенное удаление) хранили прежде
+	MY_CHECK_ASSERT( sizeof( Mutex ) <= sizeof( LockFree::DigitsQueue ) );
+	MY_CHECK_ASSERT( sizeof( SharedMutex ) <= sizeof( LockFree::DigitsQueue ) );
+	MY_CHECK_ASSERT( sizeof( Semaphore ) <= sizeof( LockFree::DigitsQueue ) );
+	MY_CHECK_ASSERT( sizeof( ConditionVariable ) <= sizeof( LockFree::DigitsQueue ) );
+
+	MY_CHECK_ASSERT( GetSyncSpinLimit() > 0 );
+	ResetSyncSpinStats();
+
 	auto task = [ & ]()
 	{
 		std::shared_ptr<Mutex> mut_ptr( new Mutex );
@@ -729,6 +748,50 @@ void check_sync( bool single_thread )
 		}
 		sh_mut_ptr.reset();
 
+		// Счётчиков читателей меньше, чем потоков: потоки их делят
+		std::shared_ptr<DistributedSharedMutex> dsh_mut_ptr( new DistributedSharedMutex( 2 ) );
+		MY_CHECK_ASSERT( dsh_mut_ptr );
+		MY_CHECK_ASSERT( dsh_mut_ptr->GetReaderSlotsNum() == 2 );
+		for( uint8_t t = 0; t < 10; ++t )
+		{
+			auto err = Go( [ &, dsh_mut_ptr ]()
+			{
+				for( uint8_t i = 0; i < 10; ++i )
+				{
+					if( ( i % 2 ) == 0 )
+					{
+						dsh_mut_ptr->Lock();
+						++dsh_unique_locks_counter;
+						MY_CHECK_ASSERT( dsh_unique_locks_counter.load() == 1 );
+						MY_CHECK_ASSERT( dsh_shared_locks_counter.load() == 0 );
+						++total_dsh_unique_locks;
+
+						std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+
+						--dsh_unique_locks_counter;
+						MY_CHECK_ASSERT( dsh_shared_locks_counter.load() == 0 );
+						dsh_mut_ptr->Unlock();
+					}
+					else
+					{
+						dsh_mut_ptr->SharedLock();
+						++dsh_shared_locks_counter;
+						++total_dsh_shared_locks;
+						MY_CHECK_ASSERT( dsh_unique_locks_counter.load() == 0 );
+
+						// Освобождение может произойти в другом потоке
+						YieldCoro();
+
+						--dsh_shared_locks_counter;
+						MY_CHECK_ASSERT( dsh_unique_locks_counter.load() == 0 );
+						dsh_mut_ptr->SharedUnlock();
+					}
+				}
+			});
+			MY_CHECK_ASSERT( !err );
+		}
+		dsh_mut_ptr.reset();
+
 		std::shared_ptr<Semaphore> sem_ptr( new Semaphore );
 		MY_CHECK_ASSERT( sem_ptr );
 		for( uint8_t t = 0; t < 10; ++t )
@@ -794,6 +857,79 @@ void check_sync( bool single_thread )
 			ev_ptr->Reset();
 		} // for( uint8_t step = 0; step < 2; ++step )
 
+		// Условная переменная: потребители ждут элементы, производители уведомляют
+		std::shared_ptr<Mutex> cv_mut_ptr( new Mutex );
+		std::shared_ptr<ConditionVariable> cv_ptr( new ConditionVariable );
+		std::shared_ptr<uint64_t> items_ptr( new uint64_t( 0 ) );
+		MY_CHECK_ASSERT( cv_mut_ptr && cv_ptr && items_ptr );
+
+		for( uint8_t t = 0; t < 10; ++t )
+		{
+			auto err = Go( [ &, cv_mut_ptr, cv_ptr, items_ptr ]()
+			{
+				for( uint8_t i = 0; i < 10; ++i )
+				{
+					cv_mut_ptr->Lock();
+					while( *items_ptr == 0 )
+					{
+						cv_ptr->Wait( *cv_mut_ptr );
+					}
+					--( *items_ptr );
+					++cv_consumed;
+					cv_mut_ptr->Unlock();
+				}
+			});
+			MY_CHECK_ASSERT( !err );
+
+			err = Go( [ cv_mut_ptr, cv_ptr, items_ptr ]()
+			{
+				for( uint8_t i = 0; i < 10; ++i )
+				{
+					cv_mut_ptr->Lock();
+					++( *items_ptr );
+					cv_ptr->NotifyOne();
+					cv_mut_ptr->Unlock();
+				}
+			});
+			MY_CHECK_ASSERT( !err );
+		}
+
+		// NotifyAll будит всех ожидающих (по очереди получают мьютекс)
+		std::shared_ptr<bool> flag_ptr( new bool( false ) );
+		MY_CHECK_ASSERT( flag_ptr );
+		for( uint8_t t = 0; t < 10; ++t )
+		{
+			auto err = Go( [ &, cv_mut_ptr, cv_ptr, flag_ptr ]()
+			{
+				cv_mut_ptr->Lock();
+				++cv_waiters_num;
+				while( !*flag_ptr )
+				{
+					cv_ptr->Wait( *cv_mut_ptr );
+				}
+				--cv_waiters_num;
+				cv_mut_ptr->Unlock();
+			});
+			MY_CHECK_ASSERT( !err );
+		}
+
+		while( cv_waiters_num.load() < 10 )
+		{
+			YieldCoro();
+		}
+
+		// Ожидающие встают в очередь до освобождения мьютекса,
+		// поэтому после его захвата все они в очереди
+		cv_mut_ptr->Lock();
+		*flag_ptr = true;
+		cv_ptr->NotifyAll();
+		cv_mut_ptr->Unlock();
+
+		while( cv_waiters_num.load() > 0 )
+		{
+			YieldCoro();
+		}
+
 	}; //auto task
 
 	Service srv;
@@ -836,7 +972,25 @@ void check_sync( bool single_thread )
 	MY_CHECK_ASSERT( sh_unique_locks_counter.load() == 0 );
 	MY_CHECK_ASSERT( sh_shared_locks_counter.load() == 0 );
 
+	MY_CHECK_ASSERT( total_dsh_unique_locks.load() == 50 );
+	MY_CHECK_ASSERT( total_dsh_shared_locks.load() == 50 );
+	MY_CHECK_ASSERT( dsh_unique_locks_counter.load() == 0 );
+	MY_CHECK_ASSERT( dsh_shared_locks_counter.load() == 0 );
+
 	MY_CHECK_ASSERT( semaphore_counter.load() == 0 );
+
+	MY_CHECK_ASSERT( cv_consumed.load() == 100 );
+	MY_CHECK_ASSERT( cv_waiters_num.load() == 0 );
+
+	// Активное ожидание - только при нескольких потоках сервиса,
+	// неудачное активное ожидание заканчивается постановкой в очередь
+	const SyncSpinStats stats = GetSyncSpinStats();
+	MY_CHECK_ASSERT( stats.SpinAcquired <= stats.Spins );
+	MY_CHECK_ASSERT( stats.Parked >= stats.Spins - stats.SpinAcquired );
+	if( single_thread )
+	{
+		MY_CHECK_ASSERT( stats.Spins == 0 );
+	}
 } // void check_sync()
 
 void check_timer( bool single_thread )
@@ -942,6 +1096,1001 @@ void check_timer( bool single_thread )
 	MY_CHECK_ASSERT( srv.Stop() );
 } // void check_timer( bool single_thread )
 
+void check_deadlines( bool single_thread )
+{
+	Service srv;
+	MY_CHECK_ASSERT( srv.Restart() );
+	Error err = srv.AddCoro( []()
+	{
+		using namespace ErrorCodes;
+		Error err;
+
+		// Истечение срока одной операции не затрагивает остальные операции сокета
+		Ip4Addr addr;
+		addr.SetIp( "127.0.0.1", err );
+		MY_CHECK_ASSERT( !err );
+		addr.SetPortNum( 45321 );
+
+		std::shared_ptr<UdpSocket> sock( new UdpSocket );
+		MY_CHECK_ASSERT( sock );
+		sock->Open( err );
+		MY_CHECK_ASSERT( !err );
+		sock->Bind( addr, err );
+		MY_CHECK_ASSERT( !err );
+
+		std::shared_ptr<std::atomic<bool>> received( new std::atomic<bool>( false ) );
+		err = Go( [ sock, received ]()
+		{
+			Ip4Addr sender_addr;
+			uint8_t val = 0;
+			Error err;
+			size_t res = sock->RecvFrom( BufferType( &val, 1 ), sender_addr,
+			                             DeadlineAfter( 10*1000*1000 ), err );
+			MY_CHECK_ASSERT( !err );
+			MY_CHECK_ASSERT( res == 1 );
+			MY_CHECK_ASSERT( val == 0x42 );
+			received->store( true );
+		});
+		MY_CHECK_ASSERT( !err );
+
+		// (ожидающая сопрограмма остаётся в списке дескриптора)
+		Ip4Addr sender_addr;
+		uint8_t val = 0;
+		for( uint8_t t = 0; t < 3; ++t )
+		{
+			auto start = DeadlineClock::now();
+			sock->RecvFrom( BufferType( &val, 1 ), sender_addr, DeadlineAfter( 20*1000 ), err );
+			MY_CHECK_ASSERT( err.Code == TimedOut );
+			MY_CHECK_ASSERT( ( DeadlineClock::now() - start ) >= std::chrono::milliseconds( 20 ) );
+			MY_CHECK_ASSERT( sock->IsOpen() );
+			MY_CHECK_ASSERT( !received->load() );
+		}
+
+		// Истёкший срок: операция не ждёт
+		sock->RecvFrom( BufferType( &val, 1 ), sender_addr, DeadlineClock::now(), err );
+		MY_CHECK_ASSERT( err.Code == TimedOut );
+
+		UdpSocket sender;
+		sender.Open( err );
+		MY_CHECK_ASSERT( !err );
+		val = 0x42;
+		sender.SendTo( ConstBufferType( &val, 1 ), addr, err );
+		MY_CHECK_ASSERT( !err );
+		while( !received->load() )
+		{
+			YieldCoro();
+		}
+
+		TcpAcceptor acceptor;
+		acceptor.Open( err );
+		MY_CHECK_ASSERT( !err );
+		addr.SetPortNum( 45322 );
+		acceptor.Bind( addr, err );
+		MY_CHECK_ASSERT( !err );
+		acceptor.Listen( 10, err );
+		MY_CHECK_ASSERT( !err );
+
+		TcpConnection conn;
+		Ip4Addr conn_addr;
+		acceptor.Accept( conn, conn_addr, DeadlineAfter( 20*1000 ), err );
+		MY_CHECK_ASSERT( err.Code == TimedOut );
+		MY_CHECK_ASSERT( acceptor.IsOpen() );
+		MY_CHECK_ASSERT( !conn.IsOpen() );
+
+		// Объекты синхронизации
+		std::shared_ptr<Mutex> mut_ptr( new Mutex );
+		MY_CHECK_ASSERT( mut_ptr );
+		mut_ptr->Lock();
+
+		std::shared_ptr<std::atomic<uint8_t>> stage_ptr( new std::atomic<uint8_t>( 0 ) );
+		err = Go( [ mut_ptr, stage_ptr ]()
+		{
+			MY_CHECK_ASSERT( !mut_ptr->Lock( DeadlineAfter( 20*1000 ) ) );
+			++( *stage_ptr );
+			MY_CHECK_ASSERT( mut_ptr->Lock( DeadlineAfter( 10*1000*1000 ) ) );
+			mut_ptr->Unlock();
+			++( *stage_ptr );
+		});
+		MY_CHECK_ASSERT( !err );
+
+		while( stage_ptr->load() == 0 )
+		{
+			YieldCoro();
+		}
+		mut_ptr->Unlock();
+
+		while( stage_ptr->load() < 2 )
+		{
+			YieldCoro();
+		}
+
+		// Монопольный "ждун" истёк - разделяемый, вставший за ним, не должен зависнуть
+		SharedMutex sh_mut;
+		MY_CHECK_ASSERT( sh_mut.TrySharedLock() );
+		MY_CHECK_ASSERT( !sh_mut.Lock( DeadlineAfter( 20*1000 ) ) );
+		MY_CHECK_ASSERT( sh_mut.SharedLock( DeadlineAfter( 20*1000 ) ) );
+		sh_mut.Unlock();
+		sh_mut.Unlock();
+		MY_CHECK_ASSERT( sh_mut.Lock( DeadlineAfter( 20*1000 ) ) );
+		MY_CHECK_ASSERT( !sh_mut.TrySharedLock() );
+		MY_CHECK_ASSERT( !sh_mut.SharedLock( DeadlineAfter( 20*1000 ) ) );
+		sh_mut.Unlock();
+
+		// Писатель, не дождавшийся выхода читателя, отдаёт блокировку
+		DistributedSharedMutex dsh_mut;
+		MY_CHECK_ASSERT( dsh_mut.TrySharedLock() );
+		MY_CHECK_ASSERT( !dsh_mut.TryLock() );
+		MY_CHECK_ASSERT( !dsh_mut.Lock( DeadlineAfter( 20*1000 ) ) );
+		MY_CHECK_ASSERT( dsh_mut.SharedLock( DeadlineAfter( 20*1000 ) ) );
+		dsh_mut.SharedUnlock();
+		dsh_mut.SharedUnlock();
+		MY_CHECK_ASSERT( dsh_mut.Lock( DeadlineAfter( 20*1000 ) ) );
+		MY_CHECK_ASSERT( !dsh_mut.TrySharedLock() );
+		MY_CHECK_ASSERT( !dsh_mut.SharedLock( DeadlineAfter( 20*1000 ) ) );
+		dsh_mut.Unlock();
+		MY_CHECK_ASSERT( dsh_mut.TryLock() );
+		dsh_mut.Unlock();
+
+		Semaphore sem;
+		MY_CHECK_ASSERT( !sem.Pop( DeadlineAfter( 20*1000 ) ) );
+		sem.Push();
+		MY_CHECK_ASSERT( sem.Pop( DeadlineAfter( 20*1000 ) ) );
+
+		Event ev;
+		MY_CHECK_ASSERT( !ev.Wait( DeadlineAfter( 20*1000 ) ) );
+		ev.Set();
+		MY_CHECK_ASSERT( ev.Wait( DeadlineAfter( 20*1000 ) ) );
+		ev.Reset();
+
+		// По истечении срока мьютекс снова захвачен
+		Mutex cv_mut;
+		ConditionVariable cv;
+		cv_mut.Lock();
+		MY_CHECK_ASSERT( !cv.Wait( cv_mut, DeadlineAfter( 20*1000 ) ) );
+		MY_CHECK_ASSERT( !cv_mut.TryLock() );
+		MY_CHECK_ASSERT( !cv.Wait( cv_mut, DeadlineClock::now() ) );
+		MY_CHECK_ASSERT( !cv_mut.TryLock() );
+		cv_mut.Unlock();
+
+		std::shared_ptr<Mutex> cv_mut_ptr( new Mutex );
+		std::shared_ptr<ConditionVariable> cv_ptr( new ConditionVariable );
+		MY_CHECK_ASSERT( cv_mut_ptr && cv_ptr );
+		cv_mut_ptr->Lock();
+		err = Go( [ cv_mut_ptr, cv_ptr ]()
+		{
+			cv_mut_ptr->Lock();
+			cv_ptr->NotifyOne();
+			cv_mut_ptr->Unlock();
+		});
+		MY_CHECK_ASSERT( !err );
+		MY_CHECK_ASSERT( cv_ptr->Wait( *cv_mut_ptr, DeadlineAfter( 10*1000*1000 ) ) );
+		cv_mut_ptr->Unlock();
+	} ); // Error err = srv.AddCoro
+	MY_CHECK_ASSERT( !err );
+
+	const uint8_t threads_num = single_thread ? 1 : 4;
+	std::vector<std::thread> threads( threads_num );
+	MY_CHECK_ASSERT( threads.size() == threads_num );
+	std::function<void()> thread_task = [ &srv ]
+	{
+		try
+		{
+			srv.Run();
+		}
+		catch( ... )
+		{
+			MY_CHECK_ASSERT( false );
+		}
+	};
+
+	for( auto &th : threads )
+	{
+		th = std::thread( thread_task );
+	}
+
+	for( auto &th : threads )
+	{
+		th.join();
+	}
+
+	MY_CHECK_ASSERT( srv.Stop() );
+} // void check_deadlines( bool single_thread )
+
+void check_timer_slack( bool single_thread )
+{
+	Service srv;
+	MY_CHECK_ASSERT( srv.Restart() );
+
+	const uint64_t slack = 32*1000;
+	srv.SetTimerSlack( slack );
+	MY_CHECK_ASSERT( srv.GetTimerSlack() == slack );
+
+	const uint8_t timers_num = 20;
+	for( uint8_t t = 0; t < timers_num; ++t )
+	{
+		Error err = srv.AddCoro( [ t, slack ]()
+		{
+			// Сроки таймеров отличаются на 1 мс, все попадают
+			// в пару окон группировки
+			const uint64_t timeout = ( 50 + t )*1000;
+			Timer timer;
+			Error err;
+
+			auto start = std::chrono::steady_clock::now();
+			if( ( t % 2 ) == 0 )
+			{
+				// Запаздывание по умолчанию для сервиса
+				timer.ExpiresAfter( timeout, err );
+			}
+			else
+			{
+				timer.ExpiresAfter( timeout, slack, err );
+			}
+			MY_CHECK_ASSERT( !err );
+
+			timer.Wait( err );
+			MY_CHECK_ASSERT( !err );
+
+			// Таймер не срабатывает раньше срока и запаздывает не больше,
+			// чем на slack (с запасом на планирование потоков)
+			auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::steady_clock::now() - start ).count();
+			MY_CHECK_ASSERT( elapsed >= ( int64_t ) timeout );
+			MY_CHECK_ASSERT( elapsed < ( int64_t ) ( timeout + slack + 200*1000 ) );
+		});
+		MY_CHECK_ASSERT( !err );
+	}
+
+	const uint8_t threads_num = single_thread ? 1 : 4;
+	std::vector<std::thread> threads( threads_num );
+	for( auto &th : threads )
+	{
+		th = std::thread( [ &srv ]
+		{
+			try
+			{
+				srv.Run();
+			}
+			catch( ... )
+			{
+				MY_CHECK_ASSERT( false );
+			}
+		});
+	}
+
+	for( auto &th : threads )
+	{
+		th.join();
+	}
+
+	MY_CHECK_ASSERT( srv.Stop() );
+
+	// Таймеры с близкими сроками должны срабатывать за общие пробуждения
+	TimerStats stats = srv.GetTimerStats();
+	MY_CHECK_ASSERT( stats.Expired >= timers_num );
+	MY_CHECK_ASSERT( stats.Wakeups + stats.WakeupsSaved == stats.Expired );
+	MY_CHECK_ASSERT( stats.WakeupsSaved > 0 );
+} // void check_timer_slack( bool single_thread )
+
+void check_sleep( bool single_thread )
+{
+	// Вне сопрограммы сервиса
+	Error err;
+	SleepFor( 1000, err );
+	MY_CHECK_ASSERT( err.Code == ErrorCodes::NotInsideSrvCoro );
+
+	Service srv;
+	MY_CHECK_ASSERT( srv.Restart() );
+
+	err = srv.AddCoro( []()
+	{
+		Error err;
+		auto start = std::chrono::steady_clock::now();
+		SleepFor( 20*1000, err );
+		MY_CHECK_ASSERT( !err );
+		MY_CHECK_ASSERT( std::chrono::steady_clock::now() - start >= std::chrono::milliseconds( 20 ) );
+
+		// Срок уже наступил
+		SleepUntil( DeadlineClock::now() - std::chrono::milliseconds( 1 ), err );
+		MY_CHECK_ASSERT( !err );
+	});
+	MY_CHECK_ASSERT( !err );
+
+	err = srv.AddCoro( []()
+	{
+		auto start = std::chrono::steady_clock::now();
+		Ticker ticker( 10*1000 );
+		Error err;
+
+		uint64_t ticks = 0;
+		while( ticks < 5 )
+		{
+			uint64_t res = ticker.Wait( err );
+			MY_CHECK_ASSERT( !err );
+			MY_CHECK_ASSERT( res >= 1 );
+			ticks += res;
+		}
+		MY_CHECK_ASSERT( std::chrono::steady_clock::now() - start >= std::chrono::milliseconds( 10*ticks ) );
+
+		// Пропущенные "тики" учитываются разом, следующие не сдвигаются
+		SleepFor( 35*1000 );
+		uint64_t res = ticker.Wait( err );
+		MY_CHECK_ASSERT( !err );
+		MY_CHECK_ASSERT( res >= 3 );
+		ticks += res;
+		MY_CHECK_ASSERT( std::chrono::steady_clock::now() - start >= std::chrono::milliseconds( 10*ticks ) );
+	});
+	MY_CHECK_ASSERT( !err );
+
+	err = srv.AddCoro( []()
+	{
+		std::shared_ptr<Ticker> ticker_ptr( new Ticker( 10*1000*1000 ) );
+		Error err = Go( [ ticker_ptr ]()
+		{
+			SleepFor( 20*1000 );
+			ticker_ptr->Cancel();
+		});
+		MY_CHECK_ASSERT( !err );
+
+		ticker_ptr->Wait( err );
+		MY_CHECK_ASSERT( err.Code == ErrorCodes::OperationAborted );
+	});
+	MY_CHECK_ASSERT( !err );
+
+	const uint8_t threads_num = single_thread ? 1 : 4;
+	std::vector<std::thread> threads( threads_num );
+	for( auto &th : threads )
+	{
+		th = std::thread( [ &srv ]
+		{
+			try
+			{
+				srv.Run();
+			}
+			catch( ... )
+			{
+				MY_CHECK_ASSERT( false );
+			}
+		});
+	}
+
+	for( auto &th : threads )
+	{
+		th.join();
+	}
+
+	MY_CHECK_ASSERT( srv.Stop() );
+
+	// Остановка сервиса прерывает сон (и после перезапуска сон снова работает)
+	for( uint8_t step = 0; step < 2; ++step )
+	{
+		MY_CHECK_ASSERT( srv.Restart() );
+
+		std::atomic<bool> started( false );
+		std::atomic<bool> stopped( false );
+		err = srv.AddCoro( [ &started, &stopped ]()
+		{
+			Error err;
+			SleepFor( 1000, err );
+			MY_CHECK_ASSERT( !err );
+
+			started.store( true );
+			SleepFor( 10*1000*1000, err );
+			MY_CHECK_ASSERT( err.Code == ErrorCodes::SrvStop );
+			stopped.store( true );
+		});
+		MY_CHECK_ASSERT( !err );
+
+		for( auto &th : threads )
+		{
+			th = std::thread( [ &srv ]{ srv.Run(); } );
+		}
+
+		while( !started.load() )
+		{
+			std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		MY_CHECK_ASSERT( srv.Stop() );
+		MY_CHECK_ASSERT( std::chrono::steady_clock::now() - start < std::chrono::seconds( 1 ) );
+		MY_CHECK_ASSERT( stopped.load() );
+
+		for( auto &th : threads )
+		{
+			th.join();
+		}
+	}
+} // void check_sleep( bool single_thread )
+
+/// Версия данных для проверки RcuCell (считает живые экземпляры)
+struct RcuVersion
+{
+	static std::atomic<int64_t> Alive;
+
+	uint64_t Num;
+
+	/// Копия Num (у целой версии значения совпадают)
+	uint64_t Check;
+
+	RcuVersion( uint64_t num ): Num( num ), Check( num )
+	{
+		++Alive;
+	}
+
+	~RcuVersion()
+	{
+		Check = 0xDEAD;
+		--Alive;
+	}
+};
+
+std::atomic<int64_t> RcuVersion::Alive( 0 );
+
+void check_rcu( bool single_thread )
+{
+	MY_CHECK_ASSERT( RcuVersion::Alive.load() == 0 );
+
+	Service srv;
+	MY_CHECK_ASSERT( srv.Restart() );
+
+	std::atomic<uint64_t> reads( 0 );
+	Error err = srv.AddCoro( [ & ]()
+	{
+		static const uint64_t VersionsNum = 100;
+		std::shared_ptr<RcuCell<RcuVersion>> cell_ptr( new RcuCell<RcuVersion>( std::unique_ptr<RcuVersion>( new RcuVersion( 0 ) ) ) );
+		MY_CHECK_ASSERT( cell_ptr );
+		std::shared_ptr<std::atomic<bool>> done_ptr( new std::atomic<bool>( false ) );
+
+		// Читатели видят целые версии, номера версий не убывают
+		for( uint8_t t = 0; t < 10; ++t )
+		{
+			Error err = Go( [ &, cell_ptr, done_ptr ]()
+			{
+				uint64_t last_num = 0;
+				while( !done_ptr->load() )
+				{
+					const RcuVersion *ver_ptr = cell_ptr->Get();
+					MY_CHECK_ASSERT( ver_ptr != nullptr );
+					MY_CHECK_ASSERT( ver_ptr->Num == ver_ptr->Check );
+					MY_CHECK_ASSERT( ver_ptr->Num >= last_num );
+					last_num = ver_ptr->Num;
+					++reads;
+					YieldCoro();
+				}
+			});
+			MY_CHECK_ASSERT( !err );
+		}
+
+		for( uint64_t num = 1; num <= VersionsNum; ++num )
+		{
+			if( ( num % 2 ) == 0 )
+			{
+				cell_ptr->Set( std::unique_ptr<RcuVersion>( new RcuVersion( num ) ) );
+			}
+			else
+			{
+				cell_ptr->Update( [ num ]( const RcuVersion *cur_ptr )
+				{
+					MY_CHECK_ASSERT( cur_ptr != nullptr );
+					MY_CHECK_ASSERT( cur_ptr->Num == num - 1 );
+					return std::unique_ptr<RcuVersion>( new RcuVersion( cur_ptr->Num + 1 ) );
+				});
+			}
+			YieldCoro();
+		}
+		MY_CHECK_ASSERT( cell_ptr->Get()->Num == VersionsNum );
+		done_ptr->store( true );
+
+		// Прежние версии удаляются во время работы сервиса
+		while( RcuVersion::Alive.load() > 1 )
+		{
+			YieldCoro();
+		}
+	});
+	MY_CHECK_ASSERT( !err );
+
+	const uint8_t threads_num = single_thread ? 1 : 4;
+	std::vector<std::thread> threads( threads_num );
+	for( auto &th : threads )
+	{
+		th = std::thread( [ &srv ]{ srv.Run(); } );
+	}
+
+	for( auto &th : threads )
+	{
+		th.join();
+	}
+
+	MY_CHECK_ASSERT( srv.Stop() );
+	MY_CHECK_ASSERT( reads.load() > 0 );
+	MY_CHECK_ASSERT( RcuVersion::Alive.load() == 0 );
+} // void check_rcu( bool single_thread )
+
+void check_futures( bool single_thread )
+{
+	Service srv;
+	MY_CHECK_ASSERT( srv.Restart() );
+
+	std::atomic<bool> done( false );
+	Error err = srv.AddCoro( [ &done ]()
+	{
+		// Значения результатов
+		std::vector<Future<uint64_t>> futures( 10 );
+		for( uint64_t t = 0; t < futures.size(); ++t )
+		{
+			Error err = Go( futures[ t ], [ t ]()
+			{
+				YieldCoro();
+				return t*t;
+			});
+			MY_CHECK_ASSERT( !err );
+			MY_CHECK_ASSERT( futures[ t ].Valid() );
+		}
+		WhenAll( futures );
+		for( uint64_t t = 0; t < futures.size(); ++t )
+		{
+			MY_CHECK_ASSERT( futures[ t ].IsReady() );
+			MY_CHECK_ASSERT( futures[ t ].Get() == t*t );
+			MY_CHECK_ASSERT( !futures[ t ].Valid() );
+		}
+
+		// Результат без значения, исключения задачи, перемещаемые значения
+		std::shared_ptr<std::atomic<bool>> flag( new std::atomic<bool>( false ) );
+		Future<void> void_future;
+		Error err = Go( void_future, [ flag ]()
+		{
+			SleepFor( 1000 );
+			flag->store( true );
+		});
+		MY_CHECK_ASSERT( !err );
+		void_future.Get();
+		MY_CHECK_ASSERT( flag->load() );
+
+		Future<std::string> str_future;
+		err = Go( str_future, []() -> std::string
+		{
+			throw std::runtime_error( "future error" );
+		});
+		MY_CHECK_ASSERT( !err );
+		bool thrown = false;
+		try
+		{
+			str_future.Get();
+		}
+		catch( const std::runtime_error &exc )
+		{
+			thrown = std::string( exc.what() ) == "future error";
+		}
+		MY_CHECK_ASSERT( thrown );
+
+		thrown = false;
+		try
+		{
+			str_future.Get();
+		}
+		catch( const std::invalid_argument& )
+		{
+			thrown = true;
+		}
+		MY_CHECK_ASSERT( thrown );
+
+		std::unique_ptr<std::string> str_ptr( new std::string( "value" ) );
+		Future<std::unique_ptr<std::string>> ptr_future;
+		err = Go( ptr_future, [ &str_ptr ]()
+		{
+			return std::move( str_ptr );
+		});
+		MY_CHECK_ASSERT( !err );
+		MY_CHECK_ASSERT( *ptr_future.Get() == "value" );
+
+		// Ожидание любого из результатов (быстрый ответ из нескольких)
+		std::vector<Future<uint64_t>> replies( 3 );
+		const uint64_t delays[] = { 200*1000, 1000, 100*1000 };
+		for( size_t t = 0; t < replies.size(); ++t )
+		{
+			uint64_t delay = delays[ t ];
+			err = Go( replies[ t ], [ delay ]()
+			{
+				SleepFor( delay );
+				return delay;
+			});
+			MY_CHECK_ASSERT( !err );
+		}
+		size_t idx = WhenAny( replies );
+		MY_CHECK_ASSERT( idx == 1 );
+		MY_CHECK_ASSERT( replies[ idx ].Get() == 1000 );
+		replies.erase( replies.begin() + idx );
+
+		// Сроки ожидания
+		MY_CHECK_ASSERT( WhenAny( replies, DeadlineAfter( 1000 ) ) == replies.size() );
+		MY_CHECK_ASSERT( !WhenAll( replies, DeadlineAfter( 1000 ) ) );
+		MY_CHECK_ASSERT( !replies[ 0 ].Wait( DeadlineAfter( 1000 ) ) );
+		MY_CHECK_ASSERT( WhenAny( replies, DeadlineAfter( 10*1000*1000 ) ) == 1 );
+		MY_CHECK_ASSERT( WhenAll( replies, DeadlineAfter( 10*1000*1000 ) ) );
+		MY_CHECK_ASSERT( WhenAny( replies ) == 0 );
+		MY_CHECK_ASSERT( replies[ 0 ].Get() == 200*1000 );
+		MY_CHECK_ASSERT( replies[ 1 ].Get() == 100*1000 );
+
+		done.store( true );
+	});
+	MY_CHECK_ASSERT( !err );
+
+	const uint8_t threads_num = single_thread ? 1 : 4;
+	std::vector<std::thread> threads( threads_num );
+	for( auto &th : threads )
+	{
+		th = std::thread( [ &srv ]{ srv.Run(); } );
+	}
+
+	for( auto &th : threads )
+	{
+		th.join();
+	}
+
+	MY_CHECK_ASSERT( srv.Stop() );
+	MY_CHECK_ASSERT( done.load() );
+} // void check_futures( bool single_thread )
+
+void check_task_group( bool single_thread )
+{
+	Service srv;
+	MY_CHECK_ASSERT( srv.Restart() );
+
+	std::atomic<bool> done( false );
+	Error err = srv.AddCoro( [ &done ]()
+	{
+		using namespace ErrorCodes;
+		Error err;
+
+		// Ожидание завершения всех сопрограмм группы
+		std::shared_ptr<std::atomic<uint64_t>> finished( new std::atomic<uint64_t>( 0 ) );
+		{
+			TaskGroup group;
+			for( uint8_t t = 0; t < 10; ++t )
+			{
+				Error err = group.Go( [ finished, t ]()
+				{
+					SleepFor( 1000*t );
+					++( *finished );
+				});
+				MY_CHECK_ASSERT( !err );
+			}
+			MY_CHECK_ASSERT( !group.Join( DeadlineAfter( 1000 ) ) );
+			group.Join();
+			MY_CHECK_ASSERT( finished->load() == 10 );
+			MY_CHECK_ASSERT( group.Join( DeadlineAfter( 1000 ) ) );
+			MY_CHECK_ASSERT( !group.IsCancelled() );
+		}
+
+		// Отмена прерывает ожидания сопрограмм группы
+		Ip4Addr addr;
+		addr.SetIp( "127.0.0.1", err );
+		MY_CHECK_ASSERT( !err );
+		addr.SetPortNum( 45331 );
+
+		std::shared_ptr<UdpSocket> sock( new UdpSocket );
+		MY_CHECK_ASSERT( sock );
+		sock->Open( err );
+		MY_CHECK_ASSERT( !err );
+		sock->Bind( addr, err );
+		MY_CHECK_ASSERT( !err );
+
+		std::shared_ptr<Event> ev( new Event );
+		std::shared_ptr<Timer> timer( new Timer );
+		timer->ExpiresAfter( 10*1000*1000 );
+		std::shared_ptr<Mutex> mut( new Mutex );
+		mut->Lock();
+		std::shared_ptr<Ticker> ticker( new Ticker( 10*1000*1000 ) );
+		std::shared_ptr<std::atomic<uint64_t>> aborted( new std::atomic<uint64_t>( 0 ) );
+
+		TaskGroup group;
+		err = group.Go( [ aborted ]()
+		{
+			Error err;
+			SleepFor( 10*1000*1000, err );
+			MY_CHECK_ASSERT( err.Code == OperationAborted );
+			++( *aborted );
+		});
+		MY_CHECK_ASSERT( !err );
+
+		err = group.Go( [ aborted, timer ]()
+		{
+			Error err;
+			timer->Wait( err );
+			MY_CHECK_ASSERT( err.Code == OperationAborted );
+			++( *aborted );
+		});
+		MY_CHECK_ASSERT( !err );
+
+		err = group.Go( [ aborted, sock ]()
+		{
+			Ip4Addr sender_addr;
+			uint8_t val = 0;
+			Error err;
+			sock->RecvFrom( BufferType( &val, 1 ), sender_addr, err );
+			MY_CHECK_ASSERT( err.Code == OperationAborted );
+			++( *aborted );
+		});
+		MY_CHECK_ASSERT( !err );
+
+		err = group.Go( [ aborted, ev ]()
+		{
+			MY_CHECK_ASSERT( !ev->Wait( DeadlineAfter( 10*1000*1000 ) ) );
+			++( *aborted );
+		});
+		MY_CHECK_ASSERT( !err );
+
+		// Ожидания без срока с буфером ошибки прерываются
+		err = group.Go( [ aborted, ev ]()
+		{
+			Error err;
+			ev->Wait( err );
+			MY_CHECK_ASSERT( err.Code == OperationAborted );
+			++( *aborted );
+		});
+		MY_CHECK_ASSERT( !err );
+
+		err = group.Go( [ aborted, mut ]()
+		{
+			Error err;
+			mut->Lock( err );
+			MY_CHECK_ASSERT( err.Code == OperationAborted );
+			++( *aborted );
+		});
+		MY_CHECK_ASSERT( !err );
+
+		// Ожидания без параметров отменой не прерываются
+		std::shared_ptr<Mutex> cleanup_mut( new Mutex );
+		cleanup_mut->Lock();
+		std::shared_ptr<std::atomic<bool>> cleaned( new std::atomic<bool>( false ) );
+		err = group.Go( [ aborted, cleanup_mut, cleaned ]()
+		{
+			Error err;
+			SleepFor( 10*1000*1000, err );
+			MY_CHECK_ASSERT( err.Code == OperationAborted );
+			{
+				LockGuard<Mutex> lock( *cleanup_mut );
+				cleaned->store( true );
+			}
+			++( *aborted );
+		});
+		MY_CHECK_ASSERT( !err );
+
+		err = group.Go( [ aborted, ticker ]()
+		{
+			Error err;
+			MY_CHECK_ASSERT( ticker->Wait( err ) == 0 );
+			MY_CHECK_ASSERT( err.Code == OperationAborted );
+			++( *aborted );
+		});
+		MY_CHECK_ASSERT( !err );
+
+		SleepFor( 10*1000 );
+		MY_CHECK_ASSERT( aborted->load() == 0 );
+
+		auto start = std::chrono::steady_clock::now();
+		group.Cancel();
+		MY_CHECK_ASSERT( group.IsCancelled() );
+		MY_CHECK_ASSERT( !group.Join( DeadlineAfter( 20*1000 ) ) );
+		MY_CHECK_ASSERT( aborted->load() == 7 );
+		MY_CHECK_ASSERT( !cleaned->load() );
+		cleanup_mut->Unlock();
+		MY_CHECK_ASSERT( group.Join( DeadlineAfter( 5*1000*1000 ) ) );
+		MY_CHECK_ASSERT( std::chrono::steady_clock::now() - start < std::chrono::seconds( 1 ) );
+		MY_CHECK_ASSERT( aborted->load() == 8 );
+		MY_CHECK_ASSERT( cleaned->load() );
+
+		// Сопрограммы в отменённой группе не создаются
+		err = group.Go( []{ MY_CHECK_ASSERT( false ); } );
+		MY_CHECK_ASSERT( err.Code == OperationAborted );
+
+		// Ожидания вне группы отмена не затрагивает
+		timer->Cancel();
+		ev->Set();
+		mut->Unlock();
+		MY_CHECK_ASSERT( mut->Lock( DeadlineAfter( 1000 ) ) );
+		mut->Unlock();
+		SleepFor( 1000, err );
+		MY_CHECK_ASSERT( !err );
+		sock->Close();
+
+		done.store( true );
+	});
+	MY_CHECK_ASSERT( !err );
+
+	const uint8_t threads_num = single_thread ? 1 : 4;
+	std::vector<std::thread> threads( threads_num );
+	for( auto &th : threads )
+	{
+		th = std::thread( [ &srv ]{ srv.Run(); } );
+	}
+
+	for( auto &th : threads )
+	{
+		th.join();
+	}
+
+	MY_CHECK_ASSERT( srv.Stop() );
+	MY_CHECK_ASSERT( done.load() );
+} // void check_task_group( bool single_thread )
+
+void check_broadcast( bool single_thread )
+{
+	Service srv;
+	MY_CHECK_ASSERT( srv.Restart() );
+
+	std::atomic<bool> done( false );
+	Error err = srv.AddCoro( [ &done ]()
+	{
+		using namespace ErrorCodes;
+		typedef Broadcast<uint64_t> BroadcastType;
+		static const uint64_t MessagesNum = 100;
+		Error err;
+
+		// Все подписчики получают одни и те же экземпляры сообщений по порядку
+		{
+			std::shared_ptr<BroadcastType> bcast( new BroadcastType( 4 ) );
+			std::shared_ptr<BroadcastType::Subscriber> slow( new BroadcastType::Subscriber( *bcast ) );
+			std::shared_ptr<std::vector<const uint64_t*>> received( new std::vector<const uint64_t*>( MessagesNum, nullptr ) );
+			std::shared_ptr<std::atomic<uint64_t>> mismatches( new std::atomic<uint64_t>( 0 ) );
+
+			TaskGroup group;
+			for( uint8_t t = 0; t < 5; ++t )
+			{
+				std::shared_ptr<BroadcastType::Subscriber> sub( new BroadcastType::Subscriber( *bcast ) );
+				err = group.Go( [ sub, received, mismatches ]()
+				{
+					for( uint64_t num = 0; num < MessagesNum; ++num )
+					{
+						BroadcastType::MessagePtr msg = sub->Receive();
+						MY_CHECK_ASSERT( msg );
+						MY_CHECK_ASSERT( *msg == num );
+						if( ( *received )[ num ] == nullptr )
+						{
+							( *received )[ num ] = msg.get();
+						}
+						else if( ( *received )[ num ] != msg.get() )
+						{
+							++( *mismatches );
+						}
+					}
+					MY_CHECK_ASSERT( sub->GetDropped() == 0 );
+
+					Error err;
+					MY_CHECK_ASSERT( !sub->Receive( err ) );
+					MY_CHECK_ASSERT( err.Code == BroadcastClosed );
+				});
+				MY_CHECK_ASSERT( !err );
+			}
+
+			for( uint64_t num = 0; num < MessagesNum; ++num )
+			{
+				bcast->Publish( std::make_shared<const uint64_t>( num ) );
+
+				// Подписчики успевают за публикацией
+				SleepFor( 100 );
+			}
+			bcast->Close();
+			group.Join();
+			MY_CHECK_ASSERT( mismatches->load() == 0 );
+
+			bcast->Publish( std::make_shared<const uint64_t>( 0 ), err );
+			MY_CHECK_ASSERT( err.Code == BroadcastClosed );
+
+			// Отставшему подписчику пропускаются старейшие сообщения
+			for( uint64_t num = MessagesNum - 4; num < MessagesNum; ++num )
+			{
+				BroadcastType::MessagePtr msg = slow->TryReceive();
+				MY_CHECK_ASSERT( msg );
+				MY_CHECK_ASSERT( *msg == num );
+			}
+			MY_CHECK_ASSERT( slow->GetDropped() == MessagesNum - 4 );
+			MY_CHECK_ASSERT( !slow->TryReceive( err ) );
+			MY_CHECK_ASSERT( err.Code == BroadcastClosed );
+		}
+
+		// Отставший подписчик отключается
+		{
+			BroadcastType bcast( 2, BroadcastOverflow::Disconnect );
+			BroadcastType::Subscriber sub( bcast );
+			MY_CHECK_ASSERT( !sub.Receive( DeadlineAfter( 1000 ), err ) );
+			MY_CHECK_ASSERT( err.Code == TimedOut );
+
+			for( uint64_t num = 0; num < 3; ++num )
+			{
+				bcast.Publish( std::make_shared<const uint64_t>( num ) );
+			}
+			MY_CHECK_ASSERT( !sub.Receive( err ) );
+			MY_CHECK_ASSERT( err.Code == SubscriberLagged );
+			MY_CHECK_ASSERT( !sub.TryReceive( err ) );
+			MY_CHECK_ASSERT( err.Code == SubscriberLagged );
+
+			BroadcastType::Subscriber new_sub( bcast );
+			MY_CHECK_ASSERT( !new_sub.TryReceive( err ) );
+			MY_CHECK_ASSERT( !err );
+			bcast.Publish( std::make_shared<const uint64_t>( 3 ) );
+			MY_CHECK_ASSERT( *new_sub.Receive() == 3 );
+		}
+
+		// Публикация ждёт самого медленного подписчика
+		{
+			std::shared_ptr<BroadcastType> bcast( new BroadcastType( 2, BroadcastOverflow::Block ) );
+			std::shared_ptr<BroadcastType::Subscriber> sub( new BroadcastType::Subscriber( *bcast ) );
+
+			bcast->Publish( std::make_shared<const uint64_t>( 0 ) );
+			bcast->Publish( std::make_shared<const uint64_t>( 1 ) );
+			bcast->Publish( std::make_shared<const uint64_t>( 2 ), DeadlineAfter( 1000 ), err );
+			MY_CHECK_ASSERT( err.Code == TimedOut );
+
+			TaskGroup group;
+			err = group.Go( [ sub ]()
+			{
+				for( uint64_t num = 0; num < MessagesNum; ++num )
+				{
+					SleepFor( 100 );
+					BroadcastType::MessagePtr msg = sub->Receive();
+					MY_CHECK_ASSERT( msg );
+					MY_CHECK_ASSERT( *msg == num );
+				}
+				MY_CHECK_ASSERT( sub->GetDropped() == 0 );
+			});
+			MY_CHECK_ASSERT( !err );
+
+			for( uint64_t num = 2; num < MessagesNum; ++num )
+			{
+				bcast->Publish( std::make_shared<const uint64_t>( num ) );
+			}
+			group.Join();
+
+			// Ожидание публикации прерывается отменой группы
+			bcast->Publish( std::make_shared<const uint64_t>( 0 ) );
+			bcast->Publish( std::make_shared<const uint64_t>( 1 ) );
+			TaskGroup pub_group;
+			err = pub_group.Go( [ bcast ]()
+			{
+				Error err;
+				bcast->Publish( std::make_shared<const uint64_t>( 2 ), DeadlineAfter( 10*1000*1000 ), err );
+				MY_CHECK_ASSERT( err.Code == OperationAborted );
+			});
+			MY_CHECK_ASSERT( !err );
+			SleepFor( 1000 );
+			pub_group.Cancel();
+			pub_group.Join();
+
+			// Отписка медленного подписчика продолжает публикацию, ждущую без срока
+			TaskGroup unsub_group;
+			err = unsub_group.Go( [ bcast ]()
+			{
+				Error err;
+				bcast->Publish( std::make_shared<const uint64_t>( 2 ), err );
+				MY_CHECK_ASSERT( !err );
+			});
+			MY_CHECK_ASSERT( !err );
+			SleepFor( 1000 );
+			sub.reset();
+			unsub_group.Join();
+		}
+
+		done.store( true );
+	});
+	MY_CHECK_ASSERT( !err );
+
+	const uint8_t threads_num = single_thread ? 1 : 4;
+	std::vector<std::thread> threads( threads_num );
+	for( auto &th : threads )
+	{
+		th = std::thread( [ &srv ]{ srv.Run(); } );
+	}
+
+	for( auto &th : threads )
+	{
+		th.join();
+	}
+
+	MY_CHECK_ASSERT( srv.Stop() );
+	MY_CHECK_ASSERT( done.load() );
+} // void check_broadcast( bool single_thread )
+
 void coro_service_tests()
 {
 	const uint16_t steps_num = 100;
@@ -963,5 +2112,19 @@ void coro_service_tests()
 		check_sync( false );
 		check_timer( true );
 		check_timer( false );
+		check_timer_slack( true );
+		check_timer_slack( false );
+		check_sleep( true );
+		check_sleep( false );
+		check_deadlines( true );
+		check_deadlines( false );
+		check_rcu( true );
+		check_rcu( false );
+		check_futures( true );
+		check_futures( false );
+		check_task_group( true );
+		check_task_group( false );
+		check_broadcast( true );
+		check_broadcast( false );
 	}
 }
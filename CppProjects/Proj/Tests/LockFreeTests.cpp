@@ -7,6 +7,7 @@
 #include <map>
 #include <thread>
 #include <atomic>
+#include <functional>
 
 #ifdef NDEBUG
 	#undef NDEBUG
@@ -498,6 +499,91 @@ void deferred_deleter_test()
 	MY_CHECK_ASSERT( LockFree::DebugStruct::GetCounter() == 0 );
 } // void deferred_deleter_test()
 
+void shared_deleter_test()
+{
+	using namespace LockFree;
+	static std::atomic<bool> Checked( false );
+	if( !Checked.exchange( true ) )
+	{
+		// Однопоточная проверка общей очереди
+		DeferredDeleter &def_queue = DeferredDeleter::Shared();
+		MY_CHECK_ASSERT( &def_queue == &DeferredDeleter::Shared() );
+
+		def_queue.Delete( new LockFree::DebugStruct( 1 ) );
+		MY_CHECK_ASSERT( LockFree::DebugStruct::GetCounter() == 0 );
+
+		// Вложенный захват эпохи тем же потоком не должен
+		// освобождать эпоху внешнего и сдвигать её
+		auto epoch1 = def_queue.EpochAcquire();
+		def_queue.Delete( new LockFree::DebugStruct( 1 ) );
+		auto epoch2 = def_queue.EpochAcquire();
+		def_queue.Delete( new LockFree::DebugStruct( 2 ) );
+		def_queue.UpdateEpoch( epoch2 );
+		epoch2.Release();
+		def_queue.Clear();
+		MY_CHECK_ASSERT( LockFree::DebugStruct::GetCounter() == 2 );
+
+		// Обновление эпохи внешнего "хранителя" разрешает удаление
+		def_queue.UpdateEpoch( epoch1 );
+		def_queue.Clear();
+		MY_CHECK_ASSERT( LockFree::DebugStruct::GetCounter() == 0 );
+
+		def_queue.Delete( new LockFree::DebugStruct( 3 ) );
+		def_queue.Clear();
+		MY_CHECK_ASSERT( LockFree::DebugStruct::GetCounter() == 1 );
+		epoch1.Release();
+		def_queue.Clear();
+		MY_CHECK_ASSERT( LockFree::DebugStruct::GetCounter() == 0 );
+	}
+
+	// Многопоточная проверка: контейнеры по умолчанию используют общую
+	// очередь, количество потоков заранее не задаётся
+	MY_CHECK_ASSERT( LockFree::DebugStruct::GetCounter() == 0 );
+	static const uint8_t ThreadsNum( 20 );
+	static const uint16_t OneThreadOpsNum( 10 );
+	Stack<LockFree::DebugStruct> stack;
+	Queue<LockFree::DebugStruct> queue;
+	std::atomic<uint32_t> popped( 0 );
+
+	auto h = [ & ]()
+	{
+		for( uint16_t t = 0; t < OneThreadOpsNum; ++t )
+		{
+			stack.Push( t );
+			queue.Push( t );
+
+			LockFree::DebugStruct Fake( -1 );
+			if( stack.Pop( &Fake ).Val != Fake.Val )
+			{
+				++popped;
+			}
+			if( queue.Pop() )
+			{
+				++popped;
+			}
+		}
+	};
+
+	std::vector<std::thread> threads( ThreadsNum );
+	for( auto &th : threads )
+	{
+		th = std::thread( h );
+	}
+
+	for( auto &th : threads )
+	{
+		th.join();
+	}
+
+	// Каждый поток извлекает не меньше, чем добавил перед извлечением,
+	// поэтому к концу контейнеры пусты
+	MY_CHECK_ASSERT( popped.load() == 2*ThreadsNum*OneThreadOpsNum );
+	MY_CHECK_ASSERT( !queue.Pop() );
+	stack.CleanDeferredQueue();
+	queue.CleanDeferredQueue();
+	MY_CHECK_ASSERT( LockFree::DebugStruct::GetCounter() == 0 );
+} // void shared_deleter_test()
+
 void test_stack_empty( LockFree::Stack<LockFree::DebugStruct> &stack )
 {
 	try
@@ -808,6 +894,71 @@ void stack_test()
 	// в очереди на отложенное удаление
 	stack.CleanDeferredQueue();
 	MY_CHECK_ASSERT( LockFree::DebugStruct::GetCounter() == 0 );
+
+	// Проверка исключения (elimination): много потоков попеременно добавляют
+	// и извлекают элементы маленького стека, Push и Pop сначала обращаются
+	// к массиву исключения, поэтому часть элементов передаётся от Push-а
+	// к Pop-у мимо стека; каждое значение должно быть извлечено ровно один раз
+	// (пул быстро выдаёт забранные элементы повторно по тем же адресам)
+	static const uint8_t EliminationThreadsNum( 16 );
+	static const uint32_t EliminationOpsNum( 200 );
+	typedef Stack<uint32_t, PoolAllocator> SmallStack;
+	SmallStack small_stack;
+	std::vector<uint32_t> popped_values[ EliminationThreadsNum ];
+	std::vector<std::thread> elimination_threads;
+	SmallStack::ForcedElimination().store( true );
+	run.store( false );
+	for( uint8_t n = 0; n < EliminationThreadsNum; ++n )
+	{
+		elimination_threads.push_back( std::thread( [ &, n ]()
+		{
+			while( !run.load() )
+			{
+				std::this_thread::yield();
+			}
+
+			const uint32_t fake = 0;
+			for( uint32_t t = 1; t <= EliminationOpsNum; ++t )
+			{
+				small_stack.Push( n*EliminationOpsNum + t );
+				const uint32_t val = small_stack.Pop( &fake );
+				if( val != fake )
+				{
+					popped_values[ n ].push_back( val );
+				}
+			}
+		} ) );
+	}
+
+	run.store( true );
+	for( auto &th : elimination_threads )
+	{
+		th.join();
+	}
+	SmallStack::ForcedElimination().store( false );
+
+	std::vector<uint8_t> counters( EliminationThreadsNum*EliminationOpsNum + 1, 0 );
+	small_stack.PopAll( popped_values[ 0 ] );
+	for( uint8_t n = 0; n < EliminationThreadsNum; ++n )
+	{
+		for( uint32_t v : popped_values[ n ] )
+		{
+			MY_CHECK_ASSERT( ( v > 0 ) && ( v < counters.size() ) );
+			++counters[ v ];
+		}
+	}
+
+	for( uint32_t t = 1; t < counters.size(); ++t )
+	{
+		MY_CHECK_ASSERT( counters[ t ] == 1 );
+	}
+
+	// Стек без массива исключения
+	Stack<uint32_t, NewAllocator, DeferredDeleter, false> plain_stack;
+	MY_CHECK_ASSERT( plain_stack.Push( 1 ) );
+	MY_CHECK_ASSERT( !plain_stack.Push( 2 ) );
+	MY_CHECK_ASSERT( plain_stack.Pop() == 2 );
+	MY_CHECK_ASSERT( plain_stack.Pop() == 1 );
 } // void stack_test()
 
 void queue_test()
@@ -927,14 +1078,1019 @@ void queue_test()
 	}
 } // void queue_test()
 
+void ring_queue_test()
+{
+	using namespace LockFree;
+	static std::atomic<bool> Checked( false );
+	if( !Checked.exchange( true ) )
+	{
+		// Однопоточная проверка
+		MY_CHECK_ASSERT( LockFree::DebugStruct::GetCounter() == 0 );
+		{
+			RingQueue<LockFree::DebugStruct, 4> queue;
+			MY_CHECK_ASSERT( queue.GetCapacity() == 4 );
+
+			LockFree::DebugStruct val( -1 );
+			MY_CHECK_ASSERT( !queue.TryPop( val ) );
+			MY_CHECK_ASSERT( val.Val == -1 );
+
+			for( int64_t t = 0; t < 4; ++t )
+			{
+				MY_CHECK_ASSERT( queue.TryPush( LockFree::DebugStruct( t ) ) );
+			}
+			MY_CHECK_ASSERT( !queue.TryPush( LockFree::DebugStruct( 4 ) ) );
+			MY_CHECK_ASSERT( LockFree::DebugStruct::GetCounter() == 5 );
+
+			MY_CHECK_ASSERT( queue.TryPop( val ) && ( val.Val == 0 ) );
+			MY_CHECK_ASSERT( queue.TryPop( val ) && ( val.Val == 1 ) );
+
+			// Пакетная запись через границу буфера: места хватает только на 2
+			LockFree::DebugStruct vals[ 3 ] = { 10, 11, 12 };
+			MY_CHECK_ASSERT( queue.TryPushBatch( vals, 3 ) == 2 );
+
+			LockFree::DebugStruct res[ 8 ];
+			MY_CHECK_ASSERT( queue.TryPopBatch( res, 8 ) == 4 );
+			MY_CHECK_ASSERT( ( res[ 0 ].Val == 2 ) && ( res[ 1 ].Val == 3 ) &&
+			                 ( res[ 2 ].Val == 10 ) && ( res[ 3 ].Val == 11 ) );
+			MY_CHECK_ASSERT( queue.TryPopBatch( res, 8 ) == 0 );
+
+			// Оставшиеся в очереди значения удаляются вместе с ней
+			MY_CHECK_ASSERT( queue.TryPushBatch( vals, 3 ) == 3 );
+		}
+		MY_CHECK_ASSERT( LockFree::DebugStruct::GetCounter() == 0 );
+	}
+
+	// Многопоточная проверка: каждое значение извлекается ровно один раз,
+	// значения одного писателя читатель получает в порядке записи
+	static const uint8_t WritersNum( 5 );
+	static const uint8_t ReadersNum( 5 );
+	static const uint32_t OneThreadOpsNum( 1000 );
+	RingQueue<uint32_t, 16> queue;
+	std::vector<uint32_t> readed_values[ ReadersNum ];
+	std::atomic<uint32_t> readed_num( 0 );
+
+	std::vector<std::thread> threads;
+	for( uint8_t w = 0; w < WritersNum; ++w )
+	{
+		threads.push_back( std::thread( [ &queue, w ]()
+		{
+			uint32_t batch[ 3 ];
+			for( uint32_t t = 0; t < OneThreadOpsNum; )
+			{
+				if( ( t % 2 ) == 0 )
+				{
+					if( queue.TryPush( w*OneThreadOpsNum + t ) )
+					{
+						++t;
+					}
+					else
+					{
+						// Очередь полна - отдаём процессор читателям
+						std::this_thread::yield();
+					}
+					continue;
+				}
+
+				uint32_t num = 0;
+				for( ; ( num < 3 ) && ( t + num < OneThreadOpsNum ); ++num )
+				{
+					batch[ num ] = w*OneThreadOpsNum + t + num;
+				}
+
+				const uint32_t pushed = ( uint32_t ) queue.TryPushBatch( batch, num );
+				if( pushed == 0 )
+				{
+					std::this_thread::yield();
+				}
+				t += pushed;
+			}
+		} ) );
+	}
+
+	for( uint8_t r = 0; r < ReadersNum; ++r )
+	{
+		threads.push_back( std::thread( [ &, r ]()
+		{
+			std::vector<uint32_t> &vec_ref = readed_values[ r ];
+			uint32_t batch[ 4 ];
+			while( readed_num.load() < WritersNum*OneThreadOpsNum )
+			{
+				const size_t num = ( r % 2 ) == 0 ? queue.TryPopBatch( batch, 4 ) :
+				                                    ( queue.TryPop( batch[ 0 ] ) ? 1 : 0 );
+				if( num == 0 )
+				{
+					// Очередь пуста - отдаём процессор писателям
+					std::this_thread::yield();
+					continue;
+				}
+
+				for( size_t t = 0; t < num; ++t )
+				{
+					vec_ref.push_back( batch[ t ] );
+				}
+				readed_num += ( uint32_t ) num;
+			}
+		} ) );
+	}
+
+	for( auto &th : threads )
+	{
+		th.join();
+	}
+
+	std::vector<uint8_t> counters( WritersNum*OneThreadOpsNum, 0 );
+	for( const auto &vec : readed_values )
+	{
+		std::vector<int64_t> last( WritersNum, -1 );
+		for( uint32_t v : vec )
+		{
+			MY_CHECK_ASSERT( v < WritersNum*OneThreadOpsNum );
+			++counters[ v ];
+			MY_CHECK_ASSERT( ( int64_t ) v > last[ v / OneThreadOpsNum ] );
+			last[ v / OneThreadOpsNum ] = v;
+		}
+	}
+
+	for( uint8_t c : counters )
+	{
+		MY_CHECK_ASSERT( c == 1 );
+	}
+} // void ring_queue_test()
+
+void spsc_ring_queue_test()
+{
+	using namespace LockFree;
+	static std::atomic<bool> Checked( false );
+	if( !Checked.exchange( true ) )
+	{
+		// Однопоточная проверка
+		MY_CHECK_ASSERT( LockFree::DebugStruct::GetCounter() == 0 );
+		{
+			SpscRingQueue<LockFree::DebugStruct, 4> queue;
+			LockFree::DebugStruct val( -1 );
+			MY_CHECK_ASSERT( !queue.TryPop( val ) );
+
+			MY_CHECK_ASSERT( queue.TryPush( LockFree::DebugStruct( 0 ) ) );
+			MY_CHECK_ASSERT( queue.TryEmplace( 1 ) );
+			MY_CHECK_ASSERT( queue.TryPop( val ) && ( val.Val == 0 ) );
+
+			// Резервирование не переходит через конец буфера
+			LockFree::DebugStruct *slots = nullptr;
+			MY_CHECK_ASSERT( queue.ReservePush( 8, slots ) == 2 );
+			new( slots ) LockFree::DebugStruct( 2 );
+			new( slots + 1 ) LockFree::DebugStruct( 3 );
+			queue.CommitPush( 2 );
+
+			MY_CHECK_ASSERT( queue.ReservePush( 8, slots ) == 1 );
+			new( slots ) LockFree::DebugStruct( 4 );
+			queue.CommitPush( 1 );
+			MY_CHECK_ASSERT( !queue.TryPush( val ) );
+			MY_CHECK_ASSERT( LockFree::DebugStruct::GetCounter() == 5 );
+
+			MY_CHECK_ASSERT( queue.ReservePop( 8, slots ) == 3 );
+			MY_CHECK_ASSERT( ( slots[ 0 ].Val == 1 ) && ( slots[ 1 ].Val == 2 ) && ( slots[ 2 ].Val == 3 ) );
+			queue.CommitPop( 3 );
+			MY_CHECK_ASSERT( LockFree::DebugStruct::GetCounter() == 2 );
+
+			// Оставшееся значение удаляется вместе с очередью
+		}
+		MY_CHECK_ASSERT( LockFree::DebugStruct::GetCounter() == 0 );
+	}
+
+	// Двухпоточная проверка: значения приходят все и по порядку
+	static const uint32_t ValuesNum( 10000 );
+	SpscRingQueue<uint32_t, 16> queue;
+
+	std::thread writer( [ &queue ]()
+	{
+		for( uint32_t t = 0; t < ValuesNum; )
+		{
+			if( ( t % 3 ) == 0 )
+			{
+				if( queue.TryPush( t ) )
+				{
+					++t;
+				}
+				else
+				{
+					// Очередь полна - отдаём процессор читателю
+					std::this_thread::yield();
+				}
+				continue;
+			}
+
+			uint32_t *slots = nullptr;
+			const size_t num = queue.ReservePush( 5, slots );
+			if( num == 0 )
+			{
+				std::this_thread::yield();
+				continue;
+			}
+
+			size_t n = 0;
+			for( ; ( n < num ) && ( t < ValuesNum ); ++n, ++t )
+			{
+				new( slots + n ) uint32_t( t );
+			}
+			queue.CommitPush( n );
+		}
+	} );
+
+	uint32_t expected = 0;
+	while( expected < ValuesNum )
+	{
+		if( ( expected % 2 ) == 0 )
+		{
+			uint32_t val = 0;
+			if( queue.TryPop( val ) )
+			{
+				MY_CHECK_ASSERT( val == expected );
+				++expected;
+			}
+			else
+			{
+				// Очередь пуста - отдаём процессор писателю
+				std::this_thread::yield();
+			}
+			continue;
+		}
+
+		uint32_t *slots = nullptr;
+		const size_t num = queue.ReservePop( 7, slots );
+		if( num == 0 )
+		{
+			std::this_thread::yield();
+			continue;
+		}
+
+		for( size_t n = 0; n < num; ++n, ++expected )
+		{
+			MY_CHECK_ASSERT( slots[ n ] == expected );
+		}
+		queue.CommitPop( num );
+	}
+	writer.join();
+} // void spsc_ring_queue_test()
+
+void segmented_queue_test()
+{
+	using namespace LockFree;
+	static std::atomic<bool> Checked( false );
+	if( !Checked.exchange( true ) )
+	{
+		// Однопоточная проверка (с переходом через границы сегментов)
+		MY_CHECK_ASSERT( LockFree::DebugStruct::GetCounter() == 0 );
+		{
+			SegmentedQueue<LockFree::DebugStruct, 4> queue( 1 );
+			LockFree::DebugStruct val( -1 );
+			MY_CHECK_ASSERT( !queue.TryPop( val ) );
+			MY_CHECK_ASSERT( val.Val == -1 );
+
+			for( int64_t round = 0; round < 3; ++round )
+			{
+				for( int64_t t = 0; t < 10; ++t )
+				{
+					queue.Push( LockFree::DebugStruct( round*10 + t ) );
+				}
+				MY_CHECK_ASSERT( LockFree::DebugStruct::GetCounter() == 11 );
+
+				for( int64_t t = 0; t < 10; ++t )
+				{
+					MY_CHECK_ASSERT( queue.TryPop( val ) );
+					MY_CHECK_ASSERT( val.Val == round*10 + t );
+				}
+				MY_CHECK_ASSERT( !queue.TryPop( val ) );
+				queue.CleanDeferredQueue();
+			}
+
+			// Оставшиеся в очереди значения удаляются вместе с ней
+			const LockFree::DebugStruct tmp( 100 );
+			for( int64_t t = 0; t < 6; ++t )
+			{
+				queue.Push( tmp );
+			}
+		}
+		MY_CHECK_ASSERT( LockFree::DebugStruct::GetCounter() == 0 );
+	}
+
+	// Многопоточная проверка: каждое значение извлекается ровно один раз,
+	// значения одного писателя читатель получает в порядке записи
+	static const uint8_t WritersNum( 5 );
+	static const uint8_t ReadersNum( 5 );
+	static const uint32_t OneThreadOpsNum( 1000 );
+	SegmentedQueue<uint32_t, 8> queue;
+	std::vector<uint32_t> readed_values[ ReadersNum ];
+	std::atomic<uint32_t> readed_num( 0 );
+
+	std::vector<std::thread> threads;
+	for( uint8_t w = 0; w < WritersNum; ++w )
+	{
+		threads.push_back( std::thread( [ &queue, w ]()
+		{
+			for( uint32_t t = 0; t < OneThreadOpsNum; ++t )
+			{
+				queue.Push( w*OneThreadOpsNum + t );
+			}
+		} ) );
+	}
+
+	for( uint8_t r = 0; r < ReadersNum; ++r )
+	{
+		threads.push_back( std::thread( [ &, r ]()
+		{
+			std::vector<uint32_t> &vec_ref = readed_values[ r ];
+			uint32_t val = 0;
+			while( readed_num.load() < WritersNum*OneThreadOpsNum )
+			{
+				if( queue.TryPop( val ) )
+				{
+					vec_ref.push_back( val );
+					++readed_num;
+				}
+			}
+		} ) );
+	}
+
+	for( auto &th : threads )
+	{
+		th.join();
+	}
+
+	std::vector<uint8_t> counters( WritersNum*OneThreadOpsNum, 0 );
+	for( const auto &vec : readed_values )
+	{
+		std::vector<int64_t> last( WritersNum, -1 );
+		for( uint32_t v : vec )
+		{
+			MY_CHECK_ASSERT( v < WritersNum*OneThreadOpsNum );
+			++counters[ v ];
+			MY_CHECK_ASSERT( ( int64_t ) v > last[ v / OneThreadOpsNum ] );
+			last[ v / OneThreadOpsNum ] = v;
+		}
+	}
+
+	for( uint8_t c : counters )
+	{
+		MY_CHECK_ASSERT( c == 1 );
+	}
+} // void segmented_queue_test()
+
+void node_pool_test()
+{
+	using namespace LockFree;
+	static std::atomic<bool> Checked( false );
+	if( !Checked.exchange( true ) )
+	{
+		// Размер блока, который больше нигде не используется
+		typedef NodePool<1040> PoolType;
+
+		// Освобождённый блок выделяется повторно
+		void *ptr1 = PoolType::Allocate();
+		void *ptr2 = PoolType::Allocate();
+		MY_CHECK_ASSERT( ( ptr1 != nullptr ) && ( ptr2 != nullptr ) && ( ptr1 != ptr2 ) );
+		PoolType::Free( ptr1 );
+		PoolType::Free( ptr2 );
+		MY_CHECK_ASSERT( PoolType::Allocate() == ptr2 );
+		MY_CHECK_ASSERT( PoolType::Allocate() == ptr1 );
+
+		// Блоки, освобождённые другим потоком, возвращаются владельцу
+		// (последняя неполная пачка - при завершении потока)
+		std::vector<void*> ptrs( 100 );
+		for( auto &ptr : ptrs )
+		{
+			ptr = PoolType::Allocate();
+		}
+		ptrs.push_back( ptr1 );
+		ptrs.push_back( ptr2 );
+
+		std::thread th( [ &ptrs ]()
+		{
+			for( void *ptr : ptrs )
+			{
+				PoolType::Free( ptr );
+			}
+		} );
+		th.join();
+
+		std::set<void*> ptrs_set( ptrs.begin(), ptrs.end() );
+		for( size_t t = 0; t < ptrs.size(); ++t )
+		{
+			void *ptr = PoolType::Allocate();
+			MY_CHECK_ASSERT( ptrs_set.erase( ptr ) == 1 );
+		}
+
+		for( void *ptr : ptrs )
+		{
+			PoolType::Free( ptr );
+		}
+	}
+
+	// Контейнеры с распределителем на пулах: элементы создаются
+	// одними потоками, а удаляются другими
+	MY_CHECK_ASSERT( LockFree::DebugStruct::GetCounter() == 0 );
+	{
+		static const uint8_t ThreadsNum( 6 );
+		static const uint16_t OneThreadOpsNum( 200 );
+		Stack<LockFree::DebugStruct, PoolAllocator> stack;
+		ForwardList<LockFree::DebugStruct, PoolAllocator> fl;
+		std::atomic<uint32_t> popped( 0 );
+
+		std::vector<std::thread> threads;
+		for( uint8_t n = 0; n < ThreadsNum; ++n )
+		{
+			threads.push_back( std::thread( [ & ]()
+			{
+				const LockFree::DebugStruct def_val( -1 );
+				for( uint16_t t = 0; t < OneThreadOpsNum; ++t )
+				{
+					stack.Push( t );
+					fl.Push( t );
+					if( stack.Pop( &def_val ).Val >= 0 )
+					{
+						++popped;
+					}
+					auto released = fl.Release();
+				}
+			} ) );
+		}
+
+		for( auto &th : threads )
+		{
+			th.join();
+		}
+		MY_CHECK_ASSERT( popped.load() == ThreadsNum*OneThreadOpsNum );
+		stack.CleanDeferredQueue();
+	}
+	MY_CHECK_ASSERT( LockFree::DebugStruct::GetCounter() == 0 );
+} // void node_pool_test()
+
+void hazard_domain_test()
+{
+	using namespace LockFree;
+	static std::atomic<bool> Checked( false );
+	if( !Checked.exchange( true ) )
+	{
+		// Защищённый объект не удаляется, остальные удаляются
+		// (неудалённых не больше CleanPeriod + HazardsNum*количество записей)
+		MY_CHECK_ASSERT( LockFree::DebugStruct::GetCounter() == 0 );
+		{
+			static const uint16_t CleanPeriod( 4 );
+			HazardDomain domain( 1, CleanPeriod );
+			std::atomic<LockFree::DebugStruct*> src( new LockFree::DebugStruct( 1 ) );
+
+			auto keeper = domain.Acquire();
+			LockFree::DebugStruct *ptr = keeper.Protect( 0, src );
+			MY_CHECK_ASSERT( ( ptr != nullptr ) && ( ptr->Val == 1 ) );
+			src.store( nullptr );
+			domain.Delete( ptr );
+
+			for( int64_t t = 0; t < 100; ++t )
+			{
+				domain.Delete( new LockFree::DebugStruct( t ) );
+				MY_CHECK_ASSERT( LockFree::DebugStruct::GetCounter() <= ( int64_t ) ( CleanPeriod + 2*HazardDomain::HazardsNum + 1 ) );
+			}
+			MY_CHECK_ASSERT( domain.Clear() );
+			MY_CHECK_ASSERT( LockFree::DebugStruct::GetCounter() == 1 );
+			MY_CHECK_ASSERT( ptr->Val == 1 );
+
+			keeper.Release();
+			MY_CHECK_ASSERT( !domain.Clear() );
+			MY_CHECK_ASSERT( LockFree::DebugStruct::GetCounter() == 0 );
+		}
+
+		// Однопоточная проверка контейнеров
+		{
+			Stack<LockFree::DebugStruct, NewAllocator, HazardDomain> stack( 1, 0 );
+			stack.Push( 1 );
+			stack.Push( LockFree::DebugStruct( 2 ) );
+			MY_CHECK_ASSERT( stack.Pop().Val == 2 );
+			MY_CHECK_ASSERT( stack.Pop().Val == 1 );
+			const LockFree::DebugStruct def_val( -1 );
+			MY_CHECK_ASSERT( stack.Pop( &def_val ).Val == -1 );
+
+			Queue<LockFree::DebugStruct, NewAllocator, HazardDomain> queue( 1, 0 );
+			queue.Push( 1 );
+			queue.Push( LockFree::DebugStruct( 2 ) );
+			MY_CHECK_ASSERT( queue.Pop()->Val == 1 );
+			MY_CHECK_ASSERT( queue.Pop()->Val == 2 );
+			MY_CHECK_ASSERT( !queue.Pop() );
+		}
+		MY_CHECK_ASSERT( LockFree::DebugStruct::GetCounter() == 0 );
+	}
+
+	// Многопоточная проверка (общий домен): каждое значение извлекается ровно один раз
+	static const uint8_t ThreadsNum( 6 );
+	static const uint32_t OneThreadOpsNum( 500 );
+	Stack<uint32_t, NewAllocator, HazardDomain> stack;
+	BasicDigitsQueue<NewAllocator, HazardDomain> queue( 0 );
+	std::vector<uint32_t> readed_values[ ThreadsNum ];
+	std::atomic<uint32_t> readed_num( 0 );
+
+	std::vector<std::thread> threads;
+	for( uint8_t n = 0; n < ThreadsNum; ++n )
+	{
+		threads.push_back( std::thread( [ &, n ]()
+		{
+			std::vector<uint32_t> &vec_ref = readed_values[ n ];
+			const uint32_t def_val = 0;
+			for( uint32_t t = 1; t <= OneThreadOpsNum; ++t )
+			{
+				stack.Push( n*OneThreadOpsNum + t );
+				queue.Push( n*OneThreadOpsNum + t );
+
+				const uint32_t val = stack.Pop( &def_val );
+				if( val != def_val )
+				{
+					queue.Push( val );
+				}
+			}
+
+			while( readed_num.load() < 2*ThreadsNum*OneThreadOpsNum )
+			{
+				const uint64_t val = queue.Pop();
+				if( val != 0 )
+				{
+					vec_ref.push_back( ( uint32_t ) val );
+					++readed_num;
+				}
+			}
+		} ) );
+	}
+
+	for( auto &th : threads )
+	{
+		th.join();
+	}
+
+	std::vector<uint8_t> counters( ThreadsNum*OneThreadOpsNum + 1, 0 );
+	for( const auto &vec : readed_values )
+	{
+		for( uint32_t v : vec )
+		{
+			MY_CHECK_ASSERT( ( v > 0 ) && ( v <= ThreadsNum*OneThreadOpsNum ) );
+			++counters[ v ];
+		}
+	}
+
+	for( uint32_t t = 1; t < counters.size(); ++t )
+	{
+		MY_CHECK_ASSERT( counters[ t ] == 2 );
+	}
+} // void hazard_domain_test()
+
+void hash_map_test()
+{
+	using namespace LockFree;
+	static std::atomic<bool> Checked( false );
+	if( !Checked.exchange( true ) )
+	{
+		// Однопоточная проверка (с несколькими переносами таблицы)
+		MY_CHECK_ASSERT( LockFree::DebugStruct::GetCounter() == 0 );
+		{
+			HashMap<int64_t, LockFree::DebugStruct> map( 1, 0 );
+			LockFree::DebugStruct val( -1 );
+			MY_CHECK_ASSERT( !map.Find( 1, val ) );
+			MY_CHECK_ASSERT( !map.Erase( 1 ) );
+
+			for( int64_t t = 0; t < 1000; ++t )
+			{
+				MY_CHECK_ASSERT( map.Insert( t, LockFree::DebugStruct( t ) ) );
+			}
+			MY_CHECK_ASSERT( !map.Insert( 5, LockFree::DebugStruct( 100 ) ) );
+			MY_CHECK_ASSERT( !map.Set( 5, LockFree::DebugStruct( 105 ) ) );
+			MY_CHECK_ASSERT( map.Size() == 1000 );
+
+			for( int64_t t = 0; t < 1000; ++t )
+			{
+				MY_CHECK_ASSERT( map.Find( t, val ) );
+				MY_CHECK_ASSERT( val.Val == ( t == 5 ? 105 : t ) );
+			}
+
+			for( int64_t t = 0; t < 1000; t += 2 )
+			{
+				MY_CHECK_ASSERT( map.Erase( t ) );
+			}
+			MY_CHECK_ASSERT( map.Size() == 500 );
+			for( int64_t t = 0; t < 1000; ++t )
+			{
+				MY_CHECK_ASSERT( map.Contains( t ) == ( ( t % 2 ) == 1 ) );
+			}
+
+			map.CleanDeferredQueue();
+			MY_CHECK_ASSERT( LockFree::DebugStruct::GetCounter() == 501 );
+		}
+		MY_CHECK_ASSERT( LockFree::DebugStruct::GetCounter() == 0 );
+	}
+
+	// Многопоточная проверка: писатели добавляют и удаляют свои ключи,
+	// читатели все время находят ключи, которые никто не удаляет
+	static const uint8_t WritersNum( 4 );
+	static const uint8_t ReadersNum( 4 );
+	static const uint32_t OneThreadKeysNum( 2000 );
+	static const uint32_t ConstKeysNum( 100 );
+	HashMap<uint32_t, uint32_t> map;
+	for( uint32_t t = 0; t < ConstKeysNum; ++t )
+	{
+		map.Insert( t, t );
+	}
+
+	std::atomic<uint8_t> writers_work( WritersNum );
+	std::vector<std::thread> threads;
+	for( uint8_t w = 0; w < WritersNum; ++w )
+	{
+		threads.push_back( std::thread( [ &, w ]()
+		{
+			const uint32_t first = ConstKeysNum + w*OneThreadKeysNum;
+			for( uint32_t t = first; t < first + OneThreadKeysNum; ++t )
+			{
+				MY_CHECK_ASSERT( map.Insert( t, t ) );
+			}
+
+			uint32_t val = 0;
+			for( uint32_t t = first; t < first + OneThreadKeysNum; ++t )
+			{
+				MY_CHECK_ASSERT( map.Find( t, val ) && ( val == t ) );
+				MY_CHECK_ASSERT( !map.Set( t, t + 1 ) );
+				if( ( t % 2 ) == 0 )
+				{
+					MY_CHECK_ASSERT( map.Erase( t ) );
+				}
+			}
+			--writers_work;
+		} ) );
+	}
+
+	for( uint8_t r = 0; r < ReadersNum; ++r )
+	{
+		threads.push_back( std::thread( [ & ]()
+		{
+			uint32_t val = 0;
+			while( writers_work.load() > 0 )
+			{
+				for( uint32_t t = 0; t < ConstKeysNum; ++t )
+				{
+					MY_CHECK_ASSERT( map.Find( t, val ) && ( val == t ) );
+				}
+			}
+		} ) );
+	}
+
+	for( auto &th : threads )
+	{
+		th.join();
+	}
+
+	MY_CHECK_ASSERT( map.Size() == ConstKeysNum + WritersNum*OneThreadKeysNum/2 );
+	uint32_t val = 0;
+	for( uint32_t t = ConstKeysNum; t < ConstKeysNum + WritersNum*OneThreadKeysNum; ++t )
+	{
+		MY_CHECK_ASSERT( map.Find( t, val ) == ( ( t % 2 ) == 1 ) );
+		MY_CHECK_ASSERT( ( ( t % 2 ) == 0 ) || ( val == t + 1 ) );
+	}
+} // void hash_map_test()
+
+void skip_list_test()
+{
+	using namespace LockFree;
+	static std::atomic<bool> Checked( false );
+	if( !Checked.exchange( true ) )
+	{
+		// Однопоточная проверка
+		MY_CHECK_ASSERT( LockFree::DebugStruct::GetCounter() == 0 );
+		{
+			SkipList<int64_t, LockFree::DebugStruct> list( 1, 0 );
+			LockFree::DebugStruct val( -1 );
+			int64_t key = -1;
+			MY_CHECK_ASSERT( list.Empty() );
+			MY_CHECK_ASSERT( !list.Find( 1, val ) );
+			MY_CHECK_ASSERT( !list.PopMin( key, val ) );
+
+			// Ключи добавляются вразнобой
+			for( int64_t t = 0; t < 1000; ++t )
+			{
+				const int64_t k = ( t*397 ) % 1000;
+				MY_CHECK_ASSERT( list.Insert( k, LockFree::DebugStruct( k ) ) );
+			}
+			MY_CHECK_ASSERT( !list.Insert( 5, LockFree::DebugStruct( 100 ) ) );
+			MY_CHECK_ASSERT( list.Find( 5, val ) && ( val.Val == 5 ) );
+
+			int64_t expected = 500;
+			for( auto iter = list.LowerBound( 500 ); iter.Valid(); iter.Next() )
+			{
+				MY_CHECK_ASSERT( ( iter.GetKey() == expected ) && ( iter.GetValue().Val == expected ) );
+				++expected;
+			}
+			MY_CHECK_ASSERT( expected == 1000 );
+
+			for( int64_t t = 0; t < 1000; t += 2 )
+			{
+				MY_CHECK_ASSERT( list.Erase( t ) );
+			}
+			MY_CHECK_ASSERT( !list.Erase( 0 ) );
+			MY_CHECK_ASSERT( !list.Find( 0, val ) );
+			MY_CHECK_ASSERT( list.LowerBound( 10 ).GetKey() == 11 );
+
+			for( int64_t t = 1; t < 500; t += 2 )
+			{
+				MY_CHECK_ASSERT( list.PopMin( key, val ) );
+				MY_CHECK_ASSERT( ( key == t ) && ( val.Val == t ) );
+			}
+
+			list.CleanDeferredQueue();
+			MY_CHECK_ASSERT( LockFree::DebugStruct::GetCounter() == 251 );
+		}
+		MY_CHECK_ASSERT( LockFree::DebugStruct::GetCounter() == 0 );
+	}
+
+	// Многопоточная проверка: очередь с приоритетом (каждый ключ
+	// извлекается ровно один раз) и обход во время изменений
+	static const uint8_t WritersNum( 4 );
+	static const uint8_t ReadersNum( 4 );
+	static const uint32_t OneThreadKeysNum( 1000 );
+	SkipList<uint32_t, uint32_t> list;
+	std::vector<uint32_t> readed_values[ ReadersNum ];
+	std::atomic<uint32_t> readed_num( 0 );
+
+	std::vector<std::thread> threads;
+	for( uint8_t w = 0; w < WritersNum; ++w )
+	{
+		threads.push_back( std::thread( [ &list, w ]()
+		{
+			for( uint32_t t = 0; t < OneThreadKeysNum; ++t )
+			{
+				MY_CHECK_ASSERT( list.Insert( t*WritersNum + w, w ) );
+			}
+		} ) );
+	}
+
+	for( uint8_t r = 0; r < ReadersNum; ++r )
+	{
+		threads.push_back( std::thread( [ &, r ]()
+		{
+			std::vector<uint32_t> &vec_ref = readed_values[ r ];
+			uint32_t key = 0;
+			uint32_t val = 0;
+			while( readed_num.load() < WritersNum*OneThreadKeysNum )
+			{
+				if( list.PopMin( key, val ) )
+				{
+					MY_CHECK_ASSERT( key % WritersNum == val );
+					vec_ref.push_back( key );
+					++readed_num;
+				}
+
+				// Обход идёт по возрастанию ключей
+				auto iter = list.Begin();
+				for( uint32_t prev = 0; iter.Valid(); iter.Next() )
+				{
+					MY_CHECK_ASSERT( ( prev == 0 ) || ( iter.GetKey() > prev ) );
+					prev = iter.GetKey();
+				}
+			}
+		} ) );
+	}
+
+	for( auto &th : threads )
+	{
+		th.join();
+	}
+	MY_CHECK_ASSERT( list.Empty() );
+
+	std::vector<uint8_t> counters( WritersNum*OneThreadKeysNum, 0 );
+	for( const auto &vec : readed_values )
+	{
+		for( uint32_t v : vec )
+		{
+			MY_CHECK_ASSERT( v < WritersNum*OneThreadKeysNum );
+			++counters[ v ];
+		}
+	}
+
+	for( uint8_t c : counters )
+	{
+		MY_CHECK_ASSERT( c == 1 );
+	}
+
+	// Добавление и удаление одних и тех же ключей
+	threads.clear();
+	std::atomic<int32_t> balance( 0 );
+	for( uint8_t n = 0; n < WritersNum; ++n )
+	{
+		threads.push_back( std::thread( [ &list, &balance ]()
+		{
+			for( uint32_t t = 0; t < OneThreadKeysNum; ++t )
+			{
+				if( list.Insert( t % 64, t ) )
+				{
+					++balance;
+				}
+
+				if( list.Erase( ( t*7 ) % 64 ) )
+				{
+					--balance;
+				}
+			}
+		} ) );
+	}
+
+	for( auto &th : threads )
+	{
+		th.join();
+	}
+
+	int32_t num = 0;
+	for( auto iter = list.Begin(); iter.Valid(); iter.Next() )
+	{
+		++num;
+	}
+	MY_CHECK_ASSERT( num == balance.load() );
+} // void skip_list_test()
+
+void batch_test()
+{
+	using namespace LockFree;
+	static std::atomic<bool> Checked( false );
+	if( !Checked.exchange( true ) )
+	{
+		// Однопоточная проверка
+		MY_CHECK_ASSERT( LockFree::DebugStruct::GetCounter() == 0 );
+		{
+			Stack<LockFree::DebugStruct> stack( 1, 0 );
+			std::vector<LockFree::DebugStruct> vals;
+			MY_CHECK_ASSERT( stack.PopAll( vals ) == 0 );
+			MY_CHECK_ASSERT( !stack.PushBatch( nullptr, 0 ) );
+
+			const LockFree::DebugStruct batch[] = { 1, 2, 3 };
+			MY_CHECK_ASSERT( stack.Push( 0 ) );
+			MY_CHECK_ASSERT( !stack.PushBatch( batch, 3 ) );
+			MY_CHECK_ASSERT( LockFree::DebugStruct::GetCounter() == 7 );
+
+			MY_CHECK_ASSERT( stack.PopAll( vals ) == 4 );
+			MY_CHECK_ASSERT( vals.size() == 4 );
+			for( int64_t t = 0; t < 4; ++t )
+			{
+				MY_CHECK_ASSERT( vals[ t ].Val == 3 - t );
+			}
+			test_stack_empty( stack );
+
+			MY_CHECK_ASSERT( stack.PushBatch( batch, 2 ) );
+			MY_CHECK_ASSERT( stack.Pop().Val == 2 );
+			MY_CHECK_ASSERT( stack.Pop().Val == 1 );
+		}
+		MY_CHECK_ASSERT( LockFree::DebugStruct::GetCounter() == 0 );
+
+		{
+			DigitsQueue queue( 0 );
+			std::vector<uint64_t> vals;
+			MY_CHECK_ASSERT( queue.PopAll( vals ) == 0 );
+			queue.PushBatch( nullptr, 0 );
+			MY_CHECK_ASSERT( queue.Pop() == 0 );
+
+			const uint64_t batch[] = { 2, 3, 4 };
+			queue.Push( 1 );
+			queue.PushBatch( batch, 3 );
+			queue.Push( 5 );
+			MY_CHECK_ASSERT( queue.Pop() == 1 );
+			MY_CHECK_ASSERT( queue.PopAll( vals ) == 4 );
+			MY_CHECK_ASSERT( ( vals.size() == 4 ) && ( vals[ 0 ] == 2 ) && ( vals[ 3 ] == 5 ) );
+			MY_CHECK_ASSERT( queue.Pop() == 0 );
+
+			queue.PushBatch( batch, 1 );
+			queue.Push( 6 );
+			MY_CHECK_ASSERT( queue.Pop() == 2 );
+			MY_CHECK_ASSERT( queue.Pop() == 6 );
+			MY_CHECK_ASSERT( queue.Pop() == 0 );
+		}
+
+		{
+			Queue<LockFree::DebugStruct> queue( 1, 0 );
+			const LockFree::DebugStruct batch[] = { 1, 2, 3 };
+			queue.PushBatch( batch, 3 );
+			MY_CHECK_ASSERT( LockFree::DebugStruct::GetCounter() == 6 );
+
+			std::vector<std::unique_ptr<LockFree::DebugStruct>> vals;
+			MY_CHECK_ASSERT( queue.PopAll( vals ) == 3 );
+			MY_CHECK_ASSERT( ( vals.size() == 3 ) && ( vals[ 0 ]->Val == 1 ) && ( vals[ 2 ]->Val == 3 ) );
+			MY_CHECK_ASSERT( !queue.Pop() );
+		}
+		MY_CHECK_ASSERT( LockFree::DebugStruct::GetCounter() == 0 );
+
+		{
+			Stack<uint32_t, NewAllocator, HazardDomain> stack( 1, 0 );
+			BasicDigitsQueue<NewAllocator, HazardDomain> queue( 0, 1, 0 );
+			const uint32_t batch[] = { 1, 2, 3 };
+			const uint64_t digits_batch[] = { 1, 2, 3 };
+			stack.PushBatch( batch, 3 );
+			queue.PushBatch( digits_batch, 3 );
+
+			std::vector<uint32_t> stack_vals;
+			std::vector<uint64_t> queue_vals;
+			MY_CHECK_ASSERT( stack.PopAll( stack_vals ) == 3 );
+			MY_CHECK_ASSERT( queue.PopAll( queue_vals ) == 3 );
+			MY_CHECK_ASSERT( ( stack_vals[ 0 ] == 3 ) && ( queue_vals[ 0 ] == 1 ) );
+		}
+	}
+
+	// Многопоточная проверка: писатели добавляют пакеты (вперемешку с одиночными
+	// значениями), читатели забирают всё сразу; каждое значение извлекается
+	// ровно один раз, значения одного писателя из очереди идут по порядку
+	static const uint8_t ThreadsNum( 6 );
+	static const uint32_t OneThreadOpsNum( 480 );
+	static const uint32_t BatchSize( 8 );
+	Stack<uint32_t> stack;
+	DigitsQueue queue( 0 );
+	std::vector<uint32_t> stack_readed[ ThreadsNum ];
+	std::vector<uint64_t> queue_readed[ ThreadsNum ];
+	std::atomic<uint32_t> stack_readed_num( 0 );
+	std::atomic<uint32_t> queue_readed_num( 0 );
+
+	std::vector<std::thread> threads;
+	for( uint8_t n = 0; n < ThreadsNum; ++n )
+	{
+		threads.push_back( std::thread( [ &, n ]()
+		{
+			uint32_t batch[ BatchSize ];
+			uint64_t digits_batch[ BatchSize ];
+			for( uint32_t t = 1; t <= OneThreadOpsNum; )
+			{
+				if( ( t % ( 2*BatchSize ) ) == 1 )
+				{
+					stack.Push( n*OneThreadOpsNum + t );
+					queue.Push( n*OneThreadOpsNum + t );
+					++t;
+					continue;
+				}
+
+				uint32_t num = 0;
+				for( ; ( num < BatchSize ) && ( t <= OneThreadOpsNum ); ++num, ++t )
+				{
+					batch[ num ] = n*OneThreadOpsNum + t;
+					digits_batch[ num ] = n*OneThreadOpsNum + t;
+				}
+				stack.PushBatch( batch, num );
+				queue.PushBatch( digits_batch, num );
+
+				stack_readed_num += ( uint32_t ) stack.PopAll( stack_readed[ n ] );
+			}
+
+			while( ( stack_readed_num.load() < ThreadsNum*OneThreadOpsNum ) ||
+			       ( queue_readed_num.load() < ThreadsNum*OneThreadOpsNum ) )
+			{
+				stack_readed_num += ( uint32_t ) stack.PopAll( stack_readed[ n ] );
+				queue_readed_num += ( uint32_t ) queue.PopAll( queue_readed[ n ] );
+			}
+		} ) );
+	}
+
+	for( auto &th : threads )
+	{
+		th.join();
+	}
+
+	std::vector<uint8_t> counters( ThreadsNum*OneThreadOpsNum + 1, 0 );
+	for( uint8_t n = 0; n < ThreadsNum; ++n )
+	{
+		for( uint32_t v : stack_readed[ n ] )
+		{
+			MY_CHECK_ASSERT( ( v > 0 ) && ( v <= ThreadsNum*OneThreadOpsNum ) );
+			++counters[ v ];
+		}
+
+		uint64_t last_vals[ ThreadsNum ] = {};
+		for( uint64_t v : queue_readed[ n ] )
+		{
+			MY_CHECK_ASSERT( ( v > 0 ) && ( v <= ThreadsNum*OneThreadOpsNum ) );
+			++counters[ v ];
+
+			const uint64_t writer = ( v - 1 ) / OneThreadOpsNum;
+			MY_CHECK_ASSERT( v > last_vals[ writer ] );
+			last_vals[ writer ] = v;
+		}
+	}
+
+	for( uint32_t t = 1; t < counters.size(); ++t )
+	{
+		MY_CHECK_ASSERT( counters[ t ] == 2 );
+	}
+} // void batch_test()
+
 void lockfree_test()
 {
 	try
 	{
 		forward_list_test();
 		deferred_deleter_test();
+		shared_deleter_test();
 		stack_test();
 		queue_test();
+		ring_queue_test();
+		spsc_ring_queue_test();
+		segmented_queue_test();
+		node_pool_test();
+		hazard_domain_test();
+		hash_map_test();
+		skip_list_test();
+		batch_test();
 	}
 	catch( const std::exception &exc )
 	{
@@ -107,6 +107,14 @@ namespace Bicycle
 #endif
 
 			public:
+				/// Следующая сопрограмма в интрузивной очереди готовых к исполнению
+				/// (используется планировщиком, сама сопрограмма поле не трогает)
+				Coroutine *NextScheduled;
+
+				/// Данные владельца сопрограммы (например, область отмены
+				/// сервиса; сама сопрограмма поле не трогает)
+				void *OwnerData;
+
 				Coroutine( const Coroutine& ) = delete;
 				Coroutine& operator=( const Coroutine& ) = delete;
 
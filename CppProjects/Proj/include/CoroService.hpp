@@ -3,3 +3,7 @@
 #include "CoroSrv/Inet.hpp"
 #include "CoroSrv/Sync.hpp"
 #include "CoroSrv/Timer.hpp"
+#include "CoroSrv/Rcu.hpp"
+#include "CoroSrv/Future.hpp"
+#include "CoroSrv/TaskGroup.hpp"
+#include "CoroSrv/Broadcast.hpp"
@@ -0,0 +1,542 @@
+#pragma once
+#include "CoroSrv/Sync.hpp"
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace Bicycle
+{
+	namespace ErrorCodes
+	{
+		/// Рассылка закрыта (подписчик прочитал все сообщения)
+		const err_code_t BroadcastClosed = 0xFFFFFE00;
+
+		/// Подписчик отключён: отстал от рассылки больше, чем на ёмкость журнала
+		const err_code_t SubscriberLagged = 0xFFFFFE01;
+	} // namespace ErrorCodes
+
+	namespace CoroService
+	{
+		/// Поведение рассылки при отставании подписчика на ёмкость журнала
+		enum class BroadcastOverflow: uint8_t
+		{
+			/// Отставшему подписчику пропускаются старейшие сообщения
+			/// (количество пропущенных учитывается в подписчике)
+			DropOldest,
+
+			/// Отставший подписчик отключается (получит ошибку SubscriberLagged)
+			Disconnect,
+
+			/// Публикация ждёт, пока самый медленный подписчик
+			/// не прочитает старейшее сообщение журнала
+			Block
+		};
+
+		/**
+		 * @brief The Broadcast class рассылка сообщений всем подписчикам. Публикуемые
+		 * сообщения неизменяемы и хранятся в общем кольцевом журнале по одному экземпляру
+		 * (публикация не копирует сообщение и не выделяет память под каждого подписчика),
+		 * подписчики читают журнал каждый со своей позиции и ждут, дочитав до конца.
+		 * Все операции выполняются внутри сопрограмм сервиса
+		 */
+		template <typename T>
+		class Broadcast
+		{
+			public:
+				/// Указатель на сообщение (разделяется журналом и всеми подписчиками)
+				typedef std::shared_ptr<const T> MessagePtr;
+
+			private:
+				/// Элемент списка подписчиков
+				struct SubscriberLink
+				{
+					/// Номер следующего сообщения для подписчика
+					uint64_t Cursor;
+
+					SubscriberLink *Prev;
+					SubscriberLink *Next;
+				};
+
+				/// Общее состояние рассылки и её подписчиков
+				struct SharedState
+				{
+					/// Мьютекс, защищающий остальные поля
+					Mutex Lock;
+
+					/// Условная переменная появления сообщения (или закрытия рассылки)
+					ConditionVariable NewMessage;
+
+					/// Условная переменная продвижения подписчиков (для BroadcastOverflow::Block)
+					ConditionVariable SpaceFreed;
+
+					/// Кольцевой журнал сообщений (сообщение с номером n - в Log[ n % Log.size() ])
+					std::vector<MessagePtr> Log;
+
+					/// Поведение при отставании подписчика
+					const BroadcastOverflow Policy;
+
+					/// Номер следующего публикуемого сообщения
+					uint64_t NextSeq;
+
+					/// Нижняя граница позиций подписчиков (для BroadcastOverflow::Block;
+					/// пересчитывается, только когда журнал кажется заполненным)
+					uint64_t SlowestCursor;
+
+					/// Количество подписчиков, ждущих сообщения
+					uint64_t ReceiversWaiting;
+
+					/// Количество публикаций, ждущих продвижения подписчиков
+					uint64_t PublishersWaiting;
+
+					/// Рассылка закрыта
+					bool Closed;
+
+					/// Объект синхронизации доступа к списку подписчиков (отписка не ждёт
+					/// Lock: подписчик может удаляться и вне сопрограммы сервиса)
+					SpinLock SubscribersLock;
+
+					/// Список подписчиков
+					SubscriberLink *Subscribers;
+
+					SharedState( size_t capacity, BroadcastOverflow policy ): Lock(),
+					                                                          NewMessage(),
+					                                                          SpaceFreed(),
+					                                                          Log( capacity ),
+					                                                          Policy( policy ),
+					                                                          NextSeq( 0 ),
+					                                                          SlowestCursor( 0 ),
+					                                                          ReceiversWaiting( 0 ),
+					                                                          PublishersWaiting( 0 ),
+					                                                          Closed( false ),
+					                                                          Subscribers( nullptr )
+					{}
+
+					/// Есть ли место для публикации (под блокировкой Lock)
+					bool HasSpace()
+					{
+						const uint64_t capacity = Log.size();
+						if( NextSeq - SlowestCursor < capacity )
+						{
+							return true;
+						}
+
+						// Пересчитываем позицию самого медленного подписчика
+						LockGuard<SpinLock> lock( SubscribersLock );
+						SlowestCursor = NextSeq;
+						for( SubscriberLink *link = Subscribers; link != nullptr; link = link->Next )
+						{
+							if( link->Cursor < SlowestCursor )
+							{
+								SlowestCursor = link->Cursor;
+							}
+						}
+
+						return NextSeq - SlowestCursor < capacity;
+					}
+				};
+
+				/**
+				 * @brief SetWaitError код ошибки ожидания, завершившегося без результата
+				 * (OperationAborted, если отменена область текущей сопрограммы, иначе TimedOut)
+				 * @param err буфер для записи ошибки
+				 */
+				static void SetWaitError( Error &err )
+				{
+					CancelScope *scope_ptr = CancelScope::Current();
+					if( ( scope_ptr != nullptr ) && scope_ptr->IsCancelled() )
+					{
+						err = Error( ErrorCodes::OperationAborted, "Operation was aborted" );
+					}
+					else
+					{
+						err = Error( ErrorCodes::TimedOut, "Operation timed out" );
+					}
+				}
+
+				/// Общее состояние (подписчики могут пережить рассылку)
+				std::shared_ptr<SharedState> State;
+
+				/// Захват Lock-а при закрытии из деструктора (вне сопрограммы сервиса
+				/// встать в очередь мьютекса нельзя - тогда поток ждёт его активно:
+				/// сопрограммы держат Lock недолго и отпускают на время ожиданий)
+				void LockForClose()
+				{
+					try
+					{
+						State->Lock.Lock();
+					}
+					catch( const Exception& )
+					{
+						while( !State->Lock.TryLock() )
+						{
+							std::this_thread::yield();
+						}
+					}
+				}
+
+				/// Закрытие рассылки (Lock должен быть захвачен)
+				void CloseLocked()
+				{
+					if( !State->Closed )
+					{
+						State->Closed = true;
+						State->NewMessage.NotifyAll();
+						State->SpaceFreed.NotifyAll();
+					}
+				}
+
+			public:
+				/// Подписчик рассылки: получает сообщения, опубликованные после его создания
+				class Subscriber
+				{
+					private:
+						/// Общее состояние рассылки
+						std::shared_ptr<SharedState> State;
+
+						/// Элемент списка подписчиков рассылки
+						SubscriberLink Link;
+
+						/// Количество пропущенных сообщений (для BroadcastOverflow::DropOldest)
+						uint64_t Dropped;
+
+						/// Подписчик отключён из-за отставания
+						bool Disconnected;
+
+						/// Захват Lock-а при отписке (вне сопрограммы сервиса занятый
+						/// мьютекс ждать нельзя - тогда уведомление отправляется без него)
+						bool LockForUnsubscribe()
+						{
+							try
+							{
+								State->Lock.Lock();
+								return true;
+							}
+							catch( const Exception& )
+							{
+								return false;
+							}
+						}
+
+						/**
+						 * @brief TakeMessage получение очередного сообщения без ожидания (под Lock-ом)
+						 * @param res буфер для сообщения
+						 * @param err буфер для записи ошибки (BroadcastClosed, SubscriberLagged)
+						 * @return false, если новых сообщений нет и рассылка не закрыта
+						 */
+						bool TakeMessage( MessagePtr &res, Error &err )
+						{
+							SharedState &state = *State;
+							if( !Disconnected && ( Link.Cursor < state.NextSeq ) )
+							{
+								const uint64_t capacity = state.Log.size();
+								if( state.NextSeq - Link.Cursor > capacity )
+								{
+									// Сообщения, до которых не дочитали, перезаписаны
+									if( state.Policy == BroadcastOverflow::Disconnect )
+									{
+										Disconnected = true;
+									}
+									else
+									{
+										MY_ASSERT( state.Policy == BroadcastOverflow::DropOldest );
+										Dropped += state.NextSeq - capacity - Link.Cursor;
+										Link.Cursor = state.NextSeq - capacity;
+									}
+								}
+
+								if( !Disconnected )
+								{
+									res = state.Log[ Link.Cursor % capacity ];
+									++Link.Cursor;
+									if( state.PublishersWaiting > 0 )
+									{
+										state.SpaceFreed.NotifyAll();
+									}
+									return true;
+								}
+							}
+
+							if( Disconnected )
+							{
+								err = Error( ErrorCodes::SubscriberLagged, "Subscriber lagged behind broadcast" );
+								return true;
+							}
+
+							if( state.Closed )
+							{
+								err = Error( ErrorCodes::BroadcastClosed, "Broadcast was closed" );
+								return true;
+							}
+							return false;
+						} // bool TakeMessage( MessagePtr &res, Error &err )
+
+					public:
+						Subscriber( const Subscriber& ) = delete;
+						Subscriber& operator=( const Subscriber& ) = delete;
+
+						/**
+						 * @brief Subscriber подписка на рассылку
+						 * @param src рассылка
+						 */
+						explicit Subscriber( Broadcast &src ): State( src.State ),
+						                                       Dropped( 0 ),
+						                                       Disconnected( false )
+						{
+							State->Lock.Lock();
+							Link.Cursor = State->NextSeq;
+							Link.Prev = nullptr;
+							{
+								LockGuard<SpinLock> lock( State->SubscribersLock );
+								Link.Next = State->Subscribers;
+								if( Link.Next != nullptr )
+								{
+									Link.Next->Prev = &Link;
+								}
+								State->Subscribers = &Link;
+							}
+							State->Lock.Unlock();
+						}
+
+						/// Отписка (публикации, ждущие подписчика, продолжатся).
+						/// При BroadcastOverflow::Block может приостановить сопрограмму
+						/// (подписчик, захваченный задачей, удаляется ещё в её сопрограмме)
+						~Subscriber()
+						{
+							// Публикация проверяет место и встаёт в очередь SpaceFreed,
+							// не отпуская Lock, поэтому уведомление под Lock-ом её не опередит
+							const bool locked = ( State->Policy == BroadcastOverflow::Block ) && LockForUnsubscribe();
+							{
+								LockGuard<SpinLock> lock( State->SubscribersLock );
+								if( Link.Prev != nullptr )
+								{
+									Link.Prev->Next = Link.Next;
+								}
+								else
+								{
+									MY_ASSERT( State->Subscribers == &Link );
+									State->Subscribers = Link.Next;
+								}
+
+								if( Link.Next != nullptr )
+								{
+									Link.Next->Prev = Link.Prev;
+								}
+							}
+
+							if( State->Policy == BroadcastOverflow::Block )
+							{
+								State->SpaceFreed.NotifyAll();
+							}
+
+							if( locked )
+							{
+								State->Lock.Unlock();
+							}
+						}
+
+						/**
+						 * @brief Receive получение очередного сообщения с ограничением по времени
+						 * @param deadline крайний срок ожидания
+						 * @param err буфер для записи ошибки (BroadcastClosed, SubscriberLagged,
+						 * TimedOut или OperationAborted при отмене области сопрограммы)
+						 * @return сообщение (пустой указатель в случае ошибки)
+						 */
+						MessagePtr Receive( const DeadlineType &deadline, Error &err )
+						{
+							err = Error();
+							MessagePtr res;
+
+							SharedState &state = *State;
+							state.Lock.Lock();
+							while( !TakeMessage( res, err ) )
+							{
+								++state.ReceiversWaiting;
+								const bool notified = state.NewMessage.Wait( state.Lock, deadline );
+								--state.ReceiversWaiting;
+								if( !notified )
+								{
+									SetWaitError( err );
+									break;
+								}
+							} // while( !TakeMessage( res, err ) )
+							state.Lock.Unlock();
+
+							return res;
+						} // MessagePtr Receive( const DeadlineType &deadline, Error &err )
+
+						/**
+						 * @brief Receive получение очередного сообщения
+						 * @param err буфер для записи ошибки (BroadcastClosed, SubscriberLagged
+						 * или OperationAborted при отмене области сопрограммы)
+						 * @return сообщение (пустой указатель в случае ошибки)
+						 */
+						MessagePtr Receive( Error &err )
+						{
+							return Receive( NoDeadline, err );
+						}
+
+						/**
+						 * @brief Receive получение очередного сообщения
+						 * (отменой области сопрограммы не прерывается)
+						 * @return сообщение
+						 * @throw Exception в случае ошибки
+						 */
+						MessagePtr Receive()
+						{
+							CancelShield shield;
+							Error err;
+							MessagePtr res = Receive( NoDeadline, err );
+							ThrowIfNeed( err );
+							return res;
+						}
+
+						/**
+						 * @brief TryReceive получение сообщения без ожидания
+						 * @param err буфер для записи ошибки (BroadcastClosed, SubscriberLagged)
+						 * @return сообщение (пустой указатель, если новых сообщений
+						 * нет или в случае ошибки)
+						 */
+						MessagePtr TryReceive( Error &err )
+						{
+							err = Error();
+							MessagePtr res;
+							State->Lock.Lock();
+							TakeMessage( res, err );
+							State->Lock.Unlock();
+							return res;
+						}
+
+						/**
+						 * @brief TryReceive получение сообщения без ожидания
+						 * @return сообщение (пустой указатель, если новых сообщений нет)
+						 * @throw Exception в случае ошибки
+						 */
+						MessagePtr TryReceive()
+						{
+							Error err;
+							MessagePtr res = TryReceive( err );
+							ThrowIfNeed( err );
+							return res;
+						}
+
+						/// Количество пропущенных сообщений (для BroadcastOverflow::DropOldest)
+						uint64_t GetDropped() const
+						{
+							return Dropped;
+						}
+				};
+
+				Broadcast( const Broadcast& ) = delete;
+				Broadcast& operator=( const Broadcast& ) = delete;
+
+				/**
+				 * @brief Broadcast конструктор
+				 * @param capacity ёмкость журнала (на сколько сообщений может отстать подписчик)
+				 * @param policy поведение при отставании подписчика на ёмкость журнала
+				 * @throw std::invalid_argument, если ёмкость нулевая
+				 */
+				explicit Broadcast( size_t capacity,
+				                    BroadcastOverflow policy = BroadcastOverflow::DropOldest ): State( new SharedState( capacity, policy ) )
+				{
+					if( capacity == 0 )
+					{
+						throw std::invalid_argument( "Broadcast capacity must be positive" );
+					}
+				}
+
+				/// Закрытие рассылки (подписчики дочитают журнал и получат BroadcastClosed;
+				/// может удаляться и вне сопрограммы сервиса)
+				~Broadcast()
+				{
+					LockForClose();
+					CloseLocked();
+					State->Lock.Unlock();
+				}
+
+				/**
+				 * @brief Publish публикация сообщения с ограничением по времени
+				 * (ожидание возможно только при BroadcastOverflow::Block)
+				 * @param msg сообщение (пустой указатель не публикуется)
+				 * @param deadline крайний срок ожидания
+				 * @param err буфер для записи ошибки (BroadcastClosed,
+				 * TimedOut или OperationAborted при отмене области сопрограммы)
+				 */
+				void Publish( MessagePtr msg, const DeadlineType &deadline, Error &err )
+				{
+					err = Error();
+					if( !msg )
+					{
+						MY_ASSERT( false );
+						throw std::invalid_argument( "Empty message" );
+					}
+
+					SharedState &state = *State;
+					state.Lock.Lock();
+					while( !state.Closed &&
+					       ( state.Policy == BroadcastOverflow::Block ) &&
+					       !state.HasSpace() )
+					{
+						++state.PublishersWaiting;
+						const bool notified = state.SpaceFreed.Wait( state.Lock, deadline );
+						--state.PublishersWaiting;
+						if( !notified )
+						{
+							SetWaitError( err );
+							state.Lock.Unlock();
+							return;
+						}
+					}
+
+					if( state.Closed )
+					{
+						err = Error( ErrorCodes::BroadcastClosed, "Broadcast was closed" );
+					}
+					else
+					{
+						// Вытесняемое сообщение удаляется, когда его дочитают все подписчики
+						state.Log[ state.NextSeq % state.Log.size() ] = std::move( msg );
+						++state.NextSeq;
+						if( state.ReceiversWaiting > 0 )
+						{
+							state.NewMessage.NotifyAll();
+						}
+					}
+					state.Lock.Unlock();
+				} // void Publish( MessagePtr msg, const DeadlineType &deadline, Error &err )
+
+				/**
+				 * @brief Publish публикация сообщения
+				 * @param msg сообщение (пустой указатель не публикуется)
+				 * @param err буфер для записи ошибки (BroadcastClosed
+				 * или OperationAborted при отмене области сопрограммы)
+				 */
+				void Publish( MessagePtr msg, Error &err )
+				{
+					Publish( std::move( msg ), NoDeadline, err );
+				}
+
+				/**
+				 * @brief Publish публикация сообщения
+				 * (отменой области сопрограммы не прерывается)
+				 * @param msg сообщение (пустой указатель не публикуется)
+				 * @throw Exception в случае ошибки
+				 */
+				void Publish( MessagePtr msg )
+				{
+					CancelShield shield;
+					Error err;
+					Publish( std::move( msg ), NoDeadline, err );
+					ThrowIfNeed( err );
+				}
+
+				/// Закрытие рассылки (новые сообщения не публикуются, подписчики
+				/// дочитают журнал и получат ошибку BroadcastClosed)
+				void Close()
+				{
+					State->Lock.Lock();
+					CloseLocked();
+					State->Lock.Unlock();
+				}
+		};
+	} // namespace CoroService
+} // namespace Bicycle
@@ -0,0 +1,367 @@
+#pragma once
+#include "CoroSrv/Sync.hpp"
+#include <exception>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+namespace Bicycle
+{
+	namespace CoroService
+	{
+		/// Элемент списка сопрограмм, ожидающих готовности любого из нескольких
+		/// результатов (хранится у ожидающей сопрограммы)
+		struct FutureListener
+		{
+			/// Событие, выставляемое при готовности результата
+			Event *ReadyEvent;
+
+			/// Соседние элементы списка
+			FutureListener *Prev;
+			FutureListener *Next;
+		};
+
+		/// Общее состояние результата сопрограммы (нешаблонная часть):
+		/// разделяется сопрограммой, вычисляющей результат, и объектом Future
+		class FutureStateBase
+		{
+			private:
+				/// Флаг готовности результата
+				std::atomic<bool> ReadyFlag;
+
+				/// Событие готовности результата
+				Event Ready;
+
+				/// SetReady выставляет события отсоединённого списка ожидающих
+				std::atomic<bool> Notifying;
+
+				/// Блокировка списка Listeners
+				SpinLock ListenersLock;
+
+				/// Список ожидающих готовности любого из нескольких результатов
+				FutureListener *Listeners;
+
+				/// Исключение, выброшенное задачей
+				std::exception_ptr Exc;
+
+				/// Исключение элемента из списка ожидающих (под блокировкой ListenersLock)
+				void UnlinkListener( FutureListener &listener );
+
+			protected:
+				FutureStateBase();
+
+				/// Отметка о готовности результата (пробуждает ожидающих)
+				void SetReady();
+
+				/// Сохранение исключения, выброшенного задачей, и отметка о готовности
+				void SetException( std::exception_ptr exc );
+
+			public:
+				FutureStateBase( const FutureStateBase& ) = delete;
+				FutureStateBase& operator=( const FutureStateBase& ) = delete;
+
+				~FutureStateBase();
+
+				/// Готов ли результат
+				bool IsReady() const;
+
+				/// Ожидание готовности результата
+				void Wait();
+
+				/**
+				 * @brief Wait ожидание готовности результата с ограничением по времени
+				 * @param deadline крайний срок ожидания
+				 * @return true, если результат готов, false - если истёк срок
+				 * или ожидание прервано отменой области сопрограммы
+				 */
+				bool Wait( const DeadlineType &deadline );
+
+				/// Выброс исключения, сохранённого задачей (если оно было)
+				void RethrowIfNeed() const;
+
+				/**
+				 * @brief AddListener добавление элемента в список ожидающих
+				 * @param listener добавляемый элемент
+				 * @return false, если результат уже готов (элемент не добавлен)
+				 */
+				bool AddListener( FutureListener &listener );
+
+				/// Удаление элемента из списка ожидающих (после возврата
+				/// событие элемента состоянием больше не используется)
+				void RemoveListener( FutureListener &listener );
+		};
+
+		/// Общее состояние результата сопрограммы
+		template <typename T>
+		class FutureState: public FutureStateBase
+		{
+			private:
+				/// Память под значение результата
+				typename std::aligned_storage<sizeof( T ), std::alignment_of<T>::value>::type Storage;
+
+				/// Создано ли значение в Storage
+				bool HasValue;
+
+			public:
+				FutureState(): FutureStateBase(), HasValue( false ) {}
+
+				~FutureState()
+				{
+					if( HasValue )
+					{
+						reinterpret_cast<T*>( &Storage )->~T();
+					}
+				}
+
+				/// Выполнение задачи и сохранение её результата (или исключения)
+				template <typename F>
+				void Run( F &task )
+				{
+					try
+					{
+						new( &Storage ) T( task() );
+						HasValue = true;
+					}
+					catch( ... )
+					{
+						SetException( std::current_exception() );
+						return;
+					}
+					SetReady();
+				}
+
+				/// Извлечение результата (вызывается после готовности)
+				T Take()
+				{
+					MY_ASSERT( HasValue );
+					return std::move( *reinterpret_cast<T*>( &Storage ) );
+				}
+		};
+
+		/// Общее состояние результата сопрограммы без значения
+		template <>
+		class FutureState<void>: public FutureStateBase
+		{
+			public:
+				FutureState(): FutureStateBase() {}
+
+				/// Выполнение задачи (с сохранением исключения, если оно будет)
+				template <typename F>
+				void Run( F &task )
+				{
+					try
+					{
+						task();
+					}
+					catch( ... )
+					{
+						SetException( std::current_exception() );
+						return;
+					}
+					SetReady();
+				}
+
+				void Take() {}
+		};
+
+		/**
+		 * @brief The Future class результат сопрограммы, запущенной через Go( future, task ).
+		 * Состояние, общее для сопрограммы и объекта, создаётся одним выделением памяти.
+		 * Ожидание готовности приостанавливает сопрограмму, а не поток
+		 */
+		template <typename T>
+		class Future
+		{
+			private:
+				/// Общее состояние
+				std::shared_ptr<FutureState<T>> State;
+
+				/// Проверка наличия состояния
+				void CheckValid() const
+				{
+					if( !State )
+					{
+						throw std::invalid_argument( "Future has no state" );
+					}
+				}
+
+			public:
+				Future() {}
+
+				/// Создание объекта, связанного с общим состоянием
+				explicit Future( std::shared_ptr<FutureState<T>> state ): State( std::move( state ) ) {}
+
+				/// Связан ли объект с сопрограммой (после Get - нет)
+				bool Valid() const
+				{
+					return ( bool ) State;
+				}
+
+				/**
+				 * @brief IsReady готов ли результат
+				 * @throw std::invalid_argument, если объект не связан с сопрограммой
+				 */
+				bool IsReady() const
+				{
+					CheckValid();
+					return State->IsReady();
+				}
+
+				/**
+				 * @brief Wait ожидание готовности результата
+				 * @throw std::invalid_argument, если объект не связан с сопрограммой
+				 */
+				void Wait() const
+				{
+					CheckValid();
+					State->Wait();
+				}
+
+				/**
+				 * @brief Wait ожидание готовности результата с ограничением по времени
+				 * @param deadline крайний срок ожидания
+				 * @return true, если результат готов, false - если истёк срок
+				 * или ожидание прервано отменой области сопрограммы
+				 * @throw std::invalid_argument, если объект не связан с сопрограммой
+				 */
+				bool Wait( const DeadlineType &deadline ) const
+				{
+					CheckValid();
+					return State->Wait( deadline );
+				}
+
+				/**
+				 * @brief Get получение результата (с ожиданием готовности);
+				 * после вызова объект не связан с сопрограммой
+				 * @return результат сопрограммы
+				 * @throw исключение, выброшенное задачей, или std::invalid_argument,
+				 * если объект не связан с сопрограммой
+				 */
+				T Get()
+				{
+					Wait();
+					std::shared_ptr<FutureState<T>> state( std::move( State ) );
+					state->RethrowIfNeed();
+					return state->Take();
+				}
+
+				/// Общее состояние (для WhenAny)
+				FutureStateBase* GetState() const
+				{
+					return State.get();
+				}
+		};
+
+		/**
+		 * @brief Go Создание сопрограммы внутри сервиса сопрограмм с получением её результата
+		 * @param future объект для получения результата (после успешного запуска связан с сопрограммой)
+		 * @param task исполняемая задача (функция без аргументов, возвращающая T)
+		 * @param stack_sz размер стека новой сопрограммы
+		 * @return Ошибка выполнения
+		 * @throw Exception, если выполняется не внутри сервиса
+		 */
+		template <typename T, typename F>
+		Error Go( Future<T> &future, F task, size_t stack_sz = 0 )
+		{
+			std::shared_ptr<FutureState<T>> state = std::make_shared<FutureState<T>>();
+			Error err = Go( [ state, task ]() mutable
+			{
+				state->Run( task );
+			}, stack_sz );
+
+			if( !err )
+			{
+				future = Future<T>( std::move( state ) );
+			}
+			return err;
+		}
+
+		/**
+		 * @brief WhenAll ожидание готовности всех результатов
+		 * @param futures результаты (все должны быть связаны с сопрограммами)
+		 * @throw std::invalid_argument, если какой-то результат не связан с сопрограммой
+		 */
+		template <typename T>
+		void WhenAll( const std::vector<Future<T>> &futures )
+		{
+			for( const auto &f : futures )
+			{
+				f.Wait();
+			}
+		}
+
+		/**
+		 * @brief WhenAll ожидание готовности всех результатов с ограничением по времени
+		 * @param futures результаты (все должны быть связаны с сопрограммами)
+		 * @param deadline крайний срок ожидания
+		 * @return true, если все результаты готовы, false - если истёк срок
+		 * или ожидание прервано отменой области сопрограммы
+		 * @throw std::invalid_argument, если какой-то результат не связан с сопрограммой
+		 */
+		template <typename T>
+		bool WhenAll( const std::vector<Future<T>> &futures, const DeadlineType &deadline )
+		{
+			for( const auto &f : futures )
+			{
+				if( !f.Wait( deadline ) )
+				{
+					return false;
+				}
+			}
+			return true;
+		}
+
+		/**
+		 * @brief WhenAnyImpl ожидание готовности любого из результатов
+		 * @param states общие состояния результатов
+		 * @param states_num количество состояний
+		 * @param deadline крайний срок ожидания (nullptr - без ограничения)
+		 * @return индекс первого готового результата (states_num - если истёк срок
+		 * или ожидание прервано отменой области сопрограммы)
+		 */
+		size_t WhenAnyImpl( FutureStateBase* const *states, size_t states_num,
+		                    const DeadlineType *deadline );
+
+		/**
+		 * @brief WhenAny ожидание готовности любого из результатов
+		 * @param futures результаты (все должны быть связаны с сопрограммами)
+		 * @return индекс первого готового результата
+		 * @throw std::invalid_argument, если futures пуст или какой-то результат
+		 * не связан с сопрограммой
+		 */
+		template <typename T>
+		size_t WhenAny( const std::vector<Future<T>> &futures )
+		{
+			std::vector<FutureStateBase*> states;
+			states.reserve( futures.size() );
+			for( const auto &f : futures )
+			{
+				states.push_back( f.GetState() );
+			}
+			return WhenAnyImpl( states.data(), states.size(), nullptr );
+		}
+
+		/**
+		 * @brief WhenAny ожидание готовности любого из результатов с ограничением по времени
+		 * @param futures результаты (все должны быть связаны с сопрограммами)
+		 * @param deadline крайний срок ожидания
+		 * @return индекс первого готового результата (futures.size() - если истёк срок
+		 * или ожидание прервано отменой области сопрограммы)
+		 * @throw std::invalid_argument, если futures пуст или какой-то результат
+		 * не связан с сопрограммой
+		 */
+		template <typename T>
+		size_t WhenAny( const std::vector<Future<T>> &futures, const DeadlineType &deadline )
+		{
+			std::vector<FutureStateBase*> states;
+			states.reserve( futures.size() );
+			for( const auto &f : futures )
+			{
+				states.push_back( f.GetState() );
+			}
+			return WhenAnyImpl( states.data(), states.size(), &deadline );
+		}
+	} // namespace CoroService
+} // namespace Bicycle
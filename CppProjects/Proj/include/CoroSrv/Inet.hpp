@@ -147,6 +147,32 @@ namespace Bicycle
 				size_t SendTo( const ConstBufferType &data,
 				               const Ip4Addr &addr );
 
+				/**
+				 * @brief SendTo отправка данных с ограничением по времени
+				 * @param data данные для отправки
+				 * @param addr адрес получателя
+				 * @param deadline крайний срок выполнения (по его истечении операция
+				 * завершается с ошибкой TimedOut, остальные операции сокета не затрагиваются)
+				 * @param err ошибка выполнения
+				 * @return количество отправленных байт
+				 */
+				size_t SendTo( const ConstBufferType &data,
+				               const Ip4Addr &addr,
+				               const DeadlineType &deadline,
+				               Error &err );
+
+				/**
+				 * @brief SendTo отправка данных с ограничением по времени
+				 * @param data данные для отправки
+				 * @param addr адрес получателя
+				 * @param deadline крайний срок выполнения
+				 * @return количество отправленных байт
+				 * @throw Exception в случае ошибки (в т.ч. по истечении срока)
+				 */
+				size_t SendTo( const ConstBufferType &data,
+				               const Ip4Addr &addr,
+				               const DeadlineType &deadline );
+
 				/**
 				 * @brief RecvFrom получение данных
 				 * @param data буфер для считываемых данных
@@ -167,6 +193,32 @@ namespace Bicycle
 				 */
 				size_t RecvFrom( const BufferType &data,
 				                 Ip4Addr &addr );
+
+				/**
+				 * @brief RecvFrom получение данных с ограничением по времени
+				 * @param data буфер для считываемых данных
+				 * @param addr буфер для записи адреса отправителя
+				 * @param deadline крайний срок выполнения (по его истечении операция
+				 * завершается с ошибкой TimedOut, остальные операции сокета не затрагиваются)
+				 * @param err ошибка выполнения
+				 * @return количество принятых байт
+				 */
+				size_t RecvFrom( const BufferType &data,
+				                 Ip4Addr &addr,
+				                 const DeadlineType &deadline,
+				                 Error &err );
+
+				/**
+				 * @brief RecvFrom получение данных с ограничением по времени
+				 * @param data буфер для считываемых данных
+				 * @param addr буфер для записи адреса отправителя
+				 * @param deadline крайний срок выполнения
+				 * @return количество принятых байт
+				 * @throw Exception в случае ошибки (в т.ч. по истечении срока)
+				 */
+				size_t RecvFrom( const BufferType &data,
+				                 Ip4Addr &addr,
+				                 const DeadlineType &deadline );
 		};
 
 		/// Класс сокета TCP, базового класса для соединения TCP и приёмника соединений
@@ -205,6 +257,24 @@ namespace Bicycle
 				 */
 				void Connect( const Ip4Addr &addr );
 
+				/**
+				 * @brief Connect подключение к указанному адресу с ограничением по времени
+				 * (по истечении срока сокет остаётся в неопределённом состоянии и должен быть закрыт)
+				 * @param addr адрес, к которому происходит подключение
+				 * @param deadline крайний срок выполнения (по его истечении операция
+				 * завершается с ошибкой TimedOut)
+				 * @param err буфер для записи ошибки выполнения
+				 */
+				void Connect( const Ip4Addr &addr, const DeadlineType &deadline, Error &err );
+
+				/**
+				 * @brief Connect подключение к указанному адресу с ограничением по времени
+				 * @param addr адрес, к которому происходит подключение
+				 * @param deadline крайний срок выполнения
+				 * @throw Exception в случае ошибки (в т.ч. по истечении срока)
+				 */
+				void Connect( const Ip4Addr &addr, const DeadlineType &deadline );
+
 				/**
 				 * @brief Send отправка данных
 				 * @param data данные для отправки
@@ -222,6 +292,28 @@ namespace Bicycle
 				 */
 				size_t Send( const ConstBufferType &data );
 
+				/**
+				 * @brief Send отправка данных с ограничением по времени
+				 * @param data данные для отправки
+				 * @param deadline крайний срок выполнения (по его истечении операция
+				 * завершается с ошибкой TimedOut, остальные операции сокета не затрагиваются)
+				 * @param err ошибка выполнения
+				 * @return количество отправленных байт
+				 */
+				size_t Send( const ConstBufferType &data,
+				             const DeadlineType &deadline,
+				             Error &err );
+
+				/**
+				 * @brief Send отправка данных с ограничением по времени
+				 * @param data данные для отправки
+				 * @param deadline крайний срок выполнения
+				 * @return количество отправленных байт
+				 * @throw Exception в случае ошибки (в т.ч. по истечении срока)
+				 */
+				size_t Send( const ConstBufferType &data,
+				             const DeadlineType &deadline );
+
 				/**
 				 * @brief Recv получение данных
 				 * @param data буфер для считываемых данных
@@ -238,6 +330,28 @@ namespace Bicycle
 				 * @throw Exception в случае ошибки
 				 */
 				size_t Recv( const BufferType &data );
+
+				/**
+				 * @brief Recv получение данных с ограничением по времени
+				 * @param data буфер для считываемых данных
+				 * @param deadline крайний срок выполнения (по его истечении операция
+				 * завершается с ошибкой TimedOut, остальные операции сокета не затрагиваются)
+				 * @param err ошибка выполнения
+				 * @return количество принятых байт
+				 */
+				size_t Recv( const BufferType &data,
+				             const DeadlineType &deadline,
+				             Error &err );
+
+				/**
+				 * @brief Recv получение данных с ограничением по времени
+				 * @param data буфер для считываемых данных
+				 * @param deadline крайний срок выполнения
+				 * @return количество принятых байт
+				 * @throw Exception в случае ошибки (в т.ч. по истечении срока)
+				 */
+				size_t Recv( const BufferType &data,
+				             const DeadlineType &deadline );
 		};
 
 
@@ -273,6 +387,27 @@ namespace Bicycle
 				 * @throw Exception в случае ошибки
 				 */
 				void Accept( TcpConnection &conn, Ip4Addr &addr );
+
+				/**
+				 * @brief Accept приём входящего соединения с ограничением по времени
+				 * @param conn буфер для нового соединения
+				 * @param addr буфер для записи адреса нового подключения
+				 * @param deadline крайний срок выполнения (по его истечении операция
+				 * завершается с ошибкой TimedOut, приёмник остаётся открытым)
+				 * @param err буфер для записи ошибки выполнения
+				 */
+				void Accept( TcpConnection &conn, Ip4Addr &addr,
+				             const DeadlineType &deadline, Error &err );
+
+				/**
+				 * @brief Accept приём входящего соединения с ограничением по времени
+				 * @param conn буфер для нового соединения
+				 * @param addr буфер для записи адреса нового подключения
+				 * @param deadline крайний срок выполнения
+				 * @throw Exception в случае ошибки (в т.ч. по истечении срока)
+				 */
+				void Accept( TcpConnection &conn, Ip4Addr &addr,
+				             const DeadlineType &deadline );
 		};
 	} // namespace CoroService
 } // namespace Bicycle
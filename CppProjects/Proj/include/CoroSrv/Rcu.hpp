@@ -0,0 +1,97 @@
+#pragma once
+#include "CoroSrv/Service.hpp"
+
+namespace Bicycle
+{
+	namespace CoroService
+	{
+		/**
+		 * @brief The RcuCell class ячейка с разделяемым неизменяемым объектом (например,
+		 * таблицей маршрутизации), который целиком заменяется новой версией.
+		 * Чтение - одна загрузка указателя без записи в общую память; прежняя версия
+		 * удаляется, когда все потоки сервиса пройдут точку покоя в цикле Execute.
+		 * Указатель, полученный сопрограммой, действителен, пока она не прервётся
+		 * (не уступит поток, не начнёт ждать ввода-вывода, объекта синхронизации и т.п.)
+		 */
+		template <typename T>
+		class RcuCell: public ServiceWorker
+		{
+			private:
+				/// Текущая версия
+				std::atomic<T*> Ptr;
+
+			public:
+				RcuCell( const RcuCell& ) = delete;
+				RcuCell& operator=( const RcuCell& ) = delete;
+
+				/**
+				 * @brief RcuCell
+				 * @param init_val начальная версия (может быть пустой)
+				 */
+				explicit RcuCell( std::unique_ptr<T> init_val = std::unique_ptr<T>() ): ServiceWorker(),
+				                                                                        Ptr( init_val.release() )
+				{}
+
+				/// Удаление текущей версии (читателей быть не должно)
+				~RcuCell()
+				{
+					delete Ptr.load();
+				}
+
+				/**
+				 * @brief Get получение текущей версии (вызывается из сопрограммы сервиса)
+				 * @return указатель на текущую версию (nullptr, если её нет)
+				 */
+				const T* Get() const
+				{
+					// Поток вне сервиса не проходит точек покоя, и версия
+					// может быть удалена, пока он её читает
+					MY_ASSERT( IsServiceThread() );
+					return Ptr.load( std::memory_order_acquire );
+				}
+
+				/**
+				 * @brief Set публикация новой версии (прежняя будет удалена
+				 * после точек покоя всех потоков сервиса)
+				 * @param new_val новая версия (может быть пустой)
+				 */
+				void Set( std::unique_ptr<T> new_val )
+				{
+					T *old_ptr = Ptr.exchange( new_val.release(), std::memory_order_acq_rel );
+					if( old_ptr != nullptr )
+					{
+						RetireRcu( old_ptr );
+					}
+				}
+
+				/**
+				 * @brief Update публикация версии, построенной по текущей
+				 * (если текущую успели заменить - построение повторяется)
+				 * @param builder функция вида std::unique_ptr<T>( const T *cur_val )
+				 * (cur_val может быть nullptr; builder не должна прерывать сопрограмму)
+				 */
+				template <typename Builder>
+				void Update( const Builder &builder )
+				{
+					T *cur_ptr = Ptr.load( std::memory_order_acquire );
+					while( true )
+					{
+						std::unique_ptr<T> new_val( builder( ( const T* ) cur_ptr ) );
+						if( Ptr.compare_exchange_strong( cur_ptr, new_val.get(), std::memory_order_acq_rel ) )
+						{
+							new_val.release();
+							break;
+						}
+
+						// Версию заменили, пока строили новую: cur_ptr обновлён,
+						// построенная версия удаляется
+					}
+
+					if( cur_ptr != nullptr )
+					{
+						RetireRcu( cur_ptr );
+					}
+				} // void Update( const Builder &builder )
+		};
+	} // namespace CoroService
+} // namespace Bicycle
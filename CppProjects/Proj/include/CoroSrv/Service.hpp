@@ -2,9 +2,11 @@
 
 #include "Coro.hpp"
 #include "Utils.hpp"
+#include "TimingWheel.hpp"
 
 #include <deque>
 #include <mutex>
+#include <chrono>
 #include <vector>
 #include <thread>
 #include <memory>
@@ -38,13 +40,239 @@ namespace Bicycle
 
 		/// Операция выполняется внутри сопрограммы сервиса
 		const err_code_t InsideSrvCoro = 0xFFFFFFF6;
+
+		/// Истёк срок, отведённый на выполнение операции
+		const err_code_t TimedOut = 0xFFFFFFF7;
 	} // namespace ErrorCodes
 
 	namespace CoroService
 	{
 		using namespace Coro;
 
+		/// Часы, по которым отсчитываются крайние сроки операций
+		typedef std::chrono::steady_clock DeadlineClock;
+
+		/// Крайний срок выполнения операции
+		typedef DeadlineClock::time_point DeadlineType;
+
+		/// Крайний срок, означающий отсутствие ограничения по времени
+		const DeadlineType NoDeadline = DeadlineType::max();
+
+		/**
+		 * @brief DeadlineAfter получение крайнего срока, отстоящего от текущего момента
+		 * @param microseconds время в микросекундах
+		 * @return крайний срок
+		 */
+		DeadlineType DeadlineAfter( uint64_t microseconds );
+
+		struct TimerQueue;
+
+		/// Узел очереди таймеров сервиса. Хранится в стеке ожидающей
+		/// сопрограммы (постановка в очередь и снятие с неё не требуют выделения памяти)
+		class TimerNode: private TimingWheelNode
+		{
+			friend class Service;
+
+			private:
+				/// Очередь таймеров, в которую узел был поставлен последним
+				TimerQueue *QueuePtr;
+
+				/// Обработка сработки узла колесом таймеров
+				virtual void OnExpired() override final;
+
+			public:
+				TimerNode( const TimerNode& ) = delete;
+				TimerNode& operator=( const TimerNode& ) = delete;
+
+				TimerNode();
+				virtual ~TimerNode();
+
+				/**
+				 * @brief OnDeadline обработка наступления срока. Вызывается из основной
+				 * сопрограммы потока сервиса под блокировкой очереди таймеров
+				 * (!!! не должна переключать сопрограммы и ставить/снимать таймеры !!!)
+				 * @return указатель на сопрограмму, в которую нужно перейти после
+				 * обработки таймеров (остальные "пробуждаемые" сопрограммы узел
+				 * добавляет в Post сам), либо nullptr
+				 */
+				virtual Coroutine* OnDeadline() = 0;
+
+				/**
+				 * @brief OnStop обработка остановки сервиса для узла, стоящего в очереди
+				 * (или ставящегося в неё после начала остановки). Вызывается под
+				 * блокировкой очереди таймеров с теми же ограничениями, что OnDeadline
+				 * @return true - узел снимается с очереди и сразу выполняется его OnDeadline,
+				 * false (по умолчанию) - узел сработает в свой срок
+				 */
+				virtual bool OnStop();
+		};
+
+		/// Очередь таймеров сервиса: потоки сервиса ставят таймеры в разные очереди,
+		/// чтобы не делить блокировку и колесо, но к потоку очередь не привязана -
+		/// сработавшие таймеры обрабатывает любой поток, получивший событие очереди
+		struct TimerQueue
+		{
+			/// Объект синхронизации доступа к очереди
+			SpinLock Lock;
+
+			/// Колесо таймеров
+			TimingWheel Wheel;
+
+			/// Момент, к которому настроено пробуждение потоков сервиса
+			DeadlineType WakeTime;
+
+			/// Сопрограммы, "пробуждённые" при текущей обработке очереди
+			std::vector<Coroutine*> Ready;
+
+			/// Количество сработавших таймеров
+			uint64_t ExpiredCount;
+
+			/// Количество обработок очереди, на которых сработал хотя бы один таймер
+			uint64_t WakeupsCount;
+
+			/// Сервис останавливается (узлы, прерываемые остановкой, срабатывают сразу)
+			bool Stopping;
+
+#ifndef _WIN32
+			/// Дескриптор timerfd, пробуждающий epoll к ближайшему сроку очереди
+			int TimerFd;
+#endif
+
+			TimerQueue( const TimerQueue& ) = delete;
+			TimerQueue& operator=( const TimerQueue& ) = delete;
+
+			TimerQueue();
+		};
+
+		/// Статистика очередей таймеров сервиса
+		struct TimerStats
+		{
+			/// Количество сработавших таймеров
+			uint64_t Expired;
+
+			/// Количество пробуждений, на которых сработал хотя бы один таймер
+			uint64_t Wakeups;
+
+			/// Количество пробуждений, сэкономленных за счёт срабатывания
+			/// нескольких таймеров за одно пробуждение (Expired - Wakeups)
+			uint64_t WakeupsSaved;
+		};
+
+		class Service;
+		class CancelableWait;
+
+		/// Область отмены: общее состояние группы сопрограмм. Ожидания сопрограмм,
+		/// привязанных к области, регистрируются в ней своим узлом таймера; отмена
+		/// ставит узлы в очередь таймеров с немедленным сроком, и их OnDeadline
+		/// прерывают ожидания (операции завершаются с ошибкой OperationAborted)
+		class CancelScope
+		{
+			friend class CancelableWait;
+
+			private:
+				/// Ссылка на сервис
+				Service &SrvRef;
+
+				/// Объект синхронизации доступа к списку ожиданий
+				/// (порядок блокировок: Lock, очередь таймеров сервиса)
+				SpinLock Lock;
+
+				/// Область отменена
+				std::atomic<bool> Cancelled;
+
+				/// Список зарегистрированных ожиданий
+				CancelableWait *Waits;
+
+			public:
+				CancelScope( const CancelScope& ) = delete;
+				CancelScope& operator=( const CancelScope& ) = delete;
+
+				CancelScope( Service &srv );
+				~CancelScope();
+
+				/// Была ли область отменена
+				bool IsCancelled() const;
+
+				/// Отмена: прерывание текущих ожиданий сопрограмм области
+				/// (последующие ожидания сразу завершаются с ошибкой)
+				void Cancel();
+
+				/// Область отмены текущей сопрограммы (nullptr, если её нет)
+				static CancelScope* Current();
+
+				/**
+				 * @brief SetCurrent привязка текущей сопрограммы к области отмены
+				 * @param scope_ptr указатель на область (nullptr - отвязка)
+				 * @return указатель на прежнюю область текущей сопрограммы
+				 */
+				static CancelScope* SetCurrent( CancelScope *scope_ptr );
+		};
+
+		/// Регистрация ожидания текущей сопрограммы в её области отмены
+		/// (хранится в стеке ожидающей сопрограммы, на время ожидания). При отмене
+		/// области узел ставится в очередь таймеров и его OnDeadline прерывает
+		/// ожидание так же, как при истечении срока. После разрушения объекта
+		/// OnDeadline узла гарантированно не выполняется и вызвана не будет
+		class CancelableWait
+		{
+			friend class CancelScope;
+
+			private:
+				/// Область отмены (nullptr, если сопрограмма не привязана к области)
+				CancelScope *ScopePtr;
+
+				/// Узел, прерывающий ожидание
+				TimerNode &NodeRef;
+
+				/// Соседние элементы списка ожиданий области
+				CancelableWait *Prev;
+				CancelableWait *Next;
+
+				/// Область была отменена до регистрации
+				bool CancelledBefore;
+
+			public:
+				CancelableWait( const CancelableWait& ) = delete;
+				CancelableWait& operator=( const CancelableWait& ) = delete;
+
+				/**
+				 * @brief CancelableWait регистрация ожидания текущей сопрограммы
+				 * @param node узел, прерывающий ожидание (не должен стоять в очереди таймеров)
+				 * @param enable false - ожидание не прерывается (регистрация не выполняется)
+				 */
+				CancelableWait( TimerNode &node, bool enable = true );
+				~CancelableWait();
+
+				/// Снятие регистрации (после возврата OnDeadline узла
+				/// гарантированно не выполняется и вызвана не будет)
+				void Unregister();
+
+				/// Была ли область отменена до регистрации (ожидать не нужно)
+				bool WasCancelled() const;
+		};
+
+		/// Защита от отмены: на время жизни объекта текущая сопрограмма отвязана
+		/// от своей области отмены, и её ожидания отменой не прерываются (для коротких
+		/// критических секций и освобождения ресурсов; вне сопрограммы ничего не делает)
+		class CancelShield
+		{
+			private:
+				/// Защищённая сопрограмма (nullptr, если объект создан вне сопрограммы)
+				Coroutine *CoroPtr;
+
+				/// Область отмены сопрограммы, восстанавливаемая при удалении объекта
+				CancelScope *PrevScope;
+
+			public:
+				CancelShield( const CancelShield& ) = delete;
+				CancelShield& operator=( const CancelShield& ) = delete;
+
+				CancelShield();
+				~CancelShield();
+		};
+
 		class AbstractCloser;
+		class IoDeadlineNode;
 		typedef std::pair<AbstractCloser*, SpinLock> PtrWithLocker;
 		typedef std::shared_ptr<PtrWithLocker> BaseDescPtr;
 		typedef std::weak_ptr<PtrWithLocker> BaseDescWeakPtr;
@@ -78,11 +306,18 @@ namespace Bicycle
 			/// Задача была отменена
 			bool WasCancelled;
 
+			/// Истёк крайний срок выполнения задачи
+			std::atomic<bool> DeadlineExpired;
+
+			/// Ожидание прервано отменой области сопрограммы
+			std::atomic<bool> GroupCancelled;
+
 			EpWaitStruct( Coroutine &coro_ref );
 		};
 
-		/// Тип списка указателей на структуры сопрограмм
-		typedef LockFree::ForwardList<EpWaitStruct*> EpWaitList;
+		/// Тип списка указателей на структуры сопрограмм (элемент добавляется
+		/// при каждом ожидании ввода-вывода - память берётся из пула потока)
+		typedef LockFree::ForwardList<EpWaitStruct*, LockFree::PoolAllocator> EpWaitList;
 
 		/// Список указателей на структуры сопрограмм + флаг срабатываний epoll-а
 		typedef std::pair<EpWaitList, std::atomic_flag> EpWaitListWithFlag;
@@ -96,6 +331,10 @@ namespace Bicycle
 			friend class AbstractCloser;
 			friend class ServiceWorker;
 			friend class BasicDescriptor;
+			friend class IoDeadlineNode;
+			friend class SyncWakeList;
+			friend class CancelScope;
+			friend class CancelableWait;
 
 			private:
 				/// Флаг, предотвращающий повторный запуск сервиса
@@ -105,10 +344,11 @@ namespace Bicycle
 				std::atomic<bool> MustBeStopped;
 
 				/// Количество сопрограмм, не считая основных сопрограмм потоков
-				std::atomic<uint64_t> CoroCount;
+				/// (меняется при каждом создании и завершении сопрограммы)
+				LockFree::PaddedAtomic<uint64_t> CoroCount;
 
 				/// Количество потоков, выполняющих Execute
-				std::atomic<uint64_t> WorkThreadsCount;
+				LockFree::PaddedAtomic<uint64_t> WorkThreadsCount;
 
 				/// Список указателей на дескрипторы, использующие данный сервис
 				LockFree::ForwardList<BaseDescWeakPtr> Descriptors;
@@ -119,9 +359,78 @@ namespace Bicycle
 				/// Флаг, показывающий необходимость очистки пустых указателей из Descriptors
 				std::atomic<bool> NeedToClearDescriptors;
 
+				/// Количество очередей таймеров
+				static const uint8_t TimerQueuesNum = 8;
+
+				/// Очереди таймеров (каждый поток сервиса ставит таймеры в "свою" очередь,
+				/// остальные потоки - в нулевую)
+				TimerQueue TimerQueues[ TimerQueuesNum ];
+
+				/// Счётчик запусков Run после перезапуска (для выбора очереди таймеров
+				/// и счётчика приостановок потока)
+				std::atomic<uint8_t> TimerQueueNum;
+
+				/// Количество счётчиков приостановок сопрограмм
+				static const uint8_t SuspendCountersNum = 16;
+
+				/// Счётчики приостановок сопрограмм потоков сервиса (по одному на поток, при
+				/// большем числе потоков делятся): по ним активное ожидание объектов
+				/// синхронизации определяет, выполняется ли ещё владелец объекта
+				LockFree::PaddedAtomic<uint64_t> SuspendCounters[ SuspendCountersNum ];
+
+				/// Допустимое запаздывание таймеров по умолчанию (в микросекундах)
+				std::atomic<uint64_t> TimerSlack;
+
+				/// Очередь на удаление прежних версий RcuCell: каждый поток держит
+				/// эпоху, пока выполняет сопрограммы, и освобождает её на время ожидания
+				/// событий (точка покоя - между итерациями цикла Execute). Общая очередь
+				/// LockFree::DeferredDeleter::Shared() не подходит: эпоха, удерживаемая
+				/// на время работы сопрограмм, задерживала бы очистку всех контейнеров процесса
+				LockFree::DeferredDeleter RcuQueue;
+
+				/**
+				 * @brief ArmTimer постановка узла в очередь таймеров текущего потока
+				 * (при вызове не из потока сервиса - в нулевую очередь)
+				 * @param node узел (не должен находиться в очереди)
+				 * @param deadline время сработки
+				 * @param slack_microsec допустимое запаздывание сработки в микросекундах
+				 * (сроки, попадающие в одно окно, обрабатываются за одно пробуждение)
+				 */
+				void ArmTimer( TimerNode &node, const DeadlineType &deadline, uint64_t slack_microsec = 0 );
+
+				/**
+				 * @brief DisarmTimer снятие узла с очереди таймеров (после выхода из
+				 * функции OnDeadline узла гарантированно не выполняется и вызвана не будет)
+				 * @param node узел
+				 * @return true, если узел был снят до сработки
+				 */
+				bool DisarmTimer( TimerNode &node );
+
+				/**
+				 * @brief WorkTimers обработка таймеров очереди, срок которых наступил,
+				 * и переход в "пробуждённые" ими сопрограммы
+				 * @param queue очередь таймеров
+				 * @param ready буфер для "пробуждённых" сопрограмм (переиспользуется между вызовами)
+				 */
+				void WorkTimers( TimerQueue &queue, std::vector<Coroutine*> &ready );
+
+				/**
+				 * @brief SetTimersWakeup платформозависимая настройка пробуждения
+				 * потоков сервиса к сроку queue.WakeTime (вызывается под блокировкой очереди)
+				 * @param queue очередь таймеров
+				 */
+				void SetTimersWakeup( TimerQueue &queue );
+
 #ifdef _WIN32
 				/// Дескриптор порта завершения ввода-вывода
 				HANDLE Iocp;
+
+				/**
+				 * @brief GetTimersWaitTimeout время ожидания Iocp до ближайшего
+				 * срока среди всех очередей таймеров
+				 * @return время ожидания в миллисекундах, либо INFINITE
+				 */
+				DWORD GetTimersWaitTimeout();
 #else
 				/// Дескриптор epoll
 				int EpollFd;
@@ -129,14 +438,19 @@ namespace Bicycle
 				/// Анонимный канал, используемый для добавления в очередь готовых к исполнению задач
 				int PostPipe[ 2 ];
 
-				/// Очередь на отложенное удаление
+				/// Очередь на отложенное удаление DescriptorStruct-ов. Поток держит её
+				/// эпоху и во время epoll_wait (указатели в событиях должны оставаться
+				/// действительными), поэтому общая очередь не используется: простаивающий
+				/// поток сервиса остановил бы очистку всех контейнеров процесса
 				LockFree::DeferredDeleter DeleteQueue;
 
-				/// Сопрограммы, готовые к исполнению
-				LockFree::ForwardList<Coroutine*> CoroutinesToExecute[ 8 ];
+				/// Сопрограммы, готовые к исполнению (интрузивные стеки,
+				/// связанные через Coroutine::NextScheduled: Post не выделяет память;
+				/// каждый стек - в своей кэш-линии)
+				LockFree::PaddedAtomic<Coroutine*> CoroutinesToExecute[ 8 ];
 
 				/// Счётчик срабатываний Post-а
-				std::atomic<uint8_t> CoroListNum;
+				LockFree::PaddedAtomic<uint8_t> CoroListNum;
 				
 				/// Обработка сопрограмм, добавленных через Post
 				void WorkPosted();
@@ -222,6 +536,20 @@ namespace Bicycle
 				 */
 				Error AddCoro( const std::function<void()> &task,
 				               size_t stack_sz = 0 );
+
+				/**
+				 * @brief SetTimerSlack настройка допустимого запаздывания по умолчанию
+				 * для таймеров сервиса (таймеры с близкими сроками будут сгруппированы
+				 * и обработаны за одно пробуждение)
+				 * @param microseconds время в микросекундах (0 - без группировки)
+				 */
+				void SetTimerSlack( uint64_t microseconds );
+
+				/// Допустимое запаздывание по умолчанию для таймеров сервиса (в микросекундах)
+				uint64_t GetTimerSlack() const;
+
+				/// Получение статистики очередей таймеров сервиса
+				TimerStats GetTimerStats();
 		};
 
 		// Классы и функции для работы внутри сопрограмм сервиса
@@ -293,8 +621,65 @@ namespace Bicycle
 				/// Сохранение указателя на задачу и переход в основную сопрограмму сервиса
 				void SetPostTaskAndSwitchToMainCoro( std::function<void()> *task );
 
+				/**
+				 * @brief ArmDeadline постановка узла в очередь таймеров сервиса
+				 * @param node узел (не должен находиться в очереди)
+				 * @param deadline время сработки
+				 * @param slack_microsec допустимое запаздывание сработки в микросекундах
+				 */
+				void ArmDeadline( TimerNode &node, const DeadlineType &deadline, uint64_t slack_microsec = 0 );
+
+				/**
+				 * @brief DisarmDeadline снятие узла с очереди таймеров сервиса
+				 * (после выхода OnDeadline узла гарантированно не выполняется)
+				 * @param node узел
+				 * @return true, если узел был снят до сработки
+				 */
+				bool DisarmDeadline( TimerNode &node );
+
 				/// Показывает, находится ли сервис в процессе остановки
 				bool IsStopped() const;
+
+				/// Количество потоков, выполняющих сервис
+				uint64_t GetWorkThreadsCount() const;
+
+				/// Выполняется ли вызов в потоке этого сервиса
+				bool IsServiceThread() const;
+
+				/// Номер текущего потока сервиса в порядке запуска Run
+				/// (для потоков вне сервиса - 0)
+				uint8_t GetServiceThreadNum() const;
+
+				/**
+				 * @brief GetRunStamp отметка выполнения текущей сопрограммы: остаётся
+				 * актуальной, пока сопрограмма не приостановится
+				 * @return отметка (0 - вызов не из потока сервиса)
+				 */
+				uint64_t GetRunStamp() const;
+
+				/**
+				 * @brief IsRunStampActual выполняется ли ещё сопрограмма, получившая отметку
+				 * (может вызываться из любого потока; пока поток сопрограммы её
+				 * не приостановил, ответ может запаздывать)
+				 * @param stamp отметка GetRunStamp (0 - всегда актуальна, отметки
+				 * с номером потока вне SuspendCountersNum - никогда)
+				 * @return false, если сопрограмма с тех пор приостанавливалась
+				 */
+				bool IsRunStampActual( uint64_t stamp ) const;
+
+				/**
+				 * @brief RetireRcu удаление объекта после того, как все потоки
+				 * сервиса пройдут точку покоя (либо сразу, если потоков нет)
+				 * @param ptr указатель на удаляемый объект
+				 */
+				template <typename T>
+				void RetireRcu( T *ptr )
+				{
+					SrvRef.RcuQueue.Delete( ptr );
+				}
+
+				/// Допустимое запаздывание по умолчанию для таймеров сервиса (в микросекундах)
+				uint64_t GetTimerSlack() const;
 		};
 
 		class AbstractCloser: public ServiceWorker
@@ -325,6 +710,8 @@ namespace Bicycle
 		/// Базовый класс сокетов и других дескрипторов
 		class BasicDescriptor : public AbstractCloser
 		{
+			friend class IoDeadlineNode;
+
 			protected:
 #ifdef _WIN32
 				/// Дескриптор
@@ -347,10 +734,13 @@ namespace Bicycle
 				 * @param task выполняемая задача (например, WSAReadFrom)
 				 * @param io_size ссылка на буфер, куда будет записано количество
 				 * записанных или отправленных байт
+				 * @param deadline крайний срок выполнения задачи (по его истечении
+				 * отменяется только эта задача, с ошибкой TimedOut)
 				 * @return ошибка выполнения
 				 * @throw std::invalid_argument, если task пустой
 				 */
-				Error ExecuteIoTask( const IoTaskType &task, size_t &io_size );
+				Error ExecuteIoTask( const IoTaskType &task, size_t &io_size,
+				                     const DeadlineType &deadline = NoDeadline );
 #else
 				typedef std::unique_ptr<DescriptorStruct, std::function<void( DescriptorStruct* )>> desc_ptr_t;
 
@@ -372,11 +762,14 @@ namespace Bicycle
 				 * @brief ExecuteIoTask выполнение асинхронной задачи ввода-вывода
 				 * @param task задача ввода-вывода (например, read или проверка наличия ошибки на сокете)
 				 * @param task_type тип задачи task
+				 * @param deadline крайний срок выполнения задачи (по его истечении
+				 * отменяется только эта задача, с ошибкой TimedOut)
 				 * @return ошибка выполнения
 				 * @throw std::invalid_argument, если task пустой
 				 */
 				Error ExecuteIoTask( const IoTaskType &task,
-				                     IoTaskTypeEnum task_type );
+				                     IoTaskTypeEnum task_type,
+				                     const DeadlineType &deadline = NoDeadline );
 #endif
 
 				BasicDescriptor();
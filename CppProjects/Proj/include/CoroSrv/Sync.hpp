@@ -5,22 +5,200 @@ namespace Bicycle
 {
 	namespace CoroService
 	{
-		class Mutex: public ServiceWorker
+		/// Элемент очереди сопрограмм, ожидающих объекта синхронизации
+		/// (хранится в стеке ожидающей сопрограммы)
+		struct SyncWaiter;
+
+		/// Интрузивная очередь сопрограмм, ожидающих объекта синхронизации
+		/// (добавление и удаление элементов не требуют выделения памяти)
+		class SyncWaitQueue
 		{
 			private:
-				/// Длина очереди сопрограмм на владение мьютексом
-				std::atomic<uint64_t> QueueLength;
+				/// Первый элемент очереди
+				SyncWaiter *Head;
 
-				/// Очередь сопрограмм на владение мьютксом
-				LockFree::DigitsQueue LockWaiters;
+				/// Последний элемент очереди
+				SyncWaiter *Tail;
+
+			public:
+				SyncWaitQueue( const SyncWaitQueue& ) = delete;
+				SyncWaitQueue& operator=( const SyncWaitQueue& ) = delete;
+
+				SyncWaitQueue();
+
+				/// Добавление элемента в конец очереди
+				void PushBack( SyncWaiter &waiter );
+
+				/// Первый элемент очереди (nullptr, если очередь пуста)
+				SyncWaiter* Front() const;
+
+				/// Извлечение первого элемента очереди (nullptr, если очередь пуста)
+				SyncWaiter* PopFront();
+
+				/// Удаление элемента из произвольного места очереди
+				void Remove( SyncWaiter &waiter );
+
+				/// Проверка очереди на пустоту
+				bool Empty() const;
+		};
+
+		/// Список сопрограмм, которым передан объект синхронизации
+		/// ("будятся" в деструкторе - после освобождения Guard-а объекта,
+		/// поэтому "разбуженная" сопрограмма может сразу удалить объект)
+		class SyncWakeList
+		{
+			private:
+				/// Ссылка на сервис
+				Service &Srv;
+
+				/// Первый элемент списка
+				SyncWaiter *Head;
+
+				/// Последний элемент списка
+				SyncWaiter *Tail;
+
+			public:
+				SyncWakeList( const SyncWakeList& ) = delete;
+				SyncWakeList& operator=( const SyncWakeList& ) = delete;
+
+				SyncWakeList( Service &srv );
+				~SyncWakeList();
+
+				/// Добавление элемента в конец списка
+				void PushBack( SyncWaiter &waiter );
+		};
+
+		/// Статистика активного ожидания Mutex и Semaphore (общая для процесса,
+		/// нужна для подбора предела активного ожидания)
+		struct SyncSpinStats
+		{
+			/// Количество ожиданий, начатых с активного ожидания
+			uint64_t Spins;
+
+			/// Количество захватов во время активного ожидания
+			uint64_t SpinAcquired;
+
+			/// Количество постановок сопрограмм в очередь ожидания
+			uint64_t Parked;
+		};
+
+		/// Получение статистики активного ожидания
+		SyncSpinStats GetSyncSpinStats();
+
+		/// Обнуление статистики активного ожидания
+		void ResetSyncSpinStats();
+
+		/**
+		 * @brief SetSyncSpinLimit установка предела активного ожидания Mutex и Semaphore
+		 * перед постановкой сопрограммы в очередь
+		 * @param pauses предел в паузах процессора (0 - активное ожидание отключено)
+		 */
+		void SetSyncSpinLimit( uint32_t pauses );
+
+		/// Предел активного ожидания Mutex и Semaphore (в паузах процессора)
+		uint32_t GetSyncSpinLimit();
+
+		class SyncDeadlineNode;
+
+		/// Базовый класс объектов синхронизации с очередью ожидающих сопрограмм.
+		/// Отменой области сопрограммы прерываются ожидания со сроком (возвращают
+		/// false, с NoDeadline - только при отмене) и с буфером ошибки (ошибка
+		/// OperationAborted); перегрузки без параметров отменой не прерываются
+		class SyncPrimitive: public ServiceWorker
+		{
+			friend class SyncDeadlineNode;
+
+			protected:
+				/// Очередь ожидающих сопрограмм
+				SyncWaitQueue Waiters;
+
+				/// Объект синхронизации доступа к очереди ожидающих сопрограмм
+				/// (объявлен последним, чтобы однобайтовое состояние наследника
+				/// могло занять место выравнивания)
+				SpinLock Guard;
+
+				/**
+				 * @brief Wait ожидание захвата объекта синхронизации
+				 * @param try_acquire функция попытки захвата (вызывается под блокировкой Guard)
+				 * @param deadline крайний срок ожидания
+				 * @param shared показывает, что ожидается разделяемое владение
+				 * @return true, если объект захвачен, false - если истёк срок
+				 * или ожидание прервано отменой области сопрограммы
+				 */
+				template<typename TryAcquire>
+				bool Wait( const TryAcquire &try_acquire, const DeadlineType &deadline, bool shared = false );
+
+				/**
+				 * @brief SpinBeforePark короткое активное ожидание с нарастающей паузой
+				 * перед постановкой в очередь (только если работают несколько потоков
+				 * сервиса, т.е. владелец может освободить объект параллельно)
+				 * @param try_acquire функция попытки захвата
+				 * @param can_spin функция, показывающая, имеет ли смысл ждать дальше
+				 * (например, выполняется ли ещё владелец объекта)
+				 * @return true, если объект захвачен, false - если надо вызывать Wait
+				 */
+				template<typename TryAcquire, typename CanSpin>
+				bool SpinBeforePark( const TryAcquire &try_acquire, const CanSpin &can_spin );
+
+				/**
+				 * @brief WakeFront передача объекта первой ожидающей сопрограмме
+				 * (вызывается под блокировкой Guard)
+				 * @param woken список, в который переносится сопрограмма
+				 * (должен быть объявлен до блокировки Guard-а)
+				 * @return true, если очередь была не пуста
+				 */
+				bool WakeFront( SyncWakeList &woken );
+
+				SyncPrimitive();
+				~SyncPrimitive();
+		};
+
+		class Mutex: public SyncPrimitive
+		{
+			friend class ConditionVariable;
+
+			private:
+				/// Состояние мьютекса: 0 - свободен, 1 - захвачен,
+				/// 2 - захвачен и, возможно, есть ожидающие сопрограммы
+				std::atomic<uint8_t> State;
+
+				/// Отметка выполнения владельца, сделанная при захвате (GetRunStamp):
+				/// активное ожидание продолжается, только пока владелец выполняется
+				std::atomic<uint64_t> OwnerStamp;
+
+				/**
+				 * @brief RequeueWaiter перенос ожидающей сопрограммы в очередь мьютекса
+				 * (если мьютекс свободен - он передаётся сопрограмме сразу)
+				 * @param waiter элемент очереди ожидающей сопрограммы (ни в какой очереди не стоит)
+				 * @param woken список, в который переносится сопрограмма, получившая мьютекс
+				 */
+				void RequeueWaiter( SyncWaiter &waiter, SyncWakeList &woken );
 
 			public:
 				Mutex();
 				~Mutex();
 
-				/// Захват мьютекса
+				/**
+				 * @brief Lock захват мьютекса
+				 * (отменой области сопрограммы не прерывается)
+				 */
 				void Lock();
 
+				/**
+				 * @brief Lock захват мьютекса
+				 * (прерывается отменой области сопрограммы)
+				 * @param err буфер для записи ошибки (OperationAborted при отмене)
+				 */
+				void Lock( Error &err );
+
+				/**
+				 * @brief Lock захват мьютекса с ограничением по времени
+				 * @param deadline крайний срок ожидания
+				 * @return true, если мьютекс захвачен, false - если истёк срок
+				 * или ожидание прервано отменой области сопрограммы
+				 */
+				bool Lock( const DeadlineType &deadline );
+
 				/// Попытка захвата мьютекса
 				bool TryLock();
 
@@ -28,20 +206,21 @@ namespace Bicycle
 				void Unlock();
 		};
 
-		class SharedMutex: public ServiceWorker
+		class SharedMutex: public SyncPrimitive
 		{
 			private:
-				/// Флаг текущего состояния
-				std::atomic<uint64_t> StateFlag;
-
-				/// Очередь сопрограмм на монопольное владение мьютксом
-				LockFree::DigitsQueue LockWaiters;
-
-				/// Очередь сопрограмм на разделяемое владение мьютксом
-				LockFree::DigitsQueue SharedLockWaiters;
+				/// Состояние: старший бит - захвачена монопольная блокировка,
+				/// следующий - возможно, есть ожидающие сопрограммы,
+				/// младшие - количество владельцев разделяемой блокировки
+				std::atomic<uint64_t> State;
 
-				/// "Пробуждение" первой сопрограммы из очереди
-				void AwakeCoro( bool for_unique_lock, bool by_push );
+				/**
+				 * @brief HandOff передача блокировки ожидающим сопрограммам
+				 * (первой монопольной, либо всем разделяемым из начала очереди),
+				 * либо её освобождение (вызывается последним владельцем под блокировкой Guard)
+				 * @param woken список сопрограмм, которым передана блокировка
+				 */
+				void HandOff( SyncWakeList &woken );
 
 			public:
 				SharedMutex();
@@ -50,38 +229,64 @@ namespace Bicycle
 				/// Попытка захвата монопольной блокировки
 				bool TryLock();
 
-				/// Захват монопольной блокировки
+				/**
+				 * @brief Lock захват монопольной блокировки
+				 * (отменой области сопрограммы не прерывается)
+				 */
 				void Lock();
+
+				/**
+				 * @brief Lock захват монопольной блокировки
+				 * (прерывается отменой области сопрограммы)
+				 * @param err буфер для записи ошибки (OperationAborted при отмене)
+				 */
+				void Lock( Error &err );
+
+				/**
+				 * @brief Lock захват монопольной блокировки с ограничением по времени
+				 * @param deadline крайний срок ожидания
+				 * @return true, если блокировка захвачена, false - если истёк срок
+				 * или ожидание прервано отменой области сопрограммы
+				 */
+				bool Lock( const DeadlineType &deadline );
 				
 				/// Попытка захвата разделяемой блокировки
 				bool TrySharedLock();
 
-				/// Захват разделяемой блокировки
+				/**
+				 * @brief SharedLock захват разделяемой блокировки
+				 * (отменой области сопрограммы не прерывается)
+				 */
 				void SharedLock();
 
+				/**
+				 * @brief SharedLock захват разделяемой блокировки
+				 * (прерывается отменой области сопрограммы)
+				 * @param err буфер для записи ошибки (OperationAborted при отмене)
+				 */
+				void SharedLock( Error &err );
+
+				/**
+				 * @brief SharedLock захват разделяемой блокировки с ограничением по времени
+				 * @param deadline крайний срок ожидания
+				 * @return true, если блокировка захвачена, false - если истёк срок
+				 * или ожидание прервано отменой области сопрограммы
+				 */
+				bool SharedLock( const DeadlineType &deadline );
+
 				/// Освобождение блокировки
 				void Unlock();
 		};
 
-		class Semaphore: public ServiceWorker
+		class Semaphore: public SyncPrimitive
 		{
 			private:
 				/// Счётчик
 				std::atomic<uint64_t> Counter;
 
-				/// Очередь ожидающих сопрограмм
-				LockFree::DigitsQueue Waiters;
-
 				/// Попытка уменьшения счётчика на 1 (его значение не может быть < 0)
 				bool TryDecrement();
 
-				/**
-				 * @brief AwakeCoro "пробудить" сопрограмму: добавить в
-				 * Service задачу перехода к сопрограмме
-				 * @param ptr элемент очереди Waiters
-				 */
-				void AwakeCoro( Coroutine *coro_ptr );
-
 			public:
 				Semaphore();
 				~Semaphore();
@@ -89,18 +294,34 @@ namespace Bicycle
 				/// Увеличение счётчика на 1
 				void Push();
 
-				/// Ожидание установления счётчика > 1 и его уменьшение на 1
+				/**
+				 * @brief Pop ожидание установления счётчика > 1 и его уменьшение на 1
+				 * (отменой области сопрограммы не прерывается)
+				 */
 				void Pop();
+
+				/**
+				 * @brief Pop ожидание установления счётчика > 1 и его уменьшение на 1
+				 * (прерывается отменой области сопрограммы)
+				 * @param err буфер для записи ошибки (OperationAborted при отмене)
+				 */
+				void Pop( Error &err );
+
+				/**
+				 * @brief Pop ожидание установления счётчика > 1 и его
+				 * уменьшение на 1 с ограничением по времени
+				 * @param deadline крайний срок ожидания
+				 * @return true, если счётчик уменьшен, false - если истёк срок
+				 * или ожидание прервано отменой области сопрограммы
+				 */
+				bool Pop( const DeadlineType &deadline );
 		};
 
-		class Event: public ServiceWorker
+		class Event: public SyncPrimitive
 		{
 			private:
-				/// Флаг состояния (-1 - событие активно, иначе - показывает длину очереди ожидающих)
-				std::atomic<int64_t> StateFlag;
-
-				/// Очередь ожидающих сопрограмм
-				LockFree::DigitsQueue Waiters;
+				/// Флаг активности события
+				std::atomic<bool> Active;
 
 			public:
 				Event();
@@ -112,8 +333,218 @@ namespace Bicycle
 				/// Сброс события (будет неактивен)
 				void Reset();
 
-				/// Ожидание активности события
+				/**
+				 * @brief Wait ожидание активности события
+				 * (отменой области сопрограммы не прерывается)
+				 */
 				void Wait();
+
+				/**
+				 * @brief Wait ожидание активности события
+				 * (прерывается отменой области сопрограммы)
+				 * @param err буфер для записи ошибки (OperationAborted при отмене)
+				 */
+				void Wait( Error &err );
+
+				/**
+				 * @brief Wait ожидание активности события с ограничением по времени
+				 * @param deadline крайний срок ожидания
+				 * @return true, если событие активно, false - если истёк срок
+				 * или ожидание прервано отменой области сопрограммы
+				 */
+				bool Wait( const DeadlineType &deadline );
+		};
+
+		/// Разделяемый мьютекс, масштабируемый по читателям: у каждого потока свой
+		/// счётчик читателей на отдельной кэш-линии (разделяемый захват и освобождение
+		/// не затрагивают общих данных, пока нет писателя), писатель суммирует счётчики.
+		/// Писатели имеют приоритет: после появления писателя новые читатели ждут
+		class DistributedSharedMutex: public SyncPrimitive
+		{
+			public:
+				/// Размер кэш-линии
+				static const size_t CacheLineSize = LockFree::CacheLineSize;
+
+			private:
+				/// Счётчик читателей, занимающий кэш-линию целиком
+				/// (может уходить в минус: освободить блокировку можно в другом потоке)
+				struct ReaderSlot
+				{
+					std::atomic<int64_t> Count;
+					uint8_t Padding[ CacheLineSize - sizeof( std::atomic<int64_t> ) ];
+				};
+
+				/// Состояние писателя: 0 - нет, 1 - монопольная блокировка захвачена
+				/// (либо писатель ждёт выхода читателей), 2 - то же и, возможно,
+				/// есть ожидающие сопрограммы
+				std::atomic<uint8_t> WriterState;
+
+				/// Количество счётчиков читателей
+				const uint8_t SlotsNum;
+
+				/// Память под счётчики читателей (с запасом на выравнивание)
+				std::unique_ptr<uint8_t[]> SlotsBuf;
+
+				/// Счётчики читателей (выровнены по кэш-линии)
+				ReaderSlot *Slots;
+
+				/// Событие выхода читателя при ожидающем писателе
+				Event ReaderLeft;
+
+				/// Счётчик читателей текущего потока
+				ReaderSlot& CurrentSlot();
+
+				/// Суммарное количество читателей
+				int64_t ReadersCount() const;
+
+				/// Выход читателя (будит писателя, ожидающего выхода читателей)
+				void ReaderExit( ReaderSlot &slot );
+
+				/// Попытка разделяемого захвата, либо пометка о наличии ожидающих
+				/// (вызывается под блокировкой Guard)
+				bool TrySharedLockOrMark();
+
+				/**
+				 * @brief WaitReaders ожидание выхода читателей писателем,
+				 * захватившим монопольную блокировку
+				 * @param deadline крайний срок ожидания
+				 * @return true, если читателей не осталось, false - если истёк срок
+				 * или ожидание прервано отменой области сопрограммы
+				 */
+				bool WaitReaders( const DeadlineType &deadline );
+
+				/**
+				 * @brief HandOff передача монопольной блокировки первой ожидающей сопрограмме,
+				 * либо впуск читателей из начала очереди (и передача блокировки писателю
+				 * за ними), либо её освобождение (вызывается писателем под блокировкой Guard)
+				 * @param woken список сопрограмм, которым передана блокировка
+				 */
+				void HandOff( SyncWakeList &woken );
+
+			public:
+				/**
+				 * @brief DistributedSharedMutex
+				 * @param slots_num количество счётчиков читателей (потоки сервиса
+				 * получают их по номеру, при большем числе потоков счётчики делятся;
+				 * 0 - по количеству потоков, выполняющих сервис при создании)
+				 */
+				explicit DistributedSharedMutex( uint8_t slots_num = 0 );
+				~DistributedSharedMutex();
+
+				/// Количество счётчиков читателей
+				uint8_t GetReaderSlotsNum() const;
+
+				/// Попытка захвата монопольной блокировки
+				bool TryLock();
+
+				/**
+				 * @brief Lock захват монопольной блокировки
+				 * (отменой области сопрограммы не прерывается)
+				 */
+				void Lock();
+
+				/**
+				 * @brief Lock захват монопольной блокировки
+				 * (прерывается отменой области сопрограммы)
+				 * @param err буфер для записи ошибки (OperationAborted при отмене)
+				 */
+				void Lock( Error &err );
+
+				/**
+				 * @brief Lock захват монопольной блокировки с ограничением по времени
+				 * @param deadline крайний срок ожидания
+				 * @return true, если блокировка захвачена, false - если истёк срок
+				 * или ожидание прервано отменой области сопрограммы
+				 */
+				bool Lock( const DeadlineType &deadline );
+
+				/// Освобождение монопольной блокировки
+				void Unlock();
+
+				/// Попытка захвата разделяемой блокировки
+				bool TrySharedLock();
+
+				/**
+				 * @brief SharedLock захват разделяемой блокировки
+				 * (отменой области сопрограммы не прерывается)
+				 */
+				void SharedLock();
+
+				/**
+				 * @brief SharedLock захват разделяемой блокировки
+				 * (прерывается отменой области сопрограммы)
+				 * @param err буфер для записи ошибки (OperationAborted при отмене)
+				 */
+				void SharedLock( Error &err );
+
+				/**
+				 * @brief SharedLock захват разделяемой блокировки с ограничением по времени
+				 * @param deadline крайний срок ожидания
+				 * @return true, если блокировка захвачена, false - если истёк срок
+				 * или ожидание прервано отменой области сопрограммы
+				 */
+				bool SharedLock( const DeadlineType &deadline );
+
+				/// Освобождение разделяемой блокировки
+				void SharedUnlock();
+		};
+
+		class CondDeadlineNode;
+
+		/// Условная переменная, используемая вместе с Mutex
+		class ConditionVariable: public SyncPrimitive
+		{
+			friend class CondDeadlineNode;
+
+			private:
+				/**
+				 * @brief RequeueFront перенос первой ожидающей сопрограммы в очередь
+				 * её мьютекса (вызывается под блокировкой Guard)
+				 * @param woken список, в который переносится сопрограмма, если мьютекс свободен
+				 * @return true, если очередь была не пуста
+				 */
+				bool RequeueFront( SyncWakeList &woken );
+
+			public:
+				ConditionVariable();
+				~ConditionVariable();
+
+				/**
+				 * @brief Wait освобождение мьютекса и ожидание уведомления
+				 * (сопрограмма встаёт в очередь до освобождения мьютекса,
+				 * поэтому уведомление не может быть пропущено)
+				 * @param mut мьютекс, захваченный текущей сопрограммой
+				 * (по возвращении снова захвачен; отменой области не прерывается)
+				 */
+				void Wait( Mutex &mut );
+
+				/**
+				 * @brief Wait освобождение мьютекса и ожидание уведомления
+				 * (прерывается отменой области сопрограммы)
+				 * @param mut мьютекс, захваченный текущей сопрограммой
+				 * (по возвращении снова захвачен, в т.ч. при отмене)
+				 * @param err буфер для записи ошибки (OperationAborted при отмене)
+				 */
+				void Wait( Mutex &mut, Error &err );
+
+				/**
+				 * @brief Wait освобождение мьютекса и ожидание уведомления
+				 * с ограничением по времени
+				 * @param mut мьютекс, захваченный текущей сопрограммой
+				 * (по возвращении снова захвачен, в т.ч. по истечении срока и при отмене)
+				 * @param deadline крайний срок ожидания
+				 * @return true, если получено уведомление, false - если истёк срок
+				 * или ожидание прервано отменой области сопрограммы
+				 */
+				bool Wait( Mutex &mut, const DeadlineType &deadline );
+
+				/// Уведомление первой ожидающей сопрограммы
+				/// (переносится в очередь мьютекса)
+				void NotifyOne();
+
+				/// Уведомление всех ожидающих сопрограмм (переносятся в очередь
+				/// мьютекса и получают его по очереди, а не все разом)
+				void NotifyAll();
 		};
 	} // namespace CoroService
 } // namespace Bicycle
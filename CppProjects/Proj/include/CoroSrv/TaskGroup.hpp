@@ -0,0 +1,84 @@
+#pragma once
+#include "CoroSrv/Sync.hpp"
+
+namespace Bicycle
+{
+	namespace CoroService
+	{
+		/**
+		 * @brief The TaskGroup class группа сопрограмм: запуск, ожидание завершения
+		 * всех сопрограмм группы и их отмена. После отмены ожидания сопрограмм группы
+		 * прерываются: ввод-вывод, Timer::Wait, Ticker::Wait и SleepFor/SleepUntil
+		 * завершаются с ошибкой OperationAborted, ожидания объектов синхронизации
+		 * с крайним сроком возвращают false, с буфером ошибки - завершаются с ошибкой
+		 * OperationAborted (ожидания без параметров не прерываются)
+		 */
+		class TaskGroup: public ServiceWorker
+		{
+			private:
+				/// Общее состояние группы и её сопрограмм
+				struct GroupState
+				{
+					/// Область отмены сопрограмм группы
+					CancelScope Scope;
+
+					/// Мьютекс, защищающий Running
+					Mutex Lock;
+
+					/// Условная переменная завершения всех сопрограмм группы
+					ConditionVariable AllDone;
+
+					/// Количество незавершённых сопрограмм группы
+					uint64_t Running;
+
+					GroupState( Service &srv );
+
+					/// Учёт завершения сопрограммы группы
+					void OnFinished();
+				};
+
+				/// Общее состояние (сопрограммы группы могут пережить объект)
+				std::shared_ptr<GroupState> State;
+
+			public:
+				TaskGroup( const TaskGroup& ) = delete;
+				TaskGroup& operator=( const TaskGroup& ) = delete;
+
+				TaskGroup();
+
+				/// Деструктор не ждёт завершения сопрограмм группы (для этого есть Join)
+				~TaskGroup();
+
+				/**
+				 * @brief Go создание сопрограммы группы
+				 * @param task исполняемая задача
+				 * @param stack_sz размер стека новой сопрограммы
+				 * @return Ошибка выполнения (OperationAborted, если группа отменена)
+				 * @throw Exception, если выполняется не внутри сервиса или
+				 * std::invalid_argument, если task - "пустышка"
+				 */
+				Error Go( std::function<void()> task, size_t stack_sz = 0 );
+
+				/// Отмена группы: прерывание ожиданий её сопрограмм
+				/// (новые сопрограммы в группе не создаются)
+				void Cancel();
+
+				/// Была ли группа отменена
+				bool IsCancelled() const;
+
+				/**
+				 * @brief Join ожидание завершения всех сопрограмм группы
+				 * (не прерывается отменой области; !!! не вызывать из сопрограммы самой группы !!!)
+				 */
+				void Join();
+
+				/**
+				 * @brief Join ожидание завершения всех сопрограмм группы с ограничением по времени
+				 * @param deadline крайний срок ожидания
+				 * (не прерывается отменой области текущей сопрограммы)
+				 * @return true, если все сопрограммы завершены, false - если истёк срок
+				 */
+				bool Join( const DeadlineType &deadline );
+		};
+	} // namespace CoroService
+} // namespace Bicycle
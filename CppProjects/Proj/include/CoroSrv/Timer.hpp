@@ -1,6 +1,5 @@
 ﻿#pragma once
 #include "CoroSrv/Service.hpp"
-#include <condition_variable>
 
 namespace Bicycle
 {
@@ -18,73 +17,79 @@ namespace Bicycle
 		class Timer: public AbstractCloser
 		{
 			private:
-				//typedef std::chrono::steady_clock ClockType;
-				typedef std::chrono::system_clock ClockType;
-
-				class TimerThread
+				/// Элемент списка сопрограмм, ждущих сработки таймера (хранится в стеке сопрограммы)
+				struct WaiterElem
 				{
-					private:
-						/// Флаг, показывающий, нужно ли продолжать работу
-						std::atomic<bool> RunFlag;
+					/// Указатель на сопрограмму
+					Coroutine *Coro;
 
-						/// Рабочий поток
-						std::thread WorkThread;
+					/// Причина пробуждения:
+					/// 0 - таймер сработал
+					/// < 0 - таймер сработал до начала ожидания
+					/// > 0 - ожидание было отменено
+					int8_t Flag;
 
-						std::condition_variable Cv;
-						std::mutex Mut;
+					/// Следующий элемент списка
+					WaiterElem *Next;
+				};
 
-						typedef std::chrono::time_point<ClockType> time_type;
-						typedef std::function<void()> task_type;
-						typedef std::pair<time_type, task_type> elem_type;
+				/// Узел очереди таймеров сервиса
+				class ExpiryNode: public TimerNode
+				{
+					private:
+						Timer &Owner;
 
-						/// Задачи для таймера
-						LockFree::ForwardList<elem_type> Tasks;
+					public:
+						ExpiryNode( Timer &owner );
+						virtual Coroutine* OnDeadline() override;
+				};
 
-						/// Задача рабочего потока
-						void ThreadFunc();
+				/// Узел, прерывающий ожидание одной сопрограммы при отмене её области
+				class CancelNode: public TimerNode
+				{
+					private:
+						Timer &Owner;
+						WaiterElem &ElemRef;
 
 					public:
-						TimerThread();
-						~TimerThread();
-
-						/**
-						 * @brief Post добавление задачи в очередь таймера
-						 * @param task задача
-						 * @param timeout_microsec время (в микросекундах)
-						 * спустя которое задача должна быть выполнена
-						 */
-						void Post( const std::function<void()> &task, uint64_t timeout_microsec );
+						CancelNode( Timer &owner, WaiterElem &elem );
+						virtual Coroutine* OnDeadline() override;
 				};
 
-				static std::shared_ptr<TimerThread> GetTimerThread();
+				/// Узел, которым таймер ставится в очередь сервиса
+				ExpiryNode Node;
 
-				/// Указатель на поток таймера
-				const std::shared_ptr<TimerThread> SharedTimerPtr;
+				/// Объект синхронизации постановки узла в очередь таймеров и снятия с неё
+				/// (порядок блокировок: ArmLock, очередь таймеров сервиса, Lock)
+				SpinLock ArmLock;
 
-				/// Структура "работника" для пробуждения сопрграмм при сработке таймера
-				struct TimerWorker
-				{
-					/// Флаг для однократного выполнения работы
-					std::atomic<bool> Flag;
+				/// Объект синхронизации доступа к Active и Waiters
+				SpinLock Lock;
 
-					// first - указатель на сопрограмму, second - указатель на флаг причины сработки^
-					// 0 - таймер сработал
-					// < 0 - таймер сработал до начала ожидания
-					// > 0 - ожидание было отменено
-					typedef std::pair<Coroutine*, int8_t*> element_t;
+				/// Таймер активен (ещё не сработал и не отменён)
+				bool Active;
 
-					/// Список сопрограмм, ждущих сработки таймера
-					LockFree::ForwardList<element_t> Waiters;
-				};
+				/// Список сопрограмм, ждущих сработки таймера
+				WaiterElem *Waiters;
 
-				SharedSpinLock WorkerPtrLock;
-				std::weak_ptr<TimerWorker> WorkerPtr;
+				/**
+				 * @brief ReleaseWaiters извлечение всех ожидающих сопрограмм
+				 * (под блокировкой Lock)
+				 * @param flag причина пробуждения
+				 * @return список ожидающих сопрограмм
+				 */
+				WaiterElem* ReleaseWaiters( int8_t flag );
+
+				/// Отмена ожидания без проверки состояния сервиса
+				void CancelWaiters();
 
 			public:
 				Timer();
+				~Timer();
 
 				/**
 				 * @brief ExpiresAfter настраивает время сработки таймера
+				 * (с допустимым запаздыванием по умолчанию для сервиса)
 				 * @param microseconds время в микросекундах, через
 				 * которое таймер будет активен
 				 * @param err буфер для записи ошибки выполнения
@@ -93,12 +98,32 @@ namespace Bicycle
 
 				/**
 				 * @brief ExpiresAfter настраивает время сработки таймера
+				 * (с допустимым запаздыванием по умолчанию для сервиса)
 				 * @param microseconds время в микросекундах, через
 				 * которое таймер будет активен
 				 * @throw Exception в случае ошибки
 				 */
 				void ExpiresAfter( uint64_t microseconds );
 
+				/**
+				 * @brief ExpiresAfter настраивает время сработки таймера
+				 * @param microseconds время в микросекундах, через
+				 * которое таймер будет активен
+				 * @param slack_microseconds допустимое запаздывание сработки в микросекундах
+				 * (таймеры, сроки которых попадают в одно окно, срабатывают за одно пробуждение)
+				 * @param err буфер для записи ошибки выполнения
+				 */
+				void ExpiresAfter( uint64_t microseconds, uint64_t slack_microseconds, Error &err );
+
+				/**
+				 * @brief ExpiresAfter настраивает время сработки таймера
+				 * @param microseconds время в микросекундах, через
+				 * которое таймер будет активен
+				 * @param slack_microseconds допустимое запаздывание сработки в микросекундах
+				 * @throw Exception в случае ошибки
+				 */
+				void ExpiresAfter( uint64_t microseconds, uint64_t slack_microseconds );
+
 				/**
 				 * @brief Wait ожидание срабатывания таймера
 				 * @param err буфер для записи ошибки выполнения
@@ -132,6 +157,163 @@ namespace Bicycle
 				virtual void Close( Error &err ) override final;
 		};
 
-		// TODO: ??? запилить (в линуксе) с использованием timerfd_create, timerfd_settime, timerfd_gettime ???
+		/**
+		 * @brief SleepUntil приостановка текущей сопрограммы до наступления срока
+		 * (без выделения памяти: узел таймера хранится в стеке сопрограммы;
+		 * используется допустимое запаздывание по умолчанию для сервиса).
+		 * Остановка сервиса прерывает ожидание (ошибка SrvStop), отмена
+		 * области сопрограммы - тоже (ошибка OperationAborted)
+		 * @param deadline срок
+		 * @param err буфер для записи ошибки выполнения
+		 */
+		void SleepUntil( const DeadlineType &deadline, Error &err );
+
+		/**
+		 * @brief SleepUntil приостановка текущей сопрограммы до наступления срока
+		 * @param deadline срок
+		 * @throw Exception в случае ошибки
+		 */
+		void SleepUntil( const DeadlineType &deadline );
+
+		/**
+		 * @brief SleepFor приостановка текущей сопрограммы на заданное время
+		 * (аналогично SleepUntil)
+		 * @param microseconds время в микросекундах
+		 * @param err буфер для записи ошибки выполнения
+		 */
+		void SleepFor( uint64_t microseconds, Error &err );
+
+		/**
+		 * @brief SleepFor приостановка текущей сопрограммы на заданное время
+		 * @param microseconds время в микросекундах
+		 * @throw Exception в случае ошибки
+		 */
+		void SleepFor( uint64_t microseconds );
+
+		/// Периодический таймер. Моменты "тиков" отсчитываются от момента
+		/// создания (запаздывание одного "тика" не сдвигает следующие),
+		/// ожидание "тика" не требует выделения памяти.
+		/// Ожидать "тика" может только одна сопрограмма одновременно
+		class Ticker: public AbstractCloser
+		{
+			private:
+				/// Узел очереди таймеров сервиса
+				class TickNode: public TimerNode
+				{
+					public:
+						/// Ссылка на тикер
+						Ticker &Owner;
+
+						/// Указатель на ожидающую сопрограмму
+						Coroutine *Coro;
+
+						/// Сопрограмма приостановлена и ещё не "пробуждена" (под WaitLock)
+						bool Waiting;
+
+						/// Ожидание было отменено (под WaitLock)
+						bool Aborted;
+
+						TickNode( Ticker &owner );
+						virtual Coroutine* OnDeadline() override;
+				};
+
+				/// Узел, прерывающий ожидание "тика" при отмене области сопрограммы
+				class CancelNode: public TimerNode
+				{
+					private:
+						Ticker &Owner;
+
+					public:
+						CancelNode( Ticker &owner );
+						virtual Coroutine* OnDeadline() override;
+				};
+
+				/// Период в микросекундах
+				const uint64_t PeriodMicrosec;
+
+				/// Допустимое запаздывание "тика" в микросекундах
+				const uint64_t SlackMicrosec;
+
+				/// Момент следующего "тика" (изменяется только ожидающей сопрограммой)
+				DeadlineType NextTick;
+
+				/// Узел, которым тикер ставится в очередь сервиса
+				TickNode Node;
+
+				/// Объект синхронизации постановки узла в очередь и его снятия при отмене
+				/// (порядок блокировок: ArmLock, очередь таймеров сервиса, WaitLock)
+				SpinLock ArmLock;
+
+				/// Объект синхронизации "пробуждения" ожидающей сопрограммы
+				SpinLock WaitLock;
+
+				/// Ожидание отменено до постановки узла в очередь
+				bool Cancelled;
+
+				/**
+				 * @brief ConsumeTicks учёт "тиков", наступивших к моменту now
+				 * @param now текущий момент
+				 * @return количество наступивших "тиков"
+				 */
+				uint64_t ConsumeTicks( const DeadlineType &now );
+
+				/// Отмена ожидания без проверки состояния сервиса
+				void CancelWait();
+
+			public:
+				/**
+				 * @brief Ticker конструктор (с допустимым запаздыванием по умолчанию для сервиса)
+				 * @param period_microseconds период в микросекундах
+				 * @throw std::invalid_argument, если период нулевой
+				 */
+				Ticker( uint64_t period_microseconds );
+
+				/**
+				 * @brief Ticker конструктор
+				 * @param period_microseconds период в микросекундах
+				 * @param slack_microseconds допустимое запаздывание "тика" в микросекундах
+				 * (ограничивается половиной периода)
+				 * @throw std::invalid_argument, если период нулевой
+				 */
+				Ticker( uint64_t period_microseconds, uint64_t slack_microseconds );
+
+				~Ticker();
+
+				/**
+				 * @brief Wait ожидание очередного "тика"
+				 * @param err буфер для записи ошибки выполнения
+				 * @return количество "тиков", наступивших с предыдущего вызова
+				 * (больше 1, если сопрограмма не успевала их обрабатывать), 0 - в случае ошибки
+				 * (OperationAborted - при отмене ожидания или области сопрограммы)
+				 */
+				uint64_t Wait( Error &err );
+
+				/**
+				 * @brief Wait ожидание очередного "тика"
+				 * @return количество "тиков", наступивших с предыдущего вызова
+				 * @throw Exception в случае ошибки
+				 */
+				uint64_t Wait();
+
+				/**
+				 * @brief Cancel отмена ожидания "тика"
+				 * (ожидающая сопрограмма получит код ошибки OperationAborted)
+				 * @param err ссылка на ошибку, куда будет записан результат операции
+				 */
+				void Cancel( Error &err );
+
+				/**
+				 * @brief Cancel отмена ожидания "тика"
+				 * (ожидающая сопрограмма получит код ошибки OperationAborted)
+				 * @throw Exception в случае ошибки
+				 */
+				void Cancel();
+
+				/**
+				 * @brief Close закрытие тикера, отмена ожидания
+				 * @param err буфер для записи ошибки
+				 */
+				virtual void Close( Error &err ) override final;
+		};
 	} // namespace CoroService
 } // namespace Bicycle
@@ -5,6 +5,12 @@
 #include <stdexcept>
 #include <vector>
 #include <memory>
+#include <algorithm>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <cstddef>
+#include <thread>
 
 #ifndef MY_ASSERT
 #define MY_ASSERT( EXPR )
@@ -195,9 +201,377 @@ namespace LockFree
 		}
 	} // namespace internal
 
+	/// Размер кэш-линии (для разнесения счётчиков, изменяемых разными потоками)
+	const size_t CacheLineSize = 64;
 
-	/// Класс потоконебезопасного однонаправленного списка
+	namespace internal
+	{
+		/// Отступ в кэш-линию
+		struct CacheLinePadding
+		{
+			uint8_t LeadingPadding[ CacheLineSize ];
+		};
+	} // namespace internal
+
+	/**
+	 * @brief The PaddedAtomic class атомарная переменная в собственной кэш-линии:
+	 * отступы до и после неё отделяют её от соседних полей и элементов массива
+	 * (отступы, а не alignas: выделение памяти в C++11 не учитывает выравнивание
+	 * больше стандартного, и от адреса объекта разнесение не зависит)
+	 */
 	template <typename T>
+	struct PaddedAtomic: private internal::CacheLinePadding, public std::atomic<T>
+	{
+		static_assert( sizeof( std::atomic<T> ) < CacheLineSize, "Atomic is too large" );
+
+		uint8_t Padding[ CacheLineSize - sizeof( std::atomic<T> ) ];
+
+		PaddedAtomic(): std::atomic<T>( T() ) {}
+		PaddedAtomic( T val ): std::atomic<T>( val ) {}
+
+		PaddedAtomic( const PaddedAtomic& ) = delete;
+		PaddedAtomic& operator=( const PaddedAtomic& ) = delete;
+
+		T operator=( T val )
+		{
+			return std::atomic<T>::operator=( val );
+		}
+	};
+
+	/**
+	 * @brief The NodePool class пул блоков памяти одного размера с кэшем у каждого потока.
+	 * Блок помнит кэш, из которого выделен: освобождённый "своим" потоком блок
+	 * возвращается в его кэш без атомарных операций, освобождённые другими потоками
+	 * копятся у освобождающего и возвращаются владельцу пачкой (одной операцией CAS).
+	 * Кэши потоков не удаляются, а переходят к новым потокам
+	 * @tparam BlockSize размер блока (без заголовка)
+	 */
+	template <size_t BlockSize>
+	class NodePool
+	{
+		private:
+			struct ThreadCache;
+
+			/// Заголовок блока
+			struct Block
+			{
+				/// Кэш, из которого выделен блок (nullptr - выделен без кэша)
+				ThreadCache *Owner;
+
+				/// Следующий свободный блок
+				Block *Next;
+			};
+
+			/// Размер заголовка с выравниванием полезной части блока
+			static const size_t HeaderSize = ( sizeof( Block ) + alignof( std::max_align_t ) - 1 ) &
+			                                 ~( alignof( std::max_align_t ) - 1 );
+
+			/// Максимальное количество блоков в кэше потока (лишние освобождаются)
+			static const size_t MaxLocalNum = 0x1000;
+
+			/// Размер пачки блоков, возвращаемой владельцу
+			static const size_t BatchSize = 32;
+
+			/// Кэш потока
+			struct ThreadCache
+			{
+				/// Свободные блоки (доступны только потоку-владельцу кэша)
+				Block *LocalFree;
+
+				/// Количество блоков в LocalFree (без учёта забранных из RemoteFree)
+				size_t LocalNum;
+
+				/// Копящаяся пачка блоков чужого кэша BatchOwner
+				Block *BatchHead;
+				Block *BatchTail;
+				size_t BatchNum;
+				ThreadCache *BatchOwner;
+
+				/// Блоки, возвращённые другими потоками
+				PaddedAtomic<Block*> RemoteFree;
+
+				/// Показывает, что кэш закреплён за потоком
+				std::atomic<bool> Busy;
+
+				/// Следующий кэш списка
+				ThreadCache *NextCache;
+
+				ThreadCache(): LocalFree( nullptr ), LocalNum( 0 ),
+				               BatchHead( nullptr ), BatchTail( nullptr ),
+				               BatchNum( 0 ), BatchOwner( nullptr ),
+				               RemoteFree( nullptr ), Busy( true ), NextCache( nullptr ) {}
+
+				/// Возврат накопленной пачки владельцу
+				void FlushBatch()
+				{
+					if( BatchHead == nullptr )
+					{
+						return;
+					}
+
+					MY_ASSERT( ( BatchOwner != nullptr ) && ( BatchTail != nullptr ) );
+					Block *old_head = BatchOwner->RemoteFree.load();
+					do
+					{
+						BatchTail->Next = old_head;
+					}
+					while( !BatchOwner->RemoteFree.compare_exchange_weak( old_head, BatchHead ) );
+
+					BatchHead = BatchTail = nullptr;
+					BatchNum = 0;
+					BatchOwner = nullptr;
+				}
+			};
+
+			/// Отдаёт кэш при завершении потока
+			struct CacheHolder
+			{
+				~CacheHolder()
+				{
+					ThreadCache *&cache_ptr = CurrentPtr();
+					if( cache_ptr != nullptr )
+					{
+						cache_ptr->FlushBatch();
+						cache_ptr->Busy.store( false );
+						cache_ptr = nullptr;
+					}
+					CacheState() = 2;
+				}
+			};
+
+			/// Список кэшей потоков (только растёт)
+			static std::atomic<ThreadCache*>& Caches()
+			{
+				static std::atomic<ThreadCache*> caches( nullptr );
+				return caches;
+			}
+
+			/// Кэш текущего потока (тривиальная переменная потока доступна
+			/// и при его завершении)
+			static ThreadCache*& CurrentPtr()
+			{
+				static thread_local ThreadCache *ptr = nullptr;
+				return ptr;
+			}
+
+			/// Состояние кэша потока: 0 - не получен, 1 - получен, 2 - отдан
+			static uint8_t& CacheState()
+			{
+				static thread_local uint8_t state = 0;
+				return state;
+			}
+
+			/// Закрепление кэша за текущим потоком
+			static ThreadCache* Register()
+			{
+				// Сначала ищем кэш, освобождённый завершившимся потоком
+				for( ThreadCache *cache = Caches().load(); cache != nullptr; cache = cache->NextCache )
+				{
+					bool expected = false;
+					if( cache->Busy.compare_exchange_strong( expected, true ) )
+					{
+						return cache;
+					}
+				}
+
+				ThreadCache *cache = new ThreadCache;
+				cache->NextCache = Caches().load();
+				while( !Caches().compare_exchange_weak( cache->NextCache, cache ) ) {}
+				return cache;
+			}
+
+			/// Кэш текущего потока (nullptr - если поток уже завершается)
+			static ThreadCache* Current()
+			{
+				uint8_t &state = CacheState();
+				if( state == 0 )
+				{
+					static thread_local CacheHolder holder;
+					CurrentPtr() = Register();
+					state = 1;
+				}
+				return CurrentPtr();
+			}
+
+			static void* Payload( Block *block )
+			{
+				return reinterpret_cast<uint8_t*>( block ) + HeaderSize;
+			}
+
+			static Block* GetBlock( void *ptr )
+			{
+				return reinterpret_cast<Block*>( reinterpret_cast<uint8_t*>( ptr ) - HeaderSize );
+			}
+
+		public:
+			NodePool() = delete;
+
+			/**
+			 * @brief Allocate выделение блока
+			 * @return указатель на память размером BlockSize
+			 * @throw std::bad_alloc, если не удалось выделить память
+			 */
+			static void* Allocate()
+			{
+				ThreadCache *cache = Current();
+				if( cache == nullptr )
+				{
+					Block *block = reinterpret_cast<Block*>( ::operator new( HeaderSize + BlockSize ) );
+					block->Owner = nullptr;
+					return Payload( block );
+				}
+
+				if( cache->LocalFree == nullptr )
+				{
+					// Забираем возвращённые другими потоками блоки
+					cache->LocalFree = cache->RemoteFree.exchange( nullptr );
+					cache->LocalNum = 0;
+				}
+
+				Block *block = cache->LocalFree;
+				if( block != nullptr )
+				{
+					cache->LocalFree = block->Next;
+					if( cache->LocalNum > 0 )
+					{
+						--cache->LocalNum;
+					}
+				}
+				else
+				{
+					block = reinterpret_cast<Block*>( ::operator new( HeaderSize + BlockSize ) );
+					block->Owner = cache;
+				}
+
+				return Payload( block );
+			} // static void* Allocate()
+
+			/**
+			 * @brief Free освобождение блока, выделенного Allocate
+			 * @param ptr указатель на блок (nullptr игнорируется)
+			 */
+			static void Free( void *ptr )
+			{
+				if( ptr == nullptr )
+				{
+					return;
+				}
+
+				Block *block = GetBlock( ptr );
+				ThreadCache *cache = Current();
+				if( cache == nullptr )
+				{
+					// Поток завершается: блок возвращается владельцу напрямую
+					if( block->Owner == nullptr )
+					{
+						::operator delete( block );
+						return;
+					}
+
+					ThreadCache *owner = block->Owner;
+					Block *old_head = owner->RemoteFree.load();
+					do
+					{
+						block->Next = old_head;
+					}
+					while( !owner->RemoteFree.compare_exchange_weak( old_head, block ) );
+					return;
+				}
+
+				if( ( block->Owner == cache ) || ( block->Owner == nullptr ) )
+				{
+					if( cache->LocalNum >= MaxLocalNum )
+					{
+						::operator delete( block );
+						return;
+					}
+
+					block->Owner = cache;
+					block->Next = cache->LocalFree;
+					cache->LocalFree = block;
+					++cache->LocalNum;
+					return;
+				}
+
+				// Блок чужого кэша - в пачку для владельца
+				if( cache->BatchOwner != block->Owner )
+				{
+					cache->FlushBatch();
+					cache->BatchOwner = block->Owner;
+				}
+
+				block->Next = cache->BatchHead;
+				cache->BatchHead = block;
+				if( cache->BatchTail == nullptr )
+				{
+					cache->BatchTail = block;
+				}
+
+				if( ++cache->BatchNum >= BatchSize )
+				{
+					cache->FlushBatch();
+				}
+			} // static void Free( void *ptr )
+	}; // class NodePool
+
+	/// Распределитель элементов контейнеров через new/delete (используется по умолчанию)
+	struct NewAllocator
+	{
+		template <typename E, typename ...Types>
+		static E* New( Types&& ...args )
+		{
+			return new E( std::forward<Types>( args )... );
+		}
+
+		template <typename E>
+		static void Delete( E *ptr )
+		{
+			delete ptr;
+		}
+	};
+
+	/// Распределитель элементов контейнеров через NodePool: в установившемся
+	/// режиме добавление и извлечение элементов не обращаются к куче
+	struct PoolAllocator
+	{
+		/// Размер блока пула для элементов типа E (кратен 16, чтобы близкие
+		/// по размеру типы пользовались общим пулом)
+		template <typename E>
+		struct PoolFor
+		{
+			typedef NodePool<( sizeof( E ) + 15 ) & ~( size_t ) 15> Type;
+		};
+
+		template <typename E, typename ...Types>
+		static E* New( Types&& ...args )
+		{
+			static_assert( alignof( E ) <= alignof( std::max_align_t ), "Overaligned type" );
+			void *mem = PoolFor<E>::Type::Allocate();
+			try
+			{
+				return new( mem ) E( std::forward<Types>( args )... );
+			}
+			catch( ... )
+			{
+				PoolFor<E>::Type::Free( mem );
+				throw;
+			}
+		}
+
+		template <typename E>
+		static void Delete( E *ptr )
+		{
+			if( ptr != nullptr )
+			{
+				ptr->~E();
+				PoolFor<E>::Type::Free( ptr );
+			}
+		}
+	};
+
+	/// Класс потоконебезопасного однонаправленного списка
+	/// (Allocator - распределитель элементов: NewAllocator или PoolAllocator)
+	template <typename T, typename Allocator = NewAllocator>
 	class UnsafeForwardList
 	{
 		public:
@@ -220,7 +594,7 @@ namespace LockFree
 				{
 					ptr = top;
 					top = top->Next.load();
-					delete ptr;
+					Allocator::Delete( ptr );
 				}
 			}
 
@@ -240,7 +614,7 @@ namespace LockFree
 					ElementType *old_top = Top;
 					Top = Top->Next;
 					T result( std::move( old_top->Value ) );
-					delete old_top;
+					Allocator::Delete( old_top );
 					return result;
 				}
 
@@ -288,7 +662,7 @@ namespace LockFree
 			 */
 			void Push( const T &new_val )
 			{
-				ElementType *new_element = new ElementType( new_val );
+				ElementType *new_element = Allocator::template New<ElementType>( new_val );
 				new_element->Next = Top;
 				Top = new_element;
 			}
@@ -299,7 +673,7 @@ namespace LockFree
 			 */
 			void Push( T &&new_val )
 			{
-				ElementType *new_element = new ElementType( std::move( new_val ) );
+				ElementType *new_element = Allocator::template New<ElementType>( std::move( new_val ) );
 				new_element->Next = Top;
 				Top = new_element;
 			}
@@ -311,7 +685,7 @@ namespace LockFree
 			template <typename ...Types>
 			void Push( Types ...args )
 			{
-				ElementType *new_element = new ElementType( args... );
+				ElementType *new_element = Allocator::template New<ElementType>( args... );
 				new_element->Next = Top;
 				Top = new_element;
 			}
@@ -383,7 +757,7 @@ namespace LockFree
 				{
 					ElementType *old_top = Top;
 					Top = Top->Next.load();
-					delete old_top;
+					Allocator::Delete( old_top );
 				}
 
 				if( Top == nullptr )
@@ -406,7 +780,7 @@ namespace LockFree
 					{
 						// Нужно удалить элемент, следующий за ptr-ом
 						ptr->Next.store( next_ptr->Next.load() );
-						delete next_ptr;
+						Allocator::Delete( next_ptr );
 					}
 					else
 					{
@@ -468,12 +842,13 @@ namespace LockFree
 	};
 
 	/// Класс потокобезопасного однонаправленого списка
-	template <typename T>
+	/// (Allocator - распределитель элементов: NewAllocator или PoolAllocator)
+	template <typename T, typename Allocator = NewAllocator>
 	class ForwardList
 	{
 		public:
 			typedef T Type;
-			typedef UnsafeForwardList<T> Unsafe;
+			typedef UnsafeForwardList<T, Allocator> Unsafe;
 
 		private:
 			typedef internal::StructElementType<T> ElementType;
@@ -498,7 +873,7 @@ namespace LockFree
 				{
 					ptr = top;
 					top = top->Next.load();
-					delete ptr;
+					Allocator::Delete( ptr );
 				}
 			}
 
@@ -509,7 +884,7 @@ namespace LockFree
 			 */
 			bool Push( const T &val )
 			{
-				return internal::PushHead( Top, new ElementType( val ) );
+				return internal::PushHead( Top, Allocator::template New<ElementType>( val ) );
 			}
 
 			/**
@@ -519,7 +894,7 @@ namespace LockFree
 			 */
 			bool Push( T &&val )
 			{
-				return internal::PushHead( Top, new ElementType( std::move( val ) ) );
+				return internal::PushHead( Top, Allocator::template New<ElementType>( std::move( val ) ) );
 			}
 
 			/**
@@ -530,7 +905,7 @@ namespace LockFree
 			template <typename ...Types>
 			bool Push( Types ...args )
 			{
-				return internal::PushHead( Top, new ElementType( args... ) );
+				return internal::PushHead( Top, Allocator::template New<ElementType>( args... ) );
 			}
 
 			/**
@@ -561,718 +936,4326 @@ namespace LockFree
 	class DeferredDeleter
 	{
 		private:
-			/// Абстрактный класс-"хранитель" удаляемого элемента
-			class AbstractPtr
+			typedef std::atomic<uint64_t> EpochType;
+
+			/// Запись об удаляемом объекте (элемент списка потока,
+			/// выделяется из пула без обращения к куче)
+			struct Retired
 			{
-				protected:
-					AbstractPtr( const AbstractPtr& ) = delete;
-					AbstractPtr& operator=( const AbstractPtr& ) = delete;
-					AbstractPtr(){}
+				/// Указатель на удаляемый объект
+				void *Ptr;
 
-				public:
-					virtual ~AbstractPtr() {}
+				/// Функция удаления объекта
+				void ( *Deleter )( void* );
+
+				/// Эпоха, в которой объект добавлен на удаление
+				uint64_t Epoch;
+
+				/// Следующая запись списка
+				Retired *Next;
 			};
 
-			/// Конкретный класс-"хранитель" удаляемого элемента
-			template <typename T>
-			class ConcretePtr: public AbstractPtr
+			/// Удаление объекта типа T распределителем Allocator
+			template <typename T, typename Allocator>
+			static void DeleteObject( void *ptr )
 			{
-				private:
-					T *Ptr;
+				Allocator::Delete( static_cast<T*>( ptr ) );
+			}
 
-				public:
-					ConcretePtr( const ConcretePtr& ) = delete;
-					ConcretePtr& operator=( const ConcretePtr& ) = delete;
+			/// Список удаляемых объектов потока. Добавляет записи только поток-владелец;
+			/// очистка (в том числе из других потоков) забирает весь список одной
+			/// операцией exchange и возвращает неудалённые записи одной операцией CAS,
+			/// поэтому ни владелец, ни очистка не ждут друг друга
+			struct RetireList
+			{
+				/// Первая запись списка
+				std::atomic<Retired*> Head;
 
-					ConcretePtr( T *ptr ): Ptr( ptr )
-					{
-						MY_ASSERT( Ptr != nullptr );
-					}
-					virtual ~ConcretePtr()
-					{
-						delete Ptr;
-					}
-			};
+				/// Количество объектов, добавленных с последней очистки
+				/// (изменяется только потоком-владельцем)
+				std::atomic<uint32_t> SinceClean;
 
-			typedef std::atomic<uint64_t> EpochType;
-			typedef std::unique_ptr<AbstractPtr> PtrType;
-			typedef std::pair<PtrType, uint64_t> PtrEpochType;
+				/// Количество очисток, разбирающих список (пока оно не нулевое,
+				/// часть записей может отсутствовать в списке)
+				std::atomic<uint32_t> CleanersNum;
 
-			/// Очередь на удаление
-			ForwardList<PtrEpochType> QueueToDelete;
+				RetireList(): Head( nullptr ), SinceClean( 0 ), CleanersNum( 0 ) {}
 
-			/// Текущая эпоха
-			EpochType CurrentEpoch;
+				/// Добавление цепочки записей от first до last в начало списка
+				void PushChain( Retired *first, Retired *last )
+				{
+					MY_ASSERT( ( first != nullptr ) && ( last != nullptr ) );
+					last->Next = Head.load();
+					while( !Head.compare_exchange_weak( last->Next, first ) ) {}
+				}
+			};
 
-			/// Текущие эпохи потоков
-			std::vector<EpochType> Epochs;
+			/// Ячейка эпохи, закреплённая за потоком (используется общей очередью)
+			struct ThreadSlot
+			{
+				uint8_t Padding0[ CacheLineSize ];
 
-			/// Счётчик удалений
-			std::atomic<uint16_t> DelCount;
+				/// Эпоха, занятая потоком (0 - не занята)
+				EpochType Epoch;
 
-			/// Счётчик занятых эпох
-			std::atomic<uint16_t> EpochsCounter;
+				/// Глубина вложенных захватов эпохи (меняется только владельцем)
+				uint32_t Depth;
 
-			/// Периодичность автоматических удалений из очереди
-			const uint16_t DelPeriod;
+				/// Показывает, что ячейка закреплена за потоком
+				std::atomic<bool> Busy;
 
-			/// Показывает, надо ли удалять объекты из очереди
-			std::atomic<bool> NeedToClean;
+				/// Следующая ячейка списка
+				ThreadSlot *Next;
 
-		public:
-			/**
-			 * @brief The EpochKeeper class занимает ячейку эпохи и освобождает при удалении
-			 */
-			class EpochKeeper
+				/// Удаляемые потоком объекты (переходят к следующему владельцу ячейки)
+				RetireList Retire;
+				uint8_t Padding1[ CacheLineSize ];
+
+				ThreadSlot(): Epoch( 0 ), Depth( 0 ), Busy( true ), Next( nullptr ), Retire() {}
+			};
+
+			/// Список удаляемых объектов потока у собственной очереди контейнера
+			/// (после завершения потока достаётся потоку с тем же идентификатором)
+			struct OwnRetireSlot
 			{
-				private:
-					friend class DeferredDeleter;
+				uint8_t Padding0[ CacheLineSize ];
 
-					/// Указатель на занимаемую ячейку эпохи
-					EpochType *EpochPtr;
+				/// Поток-владелец
+				const std::thread::id Owner;
 
-					/// Указатель на счётчик занятых эпох
-					std::atomic<uint16_t> *CounterPtr;
+				/// Удаляемые потоком объекты
+				RetireList Retire;
 
-				public:
-					EpochKeeper( const EpochKeeper& ) = delete;
-					EpochKeeper& operator=( const EpochKeeper& ) = delete;
+				/// Следующий список
+				OwnRetireSlot *Next;
+				uint8_t Padding1[ CacheLineSize ];
 
-					EpochKeeper( EpochKeeper &&ep_keep ): EpochPtr( ep_keep.EpochPtr ),
-					                                      CounterPtr( ep_keep.CounterPtr )
-					{
-						ep_keep.EpochPtr = nullptr;
-						ep_keep.CounterPtr = nullptr;
-					}
+				OwnRetireSlot( std::thread::id owner ): Owner( owner ), Retire(), Next( nullptr ) {}
+			};
 
-					EpochKeeper& operator=( EpochKeeper &&ep_keep )
-					{
-						if( &ep_keep != this )
-						{
-							Release();
+			/// Освобождает ячейку потока при его завершении
+			struct ThreadSlotHolder
+			{
+				ThreadSlot *Slot;
 
-							EpochPtr = ep_keep.EpochPtr;
-							CounterPtr = ep_keep.CounterPtr;
+				ThreadSlotHolder( DeferredDeleter &deleter ): Slot( deleter.RegisterThread() ) {}
+				~ThreadSlotHolder()
+				{
+					MY_ASSERT( Slot->Depth == 0 );
+					Slot->Busy.store( false );
+				}
+			};
 
-							ep_keep.EpochPtr = nullptr;
-							ep_keep.CounterPtr = nullptr;
-						}
+			/// Признак конструктора общей очереди
+			struct SharedTag {};
 
-						return *this;
-					}
+			/// Периодичность автоматических удалений из общей очереди
+			static const uint16_t SharedCleanPeriod = 0x100;
 
-					EpochKeeper(): EpochPtr( nullptr ), CounterPtr( nullptr ) {}
+			/// Значение ячейки, "хранитель" которой временно отказался от эпохи
+			/// (ячейка остаётся занятой, но не ограничивает удаление)
+			static const uint64_t OfflineEpoch = 0xFFFFFFFFFFFFFFFF;
 
-					EpochKeeper( EpochType &ep_ref,
-					             std::atomic<uint16_t> &count_ref ): EpochPtr( &ep_ref ),
-					                                                 CounterPtr( &count_ref )
-					{}
+			/// Текущая эпоха
+			EpochType CurrentEpoch;
 
-					~EpochKeeper()
-					{
-						Release();
-					}
+			/// Показывает, что с последнего сдвига эпохи объекты добавлялись на удаление
+			/// (эпоха сдвигается при захвате, а не при каждом удалении)
+			std::atomic<bool> EpochDirty;
 
-					void Release()
-					{
-						MY_ASSERT( ( EpochPtr == nullptr ) == ( CounterPtr == nullptr ) );
-						if( EpochPtr != nullptr )
-						{
-							EpochPtr->store( 0 );
-							EpochPtr = nullptr;
-						}
+			/// Ячейки эпох собственной очереди контейнера (пуст у общей очереди)
+			std::vector<PaddedAtomic<uint64_t>> Epochs;
 
-						if( CounterPtr != nullptr )
-						{
-							--( *CounterPtr );
-							CounterPtr = nullptr;
-						}
-					}
-			};
+			/// Список ячеек потоков (только растёт, ячейки завершившихся
+			/// потоков используются повторно); пуст у собственной очереди контейнера
+			std::atomic<ThreadSlot*> ThreadSlots;
 
-		public:
-			DeferredDeleter() = delete;
-			DeferredDeleter( const DeferredDeleter& ) = delete;
-			const DeferredDeleter& operator=( const DeferredDeleter& ) = delete;
+			/// Списки удаляемых объектов потоков у собственной очереди контейнера
+			std::atomic<OwnRetireSlot*> RetireSlots;
 
-			/**
-			 * @brief DeferredDeleter
-			 * @param threads_num количество потоков
-			 * @param period периодичность вызова Crear из Delete (0 - вызываться не будет)
-			 */
-			DeferredDeleter( uint8_t threads_num,
-			                 uint16_t del_period = 0 ): CurrentEpoch( 1 ),
-			                                            Epochs( threads_num > 0 ? threads_num : 1 ),
-			                                            DelCount( 0 ), EpochsCounter( 0 ),
-			                                            DelPeriod( del_period == 0 ? 1 : del_period ),
-			                                            NeedToClean( false )
+			/// Уникальный номер очереди (ключ кэша списков у потоков)
+			const uint64_t Id;
+
+			/// Счётчик занятых эпох
+			std::atomic<uint16_t> EpochsCounter;
+
+			/// Количество добавлений в список потока, после которого
+			/// ClearIfNeed этого потока выполняет очистку
+			const uint16_t DelPeriod;
+
+			static uint64_t NextId()
 			{
-				MY_ASSERT( Epochs.size() > 0 );
-				for( auto &iter : Epochs )
+				static std::atomic<uint64_t> id( 0 );
+				return ++id;
+			}
+
+			/// Начальная ячейка поиска свободной эпохи для нового потока
+			static size_t NextHint()
+			{
+				static std::atomic<size_t> hint( 0 );
+				return hint++;
+			}
+
+			/// Сдвиг эпохи, если с прошлого сдвига объекты добавлялись на удаление
+			void AdvanceEpochIfNeed()
+			{
+				if( EpochDirty.load() && EpochDirty.exchange( false ) )
 				{
-					// 0 - значит, эпоха свободна
-					iter.store( 0 );
+					++CurrentEpoch;
 				}
 			}
 
-			~DeferredDeleter()
+			/// Минимальная занятая эпоха
+			uint64_t MinEpoch() const
 			{
-#ifdef UNITTEST
+				uint64_t min_epoch = 0xFFFFFFFFFFFFFFFF;
+				auto check_epoch = [ &min_epoch ]( const EpochType &ep )
+				{
+					uint64_t val = ep.load();
+					if( ( val > 0 ) && ( val < min_epoch ) )
+					{
+						min_epoch = val;
+					}
+				};
+
 				for( const auto &ep : Epochs )
 				{
-					MY_ASSERT( ep.load() == 0 );
+					check_epoch( ep );
 				}
-#endif
+				for( const ThreadSlot *slot = ThreadSlots.load(); slot != nullptr; slot = slot->Next )
+				{
+					check_epoch( slot->Epoch );
+				}
+				return min_epoch;
 			}
 
 			/**
-			 * @brief Delete добавление указателя в очередь на удаление,
-			 * либо удаление, если есть возможность
-			 * @param ptr указатель на удаляемый объект
+			 * @brief CleanList удаление объектов списка, добавленных раньше,
+			 * чем были заняты эпохи (список забирается целиком, пока его разбирает
+			 * одна очистка, другие видят его пустым)
+			 * @param list список удаляемых объектов
+			 * @return true, если в списке остались (или могут остаться после
+			 * очисток из других потоков) неудалённые объекты
 			 */
-			template <typename T>
-			void Delete( T *ptr )
+			bool CleanList( RetireList &list )
 			{
-				if( ptr == nullptr )
+				if( list.Head.load() == nullptr )
 				{
-					return;
+					return list.CleanersNum.load() > 0;
 				}
-				else if( EpochsCounter.load() == 0 )
+
+				++list.CleanersNum;
+				Retired *item = list.Head.exchange( nullptr );
+
+				// Эпохи читаются после извлечения: все извлечённые объекты добавлены раньше
+				const uint64_t min_epoch = EpochsCounter.load() == 0 ? 0xFFFFFFFFFFFFFFFF : MinEpoch();
+				Retired *kept_first = nullptr;
+				Retired *kept_last = nullptr;
+				while( item != nullptr )
 				{
-					// Ни одной эпохи не захвачено
-					delete ptr;
-					return;
+					Retired *next = item->Next;
+					if( item->Epoch < min_epoch )
+					{
+						item->Deleter( item->Ptr );
+						PoolAllocator::Delete( item );
+					}
+					else
+					{
+						item->Next = kept_first;
+						kept_first = item;
+						if( kept_last == nullptr )
+						{
+							kept_last = item;
+						}
+					}
+					item = next;
 				}
 
-				// Увеличиваем текущую эпоху и добавляем ptr в очередь на удаление
-				PtrEpochType new_elem;
-				new_elem.first.reset( ( AbstractPtr* ) new ConcretePtr<T>( ptr ) );
-				new_elem.second = CurrentEpoch++;
-				QueueToDelete.Push( std::move( new_elem ) );
-
-				MY_ASSERT( DelPeriod > 0 );
-				if( ( ++DelCount % DelPeriod ) == 0 )
+				// Неудалённые объекты возвращаем в список
+				if( kept_first != nullptr )
 				{
-					NeedToClean.store( true );
+					list.PushChain( kept_first, kept_last );
 				}
-			} // void Delete( T *ptr )
+				--list.CleanersNum;
 
-			/// Удаление элементов очереди, которые возможно удалить
-			void Clear()
+				return ( kept_first != nullptr ) ||
+				       ( list.Head.load() != nullptr ) ||
+				       ( list.CleanersNum.load() > 0 );
+			} // bool CleanList( RetireList &list )
+
+			/// Удаление всех объектов списка (при уничтожении очереди)
+			static void FreeList( RetireList &list )
 			{
-				// Извлекаем все элементы очереди на удаление
-				auto queue = QueueToDelete.Release();
-				if( !queue || ( EpochsCounter.load() == 0 ) )
+				Retired *item = list.Head.exchange( nullptr );
+				while( item != nullptr )
 				{
-					// Очередь пуста, либо занятые эпохи отсутствуют
-					// (во 2-м случае элементы удалятся автоматически, при уничтожении queue)
-					return;
+					Retired *next = item->Next;
+					item->Deleter( item->Ptr );
+					PoolAllocator::Delete( item );
+					item = next;
 				}
+			}
 
-				// Определяем минимальную занятую эпоху
-				uint64_t min_epoch = 0xFFFFFFFFFFFFFFFF;
-				uint64_t val;
-				for( const auto &iter : Epochs )
+			/// Список удаляемых объектов текущего потока
+			RetireList& CurrentRetireList()
+			{
+				if( Epochs.empty() )
 				{
-					val = iter.load();
-					if( ( val > 0 ) && ( val < min_epoch ) )
-					{
-						min_epoch = val;
-					}
+					return CurrentThreadSlot().Retire;
 				}
 
-				// Удаляем все элементы, добавленные в очередь раньше, чем были заняты эпохи
-				auto checker = [ min_epoch ]( const PtrEpochType &elem ) -> bool
+				// Кэш списков, использованных потоком последними (по номерам очередей)
+				struct CacheEntry
 				{
-					MY_ASSERT( elem.first );
-					return ( elem.second < min_epoch );
+					uint64_t DeleterId;
+					RetireList *List;
 				};
-				queue.RemoveIf( checker );
+				static thread_local CacheEntry cache[ 4 ] = {};
 
-				// Добавляем все неудалённые элементы обратно в очередь
-				QueueToDelete.Push( std::move( queue ) );
-			}
+				CacheEntry &entry = cache[ Id % 4 ];
+				if( entry.DeleterId == Id )
+				{
+					return *entry.List;
+				}
+
+				const std::thread::id cur_id = std::this_thread::get_id();
+				OwnRetireSlot *slot = RetireSlots.load();
+				for( ; ( slot != nullptr ) && ( slot->Owner != cur_id ); slot = slot->Next ) {}
+
+				if( slot == nullptr )
+				{
+					slot = new OwnRetireSlot( cur_id );
+					slot->Next = RetireSlots.load();
+					while( !RetireSlots.compare_exchange_weak( slot->Next, slot ) ) {}
+				}
+
+				entry.DeleterId = Id;
+				entry.List = &slot->Retire;
+				return slot->Retire;
+			} // RetireList& CurrentRetireList()
 
 			/**
-			 * @brief ClearIfNeed Удаление элементов очереди, которые возможно удалить.
-			 * Выполняется, если было выполнено достаточное количество вызовов Delete
+			 * @brief NextOtherList очередной (по кругу) список другого потока
+			 * @param own список текущего потока
+			 * @return указатель на список (nullptr, если других списков нет)
 			 */
-			void ClearIfNeed()
+			RetireList* NextOtherList( const RetireList &own )
 			{
-				if( NeedToClean.exchange( false ) )
+				// Списки только добавляются, поэтому достаточно номера в списке
+				static thread_local size_t cursor = 0;
+				RetireList *first = nullptr;
+				size_t idx = 0;
+				auto check = [ & ]( RetireList &list ) -> bool
+				{
+					if( &list == &own )
+					{
+						return false;
+					}
+
+					if( first == nullptr )
+					{
+						first = &list;
+					}
+					return idx++ == cursor;
+				};
+
+				for( ThreadSlot *slot = ThreadSlots.load(); slot != nullptr; slot = slot->Next )
+				{
+					if( check( slot->Retire ) )
+					{
+						++cursor;
+						return &slot->Retire;
+					}
+				}
+				for( OwnRetireSlot *slot = RetireSlots.load(); slot != nullptr; slot = slot->Next )
 				{
-					Clear();
+					if( check( slot->Retire ) )
+					{
+						++cursor;
+						return &slot->Retire;
+					}
 				}
-			} // void ClearIfNeed()
 
+				// Список кончился - начинаем сначала
+				cursor = first == nullptr ? 0 : 1;
+				return first;
+			} // RetireList* NextOtherList( const RetireList &own )
+
+		public:
 			/**
-			 * @brief EpochAcquire "Захват" эпохи (пока эпоха не будет
-			 * освобождена, все элементы, добавленные в очередь после
-			 * её захвата, удалены не будут)
-			 * @return "хранитель" эпохи
+			 * @brief The EpochKeeper class занимает ячейку эпохи и освобождает при удалении
 			 */
-			EpochKeeper EpochAcquire()
+			class EpochKeeper
 			{
-				++EpochsCounter;
-				EpochType *ep_ptr = nullptr;
-				while( ep_ptr == nullptr )
-				{
-					for( auto &ep : Epochs )
+				private:
+					friend class DeferredDeleter;
+
+					/// Указатель на занимаемую ячейку эпохи
+					EpochType *EpochPtr;
+
+					/// Указатель на счётчик занятых эпох
+					std::atomic<uint16_t> *CounterPtr;
+
+					/// Ячейка потока (при захвате эпохи общей очереди,
+					/// освобождать "хранителя" надо в том же потоке)
+					ThreadSlot *SlotPtr;
+
+				public:
+					EpochKeeper( const EpochKeeper& ) = delete;
+					EpochKeeper& operator=( const EpochKeeper& ) = delete;
+
+					EpochKeeper( EpochKeeper &&ep_keep ): EpochPtr( ep_keep.EpochPtr ),
+					                                      CounterPtr( ep_keep.CounterPtr ),
+					                                      SlotPtr( ep_keep.SlotPtr )
+					{
+						ep_keep.EpochPtr = nullptr;
+						ep_keep.CounterPtr = nullptr;
+						ep_keep.SlotPtr = nullptr;
+					}
+
+					EpochKeeper& operator=( EpochKeeper &&ep_keep )
 					{
-						uint64_t expected = 0;
-						if( ep.compare_exchange_strong( expected,
-						                                CurrentEpoch.load() ) )
+						if( &ep_keep != this )
 						{
-							// Ячейка эпохи "захвачена"
-							ep_ptr = &ep;
-							break;
+							Release();
+
+							EpochPtr = ep_keep.EpochPtr;
+							CounterPtr = ep_keep.CounterPtr;
+							SlotPtr = ep_keep.SlotPtr;
+
+							ep_keep.EpochPtr = nullptr;
+							ep_keep.CounterPtr = nullptr;
+							ep_keep.SlotPtr = nullptr;
 						}
+
+						return *this;
 					}
-				} // while( ep_ptr == nullptr )
 
-				return EpochKeeper( *ep_ptr, EpochsCounter );
-			} // EpochKeeper EpochAcquire()
+					EpochKeeper(): EpochPtr( nullptr ), CounterPtr( nullptr ), SlotPtr( nullptr ) {}
 
-			/// Обновление "занятой" эпохи у "хранителя"
-			void UpdateEpoch( EpochKeeper &keeper )
-			{
-				if( keeper.EpochPtr != nullptr )
-				{
-					keeper.EpochPtr->store( CurrentEpoch.load() );
-				}
-			}
-	};
+					EpochKeeper( EpochType &ep_ref,
+					             std::atomic<uint16_t> &count_ref ): EpochPtr( &ep_ref ),
+					                                                 CounterPtr( &count_ref ),
+					                                                 SlotPtr( nullptr )
+					{}
 
-	/// Максимальный рекомендованный размер данных очереди на удаление
-	const uint16_t MaxSizeToDelete = 1024;
-	
-	template <typename T>
-	uint16_t GetCleanPeriod()
-	{
-		size_t sz = sizeof( T );
-		return MaxSizeToDelete / ( sz == 0 ? 1 : sz );
-	}
+					EpochKeeper( ThreadSlot &slot_ref,
+					             std::atomic<uint16_t> &count_ref ): EpochPtr( nullptr ),
+					                                                 CounterPtr( &count_ref ),
+					                                                 SlotPtr( &slot_ref )
+					{}
 
-	/// Класс стека (последний пришёл - первый вышел)
-	template <typename T>
-	class Stack
-	{
-		public:
-			typedef T Type;
+					~EpochKeeper()
+					{
+						Release();
+					}
 
-		private:
-			typedef internal::StructElementType<T> ElementType;
+					void Release()
+					{
+						if( SlotPtr != nullptr )
+						{
+							// Эпоха потока освобождается с последним вложенным "хранителем"
+							MY_ASSERT( CounterPtr != nullptr );
+							MY_ASSERT( SlotPtr->Depth > 0 );
+							if( --SlotPtr->Depth == 0 )
+							{
+								SlotPtr->Epoch.store( 0 );
+								--( *CounterPtr );
+							}
+
+							SlotPtr = nullptr;
+							CounterPtr = nullptr;
+							return;
+						}
 
-			/// Начало списка
-			std::atomic<ElementType*> Head;
+						MY_ASSERT( ( EpochPtr == nullptr ) == ( CounterPtr == nullptr ) );
+						if( EpochPtr != nullptr )
+						{
+							EpochPtr->store( 0 );
+							EpochPtr = nullptr;
+						}
 
-			/// Очередь для отсроченного удаления, используемая по умолчанию
-			std::unique_ptr<DeferredDeleter> DefaultQueue;
+						if( CounterPtr != nullptr )
+						{
+							--( *CounterPtr );
+							CounterPtr = nullptr;
+						}
+					}
 
-			/// Ссылка на очередь для отсроченного удаления
-			DeferredDeleter &DefQueue;
+					/**
+					 * @brief Protect чтение указателя, разыменовываемого под защитой "хранителя"
+					 * (пока эпоха занята, защищены все указатели, поэтому просто читаем)
+					 * @param src источник указателя
+					 * @return прочитанный указатель
+					 */
+					template <typename E>
+					E* Protect( size_t, const std::atomic<E*> &src ) const
+					{
+						return src.load();
+					}
+			};
 
-		public:
-			Stack( const Stack& ) = delete;
-			Stack& operator=( const Stack& ) = delete;
+			/// "Хранитель", защищающий указатели контейнера (общий интерфейс с HazardDomain)
+			typedef EpochKeeper Guard;
 
-			Stack( DeferredDeleter &def_queue ): Head( nullptr ),
-			                                     DefaultQueue(),
-			                                     DefQueue( def_queue ) {}
+		private:
+			/// Конструктор общей очереди (ячейки эпох закрепляются за потоками)
+			DeferredDeleter( SharedTag, uint16_t del_period ): CurrentEpoch( 1 ),
+			                                                   EpochDirty( false ),
+			                                                   Epochs(),
+			                                                   ThreadSlots( nullptr ),
+			                                                   RetireSlots( nullptr ),
+			                                                   Id( NextId() ),
+			                                                   EpochsCounter( 0 ),
+			                                                   DelPeriod( del_period == 0 ? 1 : del_period )
+			{}
 
-			Stack( uint8_t threads_num,
-			       uint8_t clean_period = GetCleanPeriod<T>() ):
-			    Head( nullptr ),
-			    DefaultQueue( new DeferredDeleter( threads_num, clean_period ) ),
-			    DefQueue( *DefaultQueue )
+			/// Закрепление ячейки эпохи за текущим потоком
+			ThreadSlot* RegisterThread()
 			{
-				MY_ASSERT( DefaultQueue );
+				// Сначала ищем ячейку, освобождённую завершившимся потоком
+				for( ThreadSlot *slot = ThreadSlots.load(); slot != nullptr; slot = slot->Next )
+				{
+					bool expected = false;
+					if( slot->Busy.compare_exchange_strong( expected, true ) )
+					{
+						MY_ASSERT( slot->Depth == 0 );
+						return slot;
+					}
+				}
+
+				// Свободных нет - добавляем новую в начало списка
+				ThreadSlot *slot = new ThreadSlot;
+				slot->Next = ThreadSlots.load();
+				while( !ThreadSlots.compare_exchange_weak( slot->Next, slot ) ) {}
+				return slot;
 			}
 
-			~Stack()
+			/// Ячейка эпохи текущего потока (только для общей очереди)
+			ThreadSlot& CurrentThreadSlot()
 			{
-				ElementType *head = Head.load();
-				ElementType *ptr  = nullptr;
-				while( head != nullptr )
-				{
-					ptr = head;
-					head = head->Next.load();
-					delete ptr;
-				}
+				static thread_local ThreadSlotHolder holder( *this );
+				MY_ASSERT( holder.Slot != nullptr );
+				return *holder.Slot;
 			}
 
+		public:
+			DeferredDeleter() = delete;
+			DeferredDeleter( const DeferredDeleter& ) = delete;
+			const DeferredDeleter& operator=( const DeferredDeleter& ) = delete;
+
 			/**
-			 * @brief Push добавление нового элемента в стек
-			 * @param val значение нового элемента
-			 * @return true, если до добавления элемента стек был пуст
+			 * @brief DeferredDeleter собственная очередь контейнера
+			 * @param threads_num количество потоков
+			 * @param del_period количество добавлений потока на удаление, после которого
+			 * его ClearIfNeed выполняет очистку (0 - очистка при каждом вызове, как и 1);
+			 * Delete очистку сам не запускает
 			 */
-			bool Push( const T &val )
+			DeferredDeleter( uint8_t threads_num,
+			                 uint16_t del_period = 0 ): CurrentEpoch( 1 ),
+			                                            EpochDirty( false ),
+			                                            Epochs( threads_num > 0 ? threads_num : 1 ),
+			                                            ThreadSlots( nullptr ),
+			                                            RetireSlots( nullptr ),
+			                                            Id( NextId() ),
+			                                            EpochsCounter( 0 ),
+			                                            DelPeriod( del_period == 0 ? 1 : del_period )
 			{
-				return internal::PushHead( Head, new ElementType( val ) );
+				MY_ASSERT( Epochs.size() > 0 );
 			}
 
-			/**
-			 * @brief Push добавление нового элемента в стек
-			 * @param val значение нового элемента
-			 * @return true, если до добавления элемента стек был пуст
-			 */
-			bool Push( T &&val )
+			~DeferredDeleter()
 			{
-				return internal::PushHead( Head, new ElementType( std::move( val ) ) );
+#ifdef UNITTEST
+				for( const auto &ep : Epochs )
+				{
+					MY_ASSERT( ep.load() == 0 );
+				}
+#endif
+				ThreadSlot *slot = ThreadSlots.exchange( nullptr );
+				while( slot != nullptr )
+				{
+					ThreadSlot *next = slot->Next;
+					FreeList( slot->Retire );
+					delete slot;
+					slot = next;
+				}
+
+				OwnRetireSlot *retire_slot = RetireSlots.exchange( nullptr );
+				while( retire_slot != nullptr )
+				{
+					OwnRetireSlot *next = retire_slot->Next;
+					FreeList( retire_slot->Retire );
+					delete retire_slot;
+					retire_slot = next;
+				}
 			}
 
 			/**
-			 * @brief Push добавление нового элемента в стек
-			 * @param args аргументы для создания нового элемента
-			 * @return true, если до добавления элемента стек был пуст
+			 * @brief Shared общая для процесса очередь на отложенное удаление,
+			 * используемая контейнерами по умолчанию. Ячейки эпох закрепляются
+			 * за потоками при первом обращении, поэтому их количество не зависит
+			 * от числа контейнеров и не ограничено заранее
+			 * @return ссылка на общую очередь
 			 */
-			template <typename ...Types>
-			bool Push( Types ...args )
+			static DeferredDeleter& Shared()
 			{
-				return internal::PushHead( Head, new ElementType( args... ) );
+				static DeferredDeleter shared( SharedTag(), SharedCleanPeriod );
+				return shared;
 			}
 
 			/**
-			 * @brief Pop извлечение элемента из стека
-			 * @param default_value_ptr указатель на значение по умолчанию,
-			 * которое будет возвращено, если стек пуст;
-			 * если параметр нулевой и стек пуст - будет выброшено исключение std::out_of_range
-			 * @param is_empty если параемтр ненулевой - в него будет записана информация о том,
-			 * был ли удалён последний элемент из стека (если он был непустым)
-			 * @return элемент стека
+			 * @brief Delete добавление указателя в очередь на удаление,
+			 * либо удаление, если есть возможность. Объект добавляется в список
+			 * текущего потока одной операцией CAS (запись выделяется из пула потока)
+			 * @param ptr указатель на удаляемый объект
+			 * @tparam Allocator распределитель, которым создан объект
 			 */
-			T Pop( const T *default_value_ptr = nullptr,
-			       bool *is_empty = nullptr )
+			template <typename T, typename Allocator = NewAllocator>
+			void Delete( T *ptr )
 			{
-				T result;
-				if( is_empty != nullptr )
+				if( ptr == nullptr )
+				{
+					return;
+				}
+				else if( EpochsCounter.load() == 0 )
+				{
+					// Ни одной эпохи не захвачено
+					Allocator::Delete( ptr );
+					return;
+				}
+
+				RetireList &list = CurrentRetireList();
+				Retired *item = PoolAllocator::New<Retired>();
+				item->Ptr = ptr;
+				item->Deleter = &DeleteObject<T, Allocator>;
+				item->Epoch = CurrentEpoch.load();
+				list.PushChain( item, item );
+				list.SinceClean.fetch_add( 1, std::memory_order_relaxed );
+
+				// Эпохи, захваченные после этого, будут больше эпохи объекта
+				if( !EpochDirty.load() )
+				{
+					EpochDirty.store( true );
+				}
+			} // void Delete( T *ptr )
+
+			/**
+			 * @brief Clear удаление объектов, которые возможно удалить
+			 * (из списков всех потоков)
+			 * @return true, если остались неудалённые объекты
+			 */
+			bool Clear()
+			{
+				bool res = false;
+				for( ThreadSlot *slot = ThreadSlots.load(); slot != nullptr; slot = slot->Next )
+				{
+					res = CleanList( slot->Retire ) || res;
+				}
+				for( OwnRetireSlot *slot = RetireSlots.load(); slot != nullptr; slot = slot->Next )
+				{
+					res = CleanList( slot->Retire ) || res;
+				}
+				return res;
+			}
+
+			/**
+			 * @brief ClearIfNeed Удаление объектов списка текущего потока, которые возможно удалить.
+			 * Выполняется, если поток добавил на удаление достаточное количество объектов
+			 * (очистка идёт пачками, у каждого потока - своя). Заодно очищается
+			 * список одного из других потоков (по очереди), чтобы объекты
+			 * вытесненного или завершившегося потока не копились
+			 * @param retry если true и удалены не все объекты, очистка
+			 * выполнится и при следующем вызове
+			 */
+			void ClearIfNeed( bool retry = false )
+			{
+				// Счётчик только читается, пока не наберётся пачка
+				RetireList &list = CurrentRetireList();
+				if( list.SinceClean.load( std::memory_order_relaxed ) < DelPeriod )
+				{
+					return;
+				}
+
+				list.SinceClean.store( 0, std::memory_order_relaxed );
+				if( CleanList( list ) && retry )
+				{
+					list.SinceClean.store( DelPeriod, std::memory_order_relaxed );
+				}
+
+				RetireList *other = NextOtherList( list );
+				if( other != nullptr )
+				{
+					CleanList( *other );
+				}
+			} // void ClearIfNeed( bool retry )
+
+			/**
+			 * @brief EpochAcquire "Захват" эпохи (пока эпоха не будет
+			 * освобождена, все элементы, добавленные в очередь после
+			 * её захвата, удалены не будут)
+			 * @return "хранитель" эпохи
+			 */
+			EpochKeeper EpochAcquire()
+			{
+				if( Epochs.empty() )
+				{
+					// Общая очередь: у потока своя ячейка, вложенные
+					// захваты сохраняют эпоху внешнего
+					ThreadSlot &slot = CurrentThreadSlot();
+					if( slot.Depth++ == 0 )
+					{
+						++EpochsCounter;
+						AdvanceEpochIfNeed();
+						slot.Epoch.store( CurrentEpoch.load() );
+					}
+
+					return EpochKeeper( slot, EpochsCounter );
+				}
+
+				++EpochsCounter;
+				AdvanceEpochIfNeed();
+
+				// Поиск начинается с ячейки, занятой потоком в прошлый раз
+				// (у разных потоков - разные), поэтому обычно хватает одной попытки
+				static thread_local size_t hint = NextHint();
+				const size_t slots_num = Epochs.size();
+				size_t idx = hint % slots_num;
+				while( true )
+				{
+					EpochType &ep = Epochs[ idx ];
+					uint64_t expected = 0;
+					if( ( ep.load() == 0 ) &&
+					    ep.compare_exchange_strong( expected, CurrentEpoch.load() ) )
+					{
+						// Ячейка эпохи "захвачена"
+						hint = idx;
+						return EpochKeeper( ep, EpochsCounter );
+					}
+
+					if( ++idx == slots_num )
+					{
+						idx = 0;
+					}
+				}
+			} // EpochKeeper EpochAcquire()
+
+			/// Захват эпохи контейнером (общий интерфейс с HazardDomain)
+			Guard Acquire()
+			{
+				return EpochAcquire();
+			}
+
+			/**
+			 * @brief SetOffline временный отказ "хранителя" от эпохи без освобождения ячейки
+			 * (пока не будет вызван UpdateEpoch, эпоха не препятствует удалению)
+			 * @param keeper "хранитель" эпохи
+			 */
+			void SetOffline( EpochKeeper &keeper )
+			{
+				if( keeper.EpochPtr != nullptr )
+				{
+					keeper.EpochPtr->store( OfflineEpoch );
+				}
+				else if( ( keeper.SlotPtr != nullptr ) && ( keeper.SlotPtr->Depth == 1 ) )
+				{
+					keeper.SlotPtr->Epoch.store( OfflineEpoch );
+				}
+			}
+
+			/// Обновление "занятой" эпохи у "хранителя"
+			void UpdateEpoch( EpochKeeper &keeper )
+			{
+				if( keeper.EpochPtr != nullptr )
+				{
+					AdvanceEpochIfNeed();
+					keeper.EpochPtr->store( CurrentEpoch.load() );
+				}
+				else if( ( keeper.SlotPtr != nullptr ) && ( keeper.SlotPtr->Depth == 1 ) )
+				{
+					// Эпоху вложенного захвата не сдвигаем - её держит внешний
+					AdvanceEpochIfNeed();
+					keeper.SlotPtr->Epoch.store( CurrentEpoch.load() );
+				}
+			}
+	};
+
+	/**
+	 * @brief The HazardDomain class удаление элементов контейнеров по указателям опасности
+	 * (альтернатива DeferredDeleter с ограниченным количеством неудалённых объектов).
+	 * Поток, разыменовывающий указатель, публикует его в ячейке своей записи; удаляются
+	 * только объекты, не опубликованные ни в одной записи. Долго "спящий" поток удерживает
+	 * не более HazardsNum объектов, а не все, добавленные после него
+	 */
+	class HazardDomain
+	{
+		public:
+			/// Количество указателей, одновременно защищаемых одним "хранителем"
+			static const size_t HazardsNum = 2;
+
+		private:
+			/// Запись об удаляемом объекте
+			struct Retired
+			{
+				/// Указатель на удаляемый объект
+				void *Ptr;
+
+				/// Функция удаления объекта
+				void ( *Deleter )( void* );
+			};
+
+			/// Удаление объекта типа T распределителем Allocator
+			template <typename T, typename Allocator>
+			static void DeleteObject( void *ptr )
+			{
+				Allocator::Delete( static_cast<T*>( ptr ) );
+			}
+
+			/// Запись, занимаемая потоком на время защиты указателей или удаления
+			struct Record
+			{
+				uint8_t Padding0[ CacheLineSize ];
+
+				/// Опубликованные (защищённые) указатели
+				std::atomic<void*> Hazards[ HazardsNum ];
+
+				/// Показывает, что запись занята
+				std::atomic<bool> Busy;
+
+				/// Количество объектов в Retire (читается Clear-ом других потоков)
+				std::atomic<size_t> RetiredNum;
+
+				/// Следующая запись списка
+				Record *Next;
+
+				/// Удаляемые объекты (меняются только занявшим запись)
+				std::vector<Retired> Retire;
+
+				/// Буфер для опубликованных указателей при очистке
+				std::vector<void*> Scratch;
+				uint8_t Padding1[ CacheLineSize ];
+
+				Record(): Busy( false ), RetiredNum( 0 ), Next( nullptr ), Retire(), Scratch()
+				{
+					for( auto &hazard : Hazards )
+					{
+						hazard.store( nullptr );
+					}
+				}
+			};
+
+			/// Признак конструктора общего домена
+			struct SharedTag {};
+
+			/// Количество удаляемых объектов записи (сверх защищённых), после которого
+			/// выполняется очистка, для общего домена
+			static const uint16_t SharedCleanPeriod = 0x100;
+
+			/// Список записей (только растёт, освобождённые записи используются повторно)
+			std::atomic<Record*> Records;
+
+			/// Количество записей
+			std::atomic<size_t> RecordsNum;
+
+			/// Количество удаляемых объектов записи сверх защищённых, после которого
+			/// выполняется очистка
+			const uint16_t CleanPeriod;
+
+			/// Уникальный номер домена (ключ кэша записей у потоков)
+			const uint64_t Id;
+
+			static uint64_t NextId()
+			{
+				static std::atomic<uint64_t> id( 0 );
+				return ++id;
+			}
+
+			/// Занятие свободной записи (или создание новой)
+			Record& AcquireRecord()
+			{
+				// Кэш записей, занятых потоком в последний раз (по номерам доменов):
+				// обычно запись свободна и хватает одной попытки
+				struct CacheEntry
+				{
+					uint64_t DomainId;
+					Record *Rec;
+				};
+				static thread_local CacheEntry cache[ 4 ] = {};
+
+				CacheEntry &entry = cache[ Id % 4 ];
+				bool expected = false;
+				if( ( entry.DomainId == Id ) && entry.Rec->Busy.compare_exchange_strong( expected, true ) )
+				{
+					return *entry.Rec;
+				}
+
+				Record *rec = Records.load();
+				for( ; rec != nullptr; rec = rec->Next )
+				{
+					expected = false;
+					if( !rec->Busy.load() && rec->Busy.compare_exchange_strong( expected, true ) )
+					{
+						break;
+					}
+				}
+
+				if( rec == nullptr )
+				{
+					// Свободных нет - добавляем новую в начало списка
+					rec = new Record;
+					rec->Busy.store( true );
+					rec->Next = Records.load();
+					while( !Records.compare_exchange_weak( rec->Next, rec ) ) {}
+					++RecordsNum;
+				}
+
+				entry.DomainId = Id;
+				entry.Rec = rec;
+				return *rec;
+			} // Record& AcquireRecord()
+
+			/// Освобождение записи
+			static void ReleaseRecord( Record &rec )
+			{
+				for( auto &hazard : rec.Hazards )
+				{
+					hazard.store( nullptr );
+				}
+				rec.Busy.store( false );
+			}
+
+			/**
+			 * @brief Scan удаление объектов записи, не защищённых ни одним потоком
+			 * (запись должна быть занята вызывающим)
+			 * @param rec запись
+			 */
+			void Scan( Record &rec )
+			{
+				std::vector<void*> &hazards = rec.Scratch;
+				hazards.clear();
+				for( Record *r = Records.load(); r != nullptr; r = r->Next )
+				{
+					for( const auto &hazard : r->Hazards )
+					{
+						void *ptr = hazard.load();
+						if( ptr != nullptr )
+						{
+							hazards.push_back( ptr );
+						}
+					}
+				}
+				std::sort( hazards.begin(), hazards.end() );
+
+				size_t kept = 0;
+				for( size_t t = 0; t < rec.Retire.size(); ++t )
+				{
+					if( std::binary_search( hazards.begin(), hazards.end(), rec.Retire[ t ].Ptr ) )
+					{
+						rec.Retire[ kept++ ] = rec.Retire[ t ];
+					}
+					else
+					{
+						rec.Retire[ t ].Deleter( rec.Retire[ t ].Ptr );
+					}
+				}
+				rec.Retire.resize( kept );
+				rec.RetiredNum.store( kept );
+			} // void Scan( Record &rec )
+
+			/// Конструктор общего домена
+			HazardDomain( SharedTag ): Records( nullptr ), RecordsNum( 0 ),
+			                           CleanPeriod( SharedCleanPeriod ), Id( NextId() ) {}
+
+		public:
+			/**
+			 * @brief The HazardKeeper class "хранитель" указателей: занимает запись домена
+			 * и освобождает её (вместе с опубликованными указателями) при удалении
+			 */
+			class HazardKeeper
+			{
+				private:
+					friend class HazardDomain;
+
+					/// Занятая запись
+					Record *RecordPtr;
+
+					HazardKeeper( Record &rec ): RecordPtr( &rec ) {}
+
+				public:
+					HazardKeeper( const HazardKeeper& ) = delete;
+					HazardKeeper& operator=( const HazardKeeper& ) = delete;
+
+					HazardKeeper(): RecordPtr( nullptr ) {}
+
+					HazardKeeper( HazardKeeper &&keeper ): RecordPtr( keeper.RecordPtr )
+					{
+						keeper.RecordPtr = nullptr;
+					}
+
+					HazardKeeper& operator=( HazardKeeper &&keeper )
+					{
+						if( &keeper != this )
+						{
+							Release();
+							RecordPtr = keeper.RecordPtr;
+							keeper.RecordPtr = nullptr;
+						}
+
+						return *this;
+					}
+
+					~HazardKeeper()
+					{
+						Release();
+					}
+
+					void Release()
+					{
+						if( RecordPtr != nullptr )
+						{
+							ReleaseRecord( *RecordPtr );
+							RecordPtr = nullptr;
+						}
+					}
+
+					/**
+					 * @brief Protect чтение указателя с публикацией в ячейке idx
+					 * (указатель защищён от удаления до смены ячейки или освобождения "хранителя")
+					 * @param idx номер ячейки (меньше HazardsNum)
+					 * @param src источник указателя
+					 * @return прочитанный указатель
+					 */
+					template <typename E>
+					E* Protect( size_t idx, const std::atomic<E*> &src )
+					{
+						MY_ASSERT( ( RecordPtr != nullptr ) && ( idx < HazardsNum ) );
+						std::atomic<void*> &hazard = RecordPtr->Hazards[ idx ];
+						E *ptr = src.load();
+						while( true )
+						{
+							// После публикации проверяем, что объект ещё не исключён из контейнера
+							hazard.store( ptr );
+							E *check = src.load();
+							if( check == ptr )
+							{
+								return ptr;
+							}
+							ptr = check;
+						}
+					}
+			};
+
+			/// "Хранитель", защищающий указатели контейнера (общий интерфейс с DeferredDeleter)
+			typedef HazardKeeper Guard;
+
+			HazardDomain( const HazardDomain& ) = delete;
+			HazardDomain& operator=( const HazardDomain& ) = delete;
+
+			/**
+			 * @brief HazardDomain собственный домен контейнера
+			 * @param threads_num количество записей, создаваемых заранее
+			 * (при необходимости создаются новые)
+			 * @param clean_period количество удаляемых объектов записи сверх
+			 * защищённых, после которого выполняется очистка (0 - очистка при каждом удалении)
+			 */
+			HazardDomain( uint8_t threads_num,
+			              uint16_t clean_period = 0 ): Records( nullptr ),
+			                                           RecordsNum( 0 ),
+			                                           CleanPeriod( clean_period ),
+			                                           Id( NextId() )
+			{
+				for( uint8_t t = 0; t < threads_num; ++t )
+				{
+					Record *rec = new Record;
+					rec->Next = Records.load();
+					Records.store( rec );
+					++RecordsNum;
+				}
+			}
+
+			~HazardDomain()
+			{
+				Record *rec = Records.exchange( nullptr );
+				while( rec != nullptr )
+				{
+					MY_ASSERT( !rec->Busy.load() );
+					Record *next = rec->Next;
+					for( const auto &item : rec->Retire )
+					{
+						item.Deleter( item.Ptr );
+					}
+					delete rec;
+					rec = next;
+				}
+			}
+
+			/// Общий для процесса домен
+			static HazardDomain& Shared()
+			{
+				static HazardDomain shared( ( SharedTag() ) );
+				return shared;
+			}
+
+			/**
+			 * @brief Acquire занятие записи для защиты указателей
+			 * @return "хранитель" записи
+			 */
+			Guard Acquire()
+			{
+				return Guard( AcquireRecord() );
+			}
+
+			/**
+			 * @brief Delete добавление объекта на удаление; когда у записи набирается
+			 * CleanPeriod объектов сверх количества защищаемых указателей,
+			 * удаляются все незащищённые (поэтому неудалённых объектов у записи
+			 * не больше, чем CleanPeriod + HazardsNum*количество записей)
+			 * @param ptr указатель на удаляемый объект
+			 * @tparam Allocator распределитель, которым создан объект
+			 */
+			template <typename T, typename Allocator = NewAllocator>
+			void Delete( T *ptr )
+			{
+				if( ptr == nullptr )
+				{
+					return;
+				}
+
+				Retired item;
+				item.Ptr = ptr;
+				item.Deleter = &DeleteObject<T, Allocator>;
+
+				Record &rec = AcquireRecord();
+				try
+				{
+					rec.Retire.push_back( item );
+				}
+				catch( ... )
+				{
+					ReleaseRecord( rec );
+					throw;
+				}
+				rec.RetiredNum.store( rec.Retire.size() );
+
+				if( rec.Retire.size() >= CleanPeriod + HazardsNum*RecordsNum.load() )
+				{
+					try
+					{
+						Scan( rec );
+					}
+					catch( ... )
+					{
+						ReleaseRecord( rec );
+						throw;
+					}
+				}
+				ReleaseRecord( rec );
+			} // void Delete( T *ptr )
+
+			/**
+			 * @brief Clear удаление незащищённых объектов всех свободных записей
+			 * @return true, если остались неудалённые объекты
+			 */
+			bool Clear()
+			{
+				bool res = false;
+				for( Record *rec = Records.load(); rec != nullptr; rec = rec->Next )
+				{
+					bool expected = false;
+					if( ( rec->RetiredNum.load() > 0 ) &&
+					    rec->Busy.compare_exchange_strong( expected, true ) )
+					{
+						try
+						{
+							Scan( *rec );
+						}
+						catch( ... )
+						{
+							ReleaseRecord( *rec );
+							throw;
+						}
+						ReleaseRecord( *rec );
+					}
+					res = res || ( rec->RetiredNum.load() > 0 );
+				}
+				return res;
+			}
+
+			/// Очистка выполняется при удалении (общий интерфейс с DeferredDeleter)
+			void ClearIfNeed( bool = false ) {}
+	}; // class HazardDomain
+
+	/// Максимальный рекомендованный размер данных очереди на удаление
+	const uint16_t MaxSizeToDelete = 1024;
+	
+	template <typename T>
+	uint16_t GetCleanPeriod()
+	{
+		size_t sz = sizeof( T );
+		return MaxSizeToDelete / ( sz == 0 ? 1 : sz );
+	}
+
+	/// Класс стека (последний пришёл - первый вышел)
+	/// (Allocator - распределитель элементов: NewAllocator или PoolAllocator,
+	/// Reclamation - способ удаления элементов: DeferredDeleter или HazardDomain).
+	/// При неудачной смене головы Push и Pop пытаются встретиться в массиве
+	/// исключения: Push оставляет свой элемент в ячейке и немного ждёт, Pop забирает
+	/// его оттуда, не обращаясь к голове (такая пара не меняет стек).
+	/// UseElimination = false отключает массив исключения (при слабой конкуренции
+	/// за голову встречи редки, и ожидание Push-а в ячейке только добавляет задержку)
+	template <typename T, typename Allocator = NewAllocator, typename Reclamation = DeferredDeleter,
+	          bool UseElimination = true>
+	class Stack
+	{
+		public:
+			typedef T Type;
+
+		private:
+			typedef internal::StructElementType<T> ElementType;
+			typedef PaddedAtomic<ElementType*> EliminationSlot;
+
+			/// Количество ячеек массива исключения
+			static const uint8_t EliminationSlotsNum = 8;
+
+			/// Максимальное количество проверок ячейки ожидающим Push-ем
+			static const uint16_t MaxEliminationSpins = 0x400;
+
+			/// Минимальное количество проверок ячейки ожидающим Push-ем
+			static const uint16_t MinEliminationSpins = 0x10;
+
+			/// Массив исключения с параметрами, подстраиваемыми под нагрузку на этот стек
+			struct EliminationArray
+			{
+				/// Ячейки: nullptr - свободна, элемент - Push ждёт Pop-а,
+				/// TakenMark - элемент забран, ячейку освобождает только её Push
+				/// (пока он не увидит отметку, его элемент в ячейку никто не поставит,
+				/// поэтому повторно выделенный по тому же адресу элемент не спутать с забранным)
+				EliminationSlot Slots[ EliminationSlotsNum ];
+
+				/// Количество используемых ячеек (растёт, когда ячейки заняты,
+				/// уменьшается, когда пара не находится)
+				PaddedAtomic<uint8_t> Range;
+
+				/// Сколько раз ожидающий Push проверяет ячейку (растёт после
+				/// удачных встреч, уменьшается после неудачных)
+				PaddedAtomic<uint16_t> Spins;
+
+				EliminationArray(): Range( 1 ), Spins( MinEliminationSpins ) {}
+
+				/// Случайная ячейка из используемого диапазона
+				EliminationSlot& NextSlot()
+				{
+					// Состояние генератора - потоковое (от стека не зависит)
+					static thread_local uint32_t rnd = 0;
+					if( rnd == 0 )
+					{
+						rnd = ( uint32_t ) ( size_t ) &rnd | 1;
+					}
+					rnd ^= rnd << 13;
+					rnd ^= rnd >> 17;
+					rnd ^= rnd << 5;
+					return Slots[ rnd % Range.load( std::memory_order_relaxed ) ];
+				}
+
+				void WidenRange()
+				{
+					const uint8_t range = Range.load( std::memory_order_relaxed );
+					if( range < EliminationSlotsNum )
+					{
+						Range.store( ( uint8_t ) ( range + 1 ), std::memory_order_relaxed );
+					}
+				}
+
+				void NarrowRange()
+				{
+					const uint8_t range = Range.load( std::memory_order_relaxed );
+					if( range > 1 )
+					{
+						Range.store( ( uint8_t ) ( range - 1 ), std::memory_order_relaxed );
+					}
+				}
+			};
+
+			/// Отметка забранного из ячейки элемента
+			static ElementType* TakenMark()
+			{
+				return reinterpret_cast<ElementType*>( ( uintptr_t ) 1 );
+			}
+
+			/// Начало списка
+			std::atomic<ElementType*> Head;
+
+			/// Массив исключения (создаётся при первой неудачной смене головы)
+			std::atomic<EliminationArray*> Elimination;
+
+			/// Очередь для отсроченного удаления, используемая по умолчанию
+			std::unique_ptr<Reclamation> DefaultQueue;
+
+			/// Ссылка на очередь для отсроченного удаления
+			Reclamation &DefQueue;
+
+			/// Удаление несвязанной с контейнером цепочки элементов
+			static void DeleteChain( ElementType *head )
+			{
+				ElementType *ptr = nullptr;
+				while( head != nullptr )
+				{
+					ptr = head;
+					head = head->Next.load();
+					Allocator::Delete( ptr );
+				}
+			}
+
+			/// Массив исключения (создаётся при необходимости)
+			EliminationArray& GetElimination()
+			{
+				EliminationArray *arr = Elimination.load();
+				if( arr == nullptr )
+				{
+					std::unique_ptr<EliminationArray> new_arr( new EliminationArray );
+					if( Elimination.compare_exchange_strong( arr, new_arr.get() ) )
+					{
+						arr = new_arr.release();
+					}
+				}
+				return *arr;
+			}
+
+			/**
+			 * @brief EliminatePush попытка передать элемент Pop-у через массив исключения
+			 * @param elem элемент (не добавленный в стек)
+			 * @return true, если элемент забран Pop-ом
+			 */
+			bool EliminatePush( ElementType *elem )
+			{
+				if( !UseElimination )
+				{
+					return false;
+				}
+
+				EliminationArray &arr = GetElimination();
+				EliminationSlot &slot = arr.NextSlot();
+
+				ElementType *expected = nullptr;
+				if( !slot.compare_exchange_strong( expected, elem ) )
+				{
+					// Ячейка занята другим Push-ем - расширяем диапазон
+					arr.WidenRange();
+					return false;
+				}
+
+				const uint16_t spins = arr.Spins.load( std::memory_order_relaxed );
+				for( uint16_t t = 1; t <= spins; ++t )
+				{
+					if( slot.load( std::memory_order_relaxed ) != elem )
+					{
+						break;
+					}
+
+					if( ( t % MinEliminationSpins ) == 0 )
+					{
+						// Уступаем процессор, чтобы ожидание не отнимало
+						// время у потока, который может забрать элемент
+						std::this_thread::yield();
+					}
+				}
+
+				expected = elem;
+				if( slot.compare_exchange_strong( expected, nullptr ) )
+				{
+					// Пара не нашлась - сужаем диапазон и ждём меньше
+					arr.NarrowRange();
+					if( spins > MinEliminationSpins )
+					{
+						arr.Spins.store( spins > 2*MinEliminationSpins ? ( uint16_t ) ( spins / 2 ) : MinEliminationSpins,
+						                 std::memory_order_relaxed );
+					}
+					return false;
+				}
+
+				// Элемент забран Pop-ом (к elem больше не обращаемся) - освобождаем ячейку
+				MY_ASSERT( expected == TakenMark() );
+				slot.store( nullptr );
+				if( spins < MaxEliminationSpins )
+				{
+					arr.Spins.store( spins < MaxEliminationSpins / 2 ? ( uint16_t ) ( 2*spins ) : MaxEliminationSpins,
+					                 std::memory_order_relaxed );
+				}
+				return true;
+			} // bool EliminatePush( ElementType *elem )
+
+			/**
+			 * @brief EliminatePop попытка забрать элемент ожидающего Push-а
+			 * @return элемент (nullptr, если в выбранной ячейке его нет)
+			 */
+			ElementType* EliminatePop()
+			{
+				if( !UseElimination )
+				{
+					return nullptr;
+				}
+
+				EliminationArray &arr = GetElimination();
+				EliminationSlot &slot = arr.NextSlot();
+				ElementType *elem = slot.load();
+				if( ( elem != nullptr ) && ( elem != TakenMark() ) &&
+				    slot.compare_exchange_strong( elem, TakenMark() ) )
+				{
+					return elem;
+				}
+
+				// Ячейка пуста - Push-ей мало, сужаем диапазон
+				if( elem == nullptr )
+				{
+					arr.NarrowRange();
+				}
+				return nullptr;
+			}
+
+			/**
+			 * @brief PushElement добавление элемента в голову (или передача Pop-у)
+			 * @param elem новый элемент
+			 * @return true, если до добавления стек был пуст
+			 * (для переданного Pop-у элемента - false)
+			 */
+			bool PushElement( ElementType *elem )
+			{
+				MY_ASSERT( elem != nullptr );
+#ifdef UNITTEST
+				if( UseElimination && ForcedElimination().load() && EliminatePush( elem ) )
+				{
+					return false;
+				}
+#endif
+				ElementType *old_head = Head.load();
+				while( true )
+				{
+					elem->Next.store( old_head );
+					if( Head.compare_exchange_strong( old_head, elem ) )
+					{
+						return old_head == nullptr;
+					}
+
+					if( EliminatePush( elem ) )
+					{
+						return false;
+					}
+					old_head = Head.load();
+				}
+			}
+
+		public:
+#ifdef UNITTEST
+			/// Флаг, при котором Push и Pop сначала обращаются к массиву исключения
+			/// (без борьбы за голову передача элементов мимо стека почти не происходит)
+			static std::atomic<bool>& ForcedElimination()
+			{
+				static std::atomic<bool> Flag( false );
+				return Flag;
+			}
+#endif
+
+			Stack( const Stack& ) = delete;
+			Stack& operator=( const Stack& ) = delete;
+
+			/// Стек, использующий общую очередь на отложенное удаление
+			Stack(): Head( nullptr ),
+			         Elimination( nullptr ),
+			         DefaultQueue(),
+			         DefQueue( Reclamation::Shared() ) {}
+
+			Stack( Reclamation &def_queue ): Head( nullptr ),
+			                                 Elimination( nullptr ),
+			                                 DefaultQueue(),
+			                                 DefQueue( def_queue ) {}
+
+			Stack( uint8_t threads_num,
+			       uint8_t clean_period = GetCleanPeriod<T>() ):
+			    Head( nullptr ),
+			    Elimination( nullptr ),
+			    DefaultQueue( new Reclamation( threads_num, clean_period ) ),
+			    DefQueue( *DefaultQueue )
+			{
+				MY_ASSERT( DefaultQueue );
+			}
+
+			~Stack()
+			{
+				DeleteChain( Head.load() );
+				delete Elimination.load();
+			}
+
+			/**
+			 * @brief Push добавление нового элемента в стек
+			 * @param val значение нового элемента
+			 * @return true, если до добавления элемента стек был пуст
+			 */
+			bool Push( const T &val )
+			{
+				return PushElement( Allocator::template New<ElementType>( val ) );
+			}
+
+			/**
+			 * @brief Push добавление нового элемента в стек
+			 * @param val значение нового элемента
+			 * @return true, если до добавления элемента стек был пуст
+			 */
+			bool Push( T &&val )
+			{
+				return PushElement( Allocator::template New<ElementType>( std::move( val ) ) );
+			}
+
+			/**
+			 * @brief Push добавление нового элемента в стек
+			 * @param args аргументы для создания нового элемента
+			 * @return true, если до добавления элемента стек был пуст
+			 */
+			template <typename ...Types>
+			bool Push( Types ...args )
+			{
+				return PushElement( Allocator::template New<ElementType>( args... ) );
+			}
+
+			/**
+			 * @brief PushBatch добавление нескольких элементов в стек
+			 * (элементы связываются заранее и добавляются одной сменой головы;
+			 * последнее значение из vals окажется на вершине стека)
+			 * @param vals указатель на массив значений
+			 * @param num количество значений
+			 * @return true, если до добавления элементов стек был пуст
+			 * @throw std::invalid_argument, если vals нулевой при ненулевом num
+			 */
+			bool PushBatch( const T *vals, size_t num )
+			{
+				if( ( vals == nullptr ) && ( num > 0 ) )
+				{
+					MY_ASSERT( false );
+					throw std::invalid_argument( "Values pointer cannot be nullptr" );
+				}
+
+				if( num == 0 )
+				{
+					return false;
+				}
+
+				ElementType *top = nullptr;
+				ElementType *bottom = nullptr;
+				try
+				{
+					for( size_t t = 0; t < num; ++t )
+					{
+						ElementType *elem = Allocator::template New<ElementType>( vals[ t ] );
+						elem->Next.store( top );
+						top = elem;
+						if( bottom == nullptr )
+						{
+							bottom = elem;
+						}
+					}
+				}
+				catch( ... )
+				{
+					DeleteChain( top );
+					throw;
+				}
+
+				MY_ASSERT( ( top != nullptr ) && ( bottom != nullptr ) );
+				ElementType *old_head = Head.load();
+				while( true )
+				{
+					bottom->Next.store( old_head );
+					if( Head.compare_exchange_weak( old_head, top ) )
+					{
+						return old_head == nullptr;
+					}
+				}
+
+				MY_ASSERT( false );
+				return false;
+			} // bool PushBatch( const T *vals, size_t num )
+
+			/**
+			 * @brief PopAll извлечение всех элементов стека одной сменой головы
+			 * @param vals вектор, в конец которого будут добавлены значения
+			 * (начиная с вершины стека)
+			 * @return количество извлечённых элементов
+			 * @throw std::bad_alloc, если не удалось расширить vals (стек при этом
+			 * не изменяется); исключения конструктора перемещения T (не перенесённые
+			 * в vals значения при этом теряются)
+			 */
+			size_t PopAll( std::vector<T> &vals )
+			{
+				// Память в vals выделяется до отсоединения элементов:
+				// вернуть отсоединённые элементы в стек нельзя (ABA)
+				auto epoch_keeper = DefQueue.Acquire();
+				ElementType *head = epoch_keeper.Protect( 0, Head );
+				while( head != nullptr )
+				{
+					// Пока голова (защищённая в ячейке 0) на месте, цепочка под ней
+					// не изменяется: следующий элемент защищается в ячейке 1
+					// и считается достижимым после проверки головы
+					size_t num = 0;
+					for( ElementType *elem = head; ( elem != nullptr ) && ( Head.load() == head ); ++num )
+					{
+						const std::atomic<ElementType*> next( elem->Next.load() );
+						elem = epoch_keeper.Protect( 1, next );
+					}
+					vals.reserve( vals.size() + num );
+
+					if( Head.compare_exchange_strong( head, nullptr ) )
+					{
+						break;
+					}
+					head = epoch_keeper.Protect( 0, Head );
+				}
+				epoch_keeper.Release();
+
+				// Другие потоки ещё могут читать Next отсоединённых
+				// элементов, поэтому они удаляются отложенно
+				size_t res = 0;
+				try
+				{
+					for( ; head != nullptr; ++res )
+					{
+						vals.push_back( std::move( head->Value ) );
+						ElementType *next = head->Next.load();
+						DefQueue.template Delete<ElementType, Allocator>( head );
+						head = next;
+					}
+				}
+				catch( ... )
+				{
+					while( head != nullptr )
+					{
+						ElementType *next = head->Next.load();
+						DefQueue.template Delete<ElementType, Allocator>( head );
+						head = next;
+					}
+					throw;
+				}
+
+				DefQueue.ClearIfNeed();
+				return res;
+			} // size_t PopAll( std::vector<T> &vals )
+
+			/**
+			 * @brief Pop извлечение элемента из стека
+			 * @param default_value_ptr указатель на значение по умолчанию,
+			 * которое будет возвращено, если стек пуст;
+			 * если параметр нулевой и стек пуст - будет выброшено исключение std::out_of_range
+			 * @param is_empty если параемтр ненулевой - в него будет записана информация о том,
+			 * был ли удалён последний элемент из стека (если он был непустым)
+			 * @return элемент стека
+			 */
+			T Pop( const T *default_value_ptr = nullptr,
+			       bool *is_empty = nullptr )
+			{
+				T result;
+				if( is_empty != nullptr )
+				{
+					*is_empty = false;
+				}
+
+				// "Захватываем эпоху" (пока не отпустим - можем
+				// спокойно разыменовывать защищённые указатели списка)
+				auto epoch_keeper = DefQueue.Acquire();
+
+				auto old_head = epoch_keeper.Protect( 0, Head );
+				ElementType *eliminated = nullptr;
+#ifdef UNITTEST
+				if( UseElimination && ForcedElimination().load() )
+				{
+					eliminated = EliminatePop();
+					if( eliminated != nullptr )
+					{
+						old_head = nullptr;
+					}
+				}
+#endif
+
+				// Извлекаем первый элемент из головы списка,
+				// помещаем в голову следующий элемент
+				while( old_head != nullptr )
+				{
+					MY_ASSERT( old_head != nullptr );
+
+					// Получаем указатель на элемент, следующий за головным
+					auto new_head = old_head->Next.load();
+
+					// Пытаемся изменить значение Head
+					if( Head.compare_exchange_strong( old_head, new_head ) )
+					{
+						// Получилось
+						if( is_empty != nullptr )
+						{
+							*is_empty = new_head == nullptr;
+						}
+						break;
+					}
+
+					// Голова занята другими - пробуем забрать элемент у ожидающего Push-а
+					eliminated = EliminatePop();
+					if( eliminated != nullptr )
+					{
+						break;
+					}
+
+					// Новую голову надо защитить перед разыменованием
+					old_head = epoch_keeper.Protect( 0, Head );
+				} // while( old_head != nullptr )
+
+				// Отпускаем "эпоху"
+				epoch_keeper.Release();
+
+				if( eliminated != nullptr )
+				{
+					// Элемент не был в стеке и никому больше не виден
+					result = std::move( eliminated->Value );
+					Allocator::Delete( eliminated );
+				}
+				else if( old_head != nullptr )
+				{
+					// Стек не был пуст
+					result = std::move( old_head->Value );
+					DefQueue.template Delete<ElementType, Allocator>( old_head );
+					DefQueue.ClearIfNeed();
+				}
+				else
+				{
+					// Стек пуст
+					DefQueue.ClearIfNeed();
+					if( default_value_ptr != nullptr )
+					{
+						result = *default_value_ptr;
+					}
+					else
+					{
+						throw std::out_of_range( "Stack is empty!" );
+					}
+				}
+
+				return result;
+			} // T Pop
+			
+			/// Очистить очередь на отложенное удаление
+			void CleanDeferredQueue()
+			{
+				DefQueue.Clear();
+			}
+	};
+	
+	/// Класс двусторонней очереди, хранящей 64-битные беззнаковые числа
+	/// (Allocator - распределитель элементов: NewAllocator или PoolAllocator,
+	/// Reclamation - способ удаления элементов: DeferredDeleter или HazardDomain)
+	template <typename Allocator = NewAllocator, typename Reclamation = DeferredDeleter>
+	class BasicDigitsQueue
+	{
+		public:
+			typedef uint64_t Type;
+			
+			/// Фиктивное значение
+			const Type FakeValue;
+
+		private:
+			typedef internal::StructElementType<std::atomic<Type>> ElementType;
+
+			/// Голова (откуда читаем; читатели и писатели меняют голову
+			/// и хвост независимо, поэтому они лежат в разных кэш-линиях,
+			/// отдельных и от FakeValue, читаемого каждой операцией)
+			PaddedAtomic<ElementType*> Head;
+
+			/// Хвост (куда пишем)
+			PaddedAtomic<ElementType*> Tail;
+
+			/// Очередь для отсроченного удаления, используемая по умолчанию
+			std::unique_ptr<Reclamation> DefaultQueue;
+
+			/// Ссылка на очередь для отсроченного удаления
+			Reclamation &DefQueue;
+			
+			void Init()
+			{
+				ElementType *fake_element = Allocator::template New<ElementType>( FakeValue );
+				Head.store( fake_element );
+				Tail.store( fake_element );
+			}
+
+		public:
+			BasicDigitsQueue( const BasicDigitsQueue& ) = delete;
+			BasicDigitsQueue& operator=( const BasicDigitsQueue& ) = delete;
+
+			/// Очередь, использующая общую очередь на отложенное удаление
+			explicit BasicDigitsQueue( Type fake_value ): FakeValue( fake_value ),
+			                                              Head( nullptr ), Tail( nullptr ),
+			                                              DefaultQueue(),
+			                                              DefQueue( Reclamation::Shared() )
+			{
+				Init();
+			}
+
+			BasicDigitsQueue( Type fake_value,
+			                  Reclamation &def_deleter ): FakeValue( fake_value ),
+			                                              Head( nullptr ), Tail( nullptr ),
+			                                              DefaultQueue(),
+			                                              DefQueue( def_deleter )
+			{
+				Init();
+			}
+
+			BasicDigitsQueue( Type fake_value,
+			                  uint8_t threads_num,
+			                  uint16_t clean_period = GetCleanPeriod<Type>() ):
+			    FakeValue( fake_value ),
+			    Head( nullptr ), Tail( nullptr ),
+			    DefaultQueue( new Reclamation( threads_num, clean_period ) ),
+			    DefQueue( *DefaultQueue )
+			{
+				Init();
+			}
+
+			~BasicDigitsQueue()
+			{
+				ElementType *old_head = Head.load();
+				ElementType *tmp = nullptr;
+				while( old_head != nullptr )
+				{
+					tmp = old_head;
+					old_head = old_head->Next.load();
+					Allocator::Delete( tmp );
+				}
+			}
+
+			/**
+			 * @brief Push добавление нового элемента в хвост очереди
+			 * @param val новое значение
+			 * @throw std::invalid_argument, если val имеет фиктивное значение
+			 */
+			void Push( Type val )
+			{
+				if( val == FakeValue )
+				{
+					// Недопустимое значение
+					MY_ASSERT( false );
+					throw std::invalid_argument( "Cannot add fake value to queue" );
+				}
+				
+				ElementType *new_elem = nullptr;
+
+				// "Захватываем" эпоху, чтобы можно было обращаться к "хвосту"
+				// без риска, что он будет удалён
+				auto epoch_keeper = DefQueue.Acquire();
+
+				ElementType *old_tail = epoch_keeper.Protect( 0, Tail );
+				while( val != FakeValue )
+				{
+					MY_ASSERT( old_tail != nullptr );
+
+					// Создаём новый фиктивный элемент, если нужно
+					if( new_elem == nullptr )
+					{
+						new_elem = Allocator::template New<ElementType>( FakeValue );
+						MY_ASSERT( ( new_elem != nullptr ) && ( new_elem->Value.load() == FakeValue ) );
+					}
+
+					// Ожидаем, что в хвост ещё не записаны данные
+					Type expected_val = FakeValue;
+
+					// Пытаемся записать данные в фиктивный (предположительно) элемент
+					if( old_tail->Value.compare_exchange_strong( expected_val, val ) )
+					{
+						// Значение добавлено, присваиваем val-у фиктивное значение
+						val = FakeValue;
+					}
+					MY_ASSERT( old_tail->Value.load() != FakeValue );
+
+					// Пытаемся добавить фиктивный элемент в хвост
+					ElementType *expected_elem_ptr = nullptr;
+					if( old_tail->Next.compare_exchange_strong( expected_elem_ptr,
+					                                            new_elem ) )
+					{
+						// Фиктивный элемент добавлен
+						expected_elem_ptr = new_elem;
+						new_elem = nullptr;
+					}
+
+					// К этому моменту expected_elem_ptr хранит значение old_tail->Next
+					MY_ASSERT( expected_elem_ptr != nullptr );
+
+					// Записываем в Tail указатель на новый хвост
+					// (и защищаем его перед следующей попыткой)
+					Tail.compare_exchange_strong( old_tail, expected_elem_ptr );
+					old_tail = epoch_keeper.Protect( 0, Tail );
+				} // while( val != FakeValue )
+
+				// Неиспользованный фиктивный элемент
+				Allocator::Delete( new_elem );
+			} // void Push( Type val )
+			
+			template <typename T>
+			void Push( T *ptr )
+			{
+				Push( ( Type ) ptr );
+			}
+
+			/**
+			 * @brief PushBatch добавление нескольких элементов в хвост очереди
+			 * (первое значение записывается в текущий фиктивный хвост, остальные -
+			 * в заранее связанную цепочку, которая присоединяется к хвосту одной
+			 * операцией; порядок значений сохраняется)
+			 * @param vals указатель на массив значений
+			 * @param num количество значений
+			 * @throw std::invalid_argument, если vals нулевой при ненулевом num
+			 * или среди значений есть фиктивное (при исключении ни одно значение
+			 * не добавляется)
+			 */
+			void PushBatch( const Type *vals, size_t num )
+			{
+				if( ( vals == nullptr ) && ( num > 0 ) )
+				{
+					MY_ASSERT( false );
+					throw std::invalid_argument( "Values pointer cannot be nullptr" );
+				}
+
+				for( size_t t = 0; t < num; ++t )
+				{
+					if( vals[ t ] == FakeValue )
+					{
+						// Недопустимое значение
+						MY_ASSERT( false );
+						throw std::invalid_argument( "Cannot add fake value to queue" );
+					}
+				}
+
+				if( num == 0 )
+				{
+					return;
+				}
+
+				// Цепочка: элементы со 2-го по последнее значение и новый фиктивный
+				ElementType *chain = Allocator::template New<ElementType>( FakeValue );
+				ElementType *const chain_tail = chain;
+				try
+				{
+					for( size_t t = num - 1; t > 0; --t )
+					{
+						ElementType *elem = Allocator::template New<ElementType>( vals[ t ] );
+						elem->Next.store( chain );
+						chain = elem;
+					}
+				}
+				catch( ... )
+				{
+					for( ElementType *elem = chain; elem != nullptr; )
+					{
+						ElementType *next = elem->Next.load();
+						Allocator::Delete( elem );
+						elem = next;
+					}
+					throw;
+				}
+
+				Type val = vals[ 0 ];
+				ElementType *new_elem = nullptr;
+				auto epoch_keeper = DefQueue.Acquire();
+
+				ElementType *old_tail = epoch_keeper.Protect( 0, Tail );
+				while( chain != nullptr )
+				{
+					MY_ASSERT( old_tail != nullptr );
+
+					// Пытаемся записать очередное значение в фиктивный (предположительно) хвост
+					Type expected_val = FakeValue;
+					if( ( val != FakeValue ) &&
+					    old_tail->Value.compare_exchange_strong( expected_val, val ) )
+					{
+						val = FakeValue;
+					}
+					MY_ASSERT( old_tail->Value.load() != FakeValue );
+
+					ElementType *expected_elem_ptr = nullptr;
+					if( val == FakeValue )
+					{
+						// Значение записано - присоединяем цепочку
+						if( old_tail->Next.compare_exchange_strong( expected_elem_ptr, chain ) )
+						{
+							break;
+						}
+
+						// Хвост продлён другим писателем: первое значение
+						// цепочки надо записывать уже в новый хвост
+						if( chain == chain_tail )
+						{
+							// Все значения записаны
+							Allocator::Delete( chain );
+							chain = nullptr;
+						}
+						else
+						{
+							ElementType *first = chain;
+							val = first->Value.load();
+							chain = first->Next.load();
+							Allocator::Delete( first );
+						}
+					}
+					else
+					{
+						// В хвост записал значение другой писатель - помогаем ему
+						// продлить хвост (без памяти под фиктивный элемент ждём,
+						// чтобы не бросать исключение, добавив часть значений)
+						if( new_elem == nullptr )
+						{
+							try
+							{
+								new_elem = Allocator::template New<ElementType>( FakeValue );
+							}
+							catch( ... )
+							{
+								std::this_thread::yield();
+							}
+						}
+
+						if( ( new_elem != nullptr ) &&
+						    old_tail->Next.compare_exchange_strong( expected_elem_ptr, new_elem ) )
+						{
+							expected_elem_ptr = new_elem;
+							new_elem = nullptr;
+						}
+					}
+
+					if( expected_elem_ptr != nullptr )
+					{
+						Tail.compare_exchange_strong( old_tail, expected_elem_ptr );
+					}
+					old_tail = epoch_keeper.Protect( 0, Tail );
+				} // while( chain != nullptr )
+
+				if( ( chain != nullptr ) && !Tail.compare_exchange_strong( old_tail, chain_tail ) )
+				{
+					// Хвост уже сдвинут на начало цепочки другим писателем -
+					// доводим его до конца, чтобы читатели видели все значения
+					for( old_tail = epoch_keeper.Protect( 0, Tail );
+					     old_tail->Next.load() != nullptr;
+					     old_tail = epoch_keeper.Protect( 0, Tail ) )
+					{
+						Tail.compare_exchange_strong( old_tail, old_tail->Next.load() );
+					}
+				}
+
+				// Неиспользованный фиктивный элемент
+				Allocator::Delete( new_elem );
+			} // void PushBatch( const Type *vals, size_t num )
+
+			/**
+			 * @brief Pop извлечение элемента из головы очереди
+			 * если очередь пуста - будет возвращено фиктивное значение
+			 * @return элемент из головы очереди
+			 */
+			Type Pop()
+			{
+				Type res = FakeValue;
+				auto epoch_keeper = DefQueue.Acquire();
+				ElementType *old_head = epoch_keeper.Protect( 0, Head );
+				ElementType *extracted = nullptr;
+
+				while( res == FakeValue )
+				{
+					MY_ASSERT( old_head != nullptr );
+					if( old_head == Tail.load() )
+					{
+						// Очередь состоит из одного элемента (считаем, что пуста)
+						break;
+					}
+
+					auto new_head = old_head->Next.load();
+					MY_ASSERT( new_head != nullptr );
+					if( Head.compare_exchange_weak( old_head, new_head ) )
+					{
+						// Элемент из головы очереди извлечён
+						res = old_head->Value.load();
+						MY_ASSERT( res != FakeValue );
+						extracted = old_head;
+					}
+					else
+					{
+						old_head = epoch_keeper.Protect( 0, Head );
+					}
+				} // while( res == FakeValue )
+
+				// Отпускаем эпоху, удаляем извлечённый элемент (его ещё могут
+				// читать другие потоки) и элементы очереди, которые можно
+				epoch_keeper.Release();
+				DefQueue.template Delete<ElementType, Allocator>( extracted );
+				DefQueue.ClearIfNeed();
+				
+				return res;
+			} // Type Pop()
+
+			/**
+			 * @brief PopAll извлечение всех элементов очереди одной сменой головы
+			 * (голова переносится сразу в хвост, прочитанный перед этим)
+			 * @param vals вектор, в конец которого будут добавлены значения
+			 * @return количество извлечённых значений
+			 * @throw std::bad_alloc, если не удалось расширить vals
+			 * (очередь при этом не изменяется)
+			 */
+			size_t PopAll( std::vector<Type> &vals )
+			{
+				return PopAll( vals, vals );
+			}
+
+			/**
+			 * @brief PopAll извлечение всех элементов очереди одной сменой головы
+			 * с выделением памяти под столько же элементов ещё в одном векторе
+			 * (для последующего преобразования значений без выделения памяти)
+			 * @param vals вектор, в конец которого будут добавлены значения
+			 * @param reserved вектор, в котором резервируется место под
+			 * извлечённые значения (значения в него не добавляются)
+			 * @return количество извлечённых значений
+			 * @throw std::bad_alloc, если не удалось расширить vals или reserved
+			 * (очередь при этом не изменяется)
+			 */
+			template <typename Reserved>
+			size_t PopAll( std::vector<Type> &vals, std::vector<Reserved> &reserved )
+			{
+				auto epoch_keeper = DefQueue.Acquire();
+				ElementType *old_head = epoch_keeper.Protect( 0, Head );
+				ElementType *old_tail = nullptr;
+				size_t res = 0;
+
+				while( true )
+				{
+					MY_ASSERT( old_head != nullptr );
+					old_tail = Tail.load();
+					if( old_head == old_tail )
+					{
+						// Очередь пуста
+						break;
+					}
+
+					// Голова не обгоняет хвост, поэтому old_tail достижим из old_head;
+					// память выделяется до переноса головы. Пока голова (защищённая
+					// в ячейке 0) на месте, элементы за ней не извлекаются: следующий
+					// элемент защищается в ячейке 1 и считается достижимым после проверки головы
+					res = 0;
+					for( ElementType *elem = old_head; ( elem != old_tail ) && ( Head.load() == old_head ); ++res )
+					{
+						const std::atomic<ElementType*> next( elem->Next.load() );
+						elem = epoch_keeper.Protect( 1, next );
+						MY_ASSERT( elem != nullptr );
+					}
+					vals.reserve( vals.size() + res );
+					reserved.reserve( reserved.size() + res );
+
+					if( Head.compare_exchange_weak( old_head, old_tail ) )
+					{
+						break;
+					}
+					res = 0;
+					old_head = epoch_keeper.Protect( 0, Head );
+				}
+
+				// Элементы от old_head до old_tail больше никто не извлечёт
+				epoch_keeper.Release();
+
+				for( ElementType *elem = old_head, *next = nullptr; elem != old_tail; elem = next )
+				{
+					next = elem->Next.load();
+					MY_ASSERT( next != nullptr );
+					MY_ASSERT( elem->Value.load() != FakeValue );
+					vals.push_back( elem->Value.load() );
+					DefQueue.template Delete<ElementType, Allocator>( elem );
+				}
+				DefQueue.ClearIfNeed();
+
+				return res;
+			} // size_t PopAll( std::vector<Type> &vals, std::vector<Reserved> &reserved )
+			
+			/// Очистить очередь на отложенное удаление
+			void CleanDeferredQueue()
+			{
+				DefQueue.Clear();
+			}
+	}; // class BasicDigitsQueue
+
+	/// Очередь чисел, элементы которой создаются через new/delete
+	typedef BasicDigitsQueue<> DigitsQueue;
+
+	/// Класс двусторонней очереди
+	/// (Allocator - распределитель элементов внутренней очереди указателей,
+	/// Reclamation - способ их удаления: DeferredDeleter или HazardDomain)
+	template <typename T, typename Allocator = NewAllocator, typename Reclamation = DeferredDeleter>
+	class Queue
+	{
+		public:
+			typedef T Type;
+
+		private:
+			/// Очередь, хранящая указатели в виде чисел
+			BasicDigitsQueue<Allocator, Reclamation> PtrsQueue;
+
+			/// Добавляет новый элемент в хвост
+			void PushElement( std::unique_ptr<T> &val_smart_ptr )
+			{
+				MY_ASSERT( val_smart_ptr );
+				MY_ASSERT( sizeof( typename BasicDigitsQueue<Allocator, Reclamation>::Type ) >= sizeof( val_smart_ptr.get() ) );
+				PtrsQueue.Push( ( typename BasicDigitsQueue<Allocator, Reclamation>::Type ) val_smart_ptr.get() );
+				val_smart_ptr.release();
+			}
+
+		public:
+			Queue( const Queue& ) = delete;
+			Queue& operator=( const Queue& ) = delete;
+
+			/// Очередь, использующая общую очередь на отложенное удаление
+			Queue(): PtrsQueue( 0 )
+			{}
+
+			Queue( Reclamation &def_deleter ): PtrsQueue( 0, def_deleter )
+			{}
+
+			Queue( uint8_t threads_num,
+			       uint16_t clean_period = GetCleanPeriod<T>() ): PtrsQueue( 0, threads_num, clean_period )
+			{}
+
+			~Queue()
+			{
+				for( auto val = PtrsQueue.Pop(); val != 0; val = PtrsQueue.Pop() )
+				{
+					delete ( T* ) val;
+				}
+			}
+
+			/**
+			 * @brief Push добавление нового элемента в хвост очереди
+			 * @param val новое значение
+			 */
+			void Push( const T &val )
+			{
+				std::unique_ptr<T> val_smart_ptr( new T( val ) );
+				PushElement( val_smart_ptr );
+			}
+
+			/**
+			 * @brief Push добавление нового элемента в хвост очереди
+			 * @param val новое значение
+			 */
+			void Push( T &&val )
+			{
+				std::unique_ptr<T> val_smart_ptr( new T( std::move( val ) ) );
+				PushElement( val_smart_ptr );
+			}
+
+			/**
+			 * @brief Push добавление нового элемента в хвост очереди
+			 * @param args аргументы для создания нового элемента
+			 */
+			template <typename ...Types>
+			void Push( Types ...args )
+			{
+				std::unique_ptr<T> val_smart_ptr( new T( args... ) );
+				PushElement( val_smart_ptr );
+			}
+
+			/**
+			 * @brief Pop извлечение элемента из головы очереди
+			 * если очередь пуста - будет возвращён нулевой указатель
+			 * @return элемент (в виде указателя) из головы очереди
+			 */
+			std::unique_ptr<T> Pop()
+			{
+				return std::unique_ptr<T>( ( T* ) PtrsQueue.Pop() );
+			}
+
+			/**
+			 * @brief PushBatch добавление нескольких элементов в хвост очереди
+			 * одной операцией (см. BasicDigitsQueue::PushBatch)
+			 * @param vals указатель на массив значений
+			 * @param num количество значений
+			 * @throw std::invalid_argument, если vals нулевой при ненулевом num
+			 */
+			void PushBatch( const T *vals, size_t num )
+			{
+				if( ( vals == nullptr ) && ( num > 0 ) )
+				{
+					MY_ASSERT( false );
+					throw std::invalid_argument( "Values pointer cannot be nullptr" );
+				}
+
+				std::vector<typename BasicDigitsQueue<Allocator, Reclamation>::Type> ptrs;
+				try
+				{
+					ptrs.reserve( num );
+					for( size_t t = 0; t < num; ++t )
+					{
+						ptrs.push_back( ( typename BasicDigitsQueue<Allocator, Reclamation>::Type ) new T( vals[ t ] ) );
+					}
+
+					// При исключении ни один указатель в очередь не попадает
+					PtrsQueue.PushBatch( ptrs.data(), ptrs.size() );
+				}
+				catch( ... )
+				{
+					for( auto ptr : ptrs )
+					{
+						delete ( T* ) ptr;
+					}
+					throw;
+				}
+			} // void PushBatch( const T *vals, size_t num )
+
+			/**
+			 * @brief PopAll извлечение всех элементов очереди одной операцией
+			 * @param vals вектор, в конец которого будут добавлены элементы
+			 * @return количество извлечённых элементов
+			 * @throw std::bad_alloc, если не удалось выделить память
+			 * (очередь при этом не изменяется)
+			 */
+			size_t PopAll( std::vector<std::unique_ptr<T>> &vals )
+			{
+				// Место в vals выделяется до извлечения указателей
+				std::vector<typename BasicDigitsQueue<Allocator, Reclamation>::Type> ptrs;
+				const size_t res = PtrsQueue.PopAll( ptrs, vals );
+
+				for( auto ptr : ptrs )
+				{
+					vals.emplace_back( ( T* ) ptr );
+				}
+				return res;
+			} // size_t PopAll( std::vector<std::unique_ptr<T>> &vals )
+			
+			/// Очистить очередь на отложенное удаление
+			void CleanDeferredQueue()
+			{
+				PtrsQueue.CleanDeferredQueue();
+			}
+	}; // class Queue
+
+	/**
+	 * @brief The RingQueue class ограниченная очередь на кольцевом буфере
+	 * (много писателей - много читателей, по схеме Д. Вьюкова с номерами
+	 * последовательности в ячейках). Значения хранятся в самих ячейках,
+	 * операции не выделяют память и не используют отложенное удаление.
+	 * Перемещающий конструктор T не должен выбрасывать исключений
+	 * @tparam T тип значений
+	 * @tparam Capacity ёмкость (степень двойки: индекс ячейки получается маской)
+	 */
+	template <typename T, size_t Capacity>
+	class RingQueue
+	{
+		static_assert( ( Capacity >= 2 ) && ( ( Capacity & ( Capacity - 1 ) ) == 0 ),
+		               "Capacity must be a power of 2" );
+
+		public:
+			typedef T Type;
+
+		private:
+			/// Маска индекса ячейки
+			static const size_t IndexMask = Capacity - 1;
+
+			/// Ячейка буфера
+			struct Cell
+			{
+				/// Номер последовательности: равен позиции, если ячейка свободна
+				/// для записи в неё, позиции + 1 - если в ней лежит значение
+				std::atomic<size_t> Sequence;
+
+				/// Память под значение
+				typename std::aligned_storage<sizeof( T ), std::alignment_of<T>::value>::type Storage;
+			};
+
+			/// Позиция очередной записи
+			PaddedAtomic<size_t> PushPos;
+
+			/// Позиция очередного чтения
+			PaddedAtomic<size_t> PopPos;
+
+			/// Буфер ячеек (указатель только читается)
+			std::unique_ptr<Cell[]> Buffer;
+			uint8_t Padding1[ CacheLineSize - sizeof( std::unique_ptr<Cell[]> ) ];
+
+			/**
+			 * @brief AcquirePush захват позиций для записи
+			 * @param max_num максимальное количество позиций
+			 * @param pos буфер для записи первой захваченной позиции
+			 * @return количество захваченных подряд позиций (0 - если очередь полна)
+			 */
+			size_t AcquirePush( size_t max_num, size_t &pos )
+			{
+				pos = PushPos.load( std::memory_order_relaxed );
+				while( max_num > 0 )
+				{
+					// Считаем подряд идущие свободные ячейки, начиная с pos
+					size_t num = 0;
+					for( ; num < max_num; ++num )
+					{
+						const size_t seq = Buffer[ ( pos + num ) & IndexMask ].Sequence.load( std::memory_order_acquire );
+						if( seq != pos + num )
+						{
+							break;
+						}
+					}
+
+					if( num == 0 )
+					{
+						const size_t seq = Buffer[ pos & IndexMask ].Sequence.load( std::memory_order_acquire );
+						if( ( intptr_t ) ( seq - pos ) < 0 )
+						{
+							// Ячейку ещё не освободил читатель предыдущего круга - очередь полна
+							return 0;
+						}
+
+						// Позицию уже захватил другой писатель
+						pos = PushPos.load( std::memory_order_relaxed );
+						continue;
+					}
+
+					// Свободная ячейка не может стать занятой, пока её позиция
+					// не захвачена, поэтому все num ячеек остаются нашими
+					if( PushPos.compare_exchange_weak( pos, pos + num, std::memory_order_relaxed ) )
+					{
+						return num;
+					}
+				} // while( max_num > 0 )
+
+				return 0;
+			} // size_t AcquirePush( size_t max_num, size_t &pos )
+
+			/**
+			 * @brief AcquirePop захват позиций для чтения
+			 * @param max_num максимальное количество позиций
+			 * @param pos буфер для записи первой захваченной позиции
+			 * @return количество захваченных подряд позиций (0 - если очередь пуста)
+			 */
+			size_t AcquirePop( size_t max_num, size_t &pos )
+			{
+				pos = PopPos.load( std::memory_order_relaxed );
+				while( max_num > 0 )
+				{
+					size_t num = 0;
+					for( ; num < max_num; ++num )
+					{
+						const size_t seq = Buffer[ ( pos + num ) & IndexMask ].Sequence.load( std::memory_order_acquire );
+						if( seq != pos + num + 1 )
+						{
+							break;
+						}
+					}
+
+					if( num == 0 )
+					{
+						const size_t seq = Buffer[ pos & IndexMask ].Sequence.load( std::memory_order_acquire );
+						if( ( intptr_t ) ( seq - ( pos + 1 ) ) < 0 )
+						{
+							// Значение ещё не записано - очередь пуста
+							return 0;
+						}
+
+						pos = PopPos.load( std::memory_order_relaxed );
+						continue;
+					}
+
+					if( PopPos.compare_exchange_weak( pos, pos + num, std::memory_order_relaxed ) )
+					{
+						return num;
+					}
+				} // while( max_num > 0 )
+
+				return 0;
+			} // size_t AcquirePop( size_t max_num, size_t &pos )
+
+			/// Запись значения в захваченную позицию
+			template <typename V>
+			void Put( size_t pos, V &&val )
+			{
+				Cell &cell = Buffer[ pos & IndexMask ];
+				new( &cell.Storage ) T( std::forward<V>( val ) );
+				cell.Sequence.store( pos + 1, std::memory_order_release );
+			}
+
+			/// Извлечение значения из захваченной позиции
+			void Take( size_t pos, T &val )
+			{
+				Cell &cell = Buffer[ pos & IndexMask ];
+				T *ptr = reinterpret_cast<T*>( &cell.Storage );
+				val = std::move( *ptr );
+				ptr->~T();
+
+				// Ячейка освобождается для записи на следующем круге
+				cell.Sequence.store( pos + Capacity, std::memory_order_release );
+			}
+
+		public:
+			RingQueue( const RingQueue& ) = delete;
+			RingQueue& operator=( const RingQueue& ) = delete;
+
+			RingQueue(): PushPos( 0 ),
+			             PopPos( 0 ),
+			             Buffer( new Cell[ Capacity ] )
+			{
+				for( size_t t = 0; t < Capacity; ++t )
+				{
+					Buffer[ t ].Sequence.store( t, std::memory_order_relaxed );
+				}
+			}
+
+			~RingQueue()
+			{
+				for( size_t pos = PopPos.load(), end = PushPos.load(); pos != end; ++pos )
+				{
+					reinterpret_cast<T*>( &Buffer[ pos & IndexMask ].Storage )->~T();
+				}
+			}
+
+			/// Ёмкость очереди
+			static size_t GetCapacity()
+			{
+				return Capacity;
+			}
+
+			/**
+			 * @brief TryPush добавление нового элемента в хвост очереди
+			 * @param val новое значение
+			 * @return false, если очередь полна (значение не добавлено)
+			 */
+			bool TryPush( const T &val )
+			{
+				// Копия создаётся до захвата ячейки: исключение из
+				// копирующего конструктора не оставит её занятой
+				T tmp( val );
+				return TryPush( std::move( tmp ) );
+			}
+
+			/**
+			 * @brief TryPush добавление нового элемента в хвост очереди
+			 * @param val новое значение (перемещается, только если добавлено)
+			 * @return false, если очередь полна (значение не добавлено)
+			 */
+			bool TryPush( T &&val )
+			{
+				size_t pos = 0;
+				if( AcquirePush( 1, pos ) == 0 )
+				{
+					return false;
+				}
+
+				Put( pos, std::move( val ) );
+				return true;
+			}
+
+			/**
+			 * @brief TryPop извлечение элемента из головы очереди
+			 * @param val буфер для записи значения
+			 * @return false, если очередь пуста (val не изменён)
+			 */
+			bool TryPop( T &val )
+			{
+				size_t pos = 0;
+				if( AcquirePop( 1, pos ) == 0 )
+				{
+					return false;
+				}
+
+				Take( pos, val );
+				return true;
+			}
+
+			/**
+			 * @brief TryPushBatch добавление нескольких элементов в хвост очереди
+			 * (позиции захватываются одной операцией, элементы идут подряд;
+			 * значения копируются в уже захваченные ячейки, поэтому копирующий
+			 * конструктор T не должен выбрасывать исключений)
+			 * @param vals указатель на массив значений
+			 * @param num количество значений
+			 * @return количество добавленных значений (первые из vals;
+			 * меньше num - если очередь заполнилась)
+			 */
+			size_t TryPushBatch( const T *vals, size_t num )
+			{
+				if( ( vals == nullptr ) && ( num > 0 ) )
+				{
+					MY_ASSERT( false );
+					throw std::invalid_argument( "Values pointer cannot be nullptr" );
+				}
+
+				size_t pos = 0;
+				const size_t res = AcquirePush( num, pos );
+				for( size_t t = 0; t < res; ++t )
+				{
+					Put( pos + t, vals[ t ] );
+				}
+				return res;
+			}
+
+			/**
+			 * @brief TryPopBatch извлечение нескольких элементов из головы очереди
+			 * (позиции захватываются одной операцией)
+			 * @param vals указатель на буфер для записи значений
+			 * @param max_num размер буфера
+			 * @return количество извлечённых значений (0 - если очередь пуста)
+			 */
+			size_t TryPopBatch( T *vals, size_t max_num )
+			{
+				if( ( vals == nullptr ) && ( max_num > 0 ) )
+				{
+					MY_ASSERT( false );
+					throw std::invalid_argument( "Values pointer cannot be nullptr" );
+				}
+
+				size_t pos = 0;
+				const size_t res = AcquirePop( max_num, pos );
+				for( size_t t = 0; t < res; ++t )
+				{
+					Take( pos + t, vals[ t ] );
+				}
+				return res;
+			}
+	}; // class RingQueue
+
+	/**
+	 * @brief The SpscRingQueue class ограниченная очередь на кольцевом буфере
+	 * для одного писателя и одного читателя (операции без ожидания). Позиция
+	 * записи и копия позиции чтения у писателя лежат в одной кэш-линии, позиция
+	 * чтения и копия позиции записи у читателя - в другой: чужая позиция
+	 * перечитывается, только когда по копии места (значений) не хватает.
+	 * Значения хранятся в самих ячейках; ячейки можно заполнять и читать
+	 * на месте (ReservePush/CommitPush, ReservePop/CommitPop)
+	 * @tparam T тип значений
+	 * @tparam Capacity ёмкость (степень двойки: индекс ячейки получается маской)
+	 */
+	template <typename T, size_t Capacity>
+	class SpscRingQueue
+	{
+		static_assert( ( Capacity >= 2 ) && ( ( Capacity & ( Capacity - 1 ) ) == 0 ),
+		               "Capacity must be a power of 2" );
+
+		public:
+			typedef T Type;
+
+		private:
+			/// Маска индекса ячейки
+			static const size_t IndexMask = Capacity - 1;
+
+			/// Память под значение
+			typedef typename std::aligned_storage<sizeof( T ), std::alignment_of<T>::value>::type StorageType;
+
+			/// Отступ, чтобы позиции не делили кэш-линию с соседними полями
+			uint8_t Padding0[ CacheLineSize ];
+
+			/// Позиция очередной записи (изменяется только писателем)
+			std::atomic<size_t> WritePos;
+
+			/// Последняя прочитанная писателем позиция чтения
+			size_t CachedReadPos;
+			uint8_t Padding1[ CacheLineSize - sizeof( std::atomic<size_t> ) - sizeof( size_t ) ];
+
+			/// Позиция очередного чтения (изменяется только читателем)
+			std::atomic<size_t> ReadPos;
+
+			/// Последняя прочитанная читателем позиция записи
+			size_t CachedWritePos;
+			uint8_t Padding2[ CacheLineSize - sizeof( std::atomic<size_t> ) - sizeof( size_t ) ];
+
+			/// Буфер ячеек (указатель только читается)
+			std::unique_ptr<StorageType[]> Buffer;
+			uint8_t Padding3[ CacheLineSize - sizeof( std::unique_ptr<StorageType[]> ) ];
+
+			/// Указатель на значение в позиции
+			T* Slot( size_t pos ) const
+			{
+				return reinterpret_cast<T*>( &Buffer[ pos & IndexMask ] );
+			}
+
+		public:
+			SpscRingQueue( const SpscRingQueue& ) = delete;
+			SpscRingQueue& operator=( const SpscRingQueue& ) = delete;
+
+			SpscRingQueue(): WritePos( 0 ),
+			                 CachedReadPos( 0 ),
+			                 ReadPos( 0 ),
+			                 CachedWritePos( 0 ),
+			                 Buffer( new StorageType[ Capacity ] )
+			{}
+
+			~SpscRingQueue()
+			{
+				for( size_t pos = ReadPos.load(), end = WritePos.load(); pos != end; ++pos )
+				{
+					Slot( pos )->~T();
+				}
+			}
+
+			/// Ёмкость очереди
+			static size_t GetCapacity()
+			{
+				return Capacity;
+			}
+
+			/**
+			 * @brief ReservePush получение идущих подряд свободных ячеек для записи
+			 * (вызывается только писателем). Ячейки не инициализированы: значения
+			 * создаются в них размещающим new, после чего вызывается CommitPush
+			 * @param max_num максимальное количество ячеек
+			 * @param first буфер для записи указателя на первую ячейку
+			 * @return количество ячеек (0 - если очередь полна; ячейки не переходят
+			 * через конец буфера, поэтому их может быть меньше свободного места)
+			 */
+			size_t ReservePush( size_t max_num, T *&first )
+			{
+				const size_t pos = WritePos.load( std::memory_order_relaxed );
+				size_t free_num = Capacity - ( pos - CachedReadPos );
+				if( free_num < max_num )
+				{
+					CachedReadPos = ReadPos.load( std::memory_order_acquire );
+					free_num = Capacity - ( pos - CachedReadPos );
+				}
+
+				const size_t to_end = Capacity - ( pos & IndexMask );
+				size_t res = max_num < free_num ? max_num : free_num;
+				res = res < to_end ? res : to_end;
+				first = Slot( pos );
+				return res;
+			}
+
+			/**
+			 * @brief CommitPush публикация значений, созданных в ячейках от ReservePush
+			 * (вызывается только писателем)
+			 * @param num количество значений (не больше полученного от ReservePush)
+			 */
+			void CommitPush( size_t num )
+			{
+				MY_ASSERT( WritePos.load() + num - CachedReadPos <= Capacity );
+				WritePos.store( WritePos.load( std::memory_order_relaxed ) + num, std::memory_order_release );
+			}
+
+			/**
+			 * @brief ReservePop получение идущих подряд значений для чтения на месте
+			 * (вызывается только читателем); после чтения вызывается CommitPop
+			 * @param max_num максимальное количество значений
+			 * @param first буфер для записи указателя на первое значение
+			 * @return количество значений (0 - если очередь пуста; значения не
+			 * переходят через конец буфера, поэтому их может быть меньше записанных)
+			 */
+			size_t ReservePop( size_t max_num, T *&first )
+			{
+				const size_t pos = ReadPos.load( std::memory_order_relaxed );
+				size_t ready_num = CachedWritePos - pos;
+				if( ready_num < max_num )
+				{
+					CachedWritePos = WritePos.load( std::memory_order_acquire );
+					ready_num = CachedWritePos - pos;
+				}
+
+				const size_t to_end = Capacity - ( pos & IndexMask );
+				size_t res = max_num < ready_num ? max_num : ready_num;
+				res = res < to_end ? res : to_end;
+				first = Slot( pos );
+				return res;
+			}
+
+			/**
+			 * @brief CommitPop удаление прочитанных значений и освобождение их ячеек
+			 * (вызывается только читателем)
+			 * @param num количество значений (не больше полученного от ReservePop)
+			 */
+			void CommitPop( size_t num )
+			{
+				const size_t pos = ReadPos.load( std::memory_order_relaxed );
+				MY_ASSERT( CachedWritePos - pos >= num );
+				for( size_t t = 0; t < num; ++t )
+				{
+					Slot( pos + t )->~T();
+				}
+				ReadPos.store( pos + num, std::memory_order_release );
+			}
+
+			/**
+			 * @brief TryEmplace создание нового элемента прямо в ячейке хвоста очереди
+			 * @param args аргументы для создания нового элемента
+			 * @return false, если очередь полна (элемент не создан)
+			 */
+			template <typename ...Types>
+			bool TryEmplace( Types&& ...args )
+			{
+				T *slot = nullptr;
+				if( ReservePush( 1, slot ) == 0 )
+				{
+					return false;
+				}
+
+				new( slot ) T( std::forward<Types>( args )... );
+				CommitPush( 1 );
+				return true;
+			}
+
+			/**
+			 * @brief TryPush добавление нового элемента в хвост очереди
+			 * @param val новое значение
+			 * @return false, если очередь полна (значение не добавлено)
+			 */
+			bool TryPush( const T &val )
+			{
+				return TryEmplace( val );
+			}
+
+			/**
+			 * @brief TryPush добавление нового элемента в хвост очереди
+			 * @param val новое значение (перемещается, только если добавлено)
+			 * @return false, если очередь полна (значение не добавлено)
+			 */
+			bool TryPush( T &&val )
+			{
+				return TryEmplace( std::move( val ) );
+			}
+
+			/**
+			 * @brief TryPop извлечение элемента из головы очереди
+			 * @param val буфер для записи значения
+			 * @return false, если очередь пуста (val не изменён)
+			 */
+			bool TryPop( T &val )
+			{
+				T *slot = nullptr;
+				if( ReservePop( 1, slot ) == 0 )
+				{
+					return false;
+				}
+
+				val = std::move( *slot );
+				CommitPop( 1 );
+				return true;
+			}
+	}; // class SpscRingQueue
+
+	/**
+	 * @brief The SegmentedQueue class неограниченная очередь (много писателей -
+	 * много читателей) из сегментов-массивов, хранящих значения в ячейках.
+	 * Позиции в сегменте раздаются атомарным сложением; память выделяется
+	 * один раз на сегмент, отработавшие сегменты после отложенного удаления
+	 * возвращаются в список свободных и используются повторно
+	 * @tparam T тип значений
+	 * @tparam SegmentSize количество ячеек в сегменте
+	 */
+	template <typename T, size_t SegmentSize = 64>
+	class SegmentedQueue
+	{
+		static_assert( SegmentSize > 0, "Segment size cannot be zero" );
+
+		public:
+			typedef T Type;
+
+		private:
+			/// Состояния ячейки
+			enum CellState: uint8_t
+			{
+				/// Ячейка свободна
+				CellEmpty = 0,
+
+				/// Писатель создаёт в ячейке значение
+				CellWriting,
+
+				/// В ячейке лежит значение
+				CellReady,
+
+				/// Ячейка пропущена (читатель опередил писателя или не дождался
+				/// его, либо при создании значения было выброшено исключение)
+				CellSkipped
+			};
+
+			/// Сколько раз читатель проверяет ячейку, в которой писатель
+			/// создаёт значение, прежде чем пропустить её
+			static const uint16_t WritingSpins = 0x40;
+
+			/// Ячейка сегмента
+			struct Cell
+			{
+				std::atomic<uint8_t> State;
+
+				/// Память под значение
+				typename std::aligned_storage<sizeof( T ), std::alignment_of<T>::value>::type Storage;
+			};
+
+			/// Сегмент очереди
+			struct Segment
+			{
+				/// Номер очередной ячейки для записи
+				PaddedAtomic<size_t> PushIdx;
+
+				/// Номер очередной ячейки для чтения
+				PaddedAtomic<size_t> PopIdx;
+
+				/// Следующий сегмент (в списке свободных - тоже)
+				std::atomic<Segment*> Next;
+
+				Cell Cells[ SegmentSize ];
+
+				Segment()
 				{
-					*is_empty = false;
+					Reset();
+				}
+
+				/// Подготовка сегмента к (повторному) использованию
+				void Reset()
+				{
+					PushIdx.store( 0, std::memory_order_relaxed );
+					PopIdx.store( 0, std::memory_order_relaxed );
+					Next.store( nullptr, std::memory_order_relaxed );
+					for( auto &cell : Cells )
+					{
+						cell.State.store( CellEmpty, std::memory_order_relaxed );
+					}
+				}
+			};
+
+			/// Список свободных сегментов (разделяется очередью
+			/// и сегментами, ожидающими отложенного удаления)
+			class SegmentPool
+			{
+				private:
+					/// Максимальное количество хранимых свободных сегментов
+					static const size_t MaxFreeNum = 4;
+
+					std::atomic<Segment*> FreeList;
+					std::atomic<size_t> FreeNum;
+
+				public:
+					SegmentPool( const SegmentPool& ) = delete;
+					SegmentPool& operator=( const SegmentPool& ) = delete;
+
+					SegmentPool(): FreeList( nullptr ), FreeNum( 0 ) {}
+
+					~SegmentPool()
+					{
+						Segment *seg = FreeList.load();
+						while( seg != nullptr )
+						{
+							Segment *next = seg->Next.load();
+							delete seg;
+							seg = next;
+						}
+					}
+
+					/// Получение свободного сегмента (или создание нового)
+					Segment* Get()
+					{
+						// Список забирается целиком (без риска ABA), лишнее возвращается
+						Segment *seg = FreeList.exchange( nullptr );
+						if( seg == nullptr )
+						{
+							return new Segment;
+						}
+
+						Segment *rest = seg->Next.load();
+						if( rest != nullptr )
+						{
+							Segment *bottom = rest;
+							size_t num = 1;
+							for( ; bottom->Next.load() != nullptr; bottom = bottom->Next.load(), ++num ) {}
+
+							FreeNum -= num;
+							Segment *old_head = FreeList.load();
+							do
+							{
+								bottom->Next.store( old_head );
+							}
+							while( !FreeList.compare_exchange_weak( old_head, rest ) );
+							FreeNum += num;
+						}
+						--FreeNum;
+
+						seg->Reset();
+						return seg;
+					}
+
+					/// Возврат сегмента, с которым больше никто не работает
+					void Put( Segment *seg )
+					{
+						MY_ASSERT( seg != nullptr );
+						if( FreeNum.load() >= MaxFreeNum )
+						{
+							delete seg;
+							return;
+						}
+
+						++FreeNum;
+						Segment *old_head = FreeList.load();
+						do
+						{
+							seg->Next.store( old_head );
+						}
+						while( !FreeList.compare_exchange_weak( old_head, seg ) );
+					}
+			};
+
+			/// Возвращает сегмент в список свободных, когда его удаление
+			/// разрешит очередь на отложенное удаление
+			struct SegmentRecycler
+			{
+				Segment *Seg;
+				std::shared_ptr<SegmentPool> Pool;
+
+				SegmentRecycler( Segment *seg,
+				                 const std::shared_ptr<SegmentPool> &pool ): Seg( seg ), Pool( pool ) {}
+
+				~SegmentRecycler()
+				{
+					Pool->Put( Seg );
+				}
+			};
+
+			/// Сегмент, из которого читаем
+			PaddedAtomic<Segment*> Head;
+
+			/// Сегмент, в который пишем
+			PaddedAtomic<Segment*> Tail;
+
+			/// Свободные сегменты
+			std::shared_ptr<SegmentPool> Pool;
+
+			/// Очередь для отсроченного удаления, используемая по умолчанию
+			std::unique_ptr<DeferredDeleter> DefaultQueue;
+
+			/// Ссылка на очередь для отсроченного удаления
+			DeferredDeleter &DefQueue;
+
+			void Init()
+			{
+				Segment *seg = Pool->Get();
+				Head.store( seg );
+				Tail.store( seg );
+			}
+
+			/// Добавление значения (вызывается с захваченной эпохой)
+			template <typename V>
+			void PushValue( V &&val )
+			{
+				while( true )
+				{
+					Segment *tail = Tail.load();
+					const size_t idx = tail->PushIdx.fetch_add( 1 );
+					if( idx < SegmentSize )
+					{
+						Cell &cell = tail->Cells[ idx ];
+						uint8_t expected = CellEmpty;
+						if( !cell.State.compare_exchange_strong( expected, CellWriting ) )
+						{
+							// Читатель уже пропустил ячейку
+							continue;
+						}
+
+						try
+						{
+							new( &cell.Storage ) T( std::forward<V>( val ) );
+						}
+						catch( ... )
+						{
+							cell.State.store( CellSkipped );
+							throw;
+						}
+
+						expected = CellWriting;
+						if( cell.State.compare_exchange_strong( expected, CellReady ) )
+						{
+							return;
+						}
+
+						// Читатель не дождался значения и пропустил ячейку:
+						// забираем значение и добавляем его заново
+						MY_ASSERT( expected == CellSkipped );
+						T *ptr = reinterpret_cast<T*>( &cell.Storage );
+						bool destroyed = false;
+						try
+						{
+							T retry_val( std::move( *ptr ) );
+							ptr->~T();
+							destroyed = true;
+							PushValue( std::move( retry_val ) );
+						}
+						catch( ... )
+						{
+							if( !destroyed )
+							{
+								ptr->~T();
+							}
+							throw;
+						}
+						return;
+					} // if( idx < SegmentSize )
+
+					// Сегмент заполнен - переходим к следующему (добавляя его, если нужно)
+					Segment *next = tail->Next.load();
+					if( next == nullptr )
+					{
+						Segment *new_seg = Pool->Get();
+						if( tail->Next.compare_exchange_strong( next, new_seg ) )
+						{
+							next = new_seg;
+						}
+						else
+						{
+							// Сегмент добавил другой писатель, новый никому не виден
+							Pool->Put( new_seg );
+						}
+					}
+					Tail.compare_exchange_strong( tail, next );
+				} // while( true )
+			} // void PushValue( V &&val )
+
+		public:
+			SegmentedQueue( const SegmentedQueue& ) = delete;
+			SegmentedQueue& operator=( const SegmentedQueue& ) = delete;
+
+			/// Очередь, использующая общую очередь на отложенное удаление
+			SegmentedQueue(): Head( nullptr ), Tail( nullptr ),
+			                  Pool( std::make_shared<SegmentPool>() ),
+			                  DefaultQueue(),
+			                  DefQueue( DeferredDeleter::Shared() )
+			{
+				Init();
+			}
+
+			SegmentedQueue( DeferredDeleter &def_deleter ): Head( nullptr ), Tail( nullptr ),
+			                                                Pool( std::make_shared<SegmentPool>() ),
+			                                                DefaultQueue(),
+			                                                DefQueue( def_deleter )
+			{
+				Init();
+			}
+
+			SegmentedQueue( uint8_t threads_num,
+			                uint16_t clean_period = 0 ): Head( nullptr ), Tail( nullptr ),
+			                                             Pool( std::make_shared<SegmentPool>() ),
+			                                             DefaultQueue( new DeferredDeleter( threads_num, clean_period ) ),
+			                                             DefQueue( *DefaultQueue )
+			{
+				Init();
+			}
+
+			~SegmentedQueue()
+			{
+				Segment *seg = Head.load();
+				while( seg != nullptr )
+				{
+					const size_t push_idx = seg->PushIdx.load();
+					const size_t end = push_idx < SegmentSize ? push_idx : SegmentSize;
+					for( size_t t = seg->PopIdx.load(); t < end; ++t )
+					{
+						if( seg->Cells[ t ].State.load() == CellReady )
+						{
+							reinterpret_cast<T*>( &seg->Cells[ t ].Storage )->~T();
+						}
+					}
+
+					Segment *next = seg->Next.load();
+					delete seg;
+					seg = next;
+				}
+			}
+
+			/**
+			 * @brief Push добавление нового элемента в хвост очереди
+			 * @param val новое значение
+			 */
+			void Push( const T &val )
+			{
+				auto epoch_keeper = DefQueue.EpochAcquire();
+				PushValue( val );
+			}
+
+			/**
+			 * @brief Push добавление нового элемента в хвост очереди
+			 * @param val новое значение
+			 */
+			void Push( T &&val )
+			{
+				auto epoch_keeper = DefQueue.EpochAcquire();
+				PushValue( std::move( val ) );
+			}
+
+			/**
+			 * @brief TryPop извлечение элемента из головы очереди. Не блокирует:
+			 * читатель ждёт писателя, занявшего ячейку, лишь несколько проверок,
+			 * а затем пропускает её (писатель тогда добавляет значение заново),
+			 * поэтому поток, остановленный посреди Push, не задерживает остальных
+			 * @param val буфер для записи значения
+			 * @return false, если очередь пуста или в ней только ещё не записанные
+			 * значения (val не изменён)
+			 */
+			bool TryPop( T &val )
+			{
+				bool res = false;
+				auto epoch_keeper = DefQueue.EpochAcquire();
+				while( true )
+				{
+					Segment *head = Head.load();
+					if( ( head->PopIdx.load() >= head->PushIdx.load() ) &&
+					    ( head->Next.load() == nullptr ) )
+					{
+						// Очередь пуста
+						break;
+					}
+
+					const size_t idx = head->PopIdx.fetch_add( 1 );
+					if( idx < SegmentSize )
+					{
+						Cell &cell = head->Cells[ idx ];
+						uint8_t state = CellEmpty;
+						if( cell.State.compare_exchange_strong( state, CellSkipped ) )
+						{
+							// Писатель ещё не занял ячейку - он займёт другую
+							continue;
+						}
+
+						// Писатель уже создаёт значение: недолго ждём его,
+						// затем пропускаем ячейку (если он так и не закончил)
+						for( uint16_t t = 0; ( state == CellWriting ) && ( t < WritingSpins ); ++t )
+						{
+							state = cell.State.load( std::memory_order_acquire );
+						}
+
+						if( ( state == CellWriting ) && cell.State.compare_exchange_strong( state, CellSkipped ) )
+						{
+							continue;
+						}
+
+						if( state == CellReady )
+						{
+							T *ptr = reinterpret_cast<T*>( &cell.Storage );
+							val = std::move( *ptr );
+							ptr->~T();
+							res = true;
+							break;
+						}
+						continue;
+					} // if( idx < SegmentSize )
+
+					// Сегмент прочитан - переходим к следующему
+					Segment *next = head->Next.load();
+					if( next == nullptr )
+					{
+						break;
+					}
+
+					// Хвост не должен указывать на отработавший сегмент: сдвигаем его
+					// до головы (хвост не отстаёт от головы и не движется назад)
+					Segment *tail = head;
+					Tail.compare_exchange_strong( tail, next );
+					if( Head.compare_exchange_strong( head, next ) )
+					{
+						DefQueue.Delete( new SegmentRecycler( head, Pool ) );
+					}
+				} // while( true )
+
+				// Отпускаем эпоху, удаляем элементы очереди, которые можно
+				epoch_keeper.Release();
+				DefQueue.ClearIfNeed();
+				return res;
+			} // bool TryPop( T &val )
+
+			/// Очистить очередь на отложенное удаление
+			void CleanDeferredQueue()
+			{
+				DefQueue.Clear();
+			}
+	}; // class SegmentedQueue
+
+	/**
+	 * @brief The HashMap class потокобезопасная хэш-таблица. Поиск не блокирует:
+	 * читатель захватывает эпоху и проходит цепочку корзины. Изменения блокируют
+	 * только свою корзину (блокировка и голова цепочки лежат в одной кэш-линии,
+	 * у каждой корзины - своя). Значение элемента не меняется после добавления:
+	 * Set заменяет элемент целиком, заменённые и удалённые элементы удаляются
+	 * через очередь на отложенное удаление. При заполнении создаётся таблица
+	 * вдвое больше, и каждая изменяющая операция переносит в неё несколько
+	 * корзин старой (таблица не останавливается целиком)
+	 * @tparam Key тип ключа
+	 * @tparam Value тип значения (копируется при поиске)
+	 * @tparam Hash хэш-функция ключа
+	 * @tparam Allocator распределитель элементов: NewAllocator или PoolAllocator
+	 */
+	template <typename Key, typename Value, typename Hash = std::hash<Key>, typename Allocator = NewAllocator>
+	class HashMap
+	{
+		public:
+			typedef Key KeyType;
+			typedef Value Type;
+
+		private:
+			/// Элемент цепочки корзины
+			struct Node
+			{
+				const Key K;
+				const Value V;
+
+				/// Хэш ключа (сравнивается до ключа)
+				const uint64_t H;
+
+				std::atomic<Node*> Next;
+
+				Node( const Key &key, const Value &val, uint64_t h, Node *next ): K( key ),
+				                                                                  V( val ),
+				                                                                  H( h ),
+				                                                                  Next( next ) {}
+			};
+
+			/// Корзина (занимает кэш-линию)
+			struct Bucket
+			{
+				/// Начало цепочки
+				std::atomic<Node*> Head;
+
+				/// Показывает, что корзина перенесена в следующую таблицу
+				/// (после этого цепочка не меняется)
+				std::atomic<bool> Moved;
+
+				/// Блокировка изменений цепочки
+				std::atomic_flag Lock;
+
+				Bucket(): Head( nullptr ), Moved( false )
+				{
+					Lock.clear();
+				}
+
+				void LockBucket()
+				{
+					while( Lock.test_and_set( std::memory_order_acquire ) )
+					{
+						std::this_thread::yield();
+					}
+				}
+
+				void UnlockBucket()
+				{
+					Lock.clear( std::memory_order_release );
+				}
+			};
+
+			/// Размер корзины с выравниванием на кэш-линию
+			static const size_t BucketSize = ( ( sizeof( Bucket ) + CacheLineSize - 1 ) / CacheLineSize )*CacheLineSize;
+
+			/// Таблица корзин
+			struct Table
+			{
+				/// Количество корзин (степень двойки)
+				const size_t Size;
+
+				/// Сдвиг, дающий номер корзины из старших битов перемешанного хэша
+				/// (корзина i при переносе расходится в корзины 2*i и 2*i + 1)
+				const unsigned Shift;
+
+				/// Память под корзины (с запасом на выравнивание)
+				std::unique_ptr<uint8_t[]> Memory;
+
+				/// Первая корзина, выровненная на кэш-линию
+				uint8_t *Buckets;
+
+				/// Следующая (вдвое большая) таблица, если начат перенос
+				std::atomic<Table*> NextTable;
+
+				/// Номер очередной корзины для переноса
+				std::atomic<size_t> MigratePos;
+
+				/// Количество перенесённых корзин
+				std::atomic<size_t> MigratedNum;
+
+				Table( unsigned bits ): Size( ( size_t ) 1 << bits ),
+				                        Shift( 64 - bits ),
+				                        Memory( new uint8_t[ ( Size + 1 )*BucketSize ] ),
+				                        Buckets( nullptr ),
+				                        NextTable( nullptr ),
+				                        MigratePos( 0 ),
+				                        MigratedNum( 0 )
+				{
+					const size_t addr = ( size_t ) Memory.get();
+					Buckets = Memory.get() + ( CacheLineSize - addr % CacheLineSize ) % CacheLineSize;
+					for( size_t t = 0; t < Size; ++t )
+					{
+						new( Buckets + t*BucketSize ) Bucket;
+					}
+				}
+
+				/// Элементы удаляет владелец таблицы (у перенесённых корзин - при переносе)
+				~Table()
+				{
+					for( size_t t = 0; t < Size; ++t )
+					{
+						GetBucket( t ).~Bucket();
+					}
+				}
+
+				Bucket& GetBucket( size_t idx )
+				{
+					MY_ASSERT( idx < Size );
+					return *reinterpret_cast<Bucket*>( Buckets + idx*BucketSize );
+				}
+
+				Bucket& BucketFor( uint64_t h )
+				{
+					return GetBucket( ( size_t ) ( h >> Shift ) );
 				}
+			};
+
+			/// Начальное количество корзин (степень двойки)
+			static const unsigned InitialBits = 4;
+
+			/// Среднее количество элементов на корзину, при превышении которого начинается перенос
+			static const size_t MaxLoad = 2;
+
+			/// Количество корзин, переносимых одной изменяющей операцией
+			static const size_t MigrateStep = 2;
+
+			/// Текущая таблица
+			PaddedAtomic<Table*> Current;
+
+			/// Количество полос счётчика элементов (степень двойки)
+			static const size_t CountersNum = 16;
+
+			/// Количество элементов по полосам (полоса выбирается по младшим битам
+			/// хэша ключа, меняется только под блокировкой корзины; Size суммирует
+			/// полосы, так что изменения в разных корзинах не делят кэш-линию счётчика)
+			PaddedAtomic<size_t> Counts[ CountersNum ];
+
+			/// Очередь для отсроченного удаления, используемая по умолчанию
+			std::unique_ptr<DeferredDeleter> DefaultQueue;
+
+			/// Ссылка на очередь для отсроченного удаления
+			DeferredDeleter &DefQueue;
 
-				// "Захватываем эпоху" (пока не отпустим - можем
-				// спокойно разыменовывать указатели списка)
-				auto epoch_keeper = DefQueue.EpochAcquire();
+			/// Хэш ключа с перемешиванием (номер корзины берётся из старших битов)
+			static uint64_t HashOf( const Key &key )
+			{
+				return ( ( uint64_t ) Hash()( key ) )*0x9E3779B97F4A7C15ULL;
+			}
 
-				auto old_head = Head.load();
+			/// Полоса счётчика элементов для хэша ключа
+			PaddedAtomic<size_t>& CounterFor( uint64_t h )
+			{
+				return Counts[ ( size_t ) h & ( CountersNum - 1 ) ];
+			}
 
-				// Извлекаем первый элемент из головы списка,
-				// помещаем в голову следующий элемент
-				while( old_head != nullptr )
+			/// Поиск элемента в цепочке
+			static Node* FindNode( Node *node, const Key &key, uint64_t h )
+			{
+				for( ; node != nullptr; node = node->Next.load() )
 				{
-					MY_ASSERT( old_head != nullptr );
+					if( ( node->H == h ) && ( node->K == key ) )
+					{
+						return node;
+					}
+				}
+				return nullptr;
+			}
 
-					// Получаем указатель на элемент, следующий за головным
-					auto new_head = old_head->Next.load();
+			/**
+			 * @brief LockBucketFor блокировка корзины ключа в актуальной таблице
+			 * (перенесённые корзины пропускаются; эпоха должна быть захвачена)
+			 * @param h хэш ключа
+			 * @return заблокированная корзина
+			 */
+			Bucket& LockBucketFor( uint64_t h )
+			{
+				Table *table = Current.load();
+				while( true )
+				{
+					Bucket &bucket = table->BucketFor( h );
+					bucket.LockBucket();
+					if( !bucket.Moved.load() )
+					{
+						return bucket;
+					}
 
-					// Пытаемся изменить значение Head
-					if( Head.compare_exchange_weak( old_head, new_head ) )
+					bucket.UnlockBucket();
+					table = table->NextTable.load();
+					MY_ASSERT( table != nullptr );
+				}
+			}
+
+			/// Перенос корзины в следующую таблицу (элементы копируются: читатели
+			/// старой цепочки продолжают проходить её, пока держат эпоху)
+			void MigrateBucket( Table &table, size_t idx )
+			{
+				Table *next = table.NextTable.load();
+				MY_ASSERT( next != nullptr );
+				Bucket &bucket = table.GetBucket( idx );
+
+				// Корзина idx расходится в корзины 2*idx и 2*idx + 1 следующей таблицы,
+				// в которые до отметки о переносе больше никто не пишет
+				Node *heads[ 2 ] = { nullptr, nullptr };
+				const size_t first_idx = 2*idx;
+
+				bucket.LockBucket();
+				Node *head = bucket.Head.load();
+				try
+				{
+					for( Node *node = head; node != nullptr; node = node->Next.load() )
 					{
-						// Получилось
-						if( is_empty != nullptr )
+						Node *&dst_head = heads[ ( size_t ) ( node->H >> next->Shift ) - first_idx ];
+						dst_head = Allocator::template New<Node>( node->K, node->V, node->H, dst_head );
+					}
+				}
+				catch( ... )
+				{
+					for( Node *dst_head : heads )
+					{
+						while( dst_head != nullptr )
 						{
-							*is_empty = new_head == nullptr;
+							Node *tmp = dst_head;
+							dst_head = dst_head->Next.load();
+							Allocator::Delete( tmp );
 						}
-						break;
 					}
-				} // while( old_head != nullptr )
+					bucket.UnlockBucket();
+					throw;
+				}
 
-				// Отпускаем "эпоху"
+				next->GetBucket( first_idx ).Head.store( heads[ 0 ] );
+				next->GetBucket( first_idx + 1 ).Head.store( heads[ 1 ] );
+				bucket.Moved.store( true );
+				bucket.UnlockBucket();
+
+				// Старые элементы больше не доступны из актуальной таблицы
+				while( head != nullptr )
+				{
+					Node *next_node = head->Next.load();
+					DefQueue.template Delete<Node, Allocator>( head );
+					head = next_node;
+				}
+			} // void MigrateBucket( Table &table, size_t idx )
+
+			/**
+			 * @brief MigrateIfNeed перенос нескольких корзин, если начат перенос
+			 * текущей таблицы (эпоха должна быть захвачена)
+			 * @param counter полоса счётчика, изменённая операцией: заполнение таблицы
+			 * оценивается по ней (хэши равномерны, полосы растут одинаково)
+			 */
+			void MigrateIfNeed( const PaddedAtomic<size_t> &counter )
+			{
+				Table *table = Current.load();
+				if( table->NextTable.load() == nullptr )
+				{
+					if( counter.load( std::memory_order_relaxed )*CountersNum <= table->Size*MaxLoad )
+					{
+						return;
+					}
+
+					// Начинаем перенос
+					Table *expected = nullptr;
+					std::unique_ptr<Table> new_table( new Table( 64 - table->Shift + 1 ) );
+					if( table->NextTable.compare_exchange_strong( expected, new_table.get() ) )
+					{
+						new_table.release();
+					}
+				}
+
+				for( size_t t = 0; t < MigrateStep; ++t )
+				{
+					const size_t pos = table->MigratePos.fetch_add( 1 );
+					if( pos >= table->Size )
+					{
+						return;
+					}
+
+					MigrateBucket( *table, pos );
+					if( ++table->MigratedNum == table->Size )
+					{
+						// Все корзины перенесены - следующая таблица становится текущей
+						Table *expected = table;
+						const bool res = Current.compare_exchange_strong( expected, table->NextTable.load() );
+						MY_ASSERT( res );
+						( void ) res;
+						DefQueue.Delete( table );
+						return;
+					}
+				}
+			} // void MigrateIfNeed()
+
+			/**
+			 * @brief InsertImpl добавление (замена) элемента
+			 * @param key ключ
+			 * @param val значение
+			 * @param replace заменять ли существующий элемент
+			 * @return true, если элемента с таким ключом не было
+			 */
+			bool InsertImpl( const Key &key, const Value &val, bool replace )
+			{
+				const uint64_t h = HashOf( key );
+				auto epoch_keeper = DefQueue.EpochAcquire();
+
+				Bucket &bucket = LockBucketFor( h );
+				Node *old_node = nullptr;
+				Node *new_node = nullptr;
+				try
+				{
+					old_node = FindNode( bucket.Head.load(), key, h );
+					if( ( old_node == nullptr ) || replace )
+					{
+						new_node = Allocator::template New<Node>( key, val, h, nullptr );
+					}
+				}
+				catch( ... )
+				{
+					bucket.UnlockBucket();
+					throw;
+				}
+
+				if( old_node == nullptr )
+				{
+					// Новый элемент добавляется в начало цепочки
+					new_node->Next.store( bucket.Head.load() );
+					bucket.Head.store( new_node );
+					CounterFor( h ).fetch_add( 1, std::memory_order_relaxed );
+				}
+				else if( new_node != nullptr )
+				{
+					// Новый элемент встаёт на место старого
+					new_node->Next.store( old_node->Next.load() );
+					std::atomic<Node*> *link = &bucket.Head;
+					while( link->load() != old_node )
+					{
+						link = &link->load()->Next;
+					}
+					link->store( new_node );
+				}
+				bucket.UnlockBucket();
+
+				if( ( old_node != nullptr ) && ( new_node != nullptr ) )
+				{
+					DefQueue.template Delete<Node, Allocator>( old_node );
+				}
+
+				MigrateIfNeed( CounterFor( h ) );
 				epoch_keeper.Release();
+				DefQueue.ClearIfNeed();
+				return old_node == nullptr;
+			} // bool InsertImpl( const Key &key, const Value &val, bool replace )
+
+		public:
+			HashMap( const HashMap& ) = delete;
+			HashMap& operator=( const HashMap& ) = delete;
+
+			/// Таблица, использующая общую очередь на отложенное удаление
+			HashMap(): Current( new Table( InitialBits ) ),
+			           DefaultQueue(), DefQueue( DeferredDeleter::Shared() ) {}
+
+			HashMap( DeferredDeleter &def_deleter ): Current( new Table( InitialBits ) ),
+			                                         DefaultQueue(), DefQueue( def_deleter ) {}
+
+			HashMap( uint8_t threads_num,
+			         uint16_t clean_period = GetCleanPeriod<Node>() ):
+			    Current( new Table( InitialBits ) ),
+			    DefaultQueue( new DeferredDeleter( threads_num, clean_period ) ),
+			    DefQueue( *DefaultQueue ) {}
 
-				if( old_head != nullptr )
+			~HashMap()
+			{
+				// Незавершённый перенос: у перенесённых корзин элементы уже
+				// отправлены на удаление, остальные лежат в старой таблице
+				Table *table = Current.exchange( nullptr );
+				while( table != nullptr )
 				{
-					// Стек не был пуст
-					result = std::move( old_head->Value );
-					DefQueue.Delete( old_head );
-					DefQueue.ClearIfNeed();
+					for( size_t t = 0; t < table->Size; ++t )
+					{
+						Bucket &bucket = table->GetBucket( t );
+						if( bucket.Moved.load() )
+						{
+							continue;
+						}
+
+						for( Node *node = bucket.Head.load(); node != nullptr; )
+						{
+							Node *next = node->Next.load();
+							Allocator::Delete( node );
+							node = next;
+						}
+					}
+
+					Table *next = table->NextTable.load();
+					delete table;
+					table = next;
 				}
-				else
+			}
+
+			/**
+			 * @brief Insert добавление элемента, если элемента с таким ключом нет
+			 * @param key ключ
+			 * @param val значение
+			 * @return true, если элемент добавлен
+			 */
+			bool Insert( const Key &key, const Value &val )
+			{
+				return InsertImpl( key, val, false );
+			}
+
+			/**
+			 * @brief Set добавление элемента или замена значения существующего
+			 * @param key ключ
+			 * @param val значение
+			 * @return true, если элемента с таким ключом не было
+			 */
+			bool Set( const Key &key, const Value &val )
+			{
+				return InsertImpl( key, val, true );
+			}
+
+			/**
+			 * @brief Find поиск значения по ключу (без блокировок)
+			 * @param key ключ
+			 * @param val буфер для значения
+			 * @return true, если элемент найден
+			 */
+			bool Find( const Key &key, Value &val )
+			{
+				const uint64_t h = HashOf( key );
+				auto epoch_keeper = DefQueue.EpochAcquire();
+
+				Table *table = Current.load();
+				while( true )
 				{
-					// Стек пуст
-					DefQueue.ClearIfNeed();
-					if( default_value_ptr != nullptr )
+					Bucket &bucket = table->BucketFor( h );
+					if( !bucket.Moved.load() )
 					{
-						result = *default_value_ptr;
+						// Если корзину перенесут во время обхода, старая цепочка
+						// остаётся целой до освобождения эпохи
+						Node *node = FindNode( bucket.Head.load(), key, h );
+						if( node == nullptr )
+						{
+							return false;
+						}
+
+						val = node->V;
+						return true;
 					}
-					else
+
+					table = table->NextTable.load();
+					MY_ASSERT( table != nullptr );
+				}
+			} // bool Find( const Key &key, Value &val )
+
+			/// Есть ли элемент с таким ключом
+			bool Contains( const Key &key )
+			{
+				const uint64_t h = HashOf( key );
+				auto epoch_keeper = DefQueue.EpochAcquire();
+
+				Table *table = Current.load();
+				while( table->BucketFor( h ).Moved.load() )
+				{
+					table = table->NextTable.load();
+					MY_ASSERT( table != nullptr );
+				}
+				return FindNode( table->BucketFor( h ).Head.load(), key, h ) != nullptr;
+			}
+
+			/**
+			 * @brief Erase удаление элемента
+			 * @param key ключ
+			 * @return true, если элемент был
+			 */
+			bool Erase( const Key &key )
+			{
+				const uint64_t h = HashOf( key );
+				auto epoch_keeper = DefQueue.EpochAcquire();
+
+				Bucket &bucket = LockBucketFor( h );
+				Node *node = nullptr;
+				for( std::atomic<Node*> *link = &bucket.Head; link->load() != nullptr; link = &link->load()->Next )
+				{
+					Node *cur = link->load();
+					if( ( cur->H == h ) && ( cur->K == key ) )
 					{
-						throw std::out_of_range( "Stack is empty!" );
+						// Читатели, стоящие на элементе, продолжают обход с его Next
+						link->store( cur->Next.load() );
+						node = cur;
+						CounterFor( h ).fetch_sub( 1, std::memory_order_relaxed );
+						break;
 					}
 				}
+				bucket.UnlockBucket();
+
+				if( node != nullptr )
+				{
+					DefQueue.template Delete<Node, Allocator>( node );
+					MigrateIfNeed( CounterFor( h ) );
+				}
+				epoch_keeper.Release();
+				DefQueue.ClearIfNeed();
+				return node != nullptr;
+			} // bool Erase( const Key &key )
+
+			/// Количество элементов (сумма полос; при одновременных
+			/// изменениях - приблизительное)
+			size_t Size() const
+			{
+				size_t res = 0;
+				for( const auto &counter : Counts )
+				{
+					res += counter.load( std::memory_order_relaxed );
+				}
+				return res;
+			}
 
-				return result;
-			} // T Pop
-			
 			/// Очистить очередь на отложенное удаление
 			void CleanDeferredQueue()
 			{
 				DefQueue.Clear();
 			}
-	};
-	
-	/// Класс двусторонней очереди, хранящей 64-битные беззнаковые числа
-	class DigitsQueue
+	}; // class HashMap
+
+	/**
+	 * @brief The SkipList class неблокирующий упорядоченный словарь на списке с пропусками
+	 * (ключи уникальны). Удаление элемента: сначала отмечаются его ссылки (младший бит
+	 * указателя) на всех уровнях, затем элемент исключается из списков поиском,
+	 * отработанные элементы удаляются через очередь на отложенное удаление.
+	 * PopMin извлекает наименьший элемент, поэтому словарь можно использовать как
+	 * очередь с приоритетом (например, по сроку: при одинаковых сроках ключ дополняется
+	 * уникальным номером). Элементы разной высоты создаются через operator new
+	 * @tparam Key тип ключа
+	 * @tparam Value тип значения
+	 * @tparam Compare сравнение ключей ("меньше")
+	 */
+	template <typename Key, typename Value, typename Compare = std::less<Key>>
+	class SkipList
 	{
 		public:
-			typedef uint64_t Type;
-			
-			/// Фиктивное значение
-			const Type FakeValue;
+			typedef Key KeyType;
+			typedef Value Type;
+
+			/// Максимальная высота элемента
+			static const uint8_t MaxHeight = 16;
 
 		private:
-			typedef internal::StructElementType<std::atomic<Type>> ElementType;
+			typedef std::atomic<uintptr_t> LinkType;
 
-			/// Голова (откуда читаем)
-			std::atomic<ElementType*> Head;
+			/// Элемент списка
+			struct Node
+			{
+				const Key K;
+				const Value V;
+
+				/// Количество уровней
+				const uint8_t Height;
+
+				/// Количество участников (добавляющий и удаляющий), которые ещё могут
+				/// работать со ссылками на элемент: последний отправляет его на удаление
+				std::atomic<uint8_t> Owners;
+
+				/// Ссылки на следующие элементы по уровням (Height ссылок,
+				/// размещаются в той же памяти сразу за элементом)
+				LinkType* const Next;
+
+				Node( const Key &key, const Value &val, uint8_t height, LinkType *next ): K( key ),
+				                                                                          V( val ),
+				                                                                          Height( height ),
+				                                                                          Owners( 2 ),
+				                                                                          Next( next )
+				{
+					for( uint8_t t = 0; t < Height; ++t )
+					{
+						new( &Next[ t ] ) LinkType( 0 );
+					}
+				}
+			};
+
+			static_assert( sizeof( Node ) % std::alignment_of<LinkType>::value == 0,
+			               "Node links would be misaligned" );
+
+			/// Распределитель элементов разной высоты
+			struct NodeAllocator
+			{
+				static Node* New( const Key &key, const Value &val, uint8_t height )
+				{
+					uint8_t *mem = static_cast<uint8_t*>( ::operator new( sizeof( Node ) + height*sizeof( LinkType ) ) );
+					try
+					{
+						return new( mem ) Node( key, val, height, reinterpret_cast<LinkType*>( mem + sizeof( Node ) ) );
+					}
+					catch( ... )
+					{
+						::operator delete( mem );
+						throw;
+					}
+				}
+
+				static void Delete( Node *node )
+				{
+					if( node != nullptr )
+					{
+						node->~Node();
+						::operator delete( node );
+					}
+				}
+			};
+
+			/// Признак отмеченной (удаляемой) ссылки
+			static const uintptr_t Mark = 1;
+
+			static Node* Ptr( uintptr_t link )
+			{
+				return reinterpret_cast<Node*>( link & ~Mark );
+			}
+
+			static bool IsMarked( uintptr_t link )
+			{
+				return ( link & Mark ) != 0;
+			}
+
+			static uintptr_t Link( Node *node )
+			{
+				return reinterpret_cast<uintptr_t>( node );
+			}
+
+			/// Ссылки головы списка
+			LinkType Head[ MaxHeight ];
+
+			/// Очередь для отсроченного удаления, используемая по умолчанию
+			std::unique_ptr<DeferredDeleter> DefaultQueue;
+
+			/// Ссылка на очередь для отсроченного удаления
+			DeferredDeleter &DefQueue;
+
+			void Init()
+			{
+				for( auto &link : Head )
+				{
+					link.store( 0 );
+				}
+			}
+
+			static bool Less( const Key &k1, const Key &k2 )
+			{
+				return Compare()( k1, k2 );
+			}
+
+			/// Случайная высота нового элемента (каждый следующий уровень - с вероятностью 1/4)
+			static uint8_t RandomHeight()
+			{
+				static std::atomic<uint64_t> seed( 0x9E3779B97F4A7C15ULL );
+				static thread_local uint64_t rnd = seed.fetch_add( 0x9E3779B97F4A7C15ULL );
+				rnd ^= rnd << 13;
+				rnd ^= rnd >> 7;
+				rnd ^= rnd << 17;
+
+				uint8_t height = 1;
+				for( uint64_t bits = rnd; ( height < MaxHeight ) && ( ( bits & 3 ) == 0 ); bits >>= 2 )
+				{
+					++height;
+				}
+				return height;
+			}
+
+			/**
+			 * @brief FindOnLevel поиск места ключа на одном уровне с исключением
+			 * отмеченных элементов по пути
+			 * @param key ключ
+			 * @param level уровень
+			 * @param pred ссылки предшественника, с которого начинается поиск
+			 * (на выходе - ссылки последнего элемента, меньшего ключа)
+			 * @param curr буфер для первого элемента, не меньшего ключа
+			 * @return false, если ссылка предшественника изменилась или отмечена
+			 * (поиск нужно начинать заново от головы)
+			 */
+			bool FindOnLevel( const Key &key, int level, LinkType *&pred, Node *&curr )
+			{
+				curr = Ptr( pred[ level ].load() );
+				while( curr != nullptr )
+				{
+					uintptr_t succ = curr->Next[ level ].load();
+					while( IsMarked( succ ) )
+					{
+						// Исключаем отмеченный элемент
+						uintptr_t expected = Link( curr );
+						if( !pred[ level ].compare_exchange_strong( expected, succ & ~Mark ) )
+						{
+							return false;
+						}
+
+						curr = Ptr( succ );
+						if( curr == nullptr )
+						{
+							return true;
+						}
+						succ = curr->Next[ level ].load();
+					}
+
+					if( !Less( curr->K, key ) )
+					{
+						return true;
+					}
+
+					pred = curr->Next;
+					curr = Ptr( succ );
+				} // while( curr != nullptr )
+				return true;
+			} // bool FindOnLevel( const Key &key, int level, LinkType *&pred, Node *&curr )
+
+			/**
+			 * @brief FindNode поиск места ключа на всех уровнях с исключением
+			 * отмеченных элементов по пути (эпоха должна быть захвачена)
+			 * @param key ключ
+			 * @param preds буфер для ссылок предшественников по уровням
+			 * @param succs буфер для элементов, не меньших ключа, по уровням
+			 * @return true, если элемент с таким ключом найден (succs[ 0 ])
+			 */
+			bool FindNode( const Key &key, LinkType **preds, Node **succs )
+			{
+				while( true )
+				{
+					LinkType *pred = Head;
+					int level = MaxHeight - 1;
+					for( ; level >= 0; --level )
+					{
+						Node *curr = nullptr;
+						if( !FindOnLevel( key, level, pred, curr ) )
+						{
+							break;
+						}
 
-			/// Хвост (куда пишем)
-			std::atomic<ElementType*> Tail;
+						if( preds != nullptr )
+						{
+							preds[ level ] = pred;
+							succs[ level ] = curr;
+						}
+						else if( level == 0 )
+						{
+							succs[ 0 ] = curr;
+						}
+					} // for( ; level >= 0; --level )
 
-			/// Очередь для отсроченного удаления, используемая по умолчанию
-			std::unique_ptr<DeferredDeleter> DefaultQueue;
+					if( level < 0 )
+					{
+						return ( succs[ 0 ] != nullptr ) && !Less( key, succs[ 0 ]->K );
+					}
+				} // while( true )
+			} // bool FindNode( const Key &key, LinkType **preds, Node **succs )
 
-			/// Ссылка на очередь для отсроченного удаления
-			DeferredDeleter &DefQueue;
-			
-			void Init()
+			/**
+			 * @brief MarkNode отметка ссылок элемента (сверху вниз)
+			 * @param node элемент
+			 * @return true, если нижнюю ссылку отметил этот вызов
+			 * (вызывающий стал удаляющим элемента)
+			 */
+			static bool MarkNode( Node *node )
 			{
-				ElementType *fake_element = new ElementType( FakeValue );
-				Head.store( fake_element );
-				Tail.store( fake_element );
+				for( int level = node->Height - 1; level >= 0; --level )
+				{
+					uintptr_t succ = node->Next[ level ].load();
+					while( !IsMarked( succ ) )
+					{
+						if( node->Next[ level ].compare_exchange_weak( succ, succ | Mark ) )
+						{
+							if( level == 0 )
+							{
+								return true;
+							}
+							break;
+						}
+					}
+				}
+				return false;
 			}
 
-		public:
-			DigitsQueue( const DigitsQueue& ) = delete;
-			DigitsQueue& operator=( const DigitsQueue& ) = delete;
-
-			DigitsQueue( Type fake_value,
-			             DeferredDeleter &def_deleter ): FakeValue( fake_value ),
-			                                             Head( nullptr ), Tail( nullptr ),
-			                                             DefaultQueue(),
-			                                             DefQueue( def_deleter )
+			/// Отказ от элемента одним из участников (эпоха должна быть захвачена)
+			void ReleaseNode( Node *node )
 			{
-				Init();
+				if( --node->Owners == 0 )
+				{
+					DefQueue.template Delete<Node, NodeAllocator>( node );
+				}
 			}
 
-			DigitsQueue( Type fake_value,
-			             uint8_t threads_num,
-			             uint16_t clean_period = GetCleanPeriod<Type>() ):
-			    FakeValue( fake_value ),
-			    Head( nullptr ), Tail( nullptr ),
-			    DefaultQueue( new DeferredDeleter( threads_num, clean_period ) ),
-			    DefQueue( *DefaultQueue )
+			/// Исключение удалённого элемента из всех уровней и отказ от него
+			void Unlink( Node *node )
 			{
-				Init();
+				Node *succs[ 1 ];
+				FindNode( node->K, nullptr, succs );
+				ReleaseNode( node );
 			}
 
-			~DigitsQueue()
+			/// Первый неотмеченный элемент, начиная с node (на нижнем уровне)
+			static Node* SkipMarked( Node *node )
 			{
-				ElementType *old_head = Head.load();
-				ElementType *tmp = nullptr;
-				while( old_head != nullptr )
+				while( ( node != nullptr ) && IsMarked( node->Next[ 0 ].load() ) )
 				{
-					tmp = old_head;
-					old_head = old_head->Next.load();
-					delete tmp;
+					node = Ptr( node->Next[ 0 ].load() );
 				}
+				return node;
 			}
 
+		public:
 			/**
-			 * @brief Push добавление нового элемента в хвост очереди
-			 * @param val новое значение
-			 * @throw std::invalid_argument, если val имеет фиктивное значение
+			 * @brief The Iterator class обход элементов по возрастанию ключей.
+			 * Пока итератор существует, он удерживает эпоху (элементы, удалённые
+			 * после его создания, не удаляются из памяти), поэтому долго хранить
+			 * его не следует. Элементы, добавленные или удалённые во время обхода,
+			 * могут как встретиться, так и нет
 			 */
-			void Push( Type val )
+			class Iterator
 			{
-				if( val == FakeValue )
-				{
-					// Недопустимое значение
-					MY_ASSERT( false );
-					throw std::invalid_argument( "Cannot add fake value to queue" );
-				}
-				
-				std::unique_ptr<ElementType> new_elem;
+				private:
+					friend class SkipList;
 
-				// "Захватываем" эпоху, чтобы можно было обращаться к "хвосту"
-				// без риска, что он будет удалён
-				auto epoch_keeper = DefQueue.EpochAcquire();
+					/// "Хранитель" эпохи
+					DeferredDeleter::EpochKeeper Keeper;
 
-				ElementType *old_tail = Tail.load();
-				while( val != FakeValue )
-				{
-					MY_ASSERT( old_tail != nullptr );
+					/// Текущий элемент
+					Node *Cur;
 
-					// Создаём новый фиктивный элемент, если нужно
-					if( !new_elem )
+					Iterator( DeferredDeleter::EpochKeeper &&keeper, Node *cur ): Keeper( std::move( keeper ) ),
+					                                                              Cur( SkipMarked( cur ) ) {}
+
+				public:
+					Iterator( const Iterator& ) = delete;
+					Iterator& operator=( const Iterator& ) = delete;
+
+					Iterator( Iterator &&iter ): Keeper( std::move( iter.Keeper ) ), Cur( iter.Cur )
 					{
-						new_elem = std::unique_ptr<ElementType>( new ElementType( FakeValue ) );
-						MY_ASSERT( new_elem && ( new_elem.get()->Value.load() == FakeValue ) );
+						iter.Cur = nullptr;
 					}
 
-					// Ожидаем, что в хвост ещё не записаны данные
-					Type expected_val = FakeValue;
+					/// Указывает ли итератор на элемент
+					bool Valid() const
+					{
+						return Cur != nullptr;
+					}
 
-					// Пытаемся записать данные в фиктивный (предположительно) элемент
-					if( old_tail->Value.compare_exchange_strong( expected_val, val ) )
+					const Key& GetKey() const
 					{
-						// Значение добавлено, присваиваем val-у фиктивное значение
-						val = FakeValue;
+						MY_ASSERT( Cur != nullptr );
+						return Cur->K;
 					}
-					MY_ASSERT( old_tail->Value.load() != FakeValue );
 
-					// Пытаемся добавить фиктивный элемент в хвост
-					ElementType *expected_elem_ptr = nullptr;
-					if( old_tail->Next.compare_exchange_strong( expected_elem_ptr,
-					                                            new_elem.get() ) )
+					const Value& GetValue() const
 					{
-						// Фиктивный элемент добавлен
-						expected_elem_ptr = new_elem.release();
-						MY_ASSERT( !new_elem && ( new_elem.get() == nullptr ) );
+						MY_ASSERT( Cur != nullptr );
+						return Cur->V;
 					}
 
-					// К этому моменту expected_elem_ptr хранит значение old_tail->Next
-					MY_ASSERT( expected_elem_ptr != nullptr );
+					/// Переход к следующему элементу
+					void Next()
+					{
+						MY_ASSERT( Cur != nullptr );
+						Cur = SkipMarked( Ptr( Cur->Next[ 0 ].load() ) );
+					}
+			};
 
-					// Записываем в Tail указатель на новый хвост
-					Tail.compare_exchange_strong( old_tail, expected_elem_ptr );
-				} // while( val != FakeValue )
-			} // void Push( Type val )
-			
-			template <typename T>
-			void Push( T *ptr )
+			SkipList( const SkipList& ) = delete;
+			SkipList& operator=( const SkipList& ) = delete;
+
+			/// Словарь, использующий общую очередь на отложенное удаление
+			SkipList(): DefaultQueue(), DefQueue( DeferredDeleter::Shared() )
 			{
-				Push( ( Type ) ptr );
+				Init();
+			}
+
+			SkipList( DeferredDeleter &def_deleter ): DefaultQueue(), DefQueue( def_deleter )
+			{
+				Init();
+			}
+
+			SkipList( uint8_t threads_num,
+			          uint16_t clean_period = GetCleanPeriod<Node>() ):
+			    DefaultQueue( new DeferredDeleter( threads_num, clean_period ) ),
+			    DefQueue( *DefaultQueue )
+			{
+				Init();
+			}
+
+			~SkipList()
+			{
+				// Все элементы, кроме отправленных на удаление, связаны нижним уровнем
+				Node *node = Ptr( Head[ 0 ].load() );
+				while( node != nullptr )
+				{
+					Node *next = Ptr( node->Next[ 0 ].load() );
+					NodeAllocator::Delete( node );
+					node = next;
+				}
 			}
 
 			/**
-			 * @brief Pop извлечение элемента из головы очереди
-			 * если очередь пуста - будет возвращено фиктивное значение
-			 * @return элемент из головы очереди
+			 * @brief Insert добавление элемента, если элемента с таким ключом нет
+			 * @param key ключ
+			 * @param val значение
+			 * @return true, если элемент добавлен
 			 */
-			Type Pop()
+			bool Insert( const Key &key, const Value &val )
 			{
-				Type res = FakeValue;
 				auto epoch_keeper = DefQueue.EpochAcquire();
-				ElementType *old_head = Head.load();
+				LinkType *preds[ MaxHeight ];
+				Node *succs[ MaxHeight ];
+				if( FindNode( key, preds, succs ) )
+				{
+					return false;
+				}
 
-				while( res == FakeValue )
+				const uint8_t height = RandomHeight();
+				Node *node = NodeAllocator::New( key, val, height );
+				while( true )
 				{
-					MY_ASSERT( old_head != nullptr );
-					if( old_head == Tail.load() )
+					for( uint8_t level = 0; level < height; ++level )
 					{
-						// Очередь состоит из одного элемента (считаем, что пуста)
-						break;
+						node->Next[ level ].store( Link( succs[ level ] ) );
 					}
 
-					auto new_head = old_head->Next.load();
-					MY_ASSERT( new_head != nullptr );
-					if( Head.compare_exchange_weak( old_head, new_head ) )
+					// Элемент добавлен, когда связан нижний уровень
+					uintptr_t expected = Link( succs[ 0 ] );
+					if( preds[ 0 ][ 0 ].compare_exchange_strong( expected, Link( node ) ) )
 					{
-						// Элемент из головы очереди извлечён
-						res = old_head->Value.load();
-						MY_ASSERT( res != FakeValue );
+						break;
 					}
-				} // while( res == FakeValue )
 
-				// Отпускаем эпоху, удаляем элементы очереди, которые можно
-				epoch_keeper.Release();
-				DefQueue.ClearIfNeed();
-				
-				return res;
-			} // Type Pop()
-			
-			/// Очистить очередь на отложенное удаление
-			void CleanDeferredQueue()
-			{
-				DefQueue.Clear();
-			}
-	}; // class DigitsQueue
+					if( FindNode( key, preds, succs ) )
+					{
+						NodeAllocator::Delete( node );
+						return false;
+					}
+				}
 
-	/// Класс двусторонней очереди
-	template <typename T>
-	class Queue
-	{
-		public:
-			typedef T Type;
+				// Связываем верхние уровни (пока элемент не начали удалять)
+				for( uint8_t level = 1; level < height; ++level )
+				{
+					bool linked = false;
+					while( !linked )
+					{
+						uintptr_t expected = Link( succs[ level ] );
+						if( preds[ level ][ level ].compare_exchange_strong( expected, Link( node ) ) )
+						{
+							linked = true;
+							continue;
+						}
 
-		private:
-			/// Очередь, хранящая указатели в виде чисел
-			DigitsQueue PtrsQueue;
+						// Обновляем предшественников и ссылку элемента на уровне
+						if( !FindNode( key, preds, succs ) || ( succs[ 0 ] != node ) )
+						{
+							break;
+						}
 
-			/// Добавляет новый элемент в хвост
-			void PushElement( std::unique_ptr<T> &val_smart_ptr )
-			{
-				MY_ASSERT( val_smart_ptr );
-				MY_ASSERT( sizeof( DigitsQueue::Type ) >= sizeof( val_smart_ptr.get() ) );
-				PtrsQueue.Push( ( DigitsQueue::Type ) val_smart_ptr.get() );
-				val_smart_ptr.release();
-			}
+						uintptr_t next = node->Next[ level ].load();
+						if( IsMarked( next ) ||
+						    ( ( next != Link( succs[ level ] ) ) &&
+						      !node->Next[ level ].compare_exchange_strong( next, Link( succs[ level ] ) ) ) )
+						{
+							break;
+						}
+					}
 
-		public:
-			Queue( const Queue& ) = delete;
-			Queue& operator=( const Queue& ) = delete;
+					if( !linked )
+					{
+						break;
+					}
+				} // for( uint8_t level = 1; level < height; ++level )
 
-			Queue( DeferredDeleter &def_deleter ): PtrsQueue( 0, def_deleter )
-			{}
+				// Если элемент уже удаляют, уровни, связанные после отметки, исключаем сами
+				if( IsMarked( node->Next[ 0 ].load() ) )
+				{
+					Unlink( node );
+				}
+				else
+				{
+					ReleaseNode( node );
+				}
 
-			Queue( uint8_t threads_num,
-			       uint16_t clean_period = GetCleanPeriod<T>() ): PtrsQueue( 0, threads_num, clean_period )
-			{}
+				epoch_keeper.Release();
+				DefQueue.ClearIfNeed();
+				return true;
+			} // bool Insert( const Key &key, const Value &val )
 
-			~Queue()
+			/**
+			 * @brief Find поиск значения по ключу
+			 * @param key ключ
+			 * @param val буфер для значения
+			 * @return true, если элемент найден
+			 */
+			bool Find( const Key &key, Value &val )
 			{
-				for( auto val = PtrsQueue.Pop(); val != 0; val = PtrsQueue.Pop() )
+				auto iter = LowerBound( key );
+				if( !iter.Valid() || Less( key, iter.GetKey() ) )
 				{
-					delete ( T* ) val;
+					return false;
 				}
+
+				val = iter.GetValue();
+				return true;
 			}
 
 			/**
-			 * @brief Push добавление нового элемента в хвост очереди
-			 * @param val новое значение
+			 * @brief Erase удаление элемента
+			 * @param key ключ
+			 * @return true, если элемент удалён этим вызовом
 			 */
-			void Push( const T &val )
+			bool Erase( const Key &key )
 			{
-				std::unique_ptr<T> val_smart_ptr( new T( val ) );
-				PushElement( val_smart_ptr );
+				auto epoch_keeper = DefQueue.EpochAcquire();
+				LinkType *preds[ MaxHeight ];
+				Node *succs[ MaxHeight ];
+				if( !FindNode( key, preds, succs ) || !MarkNode( succs[ 0 ] ) )
+				{
+					return false;
+				}
+
+				Unlink( succs[ 0 ] );
+				epoch_keeper.Release();
+				DefQueue.ClearIfNeed();
+				return true;
 			}
 
 			/**
-			 * @brief Push добавление нового элемента в хвост очереди
-			 * @param val новое значение
+			 * @brief PopMin извлечение элемента с наименьшим ключом
+			 * @param key буфер для ключа
+			 * @param val буфер для значения
+			 * @return true, если элемент извлечён (false - словарь пуст)
 			 */
-			void Push( T &&val )
+			bool PopMin( Key &key, Value &val )
 			{
-				std::unique_ptr<T> val_smart_ptr( new T( std::move( val ) ) );
-				PushElement( val_smart_ptr );
+				auto epoch_keeper = DefQueue.EpochAcquire();
+				while( true )
+				{
+					Node *node = SkipMarked( Ptr( Head[ 0 ].load() ) );
+					if( node == nullptr )
+					{
+						return false;
+					}
+
+					if( MarkNode( node ) )
+					{
+						// Элемент наш (пока удерживаем эпоху, он не будет удалён из памяти)
+						key = node->K;
+						val = node->V;
+						Unlink( node );
+						break;
+					}
+				}
+
+				epoch_keeper.Release();
+				DefQueue.ClearIfNeed();
+				return true;
+			} // bool PopMin( Key &key, Value &val )
+
+			/// Итератор на первый элемент с ключом не меньше key
+			Iterator LowerBound( const Key &key )
+			{
+				auto epoch_keeper = DefQueue.EpochAcquire();
+				Node *succs[ 1 ];
+				FindNode( key, nullptr, succs );
+				return Iterator( std::move( epoch_keeper ), succs[ 0 ] );
 			}
 
-			/**
-			 * @brief Push добавление нового элемента в хвост очереди
-			 * @param args аргументы для создания нового элемента
-			 */
-			template <typename ...Types>
-			void Push( Types ...args )
+			/// Итератор на первый элемент
+			Iterator Begin()
 			{
-				std::unique_ptr<T> val_smart_ptr( new T( args... ) );
-				PushElement( val_smart_ptr );
+				auto epoch_keeper = DefQueue.EpochAcquire();
+				return Iterator( std::move( epoch_keeper ), Ptr( Head[ 0 ].load() ) );
 			}
 
-			/**
-			 * @brief Pop извлечение элемента из головы очереди
-			 * если очередь пуста - будет возвращён нулевой указатель
-			 * @return элемент (в виде указателя) из головы очереди
-			 */
-			std::unique_ptr<T> Pop()
+			/// Пуст ли словарь
+			bool Empty()
 			{
-				return std::unique_ptr<T>( ( T* ) PtrsQueue.Pop() );
+				return !Begin().Valid();
 			}
-			
+
 			/// Очистить очередь на отложенное удаление
 			void CleanDeferredQueue()
 			{
-				PtrsQueue.CleanDeferredQueue();
+				DefQueue.Clear();
 			}
-	}; // class Queue
+	}; // class SkipList
 } // namespace LockFree
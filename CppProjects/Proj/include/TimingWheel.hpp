@@ -0,0 +1,494 @@
+#pragma once
+
+#include <stdint.h>
+#include <chrono>
+#include <stdexcept>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#ifndef MY_ASSERT
+#define MY_ASSERT( EXPR )
+#endif
+
+namespace Bicycle
+{
+	class TimingWheel;
+
+	/// Узел колеса таймеров (встраивается в объект-владелец,
+	/// постановка в колесо и снятие с него не требуют выделения памяти)
+	class TimingWheelNode
+	{
+		friend class TimingWheel;
+
+		private:
+			/// Предыдущий элемент списка ячейки
+			TimingWheelNode *Prev;
+
+			/// Следующий элемент списка ячейки
+			TimingWheelNode *Next;
+
+			/// Номер "тика" сработки
+			uint64_t ExpireTick;
+
+			/// Уровень колеса, в ячейке которого находится узел
+			uint8_t Level;
+
+			/// Номер ячейки уровня
+			uint8_t Slot;
+
+			/// Показывает, находится ли узел в колесе
+			bool Linked;
+
+		public:
+			TimingWheelNode( const TimingWheelNode& ) = delete;
+			TimingWheelNode& operator=( const TimingWheelNode& ) = delete;
+
+			TimingWheelNode(): Prev( nullptr ),
+			                   Next( nullptr ),
+			                   ExpireTick( 0 ),
+			                   Level( 0 ),
+			                   Slot( 0 ),
+			                   Linked( false )
+			{}
+
+			virtual ~TimingWheelNode()
+			{
+				MY_ASSERT( !Linked );
+			}
+
+			/// Показывает, находится ли узел в колесе
+			bool IsLinked() const
+			{
+				return Linked;
+			}
+
+			/**
+			 * @brief OnExpired обработка наступления срока (узел к
+			 * этому моменту уже снят с колеса и может быть поставлен снова)
+			 */
+			virtual void OnExpired() = 0;
+	};
+
+	/**
+	 * @brief The TimingWheel класс иерархического колеса таймеров:
+	 * 64 ячейки на уровень, уровни покрывают весь 64-битный диапазон "тиков".
+	 * Добавление и удаление узла - O(1), продвижение времени пропускает
+	 * пустые ячейки по битовым маскам занятости.
+	 * Не потокобезопасен (синхронизация - на стороне владельца)
+	 */
+	class TimingWheel
+	{
+		public:
+			typedef std::chrono::steady_clock ClockType;
+			typedef ClockType::time_point TimePoint;
+			typedef ClockType::duration Duration;
+
+		private:
+			/// Количество бит номера "тика" на уровень
+			static const uint8_t LevelBits = 6;
+
+			/// Количество ячеек на уровне
+			static const uint8_t SlotsNum = 1 << LevelBits;
+
+			/// Количество уровней (покрывают все 64 бита номера "тика")
+			static const uint8_t LevelsNum = ( 64 + LevelBits - 1 ) / LevelBits;
+
+			/// Длительность "тика"
+			const Duration Tick;
+
+			/// Момент, соответствующий нулевому "тику"
+			const TimePoint Start;
+
+			/// Номер последнего обработанного "тика"
+			uint64_t CurrentTick;
+
+			/// Количество узлов в колесе
+			uint64_t Count;
+
+			/// Битовые маски занятости ячеек уровней
+			uint64_t Occupied[ LevelsNum ];
+
+			/// Списки узлов в ячейках
+			TimingWheelNode *Slots[ LevelsNum ][ SlotsNum ];
+
+			static uint8_t LowestBit( uint64_t mask )
+			{
+				MY_ASSERT( mask != 0 );
+#ifdef _MSC_VER
+				unsigned long res = 0;
+				_BitScanForward64( &res, mask );
+				return ( uint8_t ) res;
+#else
+				return ( uint8_t ) __builtin_ctzll( mask );
+#endif
+			}
+
+			static uint8_t HighestBit( uint64_t mask )
+			{
+				MY_ASSERT( mask != 0 );
+#ifdef _MSC_VER
+				unsigned long res = 0;
+				_BitScanReverse64( &res, mask );
+				return ( uint8_t ) res;
+#else
+				return ( uint8_t ) ( 63 - __builtin_clzll( mask ) );
+#endif
+			}
+
+			/// Добавление узла в ячейку, соответствующую его "тику" (ExpireTick >= CurrentTick)
+			void Link( TimingWheelNode &node )
+			{
+				MY_ASSERT( !node.Linked );
+				MY_ASSERT( node.ExpireTick >= CurrentTick );
+
+				// Уровень определяется старшей группой бит, в которой
+				// номер "тика" узла отличается от текущего
+				const uint64_t diff = node.ExpireTick ^ CurrentTick;
+				const uint8_t level = diff == 0 ? 0 : HighestBit( diff ) / LevelBits;
+				const uint8_t slot = ( uint8_t ) ( ( node.ExpireTick >> ( level*LevelBits ) ) & ( SlotsNum - 1 ) );
+				MY_ASSERT( level < LevelsNum );
+
+				TimingWheelNode *&head = Slots[ level ][ slot ];
+				node.Prev = nullptr;
+				node.Next = head;
+				if( head != nullptr )
+				{
+					head->Prev = &node;
+				}
+				head = &node;
+
+				node.Level = level;
+				node.Slot = slot;
+				node.Linked = true;
+				Occupied[ level ] |= ( uint64_t ) 1 << slot;
+			}
+
+			/// Извлечение узла из его ячейки
+			void Unlink( TimingWheelNode &node )
+			{
+				MY_ASSERT( node.Linked );
+				TimingWheelNode *&head = Slots[ node.Level ][ node.Slot ];
+				if( node.Prev != nullptr )
+				{
+					node.Prev->Next = node.Next;
+				}
+				else
+				{
+					MY_ASSERT( head == &node );
+					head = node.Next;
+				}
+
+				if( node.Next != nullptr )
+				{
+					node.Next->Prev = node.Prev;
+				}
+
+				if( head == nullptr )
+				{
+					Occupied[ node.Level ] &= ~( ( uint64_t ) 1 << node.Slot );
+				}
+
+				node.Prev = node.Next = nullptr;
+				node.Linked = false;
+			}
+
+			/**
+			 * @brief NextEventTick номер ближайшего "тика", на котором
+			 * надо либо обработать узлы нулевого уровня, либо перенести
+			 * узлы старшего уровня на младшие
+			 * @param tick буфер для номера "тика"
+			 * @return false, если колесо пусто
+			 */
+			bool NextEventTick( uint64_t &tick ) const
+			{
+				bool found = false;
+				for( uint8_t level = 0; level < LevelsNum; ++level )
+				{
+					const uint8_t shift = level*LevelBits;
+					const uint8_t pos = ( uint8_t ) ( ( CurrentTick >> shift ) & ( SlotsNum - 1 ) );
+
+					// Все занятые ячейки уровня находятся "правее" текущей позиции
+					const uint64_t mask = Occupied[ level ] & ~( ( ( uint64_t ) 2 << pos ) - 1 );
+					if( mask == 0 )
+					{
+						continue;
+					}
+
+					const uint64_t slot = LowestBit( mask );
+					const uint8_t upper_shift = shift + LevelBits;
+					const uint64_t upper = upper_shift < 64 ? ( CurrentTick >> upper_shift ) << upper_shift : 0;
+					const uint64_t event_tick = upper | ( slot << shift );
+					if( !found || ( event_tick < tick ) )
+					{
+						tick = event_tick;
+						found = true;
+					}
+				}
+
+				return found;
+			}
+
+			/// Преобразование момента времени в номер "тика" (с округлением вверх)
+			uint64_t ToTick( const TimePoint &tp ) const
+			{
+				if( !( Start < tp ) )
+				{
+					return 0;
+				}
+
+				const Duration d = tp - Start;
+				const uint64_t res = ( uint64_t ) ( d.count() / Tick.count() );
+				return ( d.count() % Tick.count() ) == 0 ? res : res + 1;
+			}
+
+			/// Номер последнего "тика", завершившегося к моменту времени tp
+			uint64_t ToPassedTick( const TimePoint &tp ) const
+			{
+				return Start < tp ? ( uint64_t ) ( ( tp - Start ).count() / Tick.count() ) : 0;
+			}
+
+		public:
+			TimingWheel( const TimingWheel& ) = delete;
+			TimingWheel& operator=( const TimingWheel& ) = delete;
+
+			/**
+			 * @brief TimingWheel конструктор
+			 * @param tick длительность "тика" (точность срабатывания)
+			 * @param start момент, соответствующий нулевому "тику"
+			 * @throw std::invalid_argument, если длительность "тика" не положительна
+			 */
+			TimingWheel( const Duration &tick, const TimePoint &start = ClockType::now() ): Tick( tick ),
+			                                                                                 Start( start ),
+			                                                                                 CurrentTick( 0 ),
+			                                                                                 Count( 0 )
+			{
+				if( tick.count() <= 0 )
+				{
+					throw std::invalid_argument( "Tick must be positive" );
+				}
+
+				for( uint8_t level = 0; level < LevelsNum; ++level )
+				{
+					Occupied[ level ] = 0;
+					for( uint8_t slot = 0; slot < SlotsNum; ++slot )
+					{
+						Slots[ level ][ slot ] = nullptr;
+					}
+				}
+			}
+
+			~TimingWheel()
+			{
+				MY_ASSERT( Count == 0 );
+			}
+
+			/// Длительность "тика"
+			Duration GetTick() const
+			{
+				return Tick;
+			}
+
+			/// Количество узлов в колесе
+			uint64_t Size() const
+			{
+				return Count;
+			}
+
+			/// Проверка колеса на пустоту
+			bool Empty() const
+			{
+				return Count == 0;
+			}
+
+			/**
+			 * @brief Insert постановка узла в колесо
+			 * (срок, уже наступивший к текущему "тику", сработает на следующем)
+			 * @param node узел (не должен находиться в колесе)
+			 * @param deadline время сработки
+			 * @param slack допустимое запаздывание сработки: срок округляется вверх
+			 * до границы окна из 2^N "тиков" (наибольшего, не превышающего slack),
+			 * так что узлы с близкими сроками срабатывают за одно продвижение колеса
+			 * @throw std::invalid_argument, если узел уже в колесе
+			 */
+			void Insert( TimingWheelNode &node,
+			             const TimePoint &deadline,
+			             const Duration &slack = Duration::zero() )
+			{
+				if( node.Linked )
+				{
+					MY_ASSERT( false );
+					throw std::invalid_argument( "Node is already linked" );
+				}
+
+				uint64_t tick = ToTick( deadline );
+				const uint64_t slack_ticks = slack.count() > 0 ? ( uint64_t ) ( slack.count() / Tick.count() ) : 0;
+				if( slack_ticks > 1 )
+				{
+					// Выравниваем "тик" сработки по границе окна
+					const uint64_t window = ( uint64_t ) 1 << HighestBit( slack_ticks );
+					const uint64_t aligned = ( tick + window - 1 ) & ~( window - 1 );
+					if( aligned > tick )
+					{
+						tick = aligned;
+					}
+				}
+				node.ExpireTick = tick > CurrentTick ? tick : CurrentTick + 1;
+				Link( node );
+				++Count;
+			}
+
+			/**
+			 * @brief Remove снятие узла с колеса
+			 * @param node узел
+			 * @return true, если узел был в колесе
+			 */
+			bool Remove( TimingWheelNode &node )
+			{
+				if( !node.Linked )
+				{
+					return false;
+				}
+
+				Unlink( node );
+				MY_ASSERT( Count > 0 );
+				--Count;
+				return true;
+			}
+
+			/**
+			 * @brief NextExpiration ближайший момент, когда колесо требует
+			 * продвижения (не позже ближайшего срока сработки)
+			 * @param tp буфер для момента времени
+			 * @return false, если колесо пусто
+			 */
+			bool NextExpiration( TimePoint &tp ) const
+			{
+				uint64_t tick = 0;
+				if( !NextEventTick( tick ) )
+				{
+					return false;
+				}
+
+				if( tick > ( uint64_t ) ( ( TimePoint::max() - Start ).count() / Tick.count() ) )
+				{
+					tp = TimePoint::max();
+				}
+				else
+				{
+					tp = Start + Tick*tick;
+				}
+				return true;
+			}
+
+			/**
+			 * @brief Advance продвижение времени колеса с вызовом
+			 * OnExpired у всех узлов, срок которых наступил
+			 * @param now текущий момент времени
+			 * @return количество сработавших узлов
+			 */
+			uint64_t Advance( const TimePoint &now )
+			{
+				const uint64_t target = ToPassedTick( now );
+				uint64_t expired = 0;
+				uint64_t tick = 0;
+
+				while( NextEventTick( tick ) && ( tick <= target ) )
+				{
+					MY_ASSERT( tick > CurrentTick );
+					CurrentTick = tick;
+
+					// Переносим узлы старших уровней, ячейки которых
+					// начинаются с текущего "тика", на младшие уровни
+					for( uint8_t level = LevelsNum - 1; level > 0; --level )
+					{
+						const uint8_t shift = level*LevelBits;
+						if( ( CurrentTick & ( ( ( uint64_t ) 1 << shift ) - 1 ) ) != 0 )
+						{
+							// Младшие группы бит не нулевые: ячейка уровня ещё не началась
+							continue;
+						}
+
+						const uint8_t slot = ( uint8_t ) ( ( CurrentTick >> shift ) & ( SlotsNum - 1 ) );
+						TimingWheelNode *node_ptr = Slots[ level ][ slot ];
+						Slots[ level ][ slot ] = nullptr;
+						Occupied[ level ] &= ~( ( uint64_t ) 1 << slot );
+
+						while( node_ptr != nullptr )
+						{
+							TimingWheelNode *next = node_ptr->Next;
+							node_ptr->Linked = false;
+							Link( *node_ptr );
+							node_ptr = next;
+						}
+					}
+
+					// Обрабатываем узлы текущего "тика" по одному
+					// (OnExpired может ставить и снимать узлы)
+					const uint8_t slot = ( uint8_t ) ( CurrentTick & ( SlotsNum - 1 ) );
+					while( Slots[ 0 ][ slot ] != nullptr )
+					{
+						TimingWheelNode &node = *Slots[ 0 ][ slot ];
+						MY_ASSERT( node.ExpireTick == CurrentTick );
+						Unlink( node );
+						--Count;
+						++expired;
+						node.OnExpired();
+					}
+				}
+
+				if( target > CurrentTick )
+				{
+					CurrentTick = target;
+				}
+
+				return expired;
+			} // uint64_t Advance( const TimePoint &now )
+
+			/**
+			 * @brief ExpireIf досрочная сработка узлов, удовлетворяющих условию
+			 * (обходит все занятые ячейки: предназначена для редких событий, например остановки)
+			 * @param pred условие bool( TimingWheelNode& ) (вызывается для узла, стоящего в колесе)
+			 * @return количество сработавших узлов
+			 */
+			template< typename Pred >
+			uint64_t ExpireIf( Pred pred )
+			{
+				// Сначала снимаем отобранные узлы в отдельную цепочку:
+				// OnExpired может ставить и снимать узлы, не ломая обход
+				TimingWheelNode *expired_head = nullptr;
+				uint64_t expired = 0;
+				for( uint8_t level = 0; level < LevelsNum; ++level )
+				{
+					for( uint64_t mask = Occupied[ level ]; mask != 0; mask &= mask - 1 )
+					{
+						TimingWheelNode *node_ptr = Slots[ level ][ LowestBit( mask ) ];
+						while( node_ptr != nullptr )
+						{
+							TimingWheelNode &node = *node_ptr;
+							node_ptr = node.Next;
+							if( pred( node ) )
+							{
+								Unlink( node );
+								--Count;
+								++expired;
+								node.Next = expired_head;
+								expired_head = &node;
+							}
+						}
+					}
+				}
+
+				while( expired_head != nullptr )
+				{
+					TimingWheelNode &node = *expired_head;
+					expired_head = node.Next;
+					node.Next = nullptr;
+					node.OnExpired();
+				}
+
+				return expired;
+			} // uint64_t ExpireIf( Pred pred )
+	};
+} // namespace Bicycle
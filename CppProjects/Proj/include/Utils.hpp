@@ -6,6 +6,9 @@
 
 namespace Bicycle
 {
+	/// Пауза процессора в цикле активного ожидания
+	void CpuRelax();
+
 	/// Класс "спин-лока"
 	class SpinLock
 	{
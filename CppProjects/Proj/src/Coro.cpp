@@ -1,5 +1,8 @@
 #include "Coro.hpp"
 #include <string.h>
+#ifndef _WIN32
+#include <signal.h> // для SIGSTKSZ
+#endif
 
 namespace Bicycle
 {
@@ -148,7 +151,7 @@ namespace Bicycle
 			std::terminate();
 		} //Coroutine::CoroutineFunc
 
-		Coroutine::Coroutine(): StateFlag( 0 ), CreatedFromThread( true ), Started( true )
+		Coroutine::Coroutine(): StateFlag( 0 ), CreatedFromThread( true ), Started( true ), NextScheduled( nullptr ), OwnerData( nullptr )
 		{
 			if( Internal.Get() != nullptr )
 			{
@@ -201,6 +204,8 @@ namespace Bicycle
 #ifndef _WIN32
 		                                         , Stack( EditStackSize( stack_sz ) )
 #endif
+		                                         , NextScheduled( nullptr )
+		                                         , OwnerData( nullptr )
 		{
 			if( !task )
 			{
@@ -0,0 +1,215 @@
+#include "CoroSrv/Future.hpp"
+#include <thread>
+
+namespace Bicycle
+{
+	namespace CoroService
+	{
+		FutureStateBase::FutureStateBase(): ReadyFlag( false ),
+		                                    Ready(),
+		                                    Notifying( false ),
+		                                    Listeners( nullptr )
+		{}
+
+		FutureStateBase::~FutureStateBase()
+		{
+			MY_ASSERT( Listeners == nullptr );
+		}
+
+		void FutureStateBase::SetReady()
+		{
+			// Список отсоединяется под блокировкой, а события выставляются уже без неё;
+			// RemoveListener до сброса Notifying ждёт, чтобы ожидающий не удалил
+			// своё событие раньше времени
+			FutureListener *listeners;
+			{
+				LockGuard<SpinLock> lock( ListenersLock );
+				ReadyFlag.store( true );
+				Notifying.store( true );
+				listeners = Listeners;
+				Listeners = nullptr;
+			}
+
+			for( FutureListener *listener = listeners; listener != nullptr; listener = listener->Next )
+			{
+				listener->ReadyEvent->Set();
+			}
+			Notifying.store( false );
+			Ready.Set();
+		}
+
+		void FutureStateBase::SetException( std::exception_ptr exc )
+		{
+			Exc = exc;
+			SetReady();
+		}
+
+		bool FutureStateBase::IsReady() const
+		{
+			return ReadyFlag.load();
+		}
+
+		void FutureStateBase::Wait()
+		{
+			if( !ReadyFlag.load() )
+			{
+				Ready.Wait();
+			}
+		}
+
+		bool FutureStateBase::Wait( const DeadlineType &deadline )
+		{
+			return ReadyFlag.load() || Ready.Wait( deadline );
+		}
+
+		void FutureStateBase::RethrowIfNeed() const
+		{
+			MY_ASSERT( ReadyFlag.load() );
+			if( Exc )
+			{
+				std::rethrow_exception( Exc );
+			}
+		}
+
+		bool FutureStateBase::AddListener( FutureListener &listener )
+		{
+			LockGuard<SpinLock> lock( ListenersLock );
+			if( ReadyFlag.load() )
+			{
+				return false;
+			}
+
+			listener.Prev = nullptr;
+			listener.Next = Listeners;
+			if( Listeners != nullptr )
+			{
+				Listeners->Prev = &listener;
+			}
+			Listeners = &listener;
+			return true;
+		}
+
+		void FutureStateBase::RemoveListener( FutureListener &listener )
+		{
+			{
+				LockGuard<SpinLock> lock( ListenersLock );
+				if( !ReadyFlag.load() )
+				{
+					UnlinkListener( listener );
+					return;
+				}
+			}
+
+			// Список уже отсоединён SetReady: ждём, пока тот выставит события
+			while( Notifying.load() )
+			{
+				std::this_thread::yield();
+			}
+		}
+
+		void FutureStateBase::UnlinkListener( FutureListener &listener )
+		{
+			if( listener.Prev != nullptr )
+			{
+				listener.Prev->Next = listener.Next;
+			}
+			else
+			{
+				MY_ASSERT( Listeners == &listener );
+				Listeners = listener.Next;
+			}
+
+			if( listener.Next != nullptr )
+			{
+				listener.Next->Prev = listener.Prev;
+			}
+			listener.Prev = listener.Next = nullptr;
+		}
+
+		//-------------------------------------------------------------------------------
+
+		/// Снятие элементов с ожидания готовности результатов при выходе из области видимости
+		class FutureListenersGuard
+		{
+			private:
+				FutureStateBase* const *States;
+				std::vector<FutureListener> &Listeners;
+
+			public:
+				/// Количество добавленных элементов
+				size_t Added;
+
+				FutureListenersGuard( FutureStateBase* const *states,
+				                      std::vector<FutureListener> &listeners ): States( states ),
+				                                                                Listeners( listeners ),
+				                                                                Added( 0 )
+				{}
+
+				~FutureListenersGuard()
+				{
+					for( size_t t = 0; t < Added; ++t )
+					{
+						States[ t ]->RemoveListener( Listeners[ t ] );
+					}
+				}
+		};
+
+		size_t WhenAnyImpl( FutureStateBase* const *states, size_t states_num,
+		                    const DeadlineType *deadline )
+		{
+			if( states_num == 0 )
+			{
+				throw std::invalid_argument( "No futures to wait" );
+			}
+
+			for( size_t t = 0; t < states_num; ++t )
+			{
+				if( states[ t ] == nullptr )
+				{
+					throw std::invalid_argument( "Future has no state" );
+				}
+				else if( states[ t ]->IsReady() )
+				{
+					return t;
+				}
+			}
+
+			// Одно общее событие подписывается на готовность каждого результата
+			Event any_ready;
+			std::vector<FutureListener> listeners( states_num );
+			{
+				FutureListenersGuard guard( states, listeners );
+				for( ; guard.Added < states_num; ++guard.Added )
+				{
+					listeners[ guard.Added ].ReadyEvent = &any_ready;
+					if( !states[ guard.Added ]->AddListener( listeners[ guard.Added ] ) )
+					{
+						// Результат уже готов
+						break;
+					}
+				}
+
+				if( guard.Added == states_num )
+				{
+					if( deadline != nullptr )
+					{
+						any_ready.Wait( *deadline );
+					}
+					else
+					{
+						any_ready.Wait();
+					}
+				}
+			}
+
+			for( size_t t = 0; t < states_num; ++t )
+			{
+				if( states[ t ]->IsReady() )
+				{
+					return t;
+				}
+			}
+			return states_num;
+		} // size_t WhenAnyImpl( FutureStateBase* const *states, size_t states_num, const DeadlineType *deadline )
+	} // namespace CoroService
+} // namespace Bicycle
@@ -55,6 +55,11 @@ namespace Bicycle
 			ThrowIfNeed( err );
 		}
 
+		size_t UdpSocket::SendTo( const ConstBufferType &data, const Ip4Addr &addr, Error &err )
+		{
+			return SendTo( data, addr, NoDeadline, err );
+		}
+
 		size_t UdpSocket::SendTo( const ConstBufferType &data, const Ip4Addr &addr )
 		{
 			Error err;
@@ -63,6 +68,20 @@ namespace Bicycle
 			return res;
 		}
 
+		size_t UdpSocket::SendTo( const ConstBufferType &data, const Ip4Addr &addr,
+		                          const DeadlineType &deadline )
+		{
+			Error err;
+			size_t res = SendTo( data, addr, deadline, err );
+			ThrowIfNeed( err );
+			return res;
+		}
+
+		size_t UdpSocket::RecvFrom( const BufferType &data, Ip4Addr &addr, Error &err )
+		{
+			return RecvFrom( data, addr, NoDeadline, err );
+		}
+
 		size_t UdpSocket::RecvFrom( const BufferType &data, Ip4Addr &addr )
 		{
 			Error err;
@@ -71,10 +90,24 @@ namespace Bicycle
 			return res;
 		}
 
+		size_t UdpSocket::RecvFrom( const BufferType &data, Ip4Addr &addr,
+		                            const DeadlineType &deadline )
+		{
+			Error err;
+			size_t res = RecvFrom( data, addr, deadline, err );
+			ThrowIfNeed( err );
+			return res;
+		}
+
 		//-------------------------------------------------------------------------------
 
 		TcpSocket::TcpSocket() {}
 
+		void TcpConnection::Connect( const Ip4Addr &addr, Error &err )
+		{
+			Connect( addr, NoDeadline, err );
+		}
+
 		void TcpConnection::Connect( const Ip4Addr &addr )
 		{
 			Error err;
@@ -82,6 +115,18 @@ namespace Bicycle
 			ThrowIfNeed( err );
 		}
 
+		void TcpConnection::Connect( const Ip4Addr &addr, const DeadlineType &deadline )
+		{
+			Error err;
+			Connect( addr, deadline, err );
+			ThrowIfNeed( err );
+		}
+
+		size_t TcpConnection::Send( const ConstBufferType &data, Error &err )
+		{
+			return Send( data, NoDeadline, err );
+		}
+
 		size_t TcpConnection::Send( const ConstBufferType &data )
 		{
 			Error err;
@@ -90,6 +135,19 @@ namespace Bicycle
 			return res;
 		}
 
+		size_t TcpConnection::Send( const ConstBufferType &data, const DeadlineType &deadline )
+		{
+			Error err;
+			size_t res = Send( data, deadline, err );
+			ThrowIfNeed( err );
+			return res;
+		}
+
+		size_t TcpConnection::Recv( const BufferType &data, Error &err )
+		{
+			return Recv( data, NoDeadline, err );
+		}
+
 		size_t TcpConnection::Recv( const BufferType &data )
 		{
 			Error err;
@@ -98,6 +156,14 @@ namespace Bicycle
 			return res;
 		}
 
+		size_t TcpConnection::Recv( const BufferType &data, const DeadlineType &deadline )
+		{
+			Error err;
+			size_t res = Recv( data, deadline, err );
+			ThrowIfNeed( err );
+			return res;
+		}
+
 		void TcpAcceptor::Listen( uint16_t backlog )
 		{
 			Error err;
@@ -105,11 +171,24 @@ namespace Bicycle
 			ThrowIfNeed( err );
 		}
 
+		void TcpAcceptor::Accept( TcpConnection &conn, Ip4Addr &addr, Error &err )
+		{
+			Accept( conn, addr, NoDeadline, err );
+		}
+
 		void TcpAcceptor::Accept( TcpConnection &conn, Ip4Addr &addr )
 		{
 			Error err;
 			Accept( conn, addr, err );
 			ThrowIfNeed( err );
 		}
+
+		void TcpAcceptor::Accept( TcpConnection &conn, Ip4Addr &addr,
+		                          const DeadlineType &deadline )
+		{
+			Error err;
+			Accept( conn, addr, deadline, err );
+			ThrowIfNeed( err );
+		}
 	} // namespace CoroService
 } // namespace Bicycle
@@ -84,7 +84,8 @@ namespace Bicycle
 			return socket( AF_INET, SOCK_DGRAM, IPPROTO_UDP );
 		}
 
-		size_t UdpSocket::SendTo( const ConstBufferType &data, const Ip4Addr &addr, Error &err )
+		size_t UdpSocket::SendTo( const ConstBufferType &data, const Ip4Addr &addr,
+		                          const DeadlineType &deadline, Error &err )
 		{
 			if( ( data.first == nullptr ) || ( data.second == 0 ) )
 			{
@@ -114,12 +115,13 @@ namespace Bicycle
 				errno = 0;
 				return err_code;
 			};
-			err = ExecuteIoTask( task, IoTaskTypeEnum::Write );
+			err = ExecuteIoTask( task, IoTaskTypeEnum::Write, deadline );
 
 			return res;
 		}
 
-		size_t UdpSocket::RecvFrom( const BufferType &data, Ip4Addr &addr, Error &err )
+		size_t UdpSocket::RecvFrom( const BufferType &data, Ip4Addr &addr,
+		                            const DeadlineType &deadline, Error &err )
 		{
 			if( ( data.first == nullptr ) || ( data.second == 0 ) )
 			{
@@ -149,7 +151,7 @@ namespace Bicycle
 				errno = 0;
 				return err_code;
 			};
-			err = ExecuteIoTask( task, IoTaskTypeEnum::Read );
+			err = ExecuteIoTask( task, IoTaskTypeEnum::Read, deadline );
 
 			return res;
 		}
@@ -161,7 +163,7 @@ namespace Bicycle
 			return socket( AF_INET, SOCK_STREAM, IPPROTO_TCP );
 		}
 
-		void TcpConnection::Connect( const Ip4Addr &addr, Error &err )
+		void TcpConnection::Connect( const Ip4Addr &addr, const DeadlineType &deadline, Error &err )
 		{
 			bool was_called = false;
 			IoTaskType task = [ this, &addr, &was_called ]( int fd ) -> err_code_t
@@ -195,10 +197,10 @@ namespace Bicycle
 				was_called = err_code != EINTR;
 				return err_code;
 			};
-			err = ExecuteIoTask( task, IoTaskTypeEnum::Write );
+			err = ExecuteIoTask( task, IoTaskTypeEnum::Write, deadline );
 		}
 
-		size_t TcpConnection::Send( const ConstBufferType &data, Error &err )
+		size_t TcpConnection::Send( const ConstBufferType &data, const DeadlineType &deadline, Error &err )
 		{
 			if( ( data.first == nullptr ) || ( data.second == 0 ) )
 			{
@@ -226,12 +228,12 @@ namespace Bicycle
 				errno = 0;
 				return err_code;
 			};
-			err = ExecuteIoTask( task, IoTaskTypeEnum::Write );
+			err = ExecuteIoTask( task, IoTaskTypeEnum::Write, deadline );
 
 			return res;
 		}
 
-		size_t TcpConnection::Recv( const BufferType &data, Error &err )
+		size_t TcpConnection::Recv( const BufferType &data, const DeadlineType &deadline, Error &err )
 		{
 			if( ( data.first == nullptr ) || ( data.second == 0 ) )
 			{
@@ -259,7 +261,7 @@ namespace Bicycle
 				errno = 0;
 				return err_code;
 			};
-			err = ExecuteIoTask( task, IoTaskTypeEnum::Read );
+			err = ExecuteIoTask( task, IoTaskTypeEnum::Read, deadline );
 
 			return res;
 		}
@@ -271,7 +273,8 @@ namespace Bicycle
 			err = listen( DescriptorData->Fd, ( int ) backlog ) == 0 ? Error() : GetLastSystemError();
 		}
 
-		void TcpAcceptor::Accept( TcpConnection &conn, Ip4Addr &addr, Error &err )
+		void TcpAcceptor::Accept( TcpConnection &conn, Ip4Addr &addr,
+		                          const DeadlineType &deadline, Error &err )
 		{
 			int new_conn = -1;
 			IoTaskType task = [ this, &addr, &new_conn ]( int fd ) -> err_code_t
@@ -290,7 +293,7 @@ namespace Bicycle
 
 				return err_code;
 			};
-			err = ExecuteIoTask( task, IoTaskTypeEnum::Read );
+			err = ExecuteIoTask( task, IoTaskTypeEnum::Read, deadline );
 
 			if( !err )
 			{
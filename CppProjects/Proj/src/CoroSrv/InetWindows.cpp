@@ -119,7 +119,8 @@ namespace Bicycle
 			return socket( AF_INET, SOCK_DGRAM, IPPROTO_UDP );
 		}
 
-		size_t UdpSocket::SendTo( const ConstBufferType &data, const Ip4Addr &addr, Error &err )
+		size_t UdpSocket::SendTo( const ConstBufferType &data, const Ip4Addr &addr,
+		                          const DeadlineType &deadline, Error &err )
 		{
 			if( ( data.first == nullptr ) || ( data.second == 0 ) )
 			{
@@ -142,12 +143,13 @@ namespace Bicycle
 				                        ( LPWSAOVERLAPPED ) &task_struct, nullptr );
 				return i_res != 0 ? GetLastSockErrorCode() : ErrorCodes::Success;
 			};
-			err = ExecuteIoTask( task, res );
+			err = ExecuteIoTask( task, res, deadline );
 
 			return res;
 		}
 
-		size_t UdpSocket::RecvFrom( const BufferType &data, Ip4Addr &addr, Error &err )
+		size_t UdpSocket::RecvFrom( const BufferType &data, Ip4Addr &addr,
+		                            const DeadlineType &deadline, Error &err )
 		{
 			if( ( data.first == nullptr ) || ( data.second == 0 ) )
 			{
@@ -173,7 +175,7 @@ namespace Bicycle
 
 				return i_res != 0 ? GetLastSockErrorCode() : ErrorCodes::Success;
 			};
-			err = ExecuteIoTask( task, res );
+			err = ExecuteIoTask( task, res, deadline );
 
 			return res;
 		}
@@ -185,7 +187,7 @@ namespace Bicycle
 			return socket( AF_INET, SOCK_STREAM, IPPROTO_TCP );
 		}
 
-		void TcpConnection::Connect( const Ip4Addr &addr, Error &err )
+		void TcpConnection::Connect( const Ip4Addr &addr, const DeadlineType &deadline, Error &err )
 		{
 			DWORD bytes_rcvd = 0;
 			IoTaskType task = [ & ]( HANDLE fd, IocpStruct &task_struct ) -> err_code_t
@@ -213,10 +215,10 @@ namespace Bicycle
 				return i_res == FALSE ? GetLastSockErrorCode() : ErrorCodes::Success;
 			};
 			size_t fake_sz = 0;
-			err = ExecuteIoTask( task, fake_sz );
+			err = ExecuteIoTask( task, fake_sz, deadline );
 		} // void TcpConnection::Connect( const Ip4Addr &addr, Error &err )
 
-		size_t TcpConnection::Send( const ConstBufferType &data, Error &err )
+		size_t TcpConnection::Send( const ConstBufferType &data, const DeadlineType &deadline, Error &err )
 		{
 			if( ( data.first == nullptr ) || ( data.second == 0 ) )
 			{
@@ -238,12 +240,12 @@ namespace Bicycle
 
 				return i_res != 0 ? GetLastSockErrorCode() : ErrorCodes::Success;
 			};
-			err = ExecuteIoTask( task, res );
+			err = ExecuteIoTask( task, res, deadline );
 
 			return res;
 		}
 
-		size_t TcpConnection::Recv( const BufferType &data, Error &err )
+		size_t TcpConnection::Recv( const BufferType &data, const DeadlineType &deadline, Error &err )
 		{
 			if( ( data.first == nullptr ) || ( data.second == 0 ) )
 			{
@@ -267,7 +269,7 @@ namespace Bicycle
 
 				return i_res != 0 ? GetLastSockErrorCode() : ErrorCodes::Success;
 			};
-			err = ExecuteIoTask( task, res );
+			err = ExecuteIoTask( task, res, deadline );
 
 			return res;
 		}
@@ -278,7 +280,8 @@ namespace Bicycle
 			err = listen( ( SOCKET ) Fd, ( int ) backlog ) == 0 ? Error() : GetLastSockError();
 		}
 
-		void TcpAcceptor::Accept( TcpConnection &conn, Ip4Addr &addr, Error &err )
+		void TcpAcceptor::Accept( TcpConnection &conn, Ip4Addr &addr,
+		                          const DeadlineType &deadline, Error &err )
 		{
 			SOCKET new_sock = CreateNewSocket();
 			if( new_sock == INVALID_SOCKET )
@@ -322,7 +325,7 @@ namespace Bicycle
 				return i_res == FALSE ? GetLastSockErrorCode() : ErrorCodes::Success;
 			};
 			size_t fake_sz = 0;
-			err = ExecuteIoTask( task, fake_sz );
+			err = ExecuteIoTask( task, fake_sz, deadline );
 
 			if( !err )
 			{
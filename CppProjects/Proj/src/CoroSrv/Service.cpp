@@ -14,6 +14,9 @@ namespace Bicycle
 		/// Периодичность удаления указателей на закрытые дескрипторы
 		const uint64_t DescriptorsRemovePeriod = 0x40;
 
+		/// Длительность "тика" колёс таймеров сервиса (в микросекундах)
+		const uint64_t TimerTickMicrosec = 1000;
+
 		/// Структура с информацией для сервисов
 		struct SrvInfoStruct
 		{
@@ -26,16 +29,37 @@ namespace Bicycle
 			/// Ссылка на сопрограмму, которая удаляет сопрограмму, из которой в неё перешли, если та завершена
 			Coroutine &DeleteCoro;
 
+			/// Ссылка на очередь таймеров, в которую поток ставит таймеры
+			TimerQueue &Timers;
+
+			/// Номер потока сервиса (в порядке запуска Run после перезапуска)
+			const uint8_t RunNum;
+
+			/// Счётчик приостановок сопрограмм потока
+			LockFree::PaddedAtomic<uint64_t> &SuspendCounter;
+
 			/// Указатель на задачу, "оставленную" дескриптором при переходе в основную сопрограмму
 			std::function<void()> *DescriptorTask;
 
 			SrvInfoStruct( Service &srv_ref,
 			               Coroutine &main_coro,
-			               Coroutine &del_coro ): ServiceRef( srv_ref ),
-			                                      MainCoro( main_coro ),
-			                                      DeleteCoro( del_coro ),
-			                                      DescriptorTask( nullptr )
+			               Coroutine &del_coro,
+			               TimerQueue &timers,
+			               uint8_t run_num,
+			               LockFree::PaddedAtomic<uint64_t> &suspend_counter ): ServiceRef( srv_ref ),
+			                                                                    MainCoro( main_coro ),
+			                                                                    DeleteCoro( del_coro ),
+			                                                                    Timers( timers ),
+			                                                                    RunNum( run_num ),
+			                                                                    SuspendCounter( suspend_counter ),
+			                                                                    DescriptorTask( nullptr )
 			{}
+
+			/// Отметка о приостановке текущей сопрограммы потока
+			void CountSuspend()
+			{
+				SuspendCounter.fetch_add( 1, std::memory_order_relaxed );
+			}
 		};
 
 		/// "Потоколокальный" указатель на SrvInfoStruct
@@ -152,9 +176,14 @@ namespace Bicycle
 			// которая удаляет её и передаёт управление в основную сопрограмму
 			// Если отказаться от Post-а, можем попасть в ситуацию, когда управление больше не будет передано
 			// в текущую сопрограмму. Также будет глюк, если вызов не из сопрограммы.
-			CoroTaskType coro_fnc = [ task ]() -> Coroutine*
+			CoroTaskType coro_fnc = [ task ]() mutable -> Coroutine*
 			{
 				task();
+
+				// Захваченные задачей объекты удаляются ещё в сопрограмме
+				// (их деструкторы могут ждать объекты синхронизации)
+				task = nullptr;
+
 				SrvInfoStruct *info_ptr = ( SrvInfoStruct* ) SrvInfoPtr.Get();
 				Coroutine *res = info_ptr != nullptr ? &( info_ptr->DeleteCoro ) : nullptr;
 				MY_ASSERT( res != nullptr );
@@ -169,17 +198,142 @@ namespace Bicycle
 			return Error();
 		} // Error Go( std::function<void()> task )
 
+		void Service::ArmTimer( TimerNode &node, const DeadlineType &deadline, uint64_t slack_microsec )
+		{
+			// Ставим узел в очередь текущего потока сервиса (если вызов не из потока
+			// сервиса - в нулевую: таймеры всех сторонних потоков делят её блокировку)
+			SrvInfoStruct *info_ptr = ( SrvInfoStruct* ) SrvInfoPtr.Get();
+			TimerQueue &queue = ( info_ptr != nullptr ) && ( &( info_ptr->ServiceRef ) == this ) ?
+			                    info_ptr->Timers : TimerQueues[ 0 ];
+
+			Coroutine *stopped_coro = nullptr;
+			{
+				LockGuard<SpinLock> lock( queue.Lock );
+				MY_ASSERT( !node.IsLinked() );
+
+				node.QueuePtr = &queue;
+				if( queue.Stopping && node.OnStop() )
+				{
+					// Остановка уже обошла очередь: узел срабатывает сразу
+					stopped_coro = node.OnDeadline();
+				}
+				else
+				{
+					queue.Wheel.Insert( node, deadline, std::chrono::microseconds( slack_microsec ) );
+
+					DeadlineType wake_time;
+					if( queue.Wheel.NextExpiration( wake_time ) && ( wake_time < queue.WakeTime ) )
+					{
+						// Колесо требует продвижения раньше, чем настроено пробуждение
+						queue.WakeTime = wake_time;
+						SetTimersWakeup( queue );
+					}
+				}
+			}
+
+			if( stopped_coro != nullptr )
+			{
+				Post( stopped_coro );
+			}
+		} // void Service::ArmTimer
+
+		bool Service::DisarmTimer( TimerNode &node )
+		{
+			TimerQueue *queue_ptr = node.QueuePtr;
+			if( queue_ptr == nullptr )
+			{
+				// Узел не ставился в очередь
+				return false;
+			}
+
+			// Пробуждение, настроенное на этот узел, будет холостым
+			LockGuard<SpinLock> lock( queue_ptr->Lock );
+			return queue_ptr->Wheel.Remove( node );
+		} // bool Service::DisarmTimer( TimerNode &node )
+
+		void Service::WorkTimers( TimerQueue &queue, std::vector<Coroutine*> &ready )
+		{
+			MY_ASSERT( ready.empty() );
+			{
+				const DeadlineType now = DeadlineClock::now();
+
+				LockGuard<SpinLock> lock( queue.Lock );
+				if( now < queue.WakeTime )
+				{
+					// Срок очереди ещё не наступил
+					return;
+				}
+
+				// OnDeadline узлов складывают "пробуждённые" сопрограммы в queue.Ready
+				const uint64_t expired = queue.Wheel.Advance( now );
+				queue.Ready.swap( ready );
+
+				if( expired > 0 )
+				{
+					queue.ExpiredCount += expired;
+					++queue.WakeupsCount;
+				}
+
+				if( !queue.Wheel.NextExpiration( queue.WakeTime ) )
+				{
+					queue.WakeTime = DeadlineType::max();
+				}
+#ifndef _WIN32
+				else
+				{
+					// Перенастраиваем timerfd очереди на следующее событие колеса
+					SetTimersWakeup( queue );
+				}
+#endif
+			}
+
+			if( ready.empty() )
+			{
+				return;
+			}
+
+			// Все сопрограммы, кроме первой, помещаем в Post,
+			// в первую переходим сразу
+			for( size_t t = 1; t < ready.size(); ++t )
+			{
+				Post( ready[ t ] );
+			}
+
+			Coroutine *coro_ptr = ready.front();
+			ready.clear();
+
+			MY_ASSERT( coro_ptr != nullptr );
+			bool res = coro_ptr->SwitchTo();
+			MY_ASSERT( res );
+
+			// Выполняем задачу, "оставленную" дочерней сопрограммой
+			ExecLeftTasks();
+		} // void Service::WorkTimers( TimerQueue &queue, std::vector<Coroutine*> &ready )
+
 		Service::Service(): MustBeStopped( true ),
 		                    CoroCount( 0 ),
 		                    WorkThreadsCount( 0 ),
 							DescriptorsDeleteCount( 0 ),
-							NeedToClearDescriptors( false )
+							NeedToClearDescriptors( false ),
+							TimerQueueNum( 0 ),
+							TimerSlack( 0 ),
+							RcuQueue( 0xFF, 1 )
 #ifndef _WIN32
 							, DeleteQueue( 0xFF, 0x100 ),
 							CoroListNum( 0 )
 #endif
 		{
 			RunFlag.clear();
+			for( auto &counter : SuspendCounters )
+			{
+				counter.store( 0 );
+			}
+#ifndef _WIN32
+			for( auto &coros_list : CoroutinesToExecute )
+			{
+				coros_list.store( nullptr );
+			}
+#endif
 
 			try
 			{
@@ -216,6 +370,15 @@ namespace Bicycle
 				return false;
 			}
 
+			// Ожидания, поставленные после перезапуска, остановкой не прерваны
+			for( TimerQueue &queue : TimerQueues )
+			{
+				LockGuard<SpinLock> lock( queue.Lock );
+				queue.Stopping = false;
+			}
+
+			// Потоки Run снова распределяются по очередям таймеров с нулевой
+			TimerQueueNum.store( 0 );
 			MustBeStopped.store( false );
 
 			return true;
@@ -235,6 +398,27 @@ namespace Bicycle
 			CloseAllDescriptors();
 			MY_ASSERT( !Descriptors.Release() );
 
+			// Будим ожидания, которые сами остановку не заметят (SleepFor/SleepUntil)
+			std::vector<Coroutine*> stopped;
+			for( TimerQueue &queue : TimerQueues )
+			{
+				{
+					LockGuard<SpinLock> lock( queue.Lock );
+					queue.Stopping = true;
+					queue.Wheel.ExpireIf( []( TimingWheelNode &node )
+					{
+						return static_cast<TimerNode&>( node ).OnStop();
+					});
+					queue.Ready.swap( stopped );
+				}
+
+				for( Coroutine *coro_ptr : stopped )
+				{
+					Post( coro_ptr );
+				}
+				stopped.clear();
+			}
+
 			// TODO: ??? запилить нормальное ожидание завершения сопрограмм (как вариант, std::condition_variable в помощь) ???
 			while( ( CoroCount.load() != 0 ) || ( WorkThreadsCount.load() != 0 ) )
 			{
@@ -253,6 +437,8 @@ namespace Bicycle
 
 			DeleteQueue.Clear();
 #endif
+			// Потоков сервиса не осталось - удаляем прежние версии RcuCell
+			RcuQueue.Clear();
 
 			RunFlag.clear();
 			return true;
@@ -321,7 +507,10 @@ namespace Bicycle
 				// Создаём служебную структуру потока и запоминаем указатель на неё в
 				// "потоколокальном" указателе
 				MY_ASSERT( SrvInfoPtr.Get() == nullptr );
-				SrvInfoStruct srv_info( *this, main_coro, del_coro );
+				const uint8_t run_num = TimerQueueNum++;
+				SrvInfoStruct srv_info( *this, main_coro, del_coro,
+				                        TimerQueues[ run_num % TimerQueuesNum ], run_num,
+				                        SuspendCounters[ run_num % SuspendCountersNum ] );
 				SrvInfoPtr.Set( ( void* ) &srv_info );
 
 				// Переходим в сопрограмму очистки и обратно
@@ -372,6 +561,33 @@ namespace Bicycle
 #endif
 		} // void Service::Run()
 
+		void Service::SetTimerSlack( uint64_t microseconds )
+		{
+			TimerSlack.store( microseconds );
+		}
+
+		uint64_t Service::GetTimerSlack() const
+		{
+			return TimerSlack.load();
+		}
+
+		TimerStats Service::GetTimerStats()
+		{
+			TimerStats res;
+			res.Expired = res.Wakeups = 0;
+
+			for( TimerQueue &queue : TimerQueues )
+			{
+				LockGuard<SpinLock> lock( queue.Lock );
+				res.Expired += queue.ExpiredCount;
+				res.Wakeups += queue.WakeupsCount;
+			}
+
+			MY_ASSERT( res.Expired >= res.Wakeups );
+			res.WakeupsSaved = res.Expired - res.Wakeups;
+			return res;
+		} // TimerStats Service::GetTimerStats()
+
 		Error Service::AddCoro( const std::function<void()> &task, size_t stack_sz )
 		{
 			if( SrvInfoPtr.Get() != nullptr )
@@ -421,12 +637,189 @@ namespace Bicycle
 			});
 
 			info_ptr->DescriptorTask = &task;
+			info_ptr->CountSuspend();
 			bool res = info_ptr->MainCoro.SwitchTo();
 			MY_ASSERT( res );
 		} // void YieldCoro()
 
 		//-------------------------------------------------------------------------------
 
+		DeadlineType DeadlineAfter( uint64_t microseconds )
+		{
+			return DeadlineClock::now() + std::chrono::microseconds( microseconds );
+		}
+
+		TimerNode::TimerNode(): TimingWheelNode(), QueuePtr( nullptr ) {}
+
+		TimerNode::~TimerNode()
+		{
+			MY_ASSERT( !IsLinked() );
+		}
+
+		void TimerNode::OnExpired()
+		{
+			MY_ASSERT( QueuePtr != nullptr );
+			Coroutine *coro_ptr = OnDeadline();
+			if( coro_ptr != nullptr )
+			{
+				QueuePtr->Ready.push_back( coro_ptr );
+			}
+		}
+
+		bool TimerNode::OnStop()
+		{
+			return false;
+		}
+
+		CancelScope::CancelScope( Service &srv ): SrvRef( srv ),
+		                                          Cancelled( false ),
+		                                          Waits( nullptr )
+		{}
+
+		CancelScope::~CancelScope()
+		{
+			MY_ASSERT( Waits == nullptr );
+		}
+
+		bool CancelScope::IsCancelled() const
+		{
+			return Cancelled.load();
+		}
+
+		void CancelScope::Cancel()
+		{
+			LockGuard<SpinLock> lock( Lock );
+			if( Cancelled.exchange( true ) )
+			{
+				// Область уже отменена
+				return;
+			}
+
+			// Узлы ожиданий сработают при ближайшей обработке таймеров
+			// (снимают их с очереди сами ожидающие, в деструкторе CancelableWait)
+			const DeadlineType now = DeadlineClock::now();
+			for( CancelableWait *wait_ptr = Waits; wait_ptr != nullptr; wait_ptr = wait_ptr->Next )
+			{
+				SrvRef.ArmTimer( wait_ptr->NodeRef, now );
+			}
+		} // void CancelScope::Cancel()
+
+		CancelScope* CancelScope::Current()
+		{
+			Coroutine *cur_coro_ptr = GetCurrentCoro();
+			return cur_coro_ptr != nullptr ? ( CancelScope* ) cur_coro_ptr->OwnerData : nullptr;
+		}
+
+		CancelScope* CancelScope::SetCurrent( CancelScope *scope_ptr )
+		{
+			Coroutine *cur_coro_ptr = GetCurrentCoro();
+			if( cur_coro_ptr == nullptr )
+			{
+				throw Exception( ErrorCodes::NotInsideSrvCoro,
+				                 "Must be called from service coroutine" );
+			}
+
+			CancelScope *res = ( CancelScope* ) cur_coro_ptr->OwnerData;
+			cur_coro_ptr->OwnerData = scope_ptr;
+			return res;
+		}
+
+		CancelableWait::CancelableWait( TimerNode &node, bool enable ): ScopePtr( enable ? CancelScope::Current() : nullptr ),
+		                                                   NodeRef( node ),
+		                                                   Prev( nullptr ),
+		                                                   Next( nullptr ),
+		                                                   CancelledBefore( false )
+		{
+			if( ScopePtr == nullptr )
+			{
+				return;
+			}
+
+			LockGuard<SpinLock> lock( ScopePtr->Lock );
+			if( ScopePtr->Cancelled.load() )
+			{
+				CancelledBefore = true;
+				ScopePtr = nullptr;
+				return;
+			}
+
+			Next = ScopePtr->Waits;
+			if( Next != nullptr )
+			{
+				Next->Prev = this;
+			}
+			ScopePtr->Waits = this;
+		} // CancelableWait::CancelableWait( TimerNode &node, bool enable )
+
+		CancelableWait::~CancelableWait()
+		{
+			Unregister();
+		}
+
+		void CancelableWait::Unregister()
+		{
+			if( ScopePtr == nullptr )
+			{
+				return;
+			}
+
+			{
+				LockGuard<SpinLock> lock( ScopePtr->Lock );
+				if( Prev != nullptr )
+				{
+					Prev->Next = Next;
+				}
+				else
+				{
+					MY_ASSERT( ScopePtr->Waits == this );
+					ScopePtr->Waits = Next;
+				}
+
+				if( Next != nullptr )
+				{
+					Next->Prev = Prev;
+				}
+			}
+
+			// После снятия с области узел в очередь больше не поставят
+			ScopePtr->SrvRef.DisarmTimer( NodeRef );
+			ScopePtr = nullptr;
+		} // void CancelableWait::Unregister()
+
+		bool CancelableWait::WasCancelled() const
+		{
+			return CancelledBefore;
+		}
+
+		CancelShield::CancelShield(): CoroPtr( GetCurrentCoro() ), PrevScope( nullptr )
+		{
+			if( CoroPtr != nullptr )
+			{
+				PrevScope = ( CancelScope* ) CoroPtr->OwnerData;
+				CoroPtr->OwnerData = nullptr;
+			}
+		}
+
+		CancelShield::~CancelShield()
+		{
+			if( CoroPtr != nullptr )
+			{
+				CoroPtr->OwnerData = PrevScope;
+			}
+		}
+
+		TimerQueue::TimerQueue(): Wheel( std::chrono::microseconds( TimerTickMicrosec ) ),
+		                          WakeTime( DeadlineType::max() ),
+		                          ExpiredCount( 0 ),
+		                          WakeupsCount( 0 ),
+		                          Stopping( false )
+#ifndef _WIN32
+		                          , TimerFd( -1 )
+#endif
+		{}
+
+		//-------------------------------------------------------------------------------
+
 		/**
 		 * @brief GetCurrentService получение ссылки на сервис,
 		 * к которому относится дескриптор
@@ -466,15 +859,86 @@ namespace Bicycle
 			MY_ASSERT( info_ptr != nullptr );
 			MY_ASSERT( info_ptr->DescriptorTask == nullptr );
 			info_ptr->DescriptorTask = task;
+			info_ptr->CountSuspend();
 
 			info_ptr->MainCoro.SwitchTo();
 		} // void ServiceWorker::SetPostTaskAndSwitchToMainCoro( std::function<void()> *task )
 
+		void ServiceWorker::ArmDeadline( TimerNode &node, const DeadlineType &deadline, uint64_t slack_microsec )
+		{
+			SrvRef.ArmTimer( node, deadline, slack_microsec );
+		}
+
+		bool ServiceWorker::DisarmDeadline( TimerNode &node )
+		{
+			return SrvRef.DisarmTimer( node );
+		}
+
 		bool ServiceWorker::IsStopped() const
 		{
 			return SrvRef.MustBeStopped.load();
 		}
 
+		uint64_t ServiceWorker::GetWorkThreadsCount() const
+		{
+			return SrvRef.WorkThreadsCount.load();
+		}
+
+		bool ServiceWorker::IsServiceThread() const
+		{
+			SrvInfoStruct *info_ptr = ( SrvInfoStruct* ) SrvInfoPtr.Get();
+			return ( info_ptr != nullptr ) && ( &( info_ptr->ServiceRef ) == &SrvRef );
+		}
+
+		uint8_t ServiceWorker::GetServiceThreadNum() const
+		{
+			SrvInfoStruct *info_ptr = ( SrvInfoStruct* ) SrvInfoPtr.Get();
+			return ( info_ptr != nullptr ) && ( &( info_ptr->ServiceRef ) == &SrvRef ) ? info_ptr->RunNum : 0;
+		}
+
+		uint64_t ServiceWorker::GetTimerSlack() const
+		{
+			return SrvRef.GetTimerSlack();
+		}
+
+		/// Сдвиг номера счётчика приостановок в отметке выполнения
+		/// (в младших битах - значение счётчика)
+		static const uint8_t RunStampNumShift = 56;
+		static const uint64_t RunStampCountMask = ( ( uint64_t ) 1 << RunStampNumShift ) - 1;
+
+		uint64_t ServiceWorker::GetRunStamp() const
+		{
+			SrvInfoStruct *info_ptr = ( SrvInfoStruct* ) SrvInfoPtr.Get();
+			if( ( info_ptr == nullptr ) || ( &( info_ptr->ServiceRef ) != &SrvRef ) )
+			{
+				return 0;
+			}
+
+			// Номер счётчика хранится со сдвигом на 1, чтобы отметка не была нулевой
+			const uint64_t count = info_ptr->SuspendCounter.load( std::memory_order_relaxed );
+			const uint64_t num = info_ptr->RunNum % Service::SuspendCountersNum;
+			return ( ( num + 1 ) << RunStampNumShift ) |
+			       ( count & RunStampCountMask );
+		}
+
+		bool ServiceWorker::IsRunStampActual( uint64_t stamp ) const
+		{
+			if( stamp == 0 )
+			{
+				// Отметка потока вне сервиса: он не приостанавливается сервисом
+				return true;
+			}
+
+			const uint64_t num = ( stamp >> RunStampNumShift ) - 1;
+			if( num >= Service::SuspendCountersNum )
+			{
+				return false;
+			}
+
+			const uint64_t count = SrvRef.SuspendCounters[ num ].load( std::memory_order_relaxed );
+			return ( count & RunStampCountMask ) == ( stamp & RunStampCountMask );
+		}
+
 		AbstractCloser::AbstractCloser(): ServiceWorker(), Ptr()
 		{
 			Ptr.reset( new PtrWithLocker );
@@ -1,5 +1,6 @@
 #include "CoroService.hpp"
 #include <sys/epoll.h>
+#include <sys/timerfd.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/types.h>
@@ -14,6 +15,10 @@ namespace Bicycle
 		const uint32_t TaskWorkMask = 0x2;
 		const uint32_t DefEventMask = EPOLLET | EPOLLRDHUP;
 
+		/// Номер "списка", записываемый в канал Post-ом нулевого указателя
+		/// (уведомление о завершении цикла)
+		const uint8_t StopListNum = 0xFF;
+
 		inline void CheckOperationSuccess( int res )
 		{
 			if( res != 0 )
@@ -48,35 +53,47 @@ namespace Bicycle
 				MY_ASSERT( ( res != -1 ) || ( err.Code == EINTR ) ); // Прервано сигналом
 			}
 			while( res < 1 );
-			MY_ASSERT( coro_list_num < 8 );
-
-			auto coros_to_exec = CoroutinesToExecute[ coro_list_num ].Release();
-			MY_ASSERT( coros_to_exec );
-			size_t coros_count = coros_to_exec.Reverse();
-			MY_ASSERT( coros_count > 0 );
-
-			Coroutine *coro_ptr = nullptr;
-			while( coros_to_exec )
+			if( coro_list_num == StopListNum )
 			{
-				coro_ptr = coros_to_exec.Pop();
-				if( coro_ptr != nullptr )
-				{
-					// Переключаемся на сопрограмму
-					bool res = coro_ptr->SwitchTo();
-					MY_ASSERT( res );
-					
-					// Выполняем задачи, "оставленные" дочерней сопрограммой
-					ExecLeftTasks();
-				}
-				else if( CoroCount.load() == 0 )
+				if( CoroCount.load() == 0 )
 				{
-					// Был извлечён нулевой указатель на сопрограмму - означает завершение цикла
-					// Добавляем указатель снова, чтобы другие потоки тоже получили
-					// уведомление о необходимости завершить работу, и выходим
-					MY_ASSERT( !coros_to_exec );
+					// Уведомление о завершении цикла: передаём его дальше,
+					// чтобы другие потоки тоже завершили работу
 					Post( nullptr );
 				}
-			} // while( coros_to_exec )
+
+				return;
+			}
+			MY_ASSERT( coro_list_num < 8 );
+
+			// Забираем весь список и разворачиваем его
+			// (сопрограммы выполняются в порядке добавления)
+			Coroutine *top = CoroutinesToExecute[ coro_list_num ].exchange( nullptr );
+			MY_ASSERT( top != nullptr );
+			Coroutine *coro_ptr = nullptr;
+			while( top != nullptr )
+			{
+				Coroutine *next_ptr = top->NextScheduled;
+				top->NextScheduled = coro_ptr;
+				coro_ptr = top;
+				top = next_ptr;
+			}
+
+			while( coro_ptr != nullptr )
+			{
+				// Следующую запоминаем до перехода: сопрограмма может
+				// снова попасть в очередь раньше, чем мы вернёмся
+				Coroutine *next_ptr = coro_ptr->NextScheduled;
+
+				// Переключаемся на сопрограмму
+				bool res = coro_ptr->SwitchTo();
+				MY_ASSERT( res );
+				
+				// Выполняем задачи, "оставленные" дочерней сопрограммой
+				ExecLeftTasks();
+
+				coro_ptr = next_ptr;
+			}
 		} // void Service::WorkPosted()
 		
 		void Service::WorkEpoll( EpWaitListWithFlag &coros_list, uint32_t evs_mask )
@@ -134,29 +151,84 @@ namespace Bicycle
 			ev_data.data.ptr = nullptr;
 			ev_data.events = EPOLLIN;
 			CheckOperationSuccess( epoll_ctl( EpollFd, EPOLL_CTL_ADD, PostPipe[ 0 ], &ev_data ) );
+
+			// Создаём timerfd для каждой очереди таймеров и привязываем их к общему
+			// epoll-у (в качестве метки используется адрес очереди; событие очереди
+			// получает любой из потоков сервиса, а не тот, что ставил её таймеры)
+			for( TimerQueue &queue : TimerQueues )
+			{
+				queue.TimerFd = timerfd_create( CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC );
+				ThrowIfNeed();
+				if( queue.TimerFd == -1 )
+				{
+					MY_ASSERT( false );
+					throw Exception( ErrorCodes::UnknownError, "Unknown error" );
+				}
+
+				ev_data.data.ptr = ( void* ) &queue;
+				ev_data.events = EPOLLIN | EPOLLET;
+				CheckOperationSuccess( epoll_ctl( EpollFd, EPOLL_CTL_ADD, queue.TimerFd, &ev_data ) );
+			}
 		} // void Service::Initialize()
 
 		void Service::Close()
 		{
 			close( PostPipe[ 0 ] );
 			close( PostPipe[ 1 ] );
+			for( TimerQueue &queue : TimerQueues )
+			{
+				if( queue.TimerFd != -1 )
+				{
+					close( queue.TimerFd );
+				}
+			}
 			close( EpollFd );
 		}
 
-		void Service::Post( Coroutine *coro_ptr )
+		void Service::SetTimersWakeup( TimerQueue &queue )
 		{
-			const uint8_t list_num = ( CoroListNum++ ) % 8;
-			MY_ASSERT( list_num < 8 );
-			LockFree::ForwardList<Coroutine*> &coro_list_ref = CoroutinesToExecute[ list_num ];
+			// steady_clock отсчитывается по CLOCK_MONOTONIC
+			auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>( queue.WakeTime.time_since_epoch() ).count();
+			if( ns <= 0 )
+			{
+				// Нулевое значение it_value снимает timerfd с взвода
+				ns = 1;
+			}
+
+			itimerspec spec;
+			memset( &spec, 0, sizeof( spec ) );
+			spec.it_value.tv_sec = ns / 1000000000;
+			spec.it_value.tv_nsec = ns % 1000000000;
 
-			if( !coro_list_ref.Push( coro_ptr ) )
+			int res = timerfd_settime( queue.TimerFd, TFD_TIMER_ABSTIME, &spec, nullptr );
+			MY_ASSERT( res == 0 );
+		} // void Service::SetTimersWakeup( TimerQueue &queue )
+
+		void Service::Post( Coroutine *coro_ptr )
+		{
+			uint8_t list_num = StopListNum;
+			if( coro_ptr != nullptr )
 			{
-				// Список был не пустой - выходим
-				return;
+				list_num = ( CoroListNum++ ) % 8;
+				MY_ASSERT( list_num < 8 );
+				std::atomic<Coroutine*> &coros_list = CoroutinesToExecute[ list_num ];
+
+				Coroutine *top = coros_list.load();
+				do
+				{
+					coro_ptr->NextScheduled = top;
+				}
+				while( !coros_list.compare_exchange_weak( top, coro_ptr ) );
+
+				if( top != nullptr )
+				{
+					// Список был не пустой - выходим
+					return;
+				}
 			}
 
-			// Список был пуст - записываем 1 байт в канал, чтобы
-			// epoll среагировал
+			// Список был пуст (или это уведомление о завершении цикла) -
+			// записываем 1 байт в канал, чтобы epoll среагировал
 			int res = -1;
 
 			do
@@ -173,16 +245,27 @@ namespace Bicycle
 		{
 			static const uint8_t EventArraySize = 0x20;
 			epoll_event events_data[ EventArraySize ];
+
+			// Буфер для сопрограмм, "пробуждённых" таймерами
+			std::vector<Coroutine*> timers_ready;
 			
 			// Захватываем "эпоху" (пока она захвачена - 100% никто
 			// не удалит структуры, на которые указывают элементы events_data)
 			auto epoch = DeleteQueue.EpochAcquire();
+
+			// Эпоха читателей RcuCell (отпускается на время ожидания событий)
+			auto rcu_epoch = RcuQueue.EpochAcquire();
 			
 			while( CoroCount.load() > 0 )
 			{
 				// Удаляем указатели на закрытые дескрипторы из списка (если нужно)
 				RemoveClosedDescriptors();
 
+				// Точка покоя: сопрограммы текущего потока не держат указателей
+				// на версии RcuCell, пока поток ждёт событий
+				RcuQueue.ClearIfNeed( true );
+				RcuQueue.SetOffline( rcu_epoch );
+
 				size_t eps_sz = EventArraySize;
 				uint64_t threads_num = WorkThreadsCount.load();
 				if( threads_num > 1 )
@@ -197,6 +280,7 @@ namespace Bicycle
 				MY_ASSERT( eps_sz <= EventArraySize );
 
 				int res = epoll_wait( EpollFd, events_data, eps_sz, -1 );
+				RcuQueue.UpdateEpoch( rcu_epoch );
 				if( res == -1 )
 				{
 					Error err = GetLastSystemError();
@@ -226,6 +310,20 @@ namespace Bicycle
 						
 						continue;
 					} // if( ptr == nullptr )
+					else if( ( ( uintptr_t ) ptr >= ( uintptr_t ) TimerQueues ) &&
+					         ( ( uintptr_t ) ptr < ( uintptr_t ) ( TimerQueues + TimerQueuesNum ) ) )
+					{
+						// Сработал timerfd одной из очередей таймеров: сбрасываем
+						// его счётчик, обрабатываем таймеры, срок которых наступил,
+						// и переходим в "пробуждённые" ими сопрограммы
+						TimerQueue &queue = *( TimerQueue* ) ( void* ) ptr;
+						uint64_t expirations = 0;
+						while( ( read( queue.TimerFd, &expirations, sizeof( expirations ) ) == -1 ) &&
+						       ( errno == EINTR ) ) {}
+
+						WorkTimers( queue, timers_ready );
+						continue;
+					}
 					
 					// События готовности на одном из дескрипторов
 					static const uint32_t ErrMask = EPOLLERR | EPOLLHUP | EPOLLRDHUP;
@@ -274,7 +372,84 @@ namespace Bicycle
 
 		EpWaitStruct::EpWaitStruct( Coroutine &coro_ref ): CoroRef( coro_ref ),
 		                                                   LastEpollEvents( 0 ),
-		                                                   WasCancelled( false ) {}
+		                                                   WasCancelled( false ),
+		                                                   DeadlineExpired( false ),
+		                                                   GroupCancelled( false ) {}
+
+		/// Узел таймера, отслеживающий крайний срок задачи ввода-вывода
+		class IoDeadlineNode: public TimerNode
+		{
+			private:
+				/// Ссылка на сервис
+				Service &SrvRef;
+
+				/// Ссылка на структуру ожидающей сопрограммы
+				EpWaitStruct &WaiterRef;
+
+				/// Ссылка на структуру дескриптора
+				DescriptorStruct &DescRef;
+
+				/// Ссылка на список ожидающих сопрограмм с флагом срабатываний epoll-а
+				EpWaitListWithFlag &QueueRef;
+
+				/// Флаг, выставляемый при сработке (истечение срока или отмена области)
+				std::atomic<bool> &FlagRef;
+
+			public:
+				IoDeadlineNode( Service &srv,
+				                EpWaitStruct &waiter,
+				                DescriptorStruct &desc,
+				                EpWaitListWithFlag &queue,
+				                std::atomic<bool> &flag ): TimerNode(),
+				                                           SrvRef( srv ),
+				                                           WaiterRef( waiter ),
+				                                           DescRef( desc ),
+				                                           QueueRef( queue ),
+				                                           FlagRef( flag )
+				{}
+
+				virtual Coroutine* OnDeadline() override
+				{
+					// Под исключительной блокировкой дескриптора в список никто не
+					// добавляется: сопрограмма либо уже в нём, либо увидит флаг до
+					// постановки (ожидающие сопрограммы блокировку держат совместно)
+					LockGuard<SharedSpinLock> lock( DescRef.Lock );
+					FlagRef.store( true );
+
+					// Извлекаем из списка только "свою" сопрограмму (она завершит
+					// задачу с ошибкой TimedOut или OperationAborted), остальные
+					// возвращаем в список
+					bool found = false;
+					EpWaitList::Unsafe waiters = QueueRef.first.Release();
+					waiters.RemoveIf( [ this, &found ]( EpWaitStruct *ptr ) -> bool
+					{
+						if( ptr != &WaiterRef )
+						{
+							return false;
+						}
+
+						found = true;
+						return true;
+					});
+
+					if( QueueRef.first.Push( std::move( waiters ) ) && !QueueRef.second.test_and_set() )
+					{
+						// Пока список был извлечён, сработал epoll (флаг сбрасывается только
+						// там): возвращённые "ждуны" его пропустили - будим их для повтора
+						waiters = QueueRef.first.Release();
+						while( waiters )
+						{
+							EpWaitStruct *ptr = waiters.Pop();
+							MY_ASSERT( ptr != nullptr );
+							SrvRef.Post( &( ptr->CoroRef ) );
+						}
+					}
+
+					// Если сопрограммы в списке не было, её уже "пробудили"
+					// (epoll, Cancel или Close), либо она не успела в него встать
+					return found ? &( WaiterRef.CoroRef ) : nullptr;
+				}
+		};
 
 		void BasicDescriptor::CloseDescriptor( int fd, Error &err )
 		{
@@ -313,7 +488,8 @@ namespace Bicycle
 		}
 
 		Error BasicDescriptor::ExecuteIoTask( const IoTaskType &task,
-		                                      IoTaskTypeEnum task_type )
+		                                      IoTaskTypeEnum task_type,
+		                                      const DeadlineType &deadline )
 		{
 			if( SrvRef.MustBeStopped.load() )
 			{
@@ -337,15 +513,6 @@ namespace Bicycle
 			}
 
 			MY_ASSERT( DescriptorData );
-			SharedLocker<SharedSpinLock> lock( DescriptorData->Lock, true );
-			MY_ASSERT( lock );
-			MY_ASSERT( lock.Locked() );
-			if( DescriptorData->Fd == -1 )
-			{
-				// Дескриптор не открыт
-				return Error( ErrorCodes::NotOpen, "Descriptor is not open" );
-			}
-
 			DescriptorStruct *desc_ptr = DescriptorData.get();
 
 			MY_ASSERT( desc_ptr != nullptr );
@@ -363,6 +530,9 @@ namespace Bicycle
 			// для типа задач task_type
 			std::atomic_flag *flag_ptr = nullptr;
 
+			// Указатель на список "ждунов" вместе с флагом
+			EpWaitListWithFlag *queue_with_flag_ptr = nullptr;
+
 			EpWaitStruct ep_waiter( *cur_coro_ptr );
 			MY_ASSERT( &( ep_waiter.CoroRef ) == cur_coro_ptr );
 			MY_ASSERT( ep_waiter.LastEpollEvents == 0 );
@@ -375,22 +545,59 @@ namespace Bicycle
 					queue_ptr = &( desc_ptr->ReadQueue.first );
 					flag_ptr = &( desc_ptr->ReadQueue.second );
 					cur_ep_ev = EPOLLIN;
+					queue_with_flag_ptr = &( desc_ptr->ReadQueue );
 					break;
 
 				case IoTaskTypeEnum::Write:
 					queue_ptr = &( desc_ptr->WriteQueue.first );
 					flag_ptr = &( desc_ptr->WriteQueue.second );
 					cur_ep_ev = EPOLLOUT;
+					queue_with_flag_ptr = &( desc_ptr->WriteQueue );
 					break;
 
 				case IoTaskTypeEnum::ReadOob:
 					queue_ptr = &( desc_ptr->ReadOobQueue.first );
 					flag_ptr = &( desc_ptr->ReadOobQueue.second );
 					cur_ep_ev = EPOLLPRI;
+					queue_with_flag_ptr = &( desc_ptr->ReadOobQueue );
 					break;
 			}
 			MY_ASSERT( queue_ptr != nullptr );
 			MY_ASSERT( flag_ptr != nullptr );
+			MY_ASSERT( queue_with_flag_ptr != nullptr );
+
+			// Узлы таймеров создаются и регистрируются до захвата блокировки
+			// дескриптора (и снимаются после её освобождения): их OnDeadline
+			// берут её под блокировкой очереди таймеров
+
+			// Узел таймера крайнего срока (ставится в очередь
+			// при первом ожидании, снимается при выходе из функции)
+			IoDeadlineNode deadline_node( SrvRef, ep_waiter, *desc_ptr, *queue_with_flag_ptr, ep_waiter.DeadlineExpired );
+			bool deadline_armed = false;
+			Defer disarm_deadline( [ this, &deadline_node, &deadline_armed ]
+			{
+				if( deadline_armed )
+				{
+					DisarmDeadline( deadline_node );
+				}
+			});
+
+			// Узел, прерывающий ожидание при отмене области сопрограммы
+			IoDeadlineNode cancel_node( SrvRef, ep_waiter, *desc_ptr, *queue_with_flag_ptr, ep_waiter.GroupCancelled );
+			CancelableWait cancel_wait( cancel_node );
+			if( cancel_wait.WasCancelled() )
+			{
+				return Error( ErrorCodes::OperationAborted, "Operation was aborted" );
+			}
+
+			SharedLocker<SharedSpinLock> lock( desc_ptr->Lock, true );
+			MY_ASSERT( lock );
+			MY_ASSERT( lock.Locked() );
+			if( desc_ptr->Fd == -1 )
+			{
+				// Дескриптор не открыт
+				return Error( ErrorCodes::NotOpen, "Descriptor is not open" );
+			}
 
 			while( !err )
 			{
@@ -429,6 +636,33 @@ namespace Bicycle
 					break;
 				}
 
+				if( ep_waiter.GroupCancelled.load() )
+				{
+					// Область сопрограммы отменена
+					err.Code = ErrorCodes::OperationAborted;
+					err.What = "Operation was aborted";
+					break;
+				}
+
+				if( ( deadline != NoDeadline ) &&
+				    ( ep_waiter.DeadlineExpired.load() || !( DeadlineClock::now() < deadline ) ) )
+				{
+					// Крайний срок истёк
+					err.Code = ErrorCodes::TimedOut;
+					err.What = "Operation timed out";
+					break;
+				}
+
+				if( ( deadline != NoDeadline ) && !deadline_armed )
+				{
+					// Ставим таймер крайнего срока вне блокировки дескриптора
+					// и повторяем попытку (дескриптор мог стать готовым)
+					lock = SharedLocker<SharedSpinLock>();
+					deadline_armed = true;
+					ArmDeadline( deadline_node, deadline );
+					err = Error();
+					continue;
+				}
 
 				// Дескриптор не готов к выполнению требуемой операции,
 				// ожидаем готовности с помощью epoll-а
@@ -457,10 +691,12 @@ namespace Bicycle
 						// Добавляем элемент в очередь сопрограмм, ожидающих готовности дескриптора
 						ep_waiter.LastEpollEvents = 0;
 						MY_ASSERT( !ep_waiter.WasCancelled );
-	
-						if( !flag_ptr->test_and_set() )
+
+						if( !flag_ptr->test_and_set() ||
+						    ep_waiter.DeadlineExpired.load() || ep_waiter.GroupCancelled.load() )
 						{
-							// Было срабатывание epoll_wait-а
+							// Было срабатывание epoll_wait-а, либо узел таймера уже
+							// сработал (и сопрограмму в списке не нашёл)
 							local_lock.Unlock();
 							bool switch_res = ep_waiter.CoroRef.SwitchTo();
 							MY_ASSERT( switch_res );
@@ -520,12 +756,18 @@ namespace Bicycle
 				
 				MY_ASSERT( !lock );
 
-				if( ep_waiter.WasCancelled )
+				if( ep_waiter.WasCancelled || ep_waiter.GroupCancelled.load() )
 				{
 					// Задача была отменена
 					err.Code = ErrorCodes::OperationAborted;
 					err.What = "Operation was aborted";
 				}
+				else if( ep_waiter.DeadlineExpired.load() )
+				{
+					// Крайний срок истёк
+					err.Code = ErrorCodes::TimedOut;
+					err.What = "Operation timed out";
+				}
 
 				// TODO: ? обрабатывать EPOLLHUP и EPOLLRDHUP в ep_waiter.LastEpollEvents ?
 //				else if( ( ep_waiter.LastEpollEvents & EPOLLHUP ) != 0 )
@@ -599,7 +841,7 @@ namespace Bicycle
 		void BasicDescriptor::Close( Error &err )
 		{
 			err = Error();
-			LockFree::ForwardList<EpWaitStruct*>::Unsafe coros;
+			EpWaitList::Unsafe coros;
 
 			MY_ASSERT( DescriptorData );
 			LockGuard<SharedSpinLock> lock( DescriptorData->Lock );
@@ -632,7 +874,7 @@ namespace Bicycle
 			err = Error();
 
 			MY_ASSERT( DescriptorData );
-			LockFree::ForwardList<EpWaitStruct*>::Unsafe coros;
+			EpWaitList::Unsafe coros;
 
 			LockGuard<SharedSpinLock> lock( DescriptorData->Lock );
 			coros.Push( DescriptorData->ReadQueue.first.Release() );
@@ -31,21 +31,85 @@ namespace Bicycle
 			}
 		}
 
+		void Service::SetTimersWakeup( TimerQueue& )
+		{
+			// Будим один из потоков, чтобы он пересчитал время ожидания Iocp
+			while( PostQueuedCompletionStatus( Iocp, 0, 0xFE, nullptr ) == FALSE )
+			{
+				// Ошибка
+				MY_ASSERT( false );
+			}
+		}
+
+		DWORD Service::GetTimersWaitTimeout()
+		{
+			DeadlineType wake_time = DeadlineType::max();
+			for( TimerQueue &queue : TimerQueues )
+			{
+				LockGuard<SpinLock> lock( queue.Lock );
+				if( queue.WakeTime < wake_time )
+				{
+					wake_time = queue.WakeTime;
+				}
+			}
+
+			if( wake_time == DeadlineType::max() )
+			{
+				return INFINITE;
+			}
+
+			auto now = DeadlineClock::now();
+			if( !( now < wake_time ) )
+			{
+				return 0;
+			}
+
+			// Округляем вверх, чтобы не проснуться раньше срока
+			auto ms = std::chrono::duration_cast<std::chrono::milliseconds>( wake_time - now ).count() + 1;
+			return ms < ( INFINITE - 1 ) ? ( DWORD ) ms : ( INFINITE - 1 );
+		} // DWORD Service::GetTimersWaitTimeout()
+
 		void Service::Execute()
 		{
 			DWORD bytes_count = 0;
 			ULONG_PTR comp_key = 0;
 			LPOVERLAPPED pov = nullptr;
 
+			// Буфер для сопрограмм, "пробуждённых" таймерами
+			std::vector<Coroutine*> timers_ready;
+
+			// Эпоха читателей RcuCell (отпускается на время ожидания событий)
+			auto rcu_epoch = RcuQueue.EpochAcquire();
+
 			while( CoroCount.load() > 0 )
 			{
 				// Удаляем указатели на закрытые дескрипторы из списка (если нужно)
 				RemoveClosedDescriptors();
-				BOOL res = GetQueuedCompletionStatus( Iocp, &bytes_count, &comp_key, &pov, INFINITE );
+
+				// Обрабатываем таймеры, срок которых наступил
+				// (очереди "чужих" потоков тоже, т.к. Iocp общий)
+				for( TimerQueue &queue : TimerQueues )
+				{
+					WorkTimers( queue, timers_ready );
+				}
+
+				// Точка покоя: сопрограммы текущего потока не держат указателей
+				// на версии RcuCell, пока поток ждёт событий
+				RcuQueue.ClearIfNeed( true );
+				RcuQueue.SetOffline( rcu_epoch );
+
+				BOOL res = GetQueuedCompletionStatus( Iocp, &bytes_count, &comp_key, &pov, GetTimersWaitTimeout() );
+				RcuQueue.UpdateEpoch( rcu_epoch );
 				if( res != FALSE )
 				{
 					// Успех
-					if( comp_key != 0 )
+					if( comp_key == 0xFE )
+					{
+						// Изменился ближайший срок очереди таймеров
+						MY_ASSERT( pov == nullptr );
+						continue;
+					}
+					else if( comp_key != 0 )
 					{
 						// Была добавлена задача через Post
 						MY_ASSERT( comp_key == 0xFF );
@@ -111,6 +175,11 @@ namespace Bicycle
 						bool switch_res = param->Coro->SwitchTo();
 						MY_ASSERT( switch_res );
 					}
+					else if( error_code == WAIT_TIMEOUT )
+					{
+						// Наступил срок ближайшего таймера
+						continue;
+					}
 					else
 					{
 						// Ошибка в Iocp
@@ -143,7 +212,74 @@ namespace Bicycle
 			return Error();
 		} // Error BasicDescriptor::RegisterNewDescriptor( HANDLE fd )
 
-		Error BasicDescriptor::ExecuteIoTask( const IoTaskType &task, size_t &io_size )
+		/// Узел таймера, отслеживающий крайний срок задачи ввода-вывода
+		class IoDeadlineNode: public TimerNode
+		{
+			private:
+				/// Ссылка на дескриптор, выполняющий задачу
+				BasicDescriptor &DescRef;
+
+				/// Ссылка на структуру задачи
+				IocpStruct &TaskRef;
+
+				/// Объект синхронизации запуска задачи и её отмены
+				SpinLock Lock;
+
+				/// Задача была запущена
+				bool Started;
+
+			public:
+				/// Истёк крайний срок выполнения задачи
+				bool Expired;
+
+				IoDeadlineNode( BasicDescriptor &desc,
+				                IocpStruct &task_struct ): TimerNode(),
+				                                           DescRef( desc ),
+				                                           TaskRef( task_struct ),
+				                                           Started( false ),
+				                                           Expired( false )
+				{}
+
+				/**
+				 * @brief Start запуск задачи, если срок ещё не истёк
+				 * @param start_fnc функция запуска задачи
+				 * @return код ошибки запуска (TimedOut, если срок уже истёк)
+				 */
+				template<typename StartFnc>
+				err_code_t Start( const StartFnc &start_fnc )
+				{
+					LockGuard<SpinLock> lock( Lock );
+					if( Expired )
+					{
+						return ErrorCodes::TimedOut;
+					}
+
+					Started = true;
+					return start_fnc();
+				}
+
+				virtual Coroutine* OnDeadline() override
+				{
+					// Отменяем только эту задачу (результат придёт через Iocp
+					// с кодом ERROR_OPERATION_ABORTED)
+					LockGuard<SpinLock> lock( Lock );
+					Expired = true;
+					if( Started )
+					{
+						SharedLockGuard<SharedSpinLock> fd_lock( DescRef.FdLock );
+						if( DescRef.Fd != INVALID_HANDLE_VALUE )
+						{
+							CancelIoEx( DescRef.Fd, &TaskRef.Ov );
+						}
+					}
+
+					return nullptr;
+				}
+		};
+
+		Error BasicDescriptor::ExecuteIoTask( const IoTaskType &task,
+		                                      size_t &io_size,
+		                                      const DeadlineType &deadline )
 		{
 			if( SrvRef.MustBeStopped.load() )
 			{
@@ -162,16 +298,43 @@ namespace Bicycle
 			task_struct.ErrorCode = ErrorCodes::Success;
 			task_struct.Coro = GetCurrentCoro();
 			task_struct.IoSize = 0;
+
+			// Узел таймера крайнего срока (снимается при выходе из функции)
+			IoDeadlineNode deadline_node( *this, task_struct );
+			const bool has_deadline = deadline != NoDeadline;
+			Defer disarm_deadline( [ this, &deadline_node, has_deadline ]
+			{
+				if( has_deadline )
+				{
+					DisarmDeadline( deadline_node );
+				}
+			});
+
+			// Узел, прерывающий задачу при отмене области сопрограммы
+			IoDeadlineNode cancel_node( *this, task_struct );
+			CancelableWait cancel_wait( cancel_node );
+			if( cancel_wait.WasCancelled() )
+			{
+				return Error( ErrorCodes::OperationAborted, "Operation was aborted" );
+			}
 			
-			std::function<void()> coro_task = [ &task, &task_struct, this ]()
+			std::function<void()> coro_task = [ &task, &task_struct, &deadline, &deadline_node, &cancel_node, has_deadline, this ]()
 			{
+				if( has_deadline )
+				{
+					ArmDeadline( deadline_node, deadline );
+				}
+
 				err_code_t err;
 				{
 					SharedLockGuard<SharedSpinLock> lock( FdLock );
 
 					if( Fd != INVALID_HANDLE_VALUE )
 					{
-						err = task( Fd, task_struct );
+						err = deadline_node.Start( [ & ]
+						{
+							return cancel_node.Start( [ & ]{ return task( Fd, task_struct ); } );
+						});
 					}
 					else
 					{
@@ -193,11 +356,29 @@ namespace Bicycle
 			// Переходим в основную сопрограмму, выполняем там задачу и затем, когда будет готов результат, возвращаемся обратно
 			SetPostTaskAndSwitchToMainCoro( &coro_task );
 
+			// Снимаем таймеры (после этого OnDeadline гарантированно не выполняются)
+			disarm_deadline();
+			cancel_wait.Unregister();
+
 			Error err( GetSystemErrorByCode( task_struct.ErrorCode ) );
 			if( task_struct.ErrorCode == ErrorCodes::NotOpen )
 			{
 				err.What = "Descriptor is not open";
 			}
+			else if( cancel_node.Expired &&
+			         ( ( task_struct.ErrorCode == ErrorCodes::TimedOut ) ||
+			           ( task_struct.ErrorCode == ErrorCodes::OperationAborted ) ) )
+			{
+				// Задача отменена вместе с областью сопрограммы
+				err = Error( ErrorCodes::OperationAborted, "Operation was aborted" );
+			}
+			else if( deadline_node.Expired &&
+			         ( ( task_struct.ErrorCode == ErrorCodes::TimedOut ) ||
+			           ( task_struct.ErrorCode == ErrorCodes::OperationAborted ) ) )
+			{
+				// Задача отменена по истечении крайнего срока
+				err = Error( ErrorCodes::TimedOut, "Operation timed out" );
+			}
 
 			io_size = task_struct.IoSize;
 			return err;
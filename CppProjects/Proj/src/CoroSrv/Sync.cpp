@@ -1,18 +1,272 @@
 ﻿#include "CoroSrv/Sync.hpp"
+#include <thread>
+#include <new>
 
 namespace Bicycle
 {
 	namespace CoroService
 	{
-		Mutex::Mutex(): QueueLength( 0 ), LockWaiters( 0, 0xFF ){}
-		
-		Mutex::~Mutex()
+		/// Элемент очереди сопрограмм, ожидающих объекта синхронизации
+		struct SyncWaiter
+		{
+			/// Указатель на ожидающую сопрограмму
+			Coroutine *Coro;
+
+			/// Предыдущий элемент очереди
+			SyncWaiter *Prev;
+
+			/// Следующий элемент очереди
+			SyncWaiter *Next;
+
+			/// Элемент находится в очереди
+			bool Queued;
+
+			/// Истёк крайний срок ожидания
+			bool TimedOut;
+
+			/// Объект синхронизации передан сопрограмме
+			bool Acquired;
+
+			/// Ожидается разделяемое владение
+			bool Shared;
+
+			SyncWaiter( Coroutine *coro_ptr, bool shared ): Coro( coro_ptr ),
+			                                                Prev( nullptr ),
+			                                                Next( nullptr ),
+			                                                Queued( false ),
+			                                                TimedOut( false ),
+			                                                Acquired( false ),
+			                                                Shared( shared )
+			{}
+		};
+
+		SyncWaitQueue::SyncWaitQueue(): Head( nullptr ), Tail( nullptr ) {}
+
+		void SyncWaitQueue::PushBack( SyncWaiter &waiter )
 		{
-			MY_ASSERT( !LockWaiters.Pop() );
-			MY_ASSERT( QueueLength.load() == 0 );
+			MY_ASSERT( !waiter.Queued );
+			waiter.Prev = Tail;
+			waiter.Next = nullptr;
+			waiter.Queued = true;
+
+			if( Tail != nullptr )
+			{
+				Tail->Next = &waiter;
+			}
+			else
+			{
+				Head = &waiter;
+			}
+			Tail = &waiter;
 		}
 
-		void Mutex::Lock()
+		SyncWaiter* SyncWaitQueue::Front() const
+		{
+			return Head;
+		}
+
+		SyncWaiter* SyncWaitQueue::PopFront()
+		{
+			SyncWaiter *res = Head;
+			if( res != nullptr )
+			{
+				Remove( *res );
+			}
+
+			return res;
+		}
+
+		void SyncWaitQueue::Remove( SyncWaiter &waiter )
+		{
+			MY_ASSERT( waiter.Queued );
+			if( waiter.Prev != nullptr )
+			{
+				waiter.Prev->Next = waiter.Next;
+			}
+			else
+			{
+				MY_ASSERT( Head == &waiter );
+				Head = waiter.Next;
+			}
+
+			if( waiter.Next != nullptr )
+			{
+				waiter.Next->Prev = waiter.Prev;
+			}
+			else
+			{
+				MY_ASSERT( Tail == &waiter );
+				Tail = waiter.Prev;
+			}
+
+			waiter.Prev = waiter.Next = nullptr;
+			waiter.Queued = false;
+		}
+
+		bool SyncWaitQueue::Empty() const
+		{
+			return Head == nullptr;
+		}
+
+		//-----------------------------------------------------------------------------------------
+
+		SyncWakeList::SyncWakeList( Service &srv ): Srv( srv ), Head( nullptr ), Tail( nullptr ) {}
+
+		SyncWakeList::~SyncWakeList()
+		{
+			SyncWaiter *waiter_ptr = Head;
+			while( waiter_ptr != nullptr )
+			{
+				// Следующий элемент запоминаем заранее: после добавления
+				// в Post сопрограмма может продолжить работу, и её стек
+				// (а с ним и элемент списка) станет недействителен
+				SyncWaiter *next_ptr = waiter_ptr->Next;
+				Srv.Post( waiter_ptr->Coro );
+				waiter_ptr = next_ptr;
+			}
+		}
+
+		void SyncWakeList::PushBack( SyncWaiter &waiter )
+		{
+			MY_ASSERT( !waiter.Queued );
+			waiter.Prev = Tail;
+			waiter.Next = nullptr;
+
+			if( Tail != nullptr )
+			{
+				Tail->Next = &waiter;
+			}
+			else
+			{
+				Head = &waiter;
+			}
+			Tail = &waiter;
+		}
+
+		/// Узел таймера, отслеживающий крайний срок ожидания объекта синхронизации
+		class SyncDeadlineNode: public TimerNode
+		{
+			private:
+				/// Ссылка на объект синхронизации
+				SyncPrimitive &Owner;
+
+				/// Ссылка на элемент очереди ожидающей сопрограммы
+				SyncWaiter &WaiterRef;
+
+			public:
+				SyncDeadlineNode( SyncPrimitive &owner,
+				                  SyncWaiter &waiter ): TimerNode(),
+				                                        Owner( owner ),
+				                                        WaiterRef( waiter )
+				{}
+
+				virtual Coroutine* OnDeadline() override
+				{
+					LockGuard<SpinLock> lock( Owner.Guard );
+					WaiterRef.TimedOut = true;
+					if( !WaiterRef.Queued )
+					{
+						return nullptr;
+					}
+
+					// Сопрограмма ещё ждёт: убираем её из очереди и "пробуждаем"
+					Owner.Waiters.Remove( WaiterRef );
+					return WaiterRef.Coro;
+				}
+		};
+
+		/// Предел активного ожидания по умолчанию (в паузах процессора):
+		/// порядка микросекунды - время короткой критической секции
+		const uint32_t DefaultSpinLimit = 128;
+
+		/// Максимальная пауза между попытками захвата (в паузах процессора)
+		const uint32_t MaxSpinDelay = 16;
+
+		/// Предел активного ожидания
+		static std::atomic<uint32_t> SpinLimit( DefaultSpinLimit );
+
+		/// Количество наборов счётчиков статистики активного ожидания
+		const size_t SpinStatsStripesNum = 16;
+
+		/// Набор счётчиков статистики активного ожидания (каждый поток пишет
+		/// в свой набор, наборы не делят кэш-линии; при большем числе потоков,
+		/// чем наборов, наборы делятся)
+		struct SpinStatsStripe
+		{
+			uint8_t Padding0[ LockFree::CacheLineSize ];
+
+			std::atomic<uint64_t> Spins;
+			std::atomic<uint64_t> SpinAcquired;
+			std::atomic<uint64_t> Parked;
+
+			uint8_t Padding1[ LockFree::CacheLineSize ];
+		};
+
+		/// Счётчики статистики активного ожидания (статическая память обнулена)
+		static SpinStatsStripe SpinStats[ SpinStatsStripesNum ];
+
+		/// Набор счётчиков текущего потока
+		static SpinStatsStripe& GetSpinStatsStripe()
+		{
+			static std::atomic<size_t> stripes_used( 0 );
+			static thread_local SpinStatsStripe *stripe_ptr = &SpinStats[ ( stripes_used++ ) % SpinStatsStripesNum ];
+			return *stripe_ptr;
+		}
+
+		SyncSpinStats GetSyncSpinStats()
+		{
+			SyncSpinStats res;
+			res.Spins = res.SpinAcquired = res.Parked = 0;
+			for( const SpinStatsStripe &stripe : SpinStats )
+			{
+				res.Spins += stripe.Spins.load( std::memory_order_relaxed );
+				res.SpinAcquired += stripe.SpinAcquired.load( std::memory_order_relaxed );
+				res.Parked += stripe.Parked.load( std::memory_order_relaxed );
+			}
+			return res;
+		}
+
+		void ResetSyncSpinStats()
+		{
+			for( SpinStatsStripe &stripe : SpinStats )
+			{
+				stripe.Spins.store( 0, std::memory_order_relaxed );
+				stripe.SpinAcquired.store( 0, std::memory_order_relaxed );
+				stripe.Parked.store( 0, std::memory_order_relaxed );
+			}
+		}
+
+		void SetSyncSpinLimit( uint32_t pauses )
+		{
+			SpinLimit.store( pauses, std::memory_order_relaxed );
+		}
+
+		uint32_t GetSyncSpinLimit()
+		{
+			return SpinLimit.load( std::memory_order_relaxed );
+		}
+
+		//-----------------------------------------------------------------------------------------
+
+		/**
+		 * @brief SetWaitError запись результата ожидания без срока в буфер ошибки
+		 * @param acquired результат ожидания (false - прервано отменой области сопрограммы)
+		 * @param err буфер для записи ошибки
+		 */
+		static void SetWaitError( bool acquired, Error &err )
+		{
+			err = acquired ? Error() : Error( ErrorCodes::OperationAborted, "Operation was aborted" );
+		}
+
+		SyncPrimitive::SyncPrimitive(): ServiceWorker() {}
+
+		SyncPrimitive::~SyncPrimitive()
+		{
+			MY_ASSERT( Waiters.Empty() );
+		}
+
+		template<typename TryAcquire>
+		bool SyncPrimitive::Wait( const TryAcquire &try_acquire, const DeadlineType &deadline, bool shared )
 		{
 			Coroutine *cur_coro_ptr = GetCurrentCoro();
 			if( cur_coro_ptr == nullptr )
@@ -21,481 +275,729 @@ namespace Bicycle
 				                 "Must be called from service coroutine" );
 			}
 
-			// Предполагаем, что блокировка свободна и никто не претендует
-			if( TryLock() )
+			SyncWaiter waiter( cur_coro_ptr, shared );
+			SyncDeadlineNode deadline_node( *this, waiter );
+			const bool has_deadline = deadline != NoDeadline;
+
+			// Ожидание прерывается отменой области сопрограммы (как при истечении срока)
+			SyncDeadlineNode cancel_node( *this, waiter );
+			CancelableWait cancel_wait( cancel_node );
+			if( cancel_wait.WasCancelled() )
 			{
-				// Угадали
-				return;
+				return false;
 			}
 
-			// Не угадали
-			std::function<void()> task = [ this, cur_coro_ptr ]()
+			// Захватываем в task только указатель на параметры ожидания,
+			// чтобы std::function не выделял память
+			struct
 			{
-				// Добавляем указатель на текущую сопрограмму в очередь "ждунов"
-				LockWaiters.Push( cur_coro_ptr );
+				const TryAcquire *TryAcquirePtr;
+				SyncWaiter *WaiterPtr;
+				SyncDeadlineNode *DeadlineNodePtr;
+				const DeadlineType *DeadlinePtr;
+				bool HasDeadline;
+			} params = { &try_acquire, &waiter, &deadline_node, &deadline, has_deadline };
+
+			std::function<void()> task = [ this, &params ]()
+			{
+				// Копируем параметры: после постановки в очередь
+				// к стеку сопрограммы обращаться нельзя
+				SyncWaiter &waiter = *params.WaiterPtr;
+				Coroutine *cur_coro_ptr = waiter.Coro;
+
+				// Таймер ставим до захвата Guard-а (порядок блокировок: сначала
+				// очередь таймеров, затем Guard)
+				if( params.HasDeadline )
+				{
+					ArmDeadline( *params.DeadlineNodePtr, *params.DeadlinePtr );
+				}
 
-				// Увеличиваем счётчик ожидающих сопрограмм
-				if( QueueLength++ == 0 )
+				bool resume_now = true;
 				{
-					// Текущий поток увеличил счётчик с нулевого значения: извлекаем первый указатель из очереди
-					// (это не обязательно будет cur_coro_ptr) и переключаемся на эту сопрограмму
-					// Счётчик будет уменьшен при освобождении блокировки
-					Coroutine *coro_ptr = ( Coroutine* ) LockWaiters.Pop();
-					MY_ASSERT( coro_ptr != nullptr );
+					LockGuard<SpinLock> lock( Guard );
+					if( ( *params.TryAcquirePtr )() )
+					{
+						// Объект освободился, пока переходили в основную сопрограмму
+						waiter.Acquired = true;
+					}
+					else if( !waiter.TimedOut )
+					{
+						// Встаём в очередь
+						Waiters.PushBack( waiter );
+						resume_now = false;
 
-					bool res = coro_ptr->SwitchTo();
+						// !!! с этого момента нельзя обращаться к переменным из стека сопрограммы !!!
+					}
+				}
+
+				if( resume_now )
+				{
+					bool res = cur_coro_ptr->SwitchTo();
 					MY_ASSERT( res );
 				}
 			};
 
 			// Переходим в основную сопрограмму и выполняем task
 			// (обратно вернёмся либо из task-а, либо позже, когда
-			// дойдёт очередь владения блокировкой)
+			// объект будет передан текущей сопрограмме или истечёт срок)
 			SetPostTaskAndSwitchToMainCoro( &task );
+
+			// После снятия таймеров OnDeadline гарантированно не выполняются
+			if( has_deadline )
+			{
+				DisarmDeadline( deadline_node );
+			}
+			cancel_wait.Unregister();
+
+			MY_ASSERT( !waiter.Queued );
+			MY_ASSERT( waiter.Acquired || waiter.TimedOut );
+			return waiter.Acquired;
+		} // bool SyncPrimitive::Wait
+
+		template<typename TryAcquire, typename CanSpin>
+		bool SyncPrimitive::SpinBeforePark( const TryAcquire &try_acquire, const CanSpin &can_spin )
+		{
+			// В единственном потоке сервиса (или на единственном процессоре)
+			// владелец объекта не выполняется, пока текущая сопрограмма его
+			// ждёт - ждать активно бессмысленно
+			static const bool multi_cpu = std::thread::hardware_concurrency() > 1;
+			SpinStatsStripe &stats = GetSpinStatsStripe();
+			const uint32_t limit = SpinLimit.load( std::memory_order_relaxed );
+			if( ( limit > 0 ) && multi_cpu && ( GetWorkThreadsCount() > 1 ) )
+			{
+				stats.Spins.fetch_add( 1, std::memory_order_relaxed );
+
+				uint32_t delay = 1;
+				for( uint32_t spent = 0; ( spent < limit ) && can_spin(); spent += delay )
+				{
+					for( uint32_t t = 0; t < delay; ++t )
+					{
+						CpuRelax();
+					}
+
+					if( try_acquire() )
+					{
+						stats.SpinAcquired.fetch_add( 1, std::memory_order_relaxed );
+						return true;
+					}
+
+					if( delay < MaxSpinDelay )
+					{
+						delay *= 2;
+					}
+				}
+			}
+
+			stats.Parked.fetch_add( 1, std::memory_order_relaxed );
+			return false;
+		} // bool SyncPrimitive::SpinBeforePark
+
+		bool SyncPrimitive::WakeFront( SyncWakeList &woken )
+		{
+			SyncWaiter *waiter_ptr = Waiters.PopFront();
+			if( waiter_ptr == nullptr )
+			{
+				return false;
+			}
+
+			waiter_ptr->Acquired = true;
+			woken.PushBack( *waiter_ptr );
+			return true;
+		}
+
+		//-----------------------------------------------------------------------------------------
+
+		/// Отметка владельца, получившего мьютекс из очереди: он ещё не продолжил
+		/// выполнение, и ждать его активно бессмысленно
+		const uint64_t ParkedOwnerStamp = ~( uint64_t ) 0;
+
+		Mutex::Mutex(): SyncPrimitive(), State( 0 ), OwnerStamp( 0 ) {}
+		
+		Mutex::~Mutex()
+		{
+			MY_ASSERT( State.load() == 0 );
+		}
+
+		void Mutex::Lock()
+		{
+			if( TryLock() )
+			{
+				return;
+			}
+
+			// С отвязанной областью отмены ожидание без срока не прерывается
+			CancelShield shield;
+			if( !Lock( NoDeadline ) )
+			{
+				MY_ASSERT( false );
+			}
+		}
+
+		void Mutex::Lock( Error &err )
+		{
+			SetWaitError( Lock( NoDeadline ), err );
+		}
+
+		bool Mutex::Lock( const DeadlineType &deadline )
+		{
+			// Предполагаем, что блокировка свободна и никто не претендует
+			if( TryLock() )
+			{
+				// Угадали
+				return true;
+			}
+
+			// Не угадали: владелец может вскоре освободить мьютекс, поэтому
+			// сначала недолго ждём активно (пока нет "ждунов" в очереди
+			// и владелец выполняется, а не приостановлен с мьютексом)
+			if( SpinBeforePark( [ this ]{ return ( State.load( std::memory_order_relaxed ) == 0 ) && TryLock(); },
+			                    [ this ]{ return ( State.load( std::memory_order_relaxed ) != 2 ) &&
+			                                     IsRunStampActual( OwnerStamp.load( std::memory_order_relaxed ) ); } ) )
+			{
+				return true;
+			}
+
+			// Отмечаем, что есть "ждуны" (если при этом блокировка
+			// оказалась свободна - она наша) и встаём в очередь
+			if( !Wait( [ this ]{ return State.exchange( 2 ) == 0; }, deadline ) )
+			{
+				return false;
+			}
+
+			OwnerStamp.store( GetRunStamp(), std::memory_order_relaxed );
+			return true;
 		}
 
 		bool Mutex::TryLock()
 		{
-			// Если счётчик "ждунов" был равен 0 (никто не претендует на блокировку и не владеет ей),
-			// заменяем 0 на 1 и возвращаем true (захватили блокировку), иначе облом
-			uint64_t expected_value = 0;
-			return QueueLength.compare_exchange_strong( expected_value, 1 );
+			// Если блокировка свободна, заменяем 0 на 1 и возвращаем true
+			// (захватили блокировку), иначе облом
+			uint8_t expected_value = 0;
+			if( !State.compare_exchange_strong( expected_value, 1 ) )
+			{
+				return false;
+			}
+
+			OwnerStamp.store( GetRunStamp(), std::memory_order_relaxed );
+			return true;
 		}
 
 		void Mutex::Unlock()
 		{
-			MY_ASSERT( QueueLength.load() > 0 );
+			MY_ASSERT( State.load() != 0 );
 
-			// Уменьшаем счётчик сопрограмм-претендентов
-			if( --QueueLength == 0 )
+			// Если "ждунов" не было - просто освобождаем блокировку
+			uint8_t expected_value = 1;
+			if( State.compare_exchange_strong( expected_value, 0 ) )
 			{
-				// Больше никто не претендует на владение блокировкой
 				return;
 			}
 
-			// Ещё остались "ждуны": извлекаем из очереди первого,
-			// сообщаем основной сопрограмме о необходимости переключиться на неё
-			Coroutine *coro_ptr = ( Coroutine* ) LockWaiters.Pop();
-			MY_ASSERT( coro_ptr != nullptr );
-			PostToSrv( *coro_ptr );
+			// Возможно, есть "ждуны": передаём блокировку первому из них
+			// (состояние при этом не меняется), либо освобождаем её
+			SyncWakeList woken( SrvRef );
+			LockGuard<SpinLock> lock( Guard );
+			if( WakeFront( woken ) )
+			{
+				OwnerStamp.store( ParkedOwnerStamp, std::memory_order_relaxed );
+			}
+			else
+			{
+				State.store( 0 );
+			}
 		} // void Mutex::Unlock()
 
+		void Mutex::RequeueWaiter( SyncWaiter &waiter, SyncWakeList &woken )
+		{
+			// Как и при постановке в очередь из Lock: отмечаем, что есть
+			// "ждуны", и если мьютекс оказался свободен - он передаётся waiter-у
+			LockGuard<SpinLock> lock( Guard );
+			if( State.exchange( 2 ) == 0 )
+			{
+				OwnerStamp.store( ParkedOwnerStamp, std::memory_order_relaxed );
+				waiter.Acquired = true;
+				woken.PushBack( waiter );
+			}
+			else
+			{
+				Waiters.PushBack( waiter );
+			}
+		} // void Mutex::RequeueWaiter( SyncWaiter &waiter, SyncWakeList &woken )
+
 		//-----------------------------------------------------------------------------------------
 
+		/// Захвачена монопольная блокировка
 		const uint64_t UniqueLockFlag = 0x8000000000000000;
-		inline bool UniqueLockCaptured( uint64_t state_flag )
+
+		/// Возможно, есть сопрограммы, ожидающие блокировку
+		/// (пока флаг выставлен, захват "в обход" очереди запрещён)
+		const uint64_t LockWaitersFlag = 0x4000000000000000;
+
+		/// Маска количества владельцев разделяемой блокировки
+		const uint64_t SharedUsersMask = LockWaitersFlag - 1;
+
+		SharedMutex::SharedMutex(): SyncPrimitive(), State( 0 ) {}
+
+		SharedMutex::~SharedMutex()
 		{
-			return ( UniqueLockFlag & state_flag ) != 0;
+			MY_ASSERT( ( State.load() & ~LockWaitersFlag ) == 0 );
 		}
 
-		inline uint32_t UniqueLockWaitersNum( uint64_t state_flag )
+		void SharedMutex::HandOff( SyncWakeList &woken )
 		{
-			return ( uint32_t ) ( 0x1FFFFF & ( state_flag >> 42 ) );
-		}
+			SyncWaiter *waiter_ptr = Waiters.Front();
+			if( waiter_ptr == nullptr )
+			{
+				// Ожидающих нет (ушли по истечении срока)
+				State.store( 0 );
+				return;
+			}
+
+			// Состояние выставляем до "пробуждения" сопрограмм: получив
+			// блокировку, они могут сразу же её освободить
+			if( !waiter_ptr->Shared )
+			{
+				// Передаём монопольную блокировку первой сопрограмме
+				State.store( UniqueLockFlag | ( waiter_ptr->Next != nullptr ? LockWaitersFlag : 0 ) );
+				WakeFront( woken );
+				return;
+			}
 
-		inline uint32_t SharedLockUsersNum( uint64_t state_flag )
+			// Передаём разделяемую блокировку всем сопрограммам,
+			// ждущим её в начале очереди
+			uint64_t users_num = 0;
+			for( ; ( waiter_ptr != nullptr ) && waiter_ptr->Shared; waiter_ptr = waiter_ptr->Next )
+			{
+				++users_num;
+			}
+
+			State.store( users_num | ( waiter_ptr != nullptr ? LockWaitersFlag : 0 ) );
+			for( ; users_num > 0; --users_num )
+			{
+				WakeFront( woken );
+			}
+		} // void SharedMutex::HandOff( SyncWakeList &woken )
+
+		bool SharedMutex::TryLock()
 		{
-			return ( uint32_t ) ( 0x1FFFFF & ( state_flag >> 21 ) );
+			uint64_t expected = 0;
+			return State.compare_exchange_strong( expected, UniqueLockFlag );
 		}
 
-		inline uint32_t SharedLockWaitersNum( uint64_t state_flag )
+		void SharedMutex::Lock()
 		{
-			return ( uint32_t ) ( 0x1FFFFF & state_flag );
+			if( TryLock() )
+			{
+				return;
+			}
+
+			// С отвязанной областью отмены ожидание без срока не прерывается
+			CancelShield shield;
+			if( !Lock( NoDeadline ) )
+			{
+				MY_ASSERT( false );
+			}
 		}
 
-		inline bool UniqueLockFree( uint64_t state_flag )
+		void SharedMutex::Lock( Error &err )
 		{
-			return ( state_flag >> 42 ) == 0;
+			SetWaitError( Lock( NoDeadline ), err );
 		}
 
-#ifdef _DEBUG
-		inline void CheckStateFlag( uint64_t state_flag )
+		bool SharedMutex::Lock( const DeadlineType &deadline )
 		{
-			bool unique_lock_captured = UniqueLockCaptured( state_flag );
-			bool unique_lock_waiters  = UniqueLockWaitersNum( state_flag ) > 0;
-			bool shared_lock_captured = SharedLockUsersNum( state_flag ) > 0;
-			bool shared_lock_waiters  = SharedLockWaitersNum( state_flag ) > 0;
+			// Предполагаем, что блокировка свободна и никто на неё не претендует
+			if( TryLock() )
+			{
+				// Угадали
+				return true;
+			}
+
+			// Не угадали: захватываем блокировку, если она свободна,
+			// иначе отмечаем, что есть "ждуны", и встаём в очередь
+			return Wait( [ this ]() -> bool
+			{
+				uint64_t cur_state = State.load();
+				while( true )
+				{
+					const bool is_free = ( cur_state & ~LockWaitersFlag ) == 0;
+					const uint64_t new_state = is_free ? ( cur_state | UniqueLockFlag ) : ( cur_state | LockWaitersFlag );
+					if( State.compare_exchange_weak( cur_state, new_state ) )
+					{
+						return is_free;
+					}
+				}
+			}, deadline );
+		} // bool SharedMutex::Lock( const DeadlineType &deadline )
 
-			if( unique_lock_captured )
+		bool SharedMutex::TrySharedLock()
+		{
+			uint64_t cur_state = State.load();
+			while( ( cur_state & ( UniqueLockFlag | LockWaitersFlag ) ) == 0 )
 			{
-				MY_ASSERT( !shared_lock_captured );
+				// Монопольной блокировки и претендентов нет
+				MY_ASSERT( ( cur_state & SharedUsersMask ) < SharedUsersMask );
+				if( State.compare_exchange_weak( cur_state, cur_state + 1 ) )
+				{
+					return true;
+				}
 			}
-			else if( !shared_lock_captured )
+
+			return false;
+		} // bool SharedMutex::TrySharedLock()
+
+		void SharedMutex::SharedLock()
+		{
+			if( TrySharedLock() )
 			{
-				MY_ASSERT( !unique_lock_captured );
-				MY_ASSERT( !( unique_lock_waiters || shared_lock_waiters ) == ( state_flag == 0 ) );
-				MY_ASSERT( !( unique_lock_waiters || shared_lock_waiters ) );
+				return;
 			}
-			else if( !unique_lock_waiters )
+
+			// С отвязанной областью отмены ожидание без срока не прерывается
+			CancelShield shield;
+			if( !SharedLock( NoDeadline ) )
 			{
-				MY_ASSERT( !unique_lock_captured );
-				MY_ASSERT( shared_lock_captured );
-				MY_ASSERT( !shared_lock_waiters );
+				MY_ASSERT( false );
 			}
 		}
-#define VALIDATE_STATE( s ) CheckStateFlag( s )
-#define VALIDATE_UNIQUE_LOCK {\
-auto f = StateFlag.load();\
-VALIDATE_STATE( f );\
-MY_ASSERT( UniqueLockCaptured( f ) );\
-VALIDATE_STATE( StateFlag.load() );\
-MY_ASSERT( UniqueLockCaptured( StateFlag.load() ) );\
-MY_ASSERT( SharedLockUsersNum( StateFlag.load() ) == 0 );}
-		
-#define VALIDATE_SHARED_LOCK {\
-auto f = StateFlag.load();\
-VALIDATE_STATE( f );\
-MY_ASSERT( SharedLockUsersNum( f ) > 0 );\
-VALIDATE_STATE( StateFlag.load() );\
-MY_ASSERT( !UniqueLockCaptured( StateFlag.load() ) );\
-MY_ASSERT( SharedLockUsersNum( StateFlag.load() ) > 0 );}
-#else
-#define VALIDATE_STATE( s )
-#define VALIDATE_UNIQUE_LOCK
-#define VALIDATE_SHARED_LOCK
-#endif
-
-		inline uint64_t MakeStateMask( bool unique_lock_captured,
-		                               uint32_t unique_lock_waiters,
-		                               uint32_t shared_lock_users,
-		                               uint32_t shared_lock_waiters )
-		{
-			MY_ASSERT( UniqueLockFlag == ( uint64_t ) 1 << 63 );
-			MY_ASSERT( unique_lock_waiters <= 0x1FFFFF );
-			MY_ASSERT( shared_lock_users   <= 0x1FFFFF );
-			MY_ASSERT( shared_lock_waiters <= 0x1FFFFF );
-
-			uint64_t res = unique_lock_captured ? UniqueLockFlag : 0;
-			res |= ( ( uint64_t ) unique_lock_waiters ) << 42;
-			res |= ( ( uint64_t ) shared_lock_users   ) << 21;
-			res |=   ( uint64_t ) shared_lock_waiters;
-			return res;
+
+		void SharedMutex::SharedLock( Error &err )
+		{
+			SetWaitError( SharedLock( NoDeadline ), err );
 		}
 
-		SharedMutex::SharedMutex(): StateFlag( 0 ), LockWaiters( 0, 0xFF ), SharedLockWaiters( 0, 0xFF ) {}
+		bool SharedMutex::SharedLock( const DeadlineType &deadline )
+		{
+			// Предполагаем, что никто не владеет монопольной блокировкой
+			// и не претендует на неё
+			if( TrySharedLock() )
+			{
+				// Угадали
+				return true;
+			}
 
-		SharedMutex::~SharedMutex()
+			// Не угадали: присоединяемся к владельцам, если монопольная
+			// блокировка свободна и очередь пуста, иначе встаём в очередь
+			return Wait( [ this ]() -> bool
+			{
+				const bool no_waiters = Waiters.Empty();
+				uint64_t cur_state = State.load();
+				while( true )
+				{
+					const bool can_join = no_waiters && ( ( cur_state & UniqueLockFlag ) == 0 );
+					const uint64_t new_state = can_join ? ( cur_state + 1 ) : ( cur_state | LockWaitersFlag );
+					if( State.compare_exchange_weak( cur_state, new_state ) )
+					{
+						return can_join;
+					}
+				}
+			}, deadline, true );
+		} // bool SharedMutex::SharedLock( const DeadlineType &deadline )
+
+		void SharedMutex::Unlock()
+		{
+			uint64_t cur_state = State.load();
+			MY_ASSERT( ( cur_state & ~LockWaitersFlag ) != 0 );
+
+			// Если "ждунов" нет, либо освобождается не последняя
+			// разделяемая блокировка - обходимся без Guard-а
+			while( ( ( cur_state & LockWaitersFlag ) == 0 ) ||
+			       ( ( cur_state & SharedUsersMask ) > 1 ) )
+			{
+				const uint64_t new_state = ( cur_state & UniqueLockFlag ) != 0 ? ( cur_state & ~UniqueLockFlag ) : ( cur_state - 1 );
+				if( State.compare_exchange_weak( cur_state, new_state ) )
+				{
+					return;
+				}
+			}
+
+			// Текущая сопрограмма - последний владелец, и есть "ждуны"
+			// (пока выставлен флаг, к владельцам никто не присоединится)
+			SyncWakeList woken( SrvRef );
+			LockGuard<SpinLock> lock( Guard );
+			cur_state = State.load();
+			while( ( cur_state & SharedUsersMask ) > 1 )
+			{
+				// Пока брали Guard, разделяемые владельцы, ушедшие
+				// после нас, уменьшили счётчик - переходим к их числу
+				if( State.compare_exchange_weak( cur_state, cur_state - 1 ) )
+				{
+					return;
+				}
+			}
+
+			HandOff( woken );
+		} // void SharedMutex::Unlock()
+
+		//-----------------------------------------------------------------------------------------
+
+		/// Количество счётчиков читателей по умолчанию (по числу потоков сервиса)
+		static uint8_t DefaultReaderSlotsNum( uint64_t threads_num )
+		{
+			if( threads_num == 0 )
+			{
+				return 1;
+			}
+			return threads_num < 0xFF ? ( uint8_t ) threads_num : 0xFF;
+		}
+
+		DistributedSharedMutex::DistributedSharedMutex( uint8_t slots_num ): SyncPrimitive(),
+		                                                                    WriterState( 0 ),
+		                                                                    SlotsNum( slots_num > 0 ? slots_num :
+		                                                                              DefaultReaderSlotsNum( GetWorkThreadsCount() ) ),
+		                                                                    SlotsBuf( new uint8_t[ ( SlotsNum + 1 )*CacheLineSize ] ),
+		                                                                    Slots( nullptr ),
+		                                                                    ReaderLeft()
+		{
+			// Выравниваем счётчики по границе кэш-линии
+			uintptr_t addr = ( uintptr_t ) SlotsBuf.get();
+			addr = ( addr + CacheLineSize - 1 ) & ~( uintptr_t ) ( CacheLineSize - 1 );
+			Slots = ( ReaderSlot* ) addr;
+			for( uint8_t t = 0; t < SlotsNum; ++t )
+			{
+				new( &Slots[ t ].Count ) std::atomic<int64_t>( 0 );
+			}
+		}
+
+		DistributedSharedMutex::~DistributedSharedMutex()
 		{
-			MY_ASSERT( !LockWaiters.Pop() );
-			MY_ASSERT( !SharedLockWaiters.Pop() );
-			MY_ASSERT( StateFlag.load() == 0 );
+			MY_ASSERT( WriterState.load() == 0 );
+			MY_ASSERT( ReadersCount() == 0 );
 		}
-		
-		void SharedMutex::AwakeCoro( bool for_unique_lock, bool by_push )
-		{
-			LockFree::DigitsQueue &waiters = for_unique_lock ? LockWaiters : SharedLockWaiters;
-			Coroutine *coro_ptr = ( Coroutine* ) waiters.Pop();
-			MY_ASSERT( coro_ptr != nullptr );
 
-			if( by_push )
-			{
-				PostToSrv( *coro_ptr );
-			}
-			else
-			{
-				bool res = coro_ptr->SwitchTo();
-				MY_ASSERT( res );
-			}
+		uint8_t DistributedSharedMutex::GetReaderSlotsNum() const
+		{
+			return SlotsNum;
 		}
-		
-		bool SharedMutex::TryLock()
+
+		DistributedSharedMutex::ReaderSlot& DistributedSharedMutex::CurrentSlot()
 		{
-			uint64_t expected = 0;
-			bool res = StateFlag.compare_exchange_strong( expected, UniqueLockFlag );
-			VALIDATE_STATE( StateFlag.load() );
-			MY_ASSERT( UniqueLockCaptured( StateFlag.load() ) || !res );
-			return res;
+			// Счётчик выбирается по номеру потока сервиса
+			return Slots[ GetServiceThreadNum() % SlotsNum ];
 		}
 
-		void SharedMutex::Lock()
+		int64_t DistributedSharedMutex::ReadersCount() const
 		{
-			// Предполагаем, что блокировка свободна и никто на неё не претендует
-			VALIDATE_STATE( StateFlag.load() );
-			if( TryLock() )
+			int64_t res = 0;
+			for( uint8_t t = 0; t < SlotsNum; ++t )
 			{
-				// Угадали
-				return;
+				res += Slots[ t ].Count.load();
 			}
 
-			// Не угадали
-			Coroutine *cur_coro_ptr = GetCurrentCoro();
-			if( cur_coro_ptr == nullptr )
+			MY_ASSERT( res >= 0 );
+			return res;
+		}
+
+		void DistributedSharedMutex::ReaderExit( ReaderSlot &slot )
+		{
+			slot.Count.fetch_sub( 1 );
+			if( WriterState.load() != 0 )
 			{
-				throw Exception( ErrorCodes::NotInsideSrvCoro,
-				                 "Must be called from service coroutine" );
+				// Возможно, писатель ждёт выхода читателей
+				ReaderLeft.Set();
 			}
+		}
 
-			std::function<void()> task = [ this, cur_coro_ptr ]()
+		bool DistributedSharedMutex::TrySharedLockOrMark()
+		{
+			uint8_t state = WriterState.load();
+			while( 1 )
 			{
-				// Добавляем указатель на текущую сопрограмму в очередь "ждунов"
-				LockWaiters.Push( cur_coro_ptr );
-
-				// Увеличиваем счётчик сопрограмм, ожидающих монопольную блокировку
-				bool captured = false;
-				uint64_t new_state = 0;
-				uint64_t cur_state = StateFlag.load();
-
-				do
+				if( state == 0 )
 				{
-					VALIDATE_STATE( cur_state );
-					
-					if( cur_state == 0 )
-					{
-						// Блокировка свободна и никто на неё не претендует
-						captured = true;
-						new_state = UniqueLockFlag;
-					}
-					else
+					// Писателя нет - входим (если он успел появиться - выходим и повторяем)
+					ReaderSlot &slot = CurrentSlot();
+					slot.Count.fetch_add( 1 );
+					if( WriterState.load() == 0 )
 					{
-						// Блокировка занята (монопольная или разделяемая) - увеличиваем счётчик сопрограмм,
-						// ожидающих получения монопольной блокировки
-						MY_ASSERT( UniqueLockCaptured( cur_state ) == ( SharedLockUsersNum( cur_state ) == 0 ) );
-						captured = false;
-						new_state = MakeStateMask( UniqueLockCaptured( cur_state ),
-						                           UniqueLockWaitersNum( cur_state ) + 1,
-						                           SharedLockUsersNum( cur_state ),
-						                           SharedLockWaitersNum( cur_state ) );
+						return true;
 					}
-					MY_ASSERT( captured == ( new_state == UniqueLockFlag ) );
-					MY_ASSERT( captured || ( UniqueLockWaitersNum( new_state ) > 0 ) );
-					VALIDATE_STATE( new_state );
-				}
-				while( !StateFlag.compare_exchange_weak( cur_state, new_state ) );
-				MY_ASSERT( !captured || ( ( cur_state == 0 ) && ( new_state == UniqueLockFlag ) ) );
-				VALIDATE_STATE( StateFlag.load() );
 
-				if( captured )
+					ReaderExit( slot );
+					state = WriterState.load();
+				}
+				else if( ( state == 2 ) || WriterState.compare_exchange_weak( state, 2 ) )
 				{
-					VALIDATE_UNIQUE_LOCK;
-					
-					// Текущий поток захватил монопольную блокировку: извлекаем первый указатель из очереди
-					// (это не обязательно будет cur_coro_ptr) и переключаемся на эту сопрограмму
-					// Счётчик будет уменьшен при освобождении блокировки
-					AwakeCoro( true, false );
+					// Отметили, что есть "ждуны": писатель передаст блокировку через HandOff
+					return false;
 				}
-			}; // std::function<void()> task = [ this, cur_coro_ptr ]()
+			}
+		} // bool DistributedSharedMutex::TrySharedLockOrMark()
 
-			// Переходим в основную сопрограмму и выполняем task
-			// (обратно вернёмся либо из task-а, либо позже, когда
-			// дойдёт очередь владения блокировкой)
-			SetPostTaskAndSwitchToMainCoro( &task );
-			
-			VALIDATE_UNIQUE_LOCK;
-		} // void SharedMutex::Lock()
-		
-		bool SharedMutex::TrySharedLock()
+		bool DistributedSharedMutex::WaitReaders( const DeadlineType &deadline )
 		{
-			uint64_t cur_state = StateFlag.load();
-			uint64_t new_state = 0;
-
-			do
+			// Сброс события до проверки: выход читателя после проверки
+			// выставит событие, и ожидание не "проспит" его
+			while( ReadersCount() != 0 )
 			{
-				VALIDATE_STATE( cur_state );
-				if( !UniqueLockFree( cur_state ) )
+				ReaderLeft.Reset();
+				if( ReadersCount() == 0 )
+				{
+					break;
+				}
+				else if( !ReaderLeft.Wait( deadline ) )
 				{
-					// Кто-то владеет монопольной блокировкой, либо претендует на неё
 					return false;
 				}
-
-				MY_ASSERT( ( cur_state >> 42 ) == 0 );
-				MY_ASSERT( !UniqueLockCaptured( cur_state ) );
-				MY_ASSERT( UniqueLockWaitersNum( cur_state ) == 0 );
-				MY_ASSERT( SharedLockWaitersNum( cur_state ) == 0 );
-				new_state = MakeStateMask( false, 0, SharedLockUsersNum( cur_state ) + 1, 0 );
-			}
-			while( StateFlag.compare_exchange_weak( cur_state, new_state ) );
-			
-			VALIDATE_STATE( cur_state );
-			VALIDATE_STATE( new_state );
-			MY_ASSERT( UniqueLockFree( cur_state ) );
-			MY_ASSERT( UniqueLockFree( new_state ) );
-			MY_ASSERT( SharedLockUsersNum( new_state ) > 0 );
-			MY_ASSERT( SharedLockWaitersNum( cur_state ) == 0 );
-			MY_ASSERT( SharedLockWaitersNum( new_state ) == 0 );
-			VALIDATE_SHARED_LOCK;
+			}
 
 			return true;
-		} // bool SharedMutex::TrySharedLock()
+		} // bool DistributedSharedMutex::WaitReaders( const DeadlineType &deadline )
 
-		void SharedMutex::SharedLock()
+		void DistributedSharedMutex::HandOff( SyncWakeList &woken )
 		{
-			// Предполагаем, что никто не владеет монопольной блокировкой
-			// и не претендует на неё
-			if( TrySharedLock() )
+			MY_ASSERT( WriterState.load() != 0 );
+			SyncWaiter *front = Waiters.Front();
+			if( ( front != nullptr ) && front->Shared )
 			{
-				// Угадали
-				VALIDATE_STATE( StateFlag.load() );
-				return;
+				// Впускаем читателей из начала очереди (за них увеличиваем счётчик
+				// текущего потока: важна только сумма счётчиков)
+				ReaderSlot &slot = CurrentSlot();
+				while( ( front != nullptr ) && front->Shared )
+				{
+					slot.Count.fetch_add( 1 );
+					WakeFront( woken );
+					front = Waiters.Front();
+				}
 			}
 
-			// Не угадали
-			Coroutine *cur_coro_ptr = GetCurrentCoro();
-			if( cur_coro_ptr == nullptr )
+			if( front == nullptr )
 			{
-				throw Exception( ErrorCodes::NotInsideSrvCoro,
-				                 "Must be called from service coroutine" );
+				WriterState.store( 0 );
+			}
+			else
+			{
+				// Монопольная блокировка передаётся следующему писателю
+				// (состояние не меняется), впущенные читатели
+				// успеют выйти до того, как он начнёт
+				WakeFront( woken );
+			}
+		} // void DistributedSharedMutex::HandOff( SyncWakeList &woken )
+
+		bool DistributedSharedMutex::TryLock()
+		{
+			uint8_t expected = 0;
+			if( !WriterState.compare_exchange_strong( expected, 1 ) )
+			{
+				return false;
+			}
+			else if( ReadersCount() == 0 )
+			{
+				return true;
 			}
 
-			std::function<void()> task = [ this, cur_coro_ptr ]()
+			// Читатели есть - отказываемся от блокировки
+			Unlock();
+			return false;
+		}
+
+		void DistributedSharedMutex::Lock()
+		{
+			if( TryLock() )
 			{
-				// Добавляем указатель на текущую сопрограмму в очередь "ждунов"
-				SharedLockWaiters.Push( cur_coro_ptr );
+				return;
+			}
 
-				// Увеличиваем счётчик сопрограмм, ожидающих разделяемую блокировку
-				uint64_t cur_state = StateFlag.load();
-				uint64_t new_state = 0;
+			// С отвязанной областью отмены ожидание без срока не прерывается
+			CancelShield shield;
+			if( !Lock( NoDeadline ) )
+			{
+				MY_ASSERT( false );
+			}
+		}
 
-				bool captured = false;
+		void DistributedSharedMutex::Lock( Error &err )
+		{
+			SetWaitError( Lock( NoDeadline ), err );
+		}
 
-				do
-				{
-					VALIDATE_STATE( cur_state );
-					if( UniqueLockFree( cur_state ) )
-					{
-						// Никто не владеет монопольной блокировкой и не претендует на неё
-						captured = true;
-						
-						MY_ASSERT( ( cur_state >> 42 ) == 0 );
-						MY_ASSERT( !UniqueLockCaptured( cur_state ) );
-						MY_ASSERT( UniqueLockWaitersNum( cur_state ) == 0 );
-						MY_ASSERT( SharedLockWaitersNum( cur_state ) == 0 );
-						new_state = MakeStateMask( false, 0, SharedLockUsersNum( cur_state ) + 1, 0 );
-					}
-					else
-					{
-						// Монопольная блокировка занята, либо есть претенденты на неё:
-						// увеличиваем счётчик сопрограмм,
-						// ожидающих получения разделяемой блокировки
-						captured = false;
-						new_state = MakeStateMask( UniqueLockCaptured( cur_state ),
-						                           UniqueLockWaitersNum( cur_state ),
-						                           SharedLockUsersNum( cur_state ),
-						                           SharedLockWaitersNum( cur_state ) + 1 );
-					}
-					VALIDATE_STATE( new_state );
-				}
-				while( !StateFlag.compare_exchange_weak( cur_state, new_state ) );
+		bool DistributedSharedMutex::Lock( const DeadlineType &deadline )
+		{
+			// Сначала становимся единственным писателем (с этого момента новые
+			// читатели не входят), затем дожидаемся выхода читателей
+			uint8_t expected = 0;
+			if( !WriterState.compare_exchange_strong( expected, 1 ) &&
+			    !Wait( [ this ]{ return WriterState.exchange( 2 ) == 0; }, deadline ) )
+			{
+				return false;
+			}
 
-				if( captured )
-				{
-					VALIDATE_SHARED_LOCK;
-					
-					// Текущий поток захватил разделяемую блокировку: извлекаем первый указатель из очереди
-					// (это не обязательно будет cur_coro_ptr) и переключаемся на эту сопрограмму
-					// Счётчик будет уменьшен при освобождении блокировки
-					AwakeCoro( false, false );
-				}
-			}; // std::function<void()> task = [ this, cur_coro_ptr ]()
+			if( WaitReaders( deadline ) )
+			{
+				return true;
+			}
 
-			// Переходим в основную сопрограмму и выполняем task
-			// (обратно вернёмся либо из task-а, либо позже, когда
-			// дойдёт очередь владения блокировкой)
-			SetPostTaskAndSwitchToMainCoro( &task );
-			
-			VALIDATE_SHARED_LOCK;
-		} // void SharedMutex::SharedLock()
+			// Срок истёк - отдаём блокировку ожидающим
+			Unlock();
+			return false;
+		} // bool DistributedSharedMutex::Lock( const DeadlineType &deadline )
 
-		void SharedMutex::Unlock()
+		void DistributedSharedMutex::Unlock()
 		{
-			uint64_t cur_state = StateFlag.load();
-			uint64_t new_state;
-			VALIDATE_STATE( cur_state );
-			
-			if( cur_state == 0 )
+			uint8_t expected = 1;
+			if( WriterState.compare_exchange_strong( expected, 0 ) )
 			{
-				// Блокировка свободна
-				MY_ASSERT( false );
 				return;
 			}
 
-			int64_t get_coros = 0;
+			SyncWakeList woken( SrvRef );
+			LockGuard<SpinLock> lock( Guard );
+			HandOff( woken );
+		} // void DistributedSharedMutex::Unlock()
 
-			if( UniqueLockCaptured( cur_state ) )
+		bool DistributedSharedMutex::TrySharedLock()
+		{
+			if( WriterState.load() != 0 )
 			{
-				// Была захвачена монопольная блокировка
-				do
-				{
-					VALIDATE_STATE( cur_state );
-					MY_ASSERT( UniqueLockCaptured( cur_state ) );
-
-					const uint32_t unique_waiters_num = UniqueLockWaitersNum( cur_state );
-					const uint32_t shared_waiters_num = SharedLockWaitersNum( cur_state );
-					
-					if( unique_waiters_num == 0 )
-					{
-						// Никто не претендует на монопольную блокировку,
-						// а на разделяемую желающие, возможно, есть
-						get_coros = shared_waiters_num;
-						new_state = MakeStateMask( false, 0, shared_waiters_num, 0 );
-					}
-					else
-					{
-						// Есть желающие на монопольную блокировку
-						get_coros = -1;
-						MY_ASSERT( UniqueLockCaptured( cur_state ) );
-						MY_ASSERT( unique_waiters_num > 0 );
-						new_state = MakeStateMask( true, unique_waiters_num - 1,
-						                           0, shared_waiters_num );
-					}
-				}
-				while( !StateFlag.compare_exchange_weak( cur_state, new_state ) );
-				VALIDATE_STATE( cur_state );
-				VALIDATE_STATE( new_state );
+				return false;
 			}
-			else
+
+			ReaderSlot &slot = CurrentSlot();
+			slot.Count.fetch_add( 1 );
+			if( WriterState.load() == 0 )
 			{
-				// Была захвачена разделяемая блокировка
-				do
-				{
-					VALIDATE_STATE( cur_state );
-					MY_ASSERT( SharedLockUsersNum( cur_state ) > 0 );
+				return true;
+			}
 
-					// Уменьшаем счётчик пользователей разделяемой блокировки
-					const uint32_t cur_users_num = SharedLockUsersNum( cur_state );
-					const uint32_t unique_waiters_num = UniqueLockWaitersNum( cur_state );
-					const uint32_t shared_waiters_num = SharedLockWaitersNum( cur_state );
-					
-					MY_ASSERT( cur_users_num > 0 );
+			ReaderExit( slot );
+			return false;
+		}
 
-					if( ( cur_users_num == 1 ) && ( unique_waiters_num > 0 ) )
-					{
-						// Текущая сопрограмма - последняя, кто
-						// владеет разделяемой блокировкой, и есть
-						// очередь на монопольную блокировку
-						get_coros = -1;
-						new_state = MakeStateMask( true, unique_waiters_num - 1,
-						                           0, shared_waiters_num );
-					}
-					else
-					{
-						get_coros = 0;
-						new_state = MakeStateMask( false, unique_waiters_num, cur_users_num - 1, shared_waiters_num );
-					}
-				}
-				while( !StateFlag.compare_exchange_weak( cur_state, new_state ) );
+		void DistributedSharedMutex::SharedLock()
+		{
+			if( TrySharedLock() )
+			{
+				return;
 			}
-			
-			VALIDATE_STATE( StateFlag.load() );
 
-			if( get_coros > 0 )
+			// С отвязанной областью отмены ожидание без срока не прерывается
+			CancelShield shield;
+			if( !SharedLock( NoDeadline ) )
 			{
-				// Пробуждаем get_coros сопрограмм, ждущих разделяемую блокировку
-				VALIDATE_SHARED_LOCK;
-				for( int64_t t = 0; t < get_coros; ++t )
-				{
-					AwakeCoro( false, true );
-				}
+				MY_ASSERT( false );
 			}
-			else if( get_coros < 0 )
-			{
-				// Пробуждаем одну сопрограмму, ждущую монопольную блокировку
-				VALIDATE_UNIQUE_LOCK;
-				AwakeCoro( true, true );
+		}
 
+		void DistributedSharedMutex::SharedLock( Error &err )
+		{
+			SetWaitError( SharedLock( NoDeadline ), err );
+		}
+
+		bool DistributedSharedMutex::SharedLock( const DeadlineType &deadline )
+		{
+			// Пока писателя нет, затрагивается только счётчик текущего потока
+			if( TrySharedLock() )
+			{
+				return true;
 			}
-		} // void SharedMutex::Unlock()
 
-#undef VALIDATE_STATE
+			return Wait( [ this ]{ return TrySharedLockOrMark(); }, deadline, true );
+		}
+
+		void DistributedSharedMutex::SharedUnlock()
+		{
+			ReaderExit( CurrentSlot() );
+		}
 
 		//-----------------------------------------------------------------------------------------
 
@@ -514,64 +1016,43 @@ MY_ASSERT( SharedLockUsersNum( StateFlag.load() ) > 0 );}
 			return false;
 		} // bool Semaphore::TryDecrement()
 
-		void Semaphore::AwakeCoro( Coroutine *coro_ptr )
-		{
-			MY_ASSERT( coro_ptr != nullptr );
-			PostToSrv( *coro_ptr );
-		}
-
-		Semaphore::Semaphore(): Counter( 0 ), Waiters( 0, 0xFF ) {}
+		Semaphore::Semaphore(): SyncPrimitive(), Counter( 0 ) {}
 		
 		Semaphore::~Semaphore()
 		{
 			MY_ASSERT( Counter.load() == 0 );
-			MY_ASSERT( !Waiters.Pop() );
 		}
 
 		void Semaphore::Push()
 		{
-			// Смотрим, есть ли в очереди ожидающие сопрограммы
-			Coroutine *coro_ptr = ( Coroutine* ) Waiters.Pop();
-			if( coro_ptr != nullptr )
+			// Если в очереди есть ожидающие сопрограммы - передаём
+			// "единицу" первой из них, иначе увеличиваем счётчик
+			SyncWakeList woken( SrvRef );
+			LockGuard<SpinLock> lock( Guard );
+			if( !WakeFront( woken ) )
 			{
-				// Есть: говорим основной сопрограмме переключиться
-				// на первую из них и на этом всё
-				AwakeCoro( coro_ptr );
-				return;
+				++Counter;
 			}
+		} // void Semaphore::Push()
 
-			// Очередь пуста (была, по крайней мере): увеличиваем счётчик
-			// и смотрим, не появились ли сопрограммы в очереди
-			++Counter;
-			coro_ptr = ( Coroutine* ) Waiters.Pop();
-			if( coro_ptr == nullptr )
+		void Semaphore::Pop()
+		{
+			// С отвязанной областью отмены ожидание без срока не прерывается
+			CancelShield shield;
+			if( !Pop( NoDeadline ) )
 			{
-				// Не появились
-				return;
+				MY_ASSERT( false );
 			}
+		}
 
-			// Появились новые "ждуны": пробуем уменьшить счётчик и
-			// сообщить основной сопрограмме о необходимости переключиться
-			// на одного из "ждунов"
-
-			if( TryDecrement() )
-			{
-				// Успешно уменьшили счётчик: передаём
-				// задание основной сопрограмме
-				AwakeCoro( coro_ptr );
-				return;
-			} // if( TryDecrement() )
-
-			// Не удалось уменьшить счётчик: кто-то другой его уже обнулил.
-			// Возвращаем "ждуна" обратно в очередь (в конец)
-			MY_ASSERT( coro_ptr != nullptr );
-			Waiters.Push( coro_ptr );
-		} // void Semaphore::Push()
+		void Semaphore::Pop( Error &err )
+		{
+			SetWaitError( Pop( NoDeadline ), err );
+		}
 
-		void Semaphore::Pop()
+		bool Semaphore::Pop( const DeadlineType &deadline )
 		{
-			Coroutine *cur_coro_ptr = GetCurrentCoro();
-			if( cur_coro_ptr == nullptr )
+			if( GetCurrentCoro() == nullptr )
 			{
 				throw Exception( ErrorCodes::NotInsideSrvCoro,
 				                 "Must be called from service coroutine" );
@@ -580,117 +1061,277 @@ MY_ASSERT( SharedLockUsersNum( StateFlag.load() ) > 0 );}
 			if( TryDecrement() )
 			{
 				// Успешно уменьшили счётчик на 1
-				return;
+				return true;
 			}
 
-			// Счётчик нулевой (по крайней мере, был) - ждём его увеличения
-			std::function<void()> task = [ this, cur_coro_ptr ]()
+			// Счётчик нулевой (по крайней мере, был) - недолго ждём
+			// его увеличения активно, затем в очереди
+			if( SpinBeforePark( [ this ]{ return TryDecrement(); }, []{ return true; } ) )
 			{
-				// Добавляем указатель на текущую сопрограмму в очередь "ждунов"
-				Waiters.Push( cur_coro_ptr );
-
-				// Пробуем уменьшить счётчик (вдруг уже был увеличен)
-				if( TryDecrement() )
-				{
-					// Удалось: извлекаем первый указатель из очереди
-					// (это не обязательно будет cur_coro_ptr) и переключаемся на эту сопрограмму
-					Coroutine *coro_ptr = ( Coroutine* ) Waiters.Pop();
-					MY_ASSERT( coro_ptr != nullptr );
-
-					bool res = coro_ptr->SwitchTo();
-					MY_ASSERT( res );
-				}
-			};
+				return true;
+			}
 
-			// Переходим в основную сопрограмму и выполняем task
-			// (обратно вернёмся либо из task-а, либо позже, когда
-			// увеличится счётчик)
-			SetPostTaskAndSwitchToMainCoro( &task );
-		} // void Semaphore::Pop()
+			return Wait( [ this ]{ return TryDecrement(); }, deadline );
+		} // bool Semaphore::Pop( const DeadlineType &deadline )
 
 		//-----------------------------------------------------------------------------------------
 
-		Event::Event(): StateFlag( 0 ), Waiters( 0, 0xFF ) {}
+		Event::Event(): SyncPrimitive(), Active( false ) {}
 		
-		Event::~Event()
+		Event::~Event() {}
+
+		void Event::Set()
 		{
-			MY_ASSERT( StateFlag.load() == 0 );
-			MY_ASSERT( !Waiters.Pop() );
+			// Выставляем значение "событие активно" и
+			// пробуждаем все сопрограммы, ожидающие активности
+			SyncWakeList woken( SrvRef );
+			LockGuard<SpinLock> lock( Guard );
+			Active.store( true );
+			while( WakeFront( woken ) ) {}
 		}
 
-		void Event::Set()
+		void Event::Reset()
 		{
-			// Выставляем значение "событие активно"
-			// и получаем предыдущее состояние.
-			int64_t val = StateFlag.exchange( -1 );
+			Active.store( false );
+		}
 
-			// Если есть сопрограммы, ожидающие активности, пробуждаем их
-			for( ; val > 0; --val )
+		void Event::Wait()
+		{
+			// С отвязанной областью отмены ожидание без срока не прерывается
+			CancelShield shield;
+			if( !Wait( NoDeadline ) )
 			{
-				Coroutine *coro_ptr = ( Coroutine* ) Waiters.Pop();
-				MY_ASSERT( coro_ptr != nullptr );
-				PostToSrv( *coro_ptr );
-			} // for( int64_t val = StateFlag.exchange( -1 ); val > 0; --val )
+				MY_ASSERT( false );
+			}
 		}
 
-		void Event::Reset()
+		void Event::Wait( Error &err )
 		{
-			int64_t flag = -1;
-			StateFlag.compare_exchange_strong( flag, 0 );
+			SetWaitError( Wait( NoDeadline ), err );
 		}
 
-		void Event::Wait()
+		bool Event::Wait( const DeadlineType &deadline )
 		{
-			if( StateFlag.load() == -1 )
+			if( Active.load() )
 			{
 				// Событие активно
-				return;
+				return true;
+			}
+
+			// Событие неактивно (по крайней мере, было) - ждём его активности
+			return SyncPrimitive::Wait( [ this ]{ return Active.load(); }, deadline );
+		} // bool Event::Wait( const DeadlineType &deadline )
+
+		//-----------------------------------------------------------------------------------------
+
+		/// Элемент очереди сопрограмм, ожидающих уведомления условной переменной
+		struct CondWaiter: public SyncWaiter
+		{
+			/// Мьютекс, освобождённый ожидающей сопрограммой
+			Mutex *MutexPtr;
+
+			/// Элемент перенесён в очередь мьютекса
+			/// (меняется под блокировкой Guard-а условной переменной)
+			bool Requeued;
+
+			CondWaiter( Coroutine *coro_ptr, Mutex &mut ): SyncWaiter( coro_ptr, false ),
+			                                               MutexPtr( &mut ),
+			                                               Requeued( false )
+			{}
+		};
+
+		/// Узел таймера, отслеживающий крайний срок ожидания уведомления
+		class CondDeadlineNode: public TimerNode
+		{
+			private:
+				/// Ссылка на условную переменную
+				ConditionVariable &Owner;
+
+				/// Ссылка на элемент очереди ожидающей сопрограммы
+				CondWaiter &WaiterRef;
+
+			public:
+				CondDeadlineNode( ConditionVariable &owner,
+				                  CondWaiter &waiter ): TimerNode(),
+				                                        Owner( owner ),
+				                                        WaiterRef( waiter )
+				{}
+
+				virtual Coroutine* OnDeadline() override
+				{
+					LockGuard<SpinLock> lock( Owner.Guard );
+					if( WaiterRef.Requeued )
+					{
+						// Уведомление получено, сопрограмма ждёт мьютекс
+						// (очередь мьютекса под другой блокировкой - не трогаем)
+						return nullptr;
+					}
+
+					WaiterRef.TimedOut = true;
+					if( !WaiterRef.Queued )
+					{
+						return nullptr;
+					}
+
+					Owner.Waiters.Remove( WaiterRef );
+					return WaiterRef.Coro;
+				}
+		};
+
+		ConditionVariable::ConditionVariable(): SyncPrimitive() {}
+
+		ConditionVariable::~ConditionVariable() {}
+
+		bool ConditionVariable::RequeueFront( SyncWakeList &woken )
+		{
+			SyncWaiter *waiter_ptr = Waiters.PopFront();
+			if( waiter_ptr == nullptr )
+			{
+				return false;
+			}
+
+			// В очереди условной переменной только элементы CondWaiter
+			CondWaiter &waiter = static_cast<CondWaiter&>( *waiter_ptr );
+			waiter.Requeued = true;
+			waiter.MutexPtr->RequeueWaiter( waiter, woken );
+			return true;
+		}
+
+		void ConditionVariable::Wait( Mutex &mut )
+		{
+			// С отвязанной областью отмены ожидание без срока не прерывается
+			CancelShield shield;
+			if( !Wait( mut, NoDeadline ) )
+			{
+				MY_ASSERT( false );
 			}
+		}
+
+		void ConditionVariable::Wait( Mutex &mut, Error &err )
+		{
+			SetWaitError( Wait( mut, NoDeadline ), err );
+		}
 
+		bool ConditionVariable::Wait( Mutex &mut, const DeadlineType &deadline )
+		{
 			Coroutine *cur_coro_ptr = GetCurrentCoro();
 			if( cur_coro_ptr == nullptr )
 			{
 				throw Exception( ErrorCodes::NotInsideSrvCoro,
 				                 "Must be called from service coroutine" );
 			}
+			MY_ASSERT( mut.State.load() != 0 );
 
-			// Событие неактивно (по крайней мере, было) - ждём его активности
-			std::function<void()> task = [ this, cur_coro_ptr ]()
+			CondWaiter waiter( cur_coro_ptr, mut );
+			CondDeadlineNode deadline_node( *this, waiter );
+			const bool has_deadline = deadline != NoDeadline;
+			bool released = false;
+
+			// Ожидание прерывается отменой области сопрограммы
+			CondDeadlineNode cancel_node( *this, waiter );
+			CancelableWait cancel_wait( cancel_node );
+			if( cancel_wait.WasCancelled() )
+			{
+				return false;
+			}
+
+			// Захватываем в task только указатель на параметры ожидания,
+			// чтобы std::function не выделял память
+			struct
 			{
-				// Добавляем указатель на текущую сопрограмму в очередь "ждунов"
-				Waiters.Push( cur_coro_ptr );
+				CondWaiter *WaiterPtr;
+				CondDeadlineNode *DeadlineNodePtr;
+				const DeadlineType *DeadlinePtr;
+				bool HasDeadline;
+				bool *ReleasedPtr;
+			} params = { &waiter, &deadline_node, &deadline, has_deadline, &released };
+
+			std::function<void()> task = [ this, &params ]()
+			{
+				CondWaiter &waiter = *params.WaiterPtr;
+				Coroutine *cur_coro_ptr = waiter.Coro;
+				Mutex *mut_ptr = waiter.MutexPtr;
 
-				// Увеличиваем счётчик "ждунов"
-				int64_t state = StateFlag.load();
-				bool become_active = false;
+				if( params.HasDeadline )
+				{
+					ArmDeadline( *params.DeadlineNodePtr, *params.DeadlinePtr );
+				}
 
-				do
+				bool queued = false;
 				{
-					if( state == -1 )
+					LockGuard<SpinLock> lock( Guard );
+					if( !waiter.TimedOut )
 					{
-						become_active = true;
-						break;
+						// Встаём в очередь до освобождения мьютекса: уведомление,
+						// отправленное после освобождения, нас уже застанет
+						*params.ReleasedPtr = true;
+						Waiters.PushBack( waiter );
+						queued = true;
+
+						// !!! с этого момента нельзя обращаться к переменным из стека сопрограммы !!!
 					}
 				}
-				while( !StateFlag.compare_exchange_weak( state, state + 1 ) );
 
-				// Проверяем, не стало ли событие активно
-				if( become_active )
+				if( queued )
 				{
-					// Стало: извлекаем первый указатель из очереди
-					// (это не обязательно будет cur_coro_ptr) и переключаемся на эту сопрограмму
-					Coroutine *coro_ptr = ( Coroutine* ) Waiters.Pop();
-					MY_ASSERT( coro_ptr != nullptr );
-
-					bool res = coro_ptr->SwitchTo();
+					// Сопрограмма уже не выполняется - освобождаем мьютекс
+					// (если сопрограмму успели перенести в его очередь,
+					// мьютекс может быть передан ей сразу)
+					mut_ptr->Unlock();
+				}
+				else
+				{
+					// Срок истёк раньше, мьютекс не освобождали
+					bool res = cur_coro_ptr->SwitchTo();
 					MY_ASSERT( res );
 				}
 			};
 
-			// Переходим в основную сопрограмму и выполняем task
-			// (обратно вернёмся либо из task-а, либо позже, когда
-			// увеличится счётчик)
+			// Переходим в основную сопрограмму и выполняем task (обратно
+			// вернёмся, когда сопрограмме будет передан мьютекс, либо истечёт срок)
 			SetPostTaskAndSwitchToMainCoro( &task );
-		} // void Event::Wait()
+
+			// После снятия таймеров OnDeadline гарантированно не выполняются
+			if( has_deadline )
+			{
+				DisarmDeadline( deadline_node );
+			}
+			cancel_wait.Unregister();
+
+			MY_ASSERT( !waiter.Queued );
+			if( waiter.Acquired || !released )
+			{
+				// Сопрограмма владеет мьютексом и снова выполняется
+				mut.OwnerStamp.store( GetRunStamp(), std::memory_order_relaxed );
+			}
+
+			if( waiter.Acquired )
+			{
+				// Уведомление получено, мьютекс передан из очереди
+				return true;
+			}
+
+			MY_ASSERT( waiter.TimedOut );
+			if( released )
+			{
+				// Мьютекс возвращается и после отмены области
+				mut.Lock();
+			}
+			return false;
+		} // bool ConditionVariable::Wait( Mutex &mut, const DeadlineType &deadline )
+
+		void ConditionVariable::NotifyOne()
+		{
+			SyncWakeList woken( SrvRef );
+			LockGuard<SpinLock> lock( Guard );
+			RequeueFront( woken );
+		}
+
+		void ConditionVariable::NotifyAll()
+		{
+			SyncWakeList woken( SrvRef );
+			LockGuard<SpinLock> lock( Guard );
+			while( RequeueFront( woken ) ) {}
+		}
 	} // namespace CoroService
 } // namespace Bicycle
@@ -0,0 +1,108 @@
+#include "CoroSrv/TaskGroup.hpp"
+
+namespace Bicycle
+{
+	namespace CoroService
+	{
+		TaskGroup::GroupState::GroupState( Service &srv ): Scope( srv ),
+		                                                  Lock(),
+		                                                  AllDone(),
+		                                                  Running( 0 )
+		{}
+
+		void TaskGroup::GroupState::OnFinished()
+		{
+			Lock.Lock();
+			MY_ASSERT( Running > 0 );
+			if( --Running == 0 )
+			{
+				AllDone.NotifyAll();
+			}
+			Lock.Unlock();
+		}
+
+		TaskGroup::TaskGroup(): ServiceWorker(),
+		                        State( new GroupState( SrvRef ) )
+		{}
+
+		TaskGroup::~TaskGroup() {}
+
+		Error TaskGroup::Go( std::function<void()> task, size_t stack_sz )
+		{
+			if( !task )
+			{
+				MY_ASSERT( false );
+				throw std::invalid_argument( "Incorrect task" );
+			}
+
+			if( State->Scope.IsCancelled() )
+			{
+				return Error( ErrorCodes::OperationAborted, "Task group was cancelled" );
+			}
+
+			State->Lock.Lock();
+			++State->Running;
+			State->Lock.Unlock();
+
+			std::shared_ptr<GroupState> state( State );
+			Error err = CoroService::Go( [ state, task ]()
+			{
+				// Ожидания сопрограммы регистрируются в области отмены группы
+				CancelScope *prev_scope_ptr = CancelScope::SetCurrent( &state->Scope );
+				Defer finish( [ &state, prev_scope_ptr ]
+				{
+					CancelScope::SetCurrent( prev_scope_ptr );
+					state->OnFinished();
+				});
+
+				task();
+			}, stack_sz );
+
+			if( err )
+			{
+				State->OnFinished();
+			}
+			return err;
+		} // Error TaskGroup::Go( std::function<void()> task, size_t stack_sz )
+
+		void TaskGroup::Cancel()
+		{
+			State->Scope.Cancel();
+		}
+
+		bool TaskGroup::IsCancelled() const
+		{
+			return State->Scope.IsCancelled();
+		}
+
+		void TaskGroup::Join()
+		{
+			State->Lock.Lock();
+			while( State->Running != 0 )
+			{
+				State->AllDone.Wait( State->Lock );
+			}
+			State->Lock.Unlock();
+		}
+
+		bool TaskGroup::Join( const DeadlineType &deadline )
+		{
+			// Ожидание со сроком завершается только по его истечении
+			// (отмена области текущей сопрограммы его не прерывает)
+			CancelShield shield;
+			State->Lock.Lock();
+
+			while( State->Running != 0 )
+			{
+				if( !State->AllDone.Wait( State->Lock, deadline ) )
+				{
+					break;
+				}
+			}
+
+			const bool res = State->Running == 0;
+			State->Lock.Unlock();
+			return res;
+		} // bool TaskGroup::Join( const DeadlineType &deadline )
+	} // namespace CoroService
+} // namespace Bicycle
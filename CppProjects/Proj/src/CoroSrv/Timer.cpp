@@ -1,132 +1,113 @@
 ﻿#include "CoroSrv/Timer.hpp"
-#include <map>
 
 namespace Bicycle
 {
 	namespace CoroService
 	{
-		void Timer::TimerThread::ThreadFunc()
-		{
-			// Задачи, отсортированные по времени сработки
-			std::map<time_type, std::vector<task_type>> tasks_map;
+		Timer::ExpiryNode::ExpiryNode( Timer &owner ): TimerNode(), Owner( owner ) {}
 
-			while( RunFlag.load() )
+		Coroutine* Timer::ExpiryNode::OnDeadline()
+		{
+			// Выполняется в основной сопрограмме потока сервиса
+			// под блокировкой очереди таймеров
+			WaiterElem *elem = nullptr;
 			{
-				// Считываем новые задачи, сортируем их по времени сработки
-				auto new_elems = Tasks.Release();
-				while( new_elems )
-				{
-					elem_type elem = new_elems.Pop();
-					tasks_map[ elem.first ].push_back( std::move( elem.second ) );
-				}
-
-				bool timeout_expired = false;
-				std::unique_lock<std::mutex> lock( Mut );
-				MY_ASSERT( lock );
-				if( !RunFlag.load() )
-				{
-					// Завершаем работу
-					break;
-				}
-				else if( Tasks )
-				{
-					// Появились новые задачи
-					continue;
-				}
-
-				if( tasks_map.empty() )
-				{
-					Cv.wait( lock );
-				}
-				else
+				LockGuard<SpinLock> lock( Owner.Lock );
+				if( !Owner.Active )
 				{
-					auto tp = tasks_map.begin()->first;
-					timeout_expired = Cv.wait_until( lock, tp ) == std::cv_status::timeout;
+					// Ожидание было отменено
+					return nullptr;
 				}
-				lock.unlock();
 
-				if( timeout_expired )
-				{
-					// Сработка таймера
-					auto tp = ClockType::now();
-					while( !tasks_map.empty() )
-					{
-						auto iter = tasks_map.begin();
-						if( iter->first > tp )
-						{
-							break;
-						}
+				Owner.Active = false;
+				elem = Owner.ReleaseWaiters( 0 );
+			}
 
-						MY_ASSERT( iter != tasks_map.end() );
-						auto cur_tasks = std::move( iter->second );
-						tasks_map.erase( iter );
+			// В первую сопрограмму сервис перейдёт сам, остальные - в Post
+			// (после PostToSrv к элементу обращаться нельзя)
+			Coroutine *res = elem != nullptr ? elem->Coro : nullptr;
+			elem = elem != nullptr ? elem->Next : nullptr;
+			while( elem != nullptr )
+			{
+				WaiterElem *next = elem->Next;
+				MY_ASSERT( elem->Coro != nullptr );
+				Owner.PostToSrv( *elem->Coro );
+				elem = next;
+			}
 
-						for( auto &one_task : cur_tasks )
-						{
-							MY_ASSERT( one_task );
-							one_task();
-						}
-					}
-				}
-			} // while( RunFlag.load() )
-		} // void Timer::TimerThread::ThreadFunc()
+			return res;
+		} // Coroutine* Timer::ExpiryNode::OnDeadline()
 
-		Timer::TimerThread::TimerThread(): RunFlag( true )
+		Timer::WaiterElem* Timer::ReleaseWaiters( int8_t flag )
 		{
-			WorkThread = std::thread( [ this ]() { ThreadFunc(); } );
-		}
+			WaiterElem *res = Waiters;
+			Waiters = nullptr;
 
-		Timer::TimerThread::~TimerThread()
-		{
-			RunFlag.store( false );
+			for( WaiterElem *elem = res; elem != nullptr; elem = elem->Next )
 			{
-				std::lock_guard<std::mutex> lock( Mut );
-				Cv.notify_all();
+				elem->Flag = flag;
 			}
-			WorkThread.join();
-		}
 
-		void Timer::TimerThread::Post( const std::function<void ()> &task,
-		                               uint64_t timeout_microsec )
+			return res;
+		} // Timer::WaiterElem* Timer::ReleaseWaiters( int8_t flag )
+
+		Timer::CancelNode::CancelNode( Timer &owner,
+		                               WaiterElem &elem ): TimerNode(),
+		                                                   Owner( owner ),
+		                                                   ElemRef( elem )
+		{}
+
+		Coroutine* Timer::CancelNode::OnDeadline()
 		{
-			if( !task )
+			LockGuard<SpinLock> lock( Owner.Lock );
+			if( !Owner.Active )
 			{
-				return;
+				// Таймер сработал или отменён: сопрограмма уже
+				// "пробуждена", либо ждать не начнёт
+				return nullptr;
 			}
 
-			auto time_point = ClockType::now() + std::chrono::microseconds( timeout_microsec );
-			if( Tasks.Push( time_point, task ) )
+			// Сопрограмма прерывает ожидание с кодом OperationAborted
+			ElemRef.Flag = 1;
+			for( WaiterElem **elem_ptr = &Owner.Waiters; *elem_ptr != nullptr; elem_ptr = &( ( *elem_ptr )->Next ) )
 			{
-				// Дёргаем condition_variable только, если добавили первый элемент
-				// (иначе кто-то другой уже дёрнул её, но поток пока не обработал)
-				std::lock_guard<std::mutex> lock( Mut );
-				Cv.notify_one();
+				if( *elem_ptr == &ElemRef )
+				{
+					// Сопрограмма ждёт: убираем её из списка и "пробуждаем"
+					*elem_ptr = ElemRef.Next;
+					return ElemRef.Coro;
+				}
 			}
-		} // void Timer::TimerThread::Post
 
-		std::shared_ptr<Timer::TimerThread> Timer::GetTimerThread()
-		{
-			static std::mutex Mut;
-			static std::weak_ptr<TimerThread> WeakPtr;
+			// Сопрограмма ещё не встала в список (и не встанет)
+			return nullptr;
+		} // Coroutine* Timer::CancelNode::OnDeadline()
 
-			std::lock_guard<std::mutex> lock( Mut );
-			auto res = WeakPtr.lock();
-			if( !res )
-			{
-				res.reset( new TimerThread );
-				WeakPtr = res;
-			}
+		Timer::Timer(): Node( *this ),
+		                Active( false ),
+		                Waiters( nullptr )
+		{}
 
-			MY_ASSERT( res );
-			return res;
+		Timer::~Timer()
+		{
+			LockGuard<SpinLock> lock( ArmLock );
+			DisarmDeadline( Node );
+			MY_ASSERT( Waiters == nullptr );
 		}
 
-		Timer::Timer(): SharedTimerPtr( GetTimerThread() )
+		void Timer::ExpiresAfter( uint64_t microseconds, Error &err )
 		{
-			MY_ASSERT( SharedTimerPtr );
+			ExpiresAfter( microseconds, GetTimerSlack(), err );
 		}
 
-		void Timer::ExpiresAfter( uint64_t microseconds, Error &err )
+		void Timer::ExpiresAfter( uint64_t microseconds )
+		{
+			Error err;
+			ExpiresAfter( microseconds, err );
+			ThrowIfNeed( err );
+		}
+
+		void Timer::ExpiresAfter( uint64_t microseconds, uint64_t slack_microseconds, Error &err )
 		{
 			err = Error();
 			if( IsStopped() )
@@ -137,75 +118,30 @@ namespace Bicycle
 				return;
 			}
 
-			LockGuard<SharedSpinLock> lock( WorkerPtrLock );
-			std::shared_ptr<TimerWorker>  new_worker( WorkerPtr.lock() );
-			if( new_worker && !new_worker->Flag.load() )
-			{
-				// Таймер ещё активен (ещё не сработал)
-				err.Code = ErrorCodes::TimerNotExpired;
-				err.What = "Timer already active";
-				return;
-			}
-
-			new_worker.reset( new TimerWorker );
-			MY_ASSERT( new_worker );
-
-			// Явно сбрасываем флаг выполнения
-			new_worker->Flag.store( false );
-
-			// Добавляем фиктивный элемент
-			// (понадобится при отмене и обработке срабатывания таймера)
-			new_worker->Waiters.Push( nullptr, nullptr );
-			WorkerPtr = new_worker;
-
-			// Добавляем в поток таймера задачу
-			MY_ASSERT( SharedTimerPtr );
-			SharedTimerPtr->Post( [ this, new_worker ]()
+			LockGuard<SpinLock> arm_lock( ArmLock );
 			{
-				MY_ASSERT( new_worker );
-				if( new_worker->Flag.exchange( true ) )
+				LockGuard<SpinLock> lock( Lock );
+				if( Active )
 				{
-					// Обработка уже выполнена
+					// Таймер ещё активен (ещё не сработал)
+					err.Code = ErrorCodes::TimerNotExpired;
+					err.What = "Timer already active";
 					return;
 				}
 
-				// Извлекаем и обрабатываем элементы сопрограмм
-				auto waiters = new_worker->Waiters.Release();
-				TimerWorker::element_t elem;
-#ifdef _DEBUG
-				try
-				{
-#endif
-				while( waiters )
-				{
-					elem = waiters.Pop();
-					MY_ASSERT( ( elem.first == nullptr ) == ( elem.second == nullptr ) );
-					if( elem.first != nullptr )
-					{
-						// Таймер сработал
-						*( elem.second ) = 0;
+				Active = true;
+			}
 
-						// Передаём сервису указатель на сопрограмму для выполнения
-						MY_ASSERT( elem.first != nullptr );
-						PostToSrv( *elem.first );
-					}
-				} // while( waiters )
-#ifdef _DEBUG
-				}
-				catch( ... )
-				{
-					MY_ASSERT( false );
-				}
-#endif
-			}, microseconds );
-			new_worker.reset();
-			MY_ASSERT( !WorkerPtr.expired() );
-		} // void Timer::ExpiresAfter( uint64_t microseconds, Error &err )
+			// Ставим узел в очередь таймеров текущего потока сервиса
+			// (Node мог остаться в очереди, если таймер был отменён)
+			DisarmDeadline( Node );
+			ArmDeadline( Node, DeadlineAfter( microseconds ), slack_microseconds );
+		} // void Timer::ExpiresAfter( uint64_t microseconds, uint64_t slack_microseconds, Error &err )
 
-		void Timer::ExpiresAfter( uint64_t microseconds )
+		void Timer::ExpiresAfter( uint64_t microseconds, uint64_t slack_microseconds )
 		{
 			Error err;
-			ExpiresAfter( microseconds, err );
+			ExpiresAfter( microseconds, slack_microseconds, err );
 			ThrowIfNeed( err );
 		}
 
@@ -220,18 +156,15 @@ namespace Bicycle
 				return;
 			}
 
-			std::shared_ptr<TimerWorker> worker_ptr;
 			{
-				SharedLockGuard<SharedSpinLock> lock( WorkerPtrLock );
-				worker_ptr = WorkerPtr.lock();
-			}
-
-			if( !worker_ptr )
-			{
-				// Таймер уже сработал
-				err.Code = ErrorCodes::TimerExpired;
-				err.What = "Timer already expired";
-				return;
+				LockGuard<SpinLock> lock( Lock );
+				if( !Active )
+				{
+					// Таймер уже сработал
+					err.Code = ErrorCodes::TimerExpired;
+					err.What = "Timer already expired";
+					return;
+				}
 			}
 
 			Coroutine *cur_coro_ptr = GetCurrentCoro();
@@ -242,53 +175,60 @@ namespace Bicycle
 				return;
 			}
 
-			int8_t flag = 0;
+			WaiterElem elem;
+			elem.Coro = cur_coro_ptr;
+			elem.Flag = 0;
+			elem.Next = nullptr;
+
+			// Узел, прерывающий ожидание при отмене области сопрограммы
+			CancelNode cancel_node( *this, elem );
+			CancelableWait cancel_wait( cancel_node );
+			if( cancel_wait.WasCancelled() )
+			{
+				err.Code = ErrorCodes::OperationAborted;
+				err.What = "Operation was aborted";
+				return;
+			}
 
 			// Таймер активен (по крайней мере, был)
-			std::function<void()> task = [ this, &worker_ptr, cur_coro_ptr, &flag ]()
+			std::function<void()> task = [ this, cur_coro_ptr, &elem ]()
 			{
-				if( worker_ptr->Waiters.Push( cur_coro_ptr, &flag ) )
 				{
-					// Элементы уже были извлечены - таймер сработал
-					auto waiters = worker_ptr->Waiters.Release();
-					MY_ASSERT( worker_ptr->Flag.load() );
-					TimerWorker::element_t elem;
-#ifdef _DEBUG
-					try
-					{
-#endif
-					while( waiters )
+					LockGuard<SpinLock> lock( Lock );
+					if( !Active )
 					{
-						elem = waiters.Pop();
-						MY_ASSERT( ( elem.first != nullptr ) && ( elem.second != nullptr ) );
-						*( elem.second ) = -1;
-
-						// Передаём сервису указатель на сопрограмму для выполнения
-						MY_ASSERT( elem.first != nullptr );
-						PostToSrv( *elem.first );
-					} // while( waiters )
-#ifdef _DEBUG
+						// Таймер сработал до начала ожидания
+						elem.Flag = -1;
 					}
-					catch( ... )
+					else if( elem.Flag == 0 )
 					{
-						MY_ASSERT( false );
+						// Встаём в список ожидающих
+						// (после снятия блокировки к elem обращаться нельзя)
+						elem.Next = Waiters;
+						Waiters = &elem;
+						return;
 					}
-#endif
+
+					// Иначе область сопрограммы отменена до начала ожидания
 				}
+
+				bool res = cur_coro_ptr->SwitchTo();
+				MY_ASSERT( res );
 			};
 
 			// Переходим в основную сопрограмму и выполняем task
 			// (обратно вернёмся либо из task-а, либо позже, когда
-			// увеличится счётчик)
+			// таймер сработает или будет отменён)
 			SetPostTaskAndSwitchToMainCoro( &task );
+			cancel_wait.Unregister();
 
-			if( flag < 0 )
+			if( elem.Flag < 0 )
 			{
 				// Таймер уже сработал
 				err.Code = ErrorCodes::TimerExpired;
 				err.What = "Timer already expired";
 			}
-			else if( flag > 0 )
+			else if( elem.Flag > 0 )
 			{
 				// Ожидание было отменено
 				err.Code = ErrorCodes::OperationAborted;
@@ -303,6 +243,38 @@ namespace Bicycle
 			ThrowIfNeed( err );
 		}
 
+		void Timer::CancelWaiters()
+		{
+			WaiterElem *elem = nullptr;
+			{
+				LockGuard<SpinLock> arm_lock( ArmLock );
+				{
+					LockGuard<SpinLock> lock( Lock );
+					if( !Active )
+					{
+						// Таймер уже сработал, либо обработка отменена
+						return;
+					}
+
+					Active = false;
+					elem = ReleaseWaiters( 1 );
+				}
+
+				// Снимаем узел с очереди таймеров
+				DisarmDeadline( Node );
+			}
+
+			// "Пробуждаем" ожидающие сопрограммы
+			// (после PostToSrv к элементу обращаться нельзя)
+			while( elem != nullptr )
+			{
+				WaiterElem *next = elem->Next;
+				MY_ASSERT( elem->Coro != nullptr );
+				PostToSrv( *elem->Coro );
+				elem = next;
+			}
+		} // void Timer::CancelWaiters()
+
 		void Timer::Cancel( Error &err )
 		{
 			err = Error();
@@ -314,57 +286,441 @@ namespace Bicycle
 				return;
 			}
 
-			std::shared_ptr<TimerWorker> worker_ptr;
+			CancelWaiters();
+		} // void Timer::Cancel( Error &err )
+
+		void Timer::Cancel()
+		{
+			Error err;
+			Cancel( err );
+			ThrowIfNeed( err );
+		}
+
+		void Timer::Close( Error &err )
+		{
+			err = Error();
+			CancelWaiters();
+		}
+
+		//-----------------------------------------------------------------------------------------
+
+		/// Приостановка сопрограммы до наступления срока
+		class Sleeper: public ServiceWorker
+		{
+			private:
+				/// Узел очереди таймеров сервиса
+				class WakeNode: public TimerNode
+				{
+					public:
+						/// Указатель на приостановленную сопрограмму
+						Coroutine *Coro;
+
+						/// Ссылка на состояние ожидания
+						std::atomic<uint8_t> &StateRef;
+
+						/// Узел сработал
+						bool Fired;
+
+						/// Узел прерывает сон при остановке сервиса
+						const bool WakeOnStop;
+
+						/// Узел сработал из-за остановки сервиса
+						bool Stopped;
+
+						WakeNode( std::atomic<uint8_t> &state, bool wake_on_stop ): TimerNode(), Coro( nullptr ),
+						                                                            StateRef( state ), Fired( false ),
+						                                                            WakeOnStop( wake_on_stop ),
+						                                                            Stopped( false ) {}
+
+						virtual Coroutine* OnDeadline() override
+						{
+							// "Будит" сопрограмму тот, кто первым застал её
+							// приостановленной (при сработке до приостановки - task в Sleep)
+							Fired = true;
+							return StateRef.exchange( 2 ) == 1 ? Coro : nullptr;
+						}
+
+						virtual bool OnStop() override
+						{
+							Stopped = WakeOnStop;
+							return WakeOnStop;
+						}
+				};
+
+				/// Состояние ожидания: 0 - сопрограмма ещё не приостановлена,
+				/// 1 - приостановлена, 2 - "пробуждена" (или сработал узел до приостановки)
+				std::atomic<uint8_t> State;
+
+				/// Узел, которым сопрограмма ставится в очередь сервиса
+				/// (при остановке сервиса срабатывает досрочно)
+				WakeNode Node;
+
+				/// Узел, прерывающий сон при отмене области сопрограммы
+				WakeNode CancelNode;
+
+				/// Срок пробуждения
+				DeadlineType Deadline;
+
+			public:
+				Sleeper( const DeadlineType &deadline ): ServiceWorker(), State( 0 ), Node( State, true ),
+				                                         CancelNode( State, false ), Deadline( deadline ) {}
+
+				void Sleep( Coroutine &coro_ref, Error &err )
+				{
+					err = Error();
+					if( IsStopped() )
+					{
+						// Сервис в процессе остановки
+						err.Code = ErrorCodes::SrvStop;
+						err.What = "Coro service is stopping";
+						return;
+					}
+
+					if( !( DeadlineClock::now() < Deadline ) )
+					{
+						// Срок уже наступил
+						return;
+					}
+
+					Node.Coro = &coro_ref;
+					CancelNode.Coro = &coro_ref;
+					CancelableWait cancel_wait( CancelNode );
+					if( cancel_wait.WasCancelled() )
+					{
+						err.Code = ErrorCodes::OperationAborted;
+						err.What = "Operation was aborted";
+						return;
+					}
+
+					// Захватываем только this, чтобы std::function
+					// не выделял память под замыкание
+					std::function<void()> task = [ this ]()
+					{
+						Coroutine *coro_ptr = Node.Coro;
+						ArmDeadline( Node, Deadline, GetTimerSlack() );
+
+						// После перехода в состояние "приостановлена" к полям обращаться
+						// нельзя (сопрограмма может быть уже "пробуждена" другим потоком)
+						uint8_t expected = 0;
+						if( !State.compare_exchange_strong( expected, 1 ) )
+						{
+							// Узел сработал раньше - "будим" сопрограмму сами
+							bool res = coro_ptr->SwitchTo();
+							MY_ASSERT( res );
+						}
+					};
+
+					// Переходим в основную сопрограмму и ставим таймер, обратно
+					// вернёмся по его сработке (или при отмене области, остановке сервиса)
+					SetPostTaskAndSwitchToMainCoro( &task );
+
+					// После снятия узла OnDeadline гарантированно не выполняется
+					cancel_wait.Unregister();
+					if( CancelNode.Fired )
+					{
+						// Сон прерван отменой области: снимаем таймер
+						DisarmDeadline( Node );
+						err.Code = ErrorCodes::OperationAborted;
+						err.What = "Operation was aborted";
+					}
+					else if( Node.Stopped )
+					{
+						// Сон прерван остановкой сервиса (узел уже снят с очереди)
+						err.Code = ErrorCodes::SrvStop;
+						err.What = "Coro service is stopping";
+					}
+				}
+		};
+
+		void SleepUntil( const DeadlineType &deadline, Error &err )
+		{
+			err = Error();
+			Coroutine *cur_coro_ptr = GetCurrentCoro();
+			if( cur_coro_ptr == nullptr )
 			{
-				SharedLockGuard<SharedSpinLock> lock( WorkerPtrLock );
-				worker_ptr = WorkerPtr.lock();
+				err.Code = ErrorCodes::NotInsideSrvCoro;
+				err.What = "Must be called from service coroutine";
+				return;
 			}
 
-			if( !worker_ptr || worker_ptr->Flag.exchange( true ) )
+			Sleeper sleeper( deadline );
+			sleeper.Sleep( *cur_coro_ptr, err );
+		} // void SleepUntil( const DeadlineType &deadline, Error &err )
+
+		void SleepUntil( const DeadlineType &deadline )
+		{
+			Error err;
+			SleepUntil( deadline, err );
+			ThrowIfNeed( err );
+		}
+
+		void SleepFor( uint64_t microseconds, Error &err )
+		{
+			SleepUntil( DeadlineAfter( microseconds ), err );
+		}
+
+		void SleepFor( uint64_t microseconds )
+		{
+			Error err;
+			SleepFor( microseconds, err );
+			ThrowIfNeed( err );
+		}
+
+		//-----------------------------------------------------------------------------------------
+
+		Ticker::TickNode::TickNode( Ticker &owner ): TimerNode(),
+		                                            Owner( owner ),
+		                                            Coro( nullptr ),
+		                                            Waiting( false ),
+		                                            Aborted( false )
+		{}
+
+		Coroutine* Ticker::TickNode::OnDeadline()
+		{
+			LockGuard<SpinLock> lock( Owner.WaitLock );
+			if( !Waiting )
 			{
-				// Таймер уже сработал, либо обработка отменена
-				return;
+				// Ожидание уже прервано отменой области сопрограммы
+				return nullptr;
+			}
+
+			Waiting = false;
+			return Coro;
+		} // Coroutine* Ticker::TickNode::OnDeadline()
+
+		Ticker::CancelNode::CancelNode( Ticker &owner ): TimerNode(), Owner( owner ) {}
+
+		Coroutine* Ticker::CancelNode::OnDeadline()
+		{
+			LockGuard<SpinLock> lock( Owner.WaitLock );
+			TickNode &node = Owner.Node;
+
+			// Сопрограмма прерывает ожидание с кодом OperationAborted
+			// (узел тикера, если он в очереди, она снимет сама)
+			node.Aborted = true;
+			if( !node.Waiting )
+			{
+				// Сопрограмма ещё не приостановлена (и ждать не начнёт),
+				// либо уже "пробуждена" "тиком"
+				return nullptr;
+			}
+
+			node.Waiting = false;
+			return node.Coro;
+		} // Coroutine* Ticker::CancelNode::OnDeadline()
+
+		/// Ограничение запаздывания "тика" половиной периода
+		inline uint64_t TickerSlack( uint64_t slack_microseconds, uint64_t period_microseconds )
+		{
+			return slack_microseconds < period_microseconds / 2 ? slack_microseconds : period_microseconds / 2;
+		}
+
+		Ticker::Ticker( uint64_t period_microseconds ): AbstractCloser(),
+		                                                PeriodMicrosec( period_microseconds ),
+		                                                SlackMicrosec( TickerSlack( GetTimerSlack(), period_microseconds ) ),
+		                                                NextTick( DeadlineAfter( period_microseconds ) ),
+		                                                Node( *this ),
+		                                                Cancelled( false )
+		{
+			if( period_microseconds == 0 )
+			{
+				throw std::invalid_argument( "Ticker period must be positive" );
 			}
+		}
+
+		Ticker::Ticker( uint64_t period_microseconds,
+		                uint64_t slack_microseconds ): AbstractCloser(),
+		                                               PeriodMicrosec( period_microseconds ),
+		                                               SlackMicrosec( TickerSlack( slack_microseconds, period_microseconds ) ),
+		                                               NextTick( DeadlineAfter( period_microseconds ) ),
+		                                               Node( *this ),
+		                                               Cancelled( false )
+		{
+			if( period_microseconds == 0 )
+			{
+				throw std::invalid_argument( "Ticker period must be positive" );
+			}
+		}
 
-			auto waiters = worker_ptr->Waiters.Release();
-			TimerWorker::element_t elem;
-#ifdef _DEBUG
-			try
+		Ticker::~Ticker()
+		{
+			LockGuard<SpinLock> lock( ArmLock );
+			DisarmDeadline( Node );
+		}
+
+		uint64_t Ticker::ConsumeTicks( const DeadlineType &now )
+		{
+			if( now < NextTick )
 			{
-#endif
-			while( waiters )
+				return 0;
+			}
+
+			// Пропущенные "тики" учитываем разом, следующий
+			// назначаем по сетке от момента создания
+			const std::chrono::microseconds period( PeriodMicrosec );
+			const uint64_t res = ( uint64_t ) ( ( now - NextTick ) / period ) + 1;
+			NextTick += period*res;
+			return res;
+		} // uint64_t Ticker::ConsumeTicks( const DeadlineType &now )
+
+		uint64_t Ticker::Wait( Error &err )
+		{
+			err = Error();
+			if( IsStopped() )
 			{
-				elem = waiters.Pop();
-				MY_ASSERT( ( elem.first == nullptr ) == ( elem.second == nullptr ) );
-				if( elem.first != nullptr )
+				// Сервис в процессе остановки
+				err.Code = ErrorCodes::SrvStop;
+				err.What = "Coro service is stopping";
+				return 0;
+			}
+
+			Coroutine *cur_coro_ptr = GetCurrentCoro();
+			if( cur_coro_ptr == nullptr )
+			{
+				err.Code = ErrorCodes::NotInsideSrvCoro;
+				err.What = "Must be called from service coroutine";
+				return 0;
+			}
+
+			uint64_t res = ConsumeTicks( DeadlineClock::now() );
+			if( res > 0 )
+			{
+				// "Тик" уже наступил
+				return res;
+			}
+
+			{
+				LockGuard<SpinLock> lock( ArmLock );
+				Cancelled = false;
+			}
+
+			Node.Coro = cur_coro_ptr;
+			Node.Waiting = false;
+			Node.Aborted = false;
+
+			// Узел, прерывающий ожидание при отмене области сопрограммы
+			CancelNode cancel_node( *this );
+			CancelableWait cancel_wait( cancel_node );
+			if( cancel_wait.WasCancelled() )
+			{
+				err.Code = ErrorCodes::OperationAborted;
+				err.What = "Operation was aborted";
+				return 0;
+			}
+
+			std::function<void()> task = [ this ]()
+			{
+				Coroutine *coro_ptr = Node.Coro;
 				{
-					// Операция ожидания отменена
-					*( elem.second ) = 1;
+					LockGuard<SpinLock> lock( ArmLock );
+					if( !Cancelled )
+					{
+						bool aborted;
+						{
+							LockGuard<SpinLock> wait_lock( WaitLock );
+							aborted = Node.Aborted;
+							Node.Waiting = !aborted;
+						}
+
+						if( !aborted )
+						{
+							// Ставим узел в очередь (обратно вернёмся по его
+							// сработке, либо при отмене ожидания)
+							ArmDeadline( Node, NextTick, SlackMicrosec );
+							return;
+						}
+					}
+				}
+
+				// Ожидание отменено до постановки в очередь
+				{
+					LockGuard<SpinLock> wait_lock( WaitLock );
+					Node.Aborted = true;
+				}
 
-					// Передаём сервису указатель на сопрограмму для выполнения
-					MY_ASSERT( elem.first != nullptr );
-					PostToSrv( *elem.first );
+				bool res = coro_ptr->SwitchTo();
+				MY_ASSERT( res );
+			};
+
+			SetPostTaskAndSwitchToMainCoro( &task );
+			cancel_wait.Unregister();
+
+			if( Node.Aborted )
+			{
+				// Ожидание было отменено (узел тикера мог остаться в очереди)
+				{
+					LockGuard<SpinLock> lock( ArmLock );
+					DisarmDeadline( Node );
 				}
-			} // while( waiters )
-#ifdef _DEBUG
+
+				err.Code = ErrorCodes::OperationAborted;
+				err.What = "Operation was aborted";
+				return 0;
 			}
-			catch( ... )
+
+			res = ConsumeTicks( DeadlineClock::now() );
+			MY_ASSERT( res > 0 );
+			return res;
+		} // uint64_t Ticker::Wait( Error &err )
+
+		uint64_t Ticker::Wait()
+		{
+			Error err;
+			uint64_t res = Wait( err );
+			ThrowIfNeed( err );
+			return res;
+		}
+
+		void Ticker::CancelWait()
+		{
+			Coroutine *coro_ptr = nullptr;
 			{
-				MY_ASSERT( false );
+				LockGuard<SpinLock> lock( ArmLock );
+				Cancelled = true;
+				if( DisarmDeadline( Node ) )
+				{
+					LockGuard<SpinLock> wait_lock( WaitLock );
+					if( Node.Waiting )
+					{
+						// Узел снят до сработки - "пробуждаем" сопрограмму сами
+						Node.Waiting = false;
+						Node.Aborted = true;
+						coro_ptr = Node.Coro;
+					}
+				}
 			}
-#endif
-		} // void Timer::Cancel( Error &err )
 
-		void Timer::Cancel()
+			if( coro_ptr != nullptr )
+			{
+				PostToSrv( *coro_ptr );
+			}
+		} // void Ticker::CancelWait()
+
+		void Ticker::Cancel( Error &err )
+		{
+			err = Error();
+			if( IsStopped() )
+			{
+				// Сервис в процессе остановки
+				err.Code = ErrorCodes::SrvStop;
+				err.What = "Coro service is stopping";
+				return;
+			}
+
+			CancelWait();
+		} // void Ticker::Cancel( Error &err )
+
+		void Ticker::Cancel()
 		{
 			Error err;
 			Cancel( err );
 			ThrowIfNeed( err );
 		}
 
-		void Timer::Close( Error &err )
+		void Ticker::Close( Error &err )
 		{
-			Cancel( err );
+			err = Error();
+			CancelWait();
 		}
 	} // namespace CoroService
 } // namespace Bicycle
@@ -1,8 +1,25 @@
 #include "Utils.hpp"
 #include <stdexcept>
 
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
 namespace Bicycle
 {
+	void CpuRelax()
+	{
+#if defined( _MSC_VER ) && ( defined( _M_IX86 ) || defined( _M_X64 ) )
+		_mm_pause();
+#elif defined( __i386__ ) || defined( __x86_64__ )
+		__builtin_ia32_pause();
+#elif defined( __aarch64__ ) || defined( __arm__ )
+		asm volatile( "yield" );
+#endif
+	}
+
+	//------------------------------------------------------------------------------
+
 	SpinLock::SpinLock()
 	{
 		Flag.clear();